@@ -260,9 +260,9 @@ void CityMapView::drawAllEdges()
             QString toType = QString::fromUtf8(toNode->locationType).toLower();
             
             // Skip edges that connect street nodes to location nodes
-            bool fromIsStreet = fromType.contains("street") || fromType.contains("route") || fromType.contains("highway");
+            bool fromIsStreet = fromNode->isRoute();
             bool fromIsLocation = !fromIsStreet && fromType != "no zone";
-            bool toIsStreet = toType.contains("street") || toType.contains("route") || toType.contains("highway");
+            bool toIsStreet = toNode->isRoute();
             bool toIsLocation = !toIsStreet && toType != "no zone";
             
             // Skip location-to-street edges
@@ -325,13 +325,13 @@ void CityMapView::drawAllEdges()
         QString locationName = QString::fromUtf8(node->locationName).trimmed();
         QColor color;
         
-        if (nodeType == "home" || nodeType == "house")
+        if (node->typeId == LOCATION_HOME)
             color = QColor(100, 150, 255);  // Blue
-        else if (nodeType == "mall")
+        else if (node->typeId == LOCATION_MALL)
             color = QColor(255, 165, 0);    // Orange
-        else if (nodeType == "hospital")
+        else if (node->typeId == LOCATION_HOSPITAL)
             color = QColor(255, 100, 100); // Red
-        else if (nodeType == "school")
+        else if (node->typeId == LOCATION_SCHOOL)
             color = QColor(100, 200, 100); // Green
         else
             continue;
@@ -806,12 +806,7 @@ void CityMapView::drawStreetNamesOnEdges(const QRectF &viewRect)
     
     for (Node *node = city->getFirstNode(); node != nullptr; node = node->next)
     {
-        QString nodeType = QString::fromUtf8(node->locationType).trimmed();
-        bool isStreet = nodeType.contains("street", Qt::CaseInsensitive) ||
-                       nodeType.contains("route", Qt::CaseInsensitive) ||
-                       nodeType.contains("highway", Qt::CaseInsensitive);
-        
-        if (!isStreet) continue;
+        if (!node->isRoute()) continue;
         
         // Skip highway zone streets
         QString zone = QString::fromUtf8(node->zone).trimmed();
@@ -0,0 +1,145 @@
+#include "city.h"
+#include "dispatchengine.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <chrono>
+
+// Dispatch benchmark: greedy nearest-driver assignment at arrival time versus
+// batched optimal matching, on identical fleets and request streams.
+// Usage: benchdispatch [drivers] [requests] [batchSize]
+
+std::string getDataFilePath(const std::string &filename)
+{
+    std::string paths[] = {
+        std::string("../city_locations_path_data/") + filename,
+        std::string("./city_locations_path_data/") + filename,
+        std::string("../../city_locations_path_data/") + filename
+    };
+
+    for (const auto &path : paths)
+    {
+        std::ifstream file(path);
+        if (file.good())
+            return path;
+    }
+    return paths[0];
+}
+
+// Small deterministic LCG so both runs see the same fleet and requests
+static unsigned int nextRandom(unsigned int &state)
+{
+    state = state * 1103515245u + 12345u;
+    return (state >> 8) & 0xFFFFFF;
+}
+
+struct BenchResult
+{
+    int assigned;
+    double pickupTotal;
+    double microseconds;
+};
+
+static void placeFleet(DispatchEngine &engine, const GraphIndex *gi, const int *routeNodes,
+                       int routeCount, int driverCount)
+{
+    unsigned int seed = 11;
+    for (int id = 1; id <= driverCount; id++)
+    {
+        Node *n = gi->nodes[routeNodes[nextRandom(seed) % routeCount]];
+        engine.addDriver(id, n->id, n->zone);
+    }
+}
+
+static BenchResult runDispatch(DispatchEngine &engine, const GraphIndex *gi, int requestCount,
+                               int batchSize, bool batched)
+{
+    BenchResult result = {0, 0.0, 0.0};
+    unsigned int seed = 23;
+
+    // assignTrip logs every pickup resolution; keep the timing clean
+    std::ostringstream sink;
+    std::streambuf *saved = std::cout.rdbuf(sink.rdbuf());
+
+    auto begin = std::chrono::steady_clock::now();
+    for (int first = 1; first <= requestCount; first += batchSize)
+    {
+        int last = first + batchSize - 1 < requestCount ? first + batchSize - 1 : requestCount;
+        for (int tripId = first; tripId <= last; tripId++)
+        {
+            const char *pickup = gi->nodes[nextRandom(seed) % gi->nodeCount]->id;
+            const char *dropoff = gi->nodes[nextRandom(seed) % gi->nodeCount]->id;
+            engine.requestTrip(tripId, tripId, pickup, dropoff);
+            if (batched)
+                engine.queueForBatch(tripId);
+            else if (engine.assignNearestDriver(tripId) >= 0)
+                result.assigned++;
+        }
+        if (batched)
+            result.assigned += engine.dispatchBatch();
+        sink.str("");
+    }
+    auto end = std::chrono::steady_clock::now();
+    std::cout.rdbuf(saved);
+
+    result.microseconds = std::chrono::duration<double, std::micro>(end - begin).count();
+    for (int tripId = 1; tripId <= requestCount; tripId++)
+    {
+        Trip *trip = engine.getTrip(tripId);
+        if (trip && trip->getDriverId() >= 0)
+            result.pickupTotal += trip->getDriverToPickupPath().totalDistance;
+    }
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    int driverCount = (argc > 1) ? atoi(argv[1]) : 1000;
+    int requestCount = (argc > 2) ? atoi(argv[2]) : 600;
+    int batchSize = (argc > 3) ? atoi(argv[3]) : 30;
+    if (driverCount <= 0) driverCount = 1000;
+    if (requestCount <= 0) requestCount = 600;
+    if (batchSize <= 0) batchSize = 30;
+
+    City city;
+    if (!city.loadLocations(getDataFilePath("city-locations.csv").c_str()) ||
+        !city.loadPaths(getDataFilePath("paths.csv").c_str()))
+    {
+        std::cerr << "Failed to load city data" << std::endl;
+        return 1;
+    }
+
+    std::shared_ptr<const GraphIndex> gi = city.getGraphIndex();
+    int *routeNodes = new int[gi->nodeCount];
+    int routeCount = 0;
+    for (int i = 0; i < gi->nodeCount; i++)
+    {
+        if (city.isRouteNode(i))
+            routeNodes[routeCount++] = i;
+    }
+
+    DispatchEngine greedyEngine(&city, driverCount, requestCount);
+    placeFleet(greedyEngine, gi.get(), routeNodes, routeCount, driverCount);
+    BenchResult greedy = runDispatch(greedyEngine, gi.get(), requestCount, batchSize, false);
+
+    DispatchEngine batchEngine(&city, driverCount, requestCount);
+    placeFleet(batchEngine, gi.get(), routeNodes, routeCount, driverCount);
+    BenchResult batch = runDispatch(batchEngine, gi.get(), requestCount, batchSize, true);
+
+    std::cout << "\n=== Dispatch Benchmark (" << driverCount << " drivers, " << requestCount
+              << " requests, batches of " << batchSize << ") ===" << std::endl;
+    const BenchResult *rows[2] = {&greedy, &batch};
+    const char *names[2] = {"Greedy:  ", "Batched: "};
+    for (int k = 0; k < 2; k++)
+    {
+        const BenchResult &r = *rows[k];
+        std::cout << names[k] << r.assigned << " assigned, "
+                  << (r.assigned > 0 ? r.pickupTotal / r.assigned : 0.0) << " m avg pickup, "
+                  << (r.microseconds > 0 ? r.assigned / (r.microseconds / 1e6) : 0.0)
+                  << " assignments/s" << std::endl;
+    }
+
+    delete[] routeNodes;
+    return 0;
+}
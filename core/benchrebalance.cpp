@@ -0,0 +1,192 @@
+#include "city.h"
+#include "dispatchengine.h"
+#include <iostream>
+#include <fstream>
+#include <string>
+
+// Skewed-demand simulation: most pickups come from a few hot colonies while
+// drop-offs are spread over the city, so served drivers drift away from the
+// demand. Runs the same request stream with and without idle-driver
+// rebalancing and reports the average pickup distance and unserved requests.
+// Usage: benchrebalance [drivers] [minutes] [requestsPerMinute]
+
+std::string getDataFilePath(const std::string &filename)
+{
+    std::string paths[] = {
+        std::string("../city_locations_path_data/") + filename,
+        std::string("./city_locations_path_data/") + filename,
+        std::string("../../city_locations_path_data/") + filename
+    };
+
+    for (const auto &path : paths)
+    {
+        std::ifstream file(path);
+        if (file.good())
+            return path;
+    }
+    return paths[0];
+}
+
+static unsigned int nextRandom(unsigned int &state)
+{
+    state = state * 1103515245u + 12345u;
+    return (state >> 8) & 0xFFFFFF;
+}
+
+struct NullBuffer : std::streambuf
+{
+    int overflow(int c) override { return c; }
+};
+
+struct SimResult
+{
+    int assigned;
+    int unserved;
+    double pickupDistance;
+    long long moves;
+};
+
+static const double SIM_SPEED = 10.0;  // Metres per second for trips and repositioning
+static const int STEP_SECONDS = 30;
+
+static SimResult simulate(City *city, const GraphIndex *gi, const int *routeNodes, int routeCount,
+                          const int *hotNodes, int hotCount, int driverCount, int minutes,
+                          int perMinute, bool rebalance)
+{
+    int requestTotal = minutes * perMinute;
+    DispatchEngine engine(city, driverCount, requestTotal);
+    engine.setTerminalTripRetention(16);
+    Rebalancer *rebalancer = engine.getRebalancer();
+    rebalancer->setEnabled(rebalance);
+    rebalancer->setDriverSpeed(SIM_SPEED);
+    rebalancer->setInterval(60.0);
+    rebalancer->setHalfLife(900.0);
+    rebalancer->setMaxMovesPerRound(driverCount / 10 > 0 ? driverCount / 10 : 1);
+
+    unsigned int seed = 5;
+    for (int id = 1; id <= driverCount; id++)
+    {
+        Node *node = gi->nodes[routeNodes[nextRandom(seed) % routeCount]];
+        engine.addDriver(id, node->id, node->zone);
+    }
+
+    // Completion time of each assigned trip, in simulated seconds
+    double *finishAt = new double[requestTotal + 1];
+    for (int id = 0; id <= requestTotal; id++)
+        finishAt[id] = -1.0;
+
+    SimResult result = {0, 0, 0.0, 0};
+    int nextTripId = 1;
+    int steps = minutes * 60 / STEP_SECONDS;
+    for (int step = 0; step < steps; step++)
+    {
+        engine.getScheduler()->advanceBy(STEP_SECONDS * 1000LL);
+        double now = engine.getScheduler()->getSimTimeMs() / 1000.0;
+        for (int id = 1; id < nextTripId; id++)
+        {
+            if (finishAt[id] >= 0.0 && finishAt[id] <= now)
+            {
+                engine.completeTrip(id);
+                finishAt[id] = -1.0;
+            }
+        }
+        engine.getRebalancer()->update();
+
+        int arrivals = perMinute * STEP_SECONDS / 60;
+        for (int r = 0; r < arrivals && nextTripId <= requestTotal; r++)
+        {
+            int tripId = nextTripId++;
+            bool hot = nextRandom(seed) % 100 < 80;
+            const char *pickup = gi->nodes[hot ? hotNodes[nextRandom(seed) % hotCount]
+                                               : routeNodes[nextRandom(seed) % routeCount]]->id;
+            const char *dropoff = gi->nodes[routeNodes[nextRandom(seed) % routeCount]]->id;
+            engine.requestTrip(tripId, tripId, pickup, dropoff);
+            int driverId = engine.assignNearestDriver(tripId);
+            if (driverId < 0)
+            {
+                engine.cancelTrip(tripId);
+                result.unserved++;
+                continue;
+            }
+            double toPickup = city->getDistance(engine.getDriver(driverId)->getCurrentNodeId(), pickup);
+            double ride = city->getDistance(pickup, dropoff);
+            result.pickupDistance += toPickup;
+            result.assigned++;
+            engine.startPickupMovement(tripId);
+            engine.startTrip(tripId);
+            finishAt[tripId] = now + (toPickup + ride) / SIM_SPEED;
+        }
+    }
+    result.moves = rebalancer->getMovesIssued();
+    delete[] finishAt;
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    int driverCount = (argc > 1) ? atoi(argv[1]) : 200;
+    int minutes = (argc > 2) ? atoi(argv[2]) : 120;
+    int perMinute = (argc > 3) ? atoi(argv[3]) : 10;
+    if (driverCount <= 0) driverCount = 200;
+    if (minutes <= 0) minutes = 120;
+    if (perMinute <= 0) perMinute = 10;
+
+    City city;
+    if (!city.loadLocations(getDataFilePath("city-locations.csv").c_str()) ||
+        !city.loadPaths(getDataFilePath("paths.csv").c_str()))
+    {
+        std::cerr << "Failed to load city data" << std::endl;
+        return 1;
+    }
+
+    std::shared_ptr<const GraphIndex> gi = city.getGraphIndex();
+    int *routeNodes = new int[gi->nodeCount];
+    int routeCount = 0;
+    for (int i = 0; i < gi->nodeCount; i++)
+    {
+        if (city.isRouteNode(i))
+            routeNodes[routeCount++] = i;
+    }
+
+    // Hot spots: every route node in the colonies of three random route nodes
+    DispatchEngine probe(&city, 1, 1);
+    int hotColonies[3];
+    unsigned int seed = 17;
+    for (int h = 0; h < 3; h++)
+        hotColonies[h] = probe.getRebalancer()->getColonyId(gi->nodes[routeNodes[nextRandom(seed) % routeCount]]->id);
+    int *hotNodes = new int[routeCount];
+    int hotCount = 0;
+    for (int i = 0; i < routeCount; i++)
+    {
+        int colony = probe.getRebalancer()->getColonyId(gi->nodes[routeNodes[i]]->id);
+        if (colony == hotColonies[0] || colony == hotColonies[1] || colony == hotColonies[2])
+            hotNodes[hotCount++] = routeNodes[i];
+    }
+
+    NullBuffer nullBuffer;
+    std::streambuf *saved = std::cout.rdbuf(&nullBuffer);
+    SimResult plain = simulate(&city, gi.get(), routeNodes, routeCount, hotNodes, hotCount,
+                               driverCount, minutes, perMinute, false);
+    SimResult balanced = simulate(&city, gi.get(), routeNodes, routeCount, hotNodes, hotCount,
+                                  driverCount, minutes, perMinute, true);
+    std::cout.rdbuf(saved);
+
+    std::cout << "\n=== Idle Driver Rebalancing (" << driverCount << " drivers, " << minutes
+              << " min, " << perMinute << " requests/min, 80% from "
+              << probe.getRebalancer()->getColonyName(hotColonies[0]) << ", "
+              << probe.getRebalancer()->getColonyName(hotColonies[1]) << ", "
+              << probe.getRebalancer()->getColonyName(hotColonies[2]) << ") ===" << std::endl;
+    const SimResult *rows[2] = {&plain, &balanced};
+    const char *names[2] = {"Without rebalancing: ", "With rebalancing:    "};
+    for (int k = 0; k < 2; k++)
+    {
+        const SimResult &r = *rows[k];
+        std::cout << names[k] << r.assigned << " assigned, " << r.unserved << " unserved, average pickup "
+                  << (r.assigned > 0 ? r.pickupDistance / r.assigned : 0.0) << " m, "
+                  << r.moves << " repositioning moves" << std::endl;
+    }
+
+    delete[] hotNodes;
+    delete[] routeNodes;
+    return 0;
+}
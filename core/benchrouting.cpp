@@ -0,0 +1,93 @@
+#include "city.h"
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <chrono>
+
+// Routing benchmark: compares A* latency with the graph index built in
+// linked-list order against the Hilbert-curve order used by City::freeze().
+
+std::string getDataFilePath(const std::string &filename)
+{
+    std::string paths[] = {
+        std::string("../city_locations_path_data/") + filename,
+        std::string("./city_locations_path_data/") + filename,
+        std::string("../../city_locations_path_data/") + filename
+    };
+
+    for (const auto &path : paths)
+    {
+        std::ifstream file(path);
+        if (file.good())
+            return path;
+    }
+    return paths[0];
+}
+
+// Small deterministic LCG so both runs route the same pairs
+static unsigned int nextRandom(unsigned int &state)
+{
+    state = state * 1103515245u + 12345u;
+    return (state >> 8) & 0xFFFFFF;
+}
+
+static double runQueries(const City &city, char (*starts)[MAX_STRING_LENGTH],
+                         char (*goals)[MAX_STRING_LENGTH], int queryCount, double &checksum)
+{
+    checksum = 0.0;
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < queryCount; i++)
+    {
+        PathResult r = city.findShortestPathAStar(starts[i], goals[i]);
+        checksum += r.totalDistance;
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(end - begin).count() / queryCount;
+}
+
+int main(int argc, char **argv)
+{
+    int queryCount = (argc > 1) ? atoi(argv[1]) : 500;
+    if (queryCount <= 0)
+        queryCount = 500;
+
+    City city;
+    if (!city.loadLocations(getDataFilePath("city-locations.csv").c_str()) ||
+        !city.loadPaths(getDataFilePath("paths.csv").c_str()))
+    {
+        std::cerr << "Failed to load city data" << std::endl;
+        return 1;
+    }
+
+    // Pick random node pairs by ID (indices change between the two layouts)
+    char (*starts)[MAX_STRING_LENGTH] = new char[queryCount][MAX_STRING_LENGTH];
+    char (*goals)[MAX_STRING_LENGTH] = new char[queryCount][MAX_STRING_LENGTH];
+    unsigned int seed = 42;
+    int n = city.getGraphIndex()->nodeCount;
+    for (int i = 0; i < queryCount; i++)
+    {
+        strcpy(starts[i], city.getNodeByIndex(nextRandom(seed) % n)->id);
+        strcpy(goals[i], city.getNodeByIndex(nextRandom(seed) % n)->id);
+    }
+
+    double listChecksum = 0.0, hilbertChecksum = 0.0;
+
+    city.freeze(false);
+    runQueries(city, starts, goals, queryCount / 10 + 1, listChecksum); // warm-up
+    double listUs = runQueries(city, starts, goals, queryCount, listChecksum);
+
+    city.freeze(true);
+    runQueries(city, starts, goals, queryCount / 10 + 1, hilbertChecksum); // warm-up
+    double hilbertUs = runQueries(city, starts, goals, queryCount, hilbertChecksum);
+
+    std::cout << "\n=== A* Routing Benchmark (" << queryCount << " queries, "
+              << n << " nodes) ===" << std::endl;
+    std::cout << "List order:    " << listUs << " us/query" << std::endl;
+    std::cout << "Hilbert order: " << hilbertUs << " us/query" << std::endl;
+    std::cout << "Speedup:       " << (hilbertUs > 0 ? listUs / hilbertUs : 0.0) << "x" << std::endl;
+    std::cout << "Checksums match: " << (listChecksum == hilbertChecksum ? "YES" : "NO") << std::endl;
+
+    delete[] starts;
+    delete[] goals;
+    return 0;
+}
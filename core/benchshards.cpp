@@ -0,0 +1,159 @@
+#include "city.h"
+#include "shardeddispatcher.h"
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <chrono>
+#include <thread>
+
+// Multi-threaded load test: producer threads submit trip requests into a
+// single-shard dispatcher and into one shard per zone, then complete every
+// assigned trip. Reports throughput for both so the scaling is visible.
+// Usage: benchshards [drivers] [requests] [producers]
+
+std::string getDataFilePath(const std::string &filename)
+{
+    std::string paths[] = {
+        std::string("../city_locations_path_data/") + filename,
+        std::string("./city_locations_path_data/") + filename,
+        std::string("../../city_locations_path_data/") + filename
+    };
+
+    for (const auto &path : paths)
+    {
+        std::ifstream file(path);
+        if (file.good())
+            return path;
+    }
+    return paths[0];
+}
+
+static unsigned int nextRandom(unsigned int &state)
+{
+    state = state * 1103515245u + 12345u;
+    return (state >> 8) & 0xFFFFFF;
+}
+
+// Engines log every operation; workers write here instead of the console
+struct NullBuffer : std::streambuf
+{
+    int overflow(int c) override { return c; }
+};
+
+struct LoadResult
+{
+    int assigned;
+    int handoffs;
+    int migrations;
+    double requestSeconds;
+    double completeSeconds;
+};
+
+static void produce(ShardedDispatcher *dispatcher, const GraphIndex *gi, const int *routeNodes,
+                    int routeCount, int count, unsigned int seed)
+{
+    for (int i = 0; i < count; i++)
+    {
+        const char *pickup = gi->nodes[routeNodes[nextRandom(seed) % routeCount]]->id;
+        const char *dropoff = gi->nodes[routeNodes[nextRandom(seed) % routeCount]]->id;
+        dispatcher->requestTrip(i, pickup, dropoff);
+    }
+}
+
+static void completeRange(ShardedDispatcher *dispatcher, int first, int last)
+{
+    for (int tripId = first; tripId <= last; tripId++)
+        dispatcher->completeTrip(tripId);
+}
+
+static LoadResult runLoad(City *city, const GraphIndex *gi, const int *routeNodes, int routeCount,
+                          int shardCount, int driverCount, int requestCount, int producers)
+{
+    ShardedDispatcher dispatcher(city, shardCount, requestCount);
+    dispatcher.start();
+    unsigned int seed = 11;
+    for (int i = 0; i < driverCount; i++)
+        dispatcher.addDriver(gi->nodes[routeNodes[nextRandom(seed) % routeCount]]->id);
+    dispatcher.drain();
+
+    std::thread *threads = new std::thread[producers];
+    int perProducer = requestCount / producers;
+    auto begin = std::chrono::steady_clock::now();
+    for (int p = 0; p < producers; p++)
+        threads[p] = std::thread(produce, &dispatcher, gi, routeNodes, routeCount, perProducer, 23u + p);
+    for (int p = 0; p < producers; p++)
+        threads[p].join();
+    dispatcher.drain();
+    auto requested = std::chrono::steady_clock::now();
+
+    int submitted = perProducer * producers;
+    for (int p = 0; p < producers; p++)
+        threads[p] = std::thread(completeRange, &dispatcher, 1 + p * submitted / producers,
+                                 (p + 1) * submitted / producers);
+    for (int p = 0; p < producers; p++)
+        threads[p].join();
+    dispatcher.drain();
+    auto completed = std::chrono::steady_clock::now();
+    dispatcher.stop();
+    delete[] threads;
+
+    LoadResult result;
+    result.assigned = dispatcher.getAssignedCount();
+    result.handoffs = dispatcher.getHandoffCount();
+    result.migrations = dispatcher.getMigrationCount();
+    result.requestSeconds = std::chrono::duration<double>(requested - begin).count();
+    result.completeSeconds = std::chrono::duration<double>(completed - requested).count();
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    int driverCount = (argc > 1) ? atoi(argv[1]) : 2000;
+    int requestCount = (argc > 2) ? atoi(argv[2]) : 800;
+    int producers = (argc > 3) ? atoi(argv[3]) : 4;
+    if (driverCount <= 0) driverCount = 2000;
+    if (requestCount <= 0) requestCount = 800;
+    if (producers <= 0) producers = 4;
+
+    City city;
+    if (!city.loadLocations(getDataFilePath("city-locations.csv").c_str()) ||
+        !city.loadPaths(getDataFilePath("paths.csv").c_str()))
+    {
+        std::cerr << "Failed to load city data" << std::endl;
+        return 1;
+    }
+
+    std::shared_ptr<const GraphIndex> gi = city.getGraphIndex();
+    int *routeNodes = new int[gi->nodeCount];
+    int routeCount = 0;
+    for (int i = 0; i < gi->nodeCount; i++)
+    {
+        if (city.isRouteNode(i))
+            routeNodes[routeCount++] = i;
+    }
+
+    NullBuffer nullBuffer;
+    std::streambuf *saved = std::cout.rdbuf(&nullBuffer);
+    LoadResult single = runLoad(&city, gi.get(), routeNodes, routeCount, 1, driverCount, requestCount, producers);
+    LoadResult zoned = runLoad(&city, gi.get(), routeNodes, routeCount, 5, driverCount, requestCount, producers);
+    std::cout.rdbuf(saved);
+
+    std::cout << "\n=== Sharded Dispatch Load Test (" << driverCount << " drivers, " << requestCount
+              << " requests, " << producers << " producers, "
+              << std::thread::hardware_concurrency() << " hardware threads) ===" << std::endl;
+    const LoadResult *rows[2] = {&single, &zoned};
+    const char *names[2] = {"1 shard:  ", "5 shards: "};
+    for (int k = 0; k < 2; k++)
+    {
+        const LoadResult &r = *rows[k];
+        std::cout << names[k] << r.assigned << " assigned at "
+                  << (r.requestSeconds > 0 ? r.assigned / r.requestSeconds : 0.0) << " req/s, "
+                  << (r.completeSeconds > 0 ? r.assigned / r.completeSeconds : 0.0) << " completions/s, "
+                  << r.handoffs << " handoffs, " << r.migrations << " driver migrations" << std::endl;
+    }
+    if (single.requestSeconds > 0 && zoned.requestSeconds > 0)
+        std::cout << "Request throughput speedup: " << single.requestSeconds / zoned.requestSeconds << "x" << std::endl;
+
+    delete[] routeNodes;
+    return 0;
+}
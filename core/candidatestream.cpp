@@ -0,0 +1,152 @@
+#include "candidatestream.h"
+#include "dispatchengine.h"
+#include <cstdio>
+
+// Values in offered
+static const int OFFERED = 1;
+static const int EXCLUDED = 2;
+
+CandidateStream::CandidateStream(const DispatchEngine *e, FreeDriverIndex *freeIndex, const Node *pickup)
+    : engine(e), index(freeIndex), x(pickup->x), y(pickup->y), phase(0), fetchSize(0),
+      phaseComplete(false), heap(nullptr), heapCount(0), heapCapacity(0), offered(16),
+      excludedCount(0), fetched(nullptr), fetchedDist(nullptr), fetchedCapacity(0)
+{
+    snprintf(zone, sizeof(zone), "%s", pickup->zone);
+    if (zone[0] == '\0')
+        phase = 1;
+}
+
+CandidateStream::~CandidateStream()
+{
+    delete[] heap;
+    delete[] fetched;
+    delete[] fetchedDist;
+}
+
+bool CandidateStream::before(const Candidate &a, const Candidate &b) const
+{
+    if (a.distance != b.distance)
+        return a.distance < b.distance;
+    return a.driverId < b.driverId;
+}
+
+void CandidateStream::push(int driverId, double distance)
+{
+    if (heapCount == heapCapacity)
+    {
+        int newCapacity = heapCapacity > 0 ? heapCapacity * 2 : 16;
+        Candidate *grown = new Candidate[newCapacity];
+        for (int i = 0; i < heapCount; i++)
+            grown[i] = heap[i];
+        delete[] heap;
+        heap = grown;
+        heapCapacity = newCapacity;
+    }
+    Candidate moving = {driverId, distance};
+    int i = heapCount++;
+    while (i > 0 && before(moving, heap[(i - 1) / 2]))
+    {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = moving;
+}
+
+CandidateStream::Candidate CandidateStream::popTop()
+{
+    Candidate top = heap[0];
+    Candidate moving = heap[--heapCount];
+    int i = 0;
+    while (true)
+    {
+        int child = i * 2 + 1;
+        if (child >= heapCount)
+            break;
+        if (child + 1 < heapCount && before(heap[child + 1], heap[child]))
+            child++;
+        if (!before(heap[child], moving))
+            break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    if (heapCount > 0)
+        heap[i] = moving;
+    return top;
+}
+
+// Runs once the heap is empty: asks the index for twice as many drivers as
+// last time and keeps the ones not offered yet. A phase ends when the index
+// returns fewer drivers than asked for.
+bool CandidateStream::refill()
+{
+    while (phase < 2)
+    {
+        if (phaseComplete)
+        {
+            phase++;
+            fetchSize = 0;
+            phaseComplete = false;
+            continue;
+        }
+
+        fetchSize = fetchSize > 0 ? fetchSize * 2 : 8;
+        if (fetchSize > fetchedCapacity)
+        {
+            delete[] fetched;
+            delete[] fetchedDist;
+            fetched = new Driver *[fetchSize];
+            fetchedDist = new double[fetchSize];
+            fetchedCapacity = fetchSize;
+        }
+        int found = index->findNearestK(x, y, phase == 0 ? zone : nullptr, fetchSize, fetched, fetchedDist);
+        phaseComplete = found < fetchSize;
+
+        int state;
+        for (int i = 0; i < found; i++)
+        {
+            if (!offered.find(fetched[i]->getDriverId(), state))
+                push(fetched[i]->getDriverId(), fetchedDist[i]);
+        }
+        if (heapCount > 0)
+            return true;
+    }
+    return false;
+}
+
+int CandidateStream::next()
+{
+    while (heapCount > 0 || refill())
+    {
+        Candidate candidate = popTop();
+        int state;
+        if (offered.find(candidate.driverId, state))
+            continue;   // Excluded after it was fetched
+        Driver *driver = engine->getDriver(candidate.driverId);
+        if (!driver || !driver->isAvailable())
+            continue;   // Taken meanwhile; a later fetch lists it again once it is free
+        offered.insert(candidate.driverId, OFFERED);
+        return candidate.driverId;
+    }
+    return -1;
+}
+
+bool CandidateStream::exclude(int driverId)
+{
+    int state;
+    if (offered.find(driverId, state) && state == EXCLUDED)
+        return false;
+    offered.insert(driverId, EXCLUDED);
+    excludedCount++;
+    return true;
+}
+
+bool CandidateStream::isExcluded(int driverId) const
+{
+    int state;
+    return offered.find(driverId, state) && state == EXCLUDED;
+}
+
+int CandidateStream::getExcludedCount() const
+{
+    return excludedCount;
+}
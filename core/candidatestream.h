@@ -0,0 +1,62 @@
+#ifndef CANDIDATESTREAM_H
+#define CANDIDATESTREAM_H
+
+#include "freedriverindex.h"
+#include "registry.h"
+
+class DispatchEngine;
+
+// Ranked, lazily evaluated driver candidates for one request. Drivers come
+// nearest first by straight-line distance to the pickup: drivers in the
+// pickup's zone first, then all others, the same order assignNearestDriver
+// uses. Candidates are fetched from the free-driver index k at a time into a
+// min-heap. k doubles only when the heap runs dry, so taking the next best
+// is O(log k) amortised rather than a fleet scan. Drivers already offered
+// or excluded for this request are never offered again. A driver that went
+// busy after it was fetched is skipped.
+class CandidateStream
+{
+private:
+    struct Candidate
+    {
+        int driverId;
+        double distance;
+    };
+
+    const DispatchEngine *engine;
+    FreeDriverIndex *index;
+    double x;
+    double y;
+    char zone[MAX_STRING_LENGTH];
+    int phase;              // 0 = pickup zone, 1 = any zone, 2 = exhausted
+    int fetchSize;          // k of the last fetch in this phase
+    bool phaseComplete;     // The last fetch returned every free driver it could
+
+    Candidate *heap;
+    int heapCount;
+    int heapCapacity;
+    IdMap offered;          // Driver ids handed out or excluded
+    int excludedCount;
+
+    Driver **fetched;       // Scratch for the index query
+    double *fetchedDist;
+    int fetchedCapacity;
+
+    bool before(const Candidate &a, const Candidate &b) const;
+    void push(int driverId, double distance);
+    Candidate popTop();
+    bool refill();
+
+public:
+    CandidateStream(const DispatchEngine *e, FreeDriverIndex *freeIndex, const Node *pickup);
+    ~CandidateStream();
+    CandidateStream(const CandidateStream &) = delete;
+    CandidateStream &operator=(const CandidateStream &) = delete;
+
+    int next();                       // Next best free driver, -1 when none is left
+    bool exclude(int driverId);       // Never offer this driver again; false if already excluded
+    bool isExcluded(int driverId) const;
+    int getExcludedCount() const;
+};
+
+#endif // CANDIDATESTREAM_H
@@ -1,10 +1,11 @@
 #include "city.h"
+#include <cstdio>
 #include <cstring>
 #include <fstream>
 #include <iostream>
 
 // Node constructor
-Node::Node() : streetNo(0), nodeNo(0), x(0.0), y(0.0), next(nullptr)
+Node::Node() : streetNo(0), nodeNo(0), x(0.0), y(0.0), typeId(-1), flags(0), index(-1), next(nullptr)
 {
     id[0] = '\0';
     zone[0] = '\0';
@@ -15,7 +16,7 @@ Node::Node() : streetNo(0), nodeNo(0), x(0.0), y(0.0), next(nullptr)
 }
 
 // EdgeNode constructor
-EdgeNode::EdgeNode() : weight(0.0), next(nullptr)
+EdgeNode::EdgeNode() : weight(0.0), closed(false), next(nullptr)
 {
     toNodeId[0] = '\0';
     connectionType[0] = '\0';
@@ -27,9 +28,158 @@ AdjListNode::AdjListNode() : edges(nullptr), next(nullptr)
     nodeId[0] = '\0';
 }
 
+// GraphIndex constructor
+GraphIndex::GraphIndex()
+    : version(0), nodeCount(0), edgeCount(0), nodes(nullptr), x(nullptr), y(nullptr),
+      adjOffset(nullptr), adjTarget(nullptr), adjWeight(nullptr), adjClosed(nullptr),
+      idSlots(nullptr), idCapacity(0), segmentCount(0), segFrom(nullptr), segTo(nullptr),
+      gridMinX(0.0), gridMinY(0.0), gridCellSize(1.0), gridCols(0), gridRows(0),
+      gridOffset(nullptr), gridSegments(nullptr), nodeFlags(nullptr), nodeType(nullptr),
+      typeCount(0), typeOffset(nullptr), typeNodes(nullptr), typeWords(0), typeBits(nullptr),
+      nodeZone(nullptr), zoneCount(0), heuristicScale(1.0)
+{
+}
+
+// GraphIndex deep copy - the next version starts as an exact copy and is then patched
+GraphIndex::GraphIndex(const GraphIndex &other)
+    : version(other.version), nodeCount(other.nodeCount), edgeCount(other.edgeCount),
+      idCapacity(other.idCapacity), segmentCount(other.segmentCount),
+      gridMinX(other.gridMinX), gridMinY(other.gridMinY), gridCellSize(other.gridCellSize),
+      gridCols(other.gridCols), gridRows(other.gridRows), typeCount(other.typeCount),
+      typeWords(other.typeWords), zoneCount(other.zoneCount), heuristicScale(other.heuristicScale)
+{
+    int n = nodeCount;
+    int e = edgeCount > 0 ? edgeCount : 1;
+    nodes = new Node *[n];
+    x = new double[n];
+    y = new double[n];
+    adjOffset = new int[n + 1];
+    adjTarget = new int[e];
+    adjWeight = new double[e];
+    adjClosed = new unsigned char[e];
+    idSlots = new int[idCapacity];
+
+    memcpy(nodes, other.nodes, sizeof(Node *) * n);
+    memcpy(x, other.x, sizeof(double) * n);
+    memcpy(y, other.y, sizeof(double) * n);
+    memcpy(adjOffset, other.adjOffset, sizeof(int) * (n + 1));
+    memcpy(adjTarget, other.adjTarget, sizeof(int) * edgeCount);
+    memcpy(adjWeight, other.adjWeight, sizeof(double) * edgeCount);
+    memcpy(adjClosed, other.adjClosed, sizeof(unsigned char) * edgeCount);
+    memcpy(idSlots, other.idSlots, sizeof(int) * idCapacity);
+
+    int cells = gridCols * gridRows;
+    int gridEntries = other.gridOffset ? other.gridOffset[cells] : 0;
+    segFrom = new int[segmentCount > 0 ? segmentCount : 1];
+    segTo = new int[segmentCount > 0 ? segmentCount : 1];
+    gridOffset = new int[cells + 1];
+    gridSegments = new int[gridEntries > 0 ? gridEntries : 1];
+    memcpy(segFrom, other.segFrom, sizeof(int) * segmentCount);
+    memcpy(segTo, other.segTo, sizeof(int) * segmentCount);
+    if (other.gridOffset)
+        memcpy(gridOffset, other.gridOffset, sizeof(int) * (cells + 1));
+    else
+        gridOffset[0] = 0;
+    memcpy(gridSegments, other.gridSegments, sizeof(int) * gridEntries);
+
+    nodeFlags = new unsigned char[n > 0 ? n : 1];
+    nodeType = new int[n > 0 ? n : 1];
+    typeOffset = new int[typeCount + 1];
+    typeNodes = new int[n > 0 ? n : 1];
+    typeBits = new unsigned long long[typeCount * typeWords > 0 ? typeCount * typeWords : 1];
+    memcpy(nodeFlags, other.nodeFlags, sizeof(unsigned char) * n);
+    memcpy(nodeType, other.nodeType, sizeof(int) * n);
+    memcpy(typeOffset, other.typeOffset, sizeof(int) * (typeCount + 1));
+    memcpy(typeNodes, other.typeNodes, sizeof(int) * n);
+    memcpy(typeBits, other.typeBits, sizeof(unsigned long long) * typeCount * typeWords);
+
+    nodeZone = new int[n > 0 ? n : 1];
+    memcpy(nodeZone, other.nodeZone, sizeof(int) * n);
+}
+
+// GraphIndex destructor - the Node objects themselves belong to the City list
+GraphIndex::~GraphIndex()
+{
+    delete[] nodes;
+    delete[] x;
+    delete[] y;
+    delete[] adjOffset;
+    delete[] adjTarget;
+    delete[] adjWeight;
+    delete[] adjClosed;
+    delete[] idSlots;
+    delete[] segFrom;
+    delete[] segTo;
+    delete[] gridOffset;
+    delete[] gridSegments;
+    delete[] nodeFlags;
+    delete[] nodeType;
+    delete[] typeOffset;
+    delete[] typeNodes;
+    delete[] typeBits;
+    delete[] nodeZone;
+}
+
+// FNV-1a hash of a node ID
+static unsigned int hashNodeId(const char *id)
+{
+    unsigned int h = 2166136261u;
+    for (int i = 0; id[i] != '\0'; i++)
+    {
+        h ^= (unsigned char)id[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Look up a node index by ID in the open-addressing table
+int GraphIndex::findIndex(const char *nodeId) const
+{
+    if (!nodeId || idCapacity == 0)
+        return -1;
+
+    unsigned int mask = (unsigned int)idCapacity - 1;
+    unsigned int slot = hashNodeId(nodeId) & mask;
+    while (idSlots[slot] != -1)
+    {
+        int idx = idSlots[slot];
+        if (strcmp(nodes[idx]->id, nodeId) == 0)
+            return idx;
+        slot = (slot + 1) & mask;
+    }
+    return -1;
+}
+
+// Find the CSR slot of the directed edge from -> to
+int GraphIndex::findEdge(int from, int to) const
+{
+    if (from < 0 || from >= nodeCount)
+        return -1;
+    for (int e = adjOffset[from]; e < adjOffset[from + 1]; e++)
+    {
+        if (adjTarget[e] == to)
+            return e;
+    }
+    return -1;
+}
+
+// Test a node's bit in the bitset of a type
+bool GraphIndex::hasType(int index, int typeId) const
+{
+    if (typeId < 0 || typeId >= typeCount || index < 0 || index >= nodeCount)
+        return false;
+    return (typeBits[typeId * typeWords + index / 64] >> (index % 64)) & 1ULL;
+}
+
 // City constructor
-City::City() : nodeListHead(nullptr), adjacencyListHead(nullptr), nodeCount(0), edgeCount(0)
+City::City() : nodeListHead(nullptr), adjacencyListHead(nullptr), nodeCount(0), edgeCount(0),
+               graphVersion(0), typeNames(nullptr), typeCount(0), typeCapacity(0)
 {
+    // Built-in types take the LocationType ids, in enum order
+    const char *builtins[LOCATION_TYPE_BUILTIN_COUNT] = {"street", "highway", "home",
+                                                         "hospital", "school", "mall"};
+    for (int t = 0; t < LOCATION_TYPE_BUILTIN_COUNT; t++)
+        registerLocationType(builtins[t]);
 }
 
 // City destructor - clean up all dynamically allocated memory
@@ -60,6 +210,8 @@ City::~City()
         currentAdj = currentAdj->next;
         delete temp;
     }
+
+    delete[] typeNames;
 }
 
 // Trim whitespace from string
@@ -156,9 +308,45 @@ double City::calculateDistance(double x1, double y1, double x2, double y2) const
     return sqrt(dx * dx + dy * dy);
 }
 
+// Return the id of a location type, registering it if it is new
+int City::registerLocationType(const char *typeName)
+{
+    int existing = getLocationTypeId(typeName);
+    if (existing >= 0)
+        return existing;
+
+    if (typeCount == typeCapacity)
+    {
+        int newCapacity = typeCapacity > 0 ? typeCapacity * 2 : 8;
+        char (*grown)[MAX_STRING_LENGTH] = new char[newCapacity][MAX_STRING_LENGTH];
+        if (typeCount > 0)
+            memcpy(grown, typeNames, sizeof(char) * MAX_STRING_LENGTH * typeCount);
+        delete[] typeNames;
+        typeNames = grown;
+        typeCapacity = newCapacity;
+    }
+
+    strncpy(typeNames[typeCount], typeName, MAX_STRING_LENGTH - 1);
+    typeNames[typeCount][MAX_STRING_LENGTH - 1] = '\0';
+    return typeCount++;
+}
+
+// Convert the node's locationType string into a type id and flag byte
+void City::classifyNode(Node *node)
+{
+    node->typeId = registerLocationType(node->locationType);
+    if (node->typeId == LOCATION_STREET || node->typeId == LOCATION_HIGHWAY)
+        node->flags = NODE_FLAG_ROUTE;
+    else
+        node->flags = NODE_FLAG_LOCATION;
+}
+
 // Insert node into dynamic linked list (grows automatically)
 void City::insertNode(Node *node)
 {
+    invalidateIndex();
+    if (node->typeId < 0)
+        classifyNode(node);  // Nodes built by callers outside the loaders
     node->next = nodeListHead;
     nodeListHead = node;
     nodeCount++;
@@ -187,49 +375,31 @@ AdjListNode *City::findOrCreateAdjListNode(const char *nodeId)
 }
 
 // Add undirected edge (adds both directions, grows dynamically)
-void City::addEdge(const char *fromId, const char *toId, double weight, const char *connType)
+// Each direction is added only if missing, so a road whose reverse edge was
+// never loaded gets it here. Returns true if at least one direction was new
+bool City::addEdge(const char *fromId, const char *toId, double weight, const char *connType)
 {
-    // Add edge from -> to if it does not already exist
-    AdjListNode *fromNode = findOrCreateAdjListNode(fromId);
-    EdgeNode *edgeWalk = fromNode->edges;
-    while (edgeWalk != nullptr)
+    const char *ends[2][2] = {{fromId, toId}, {toId, fromId}};
+    bool added = false;
+    for (int d = 0; d < 2; d++)
     {
-        if (strcmp(edgeWalk->toNodeId, toId) == 0)
-        {
-            // Edge already present; skip duplicate
-            return;
-        }
-        edgeWalk = edgeWalk->next;
-    }
-
-    EdgeNode *newEdge = new EdgeNode();
-    strcpy(newEdge->toNodeId, toId);
-    newEdge->weight = weight;
-    strcpy(newEdge->connectionType, connType);
-    newEdge->next = fromNode->edges;
-    fromNode->edges = newEdge;
-    edgeCount++;
-
-    // Add reverse edge to -> from (undirected graph) if missing
-    AdjListNode *toNode = findOrCreateAdjListNode(toId);
-    EdgeNode *reverseWalk = toNode->edges;
-    while (reverseWalk != nullptr)
-    {
-        if (strcmp(reverseWalk->toNodeId, fromId) == 0)
-        {
-            // Reverse edge already present; done
-            return;
-        }
-        reverseWalk = reverseWalk->next;
+        AdjListNode *node = findOrCreateAdjListNode(ends[d][0]);
+        EdgeNode *edgeWalk = node->edges;
+        while (edgeWalk != nullptr && strcmp(edgeWalk->toNodeId, ends[d][1]) != 0)
+            edgeWalk = edgeWalk->next;
+        if (edgeWalk != nullptr)
+            continue; // Direction already present; skip duplicate
+
+        EdgeNode *newEdge = new EdgeNode();
+        strcpy(newEdge->toNodeId, ends[d][1]);
+        newEdge->weight = weight;
+        strcpy(newEdge->connectionType, connType);
+        newEdge->next = node->edges;
+        node->edges = newEdge;
+        edgeCount++;
+        added = true;
     }
-
-    EdgeNode *reverseEdge = new EdgeNode();
-    strcpy(reverseEdge->toNodeId, fromId);
-    reverseEdge->weight = weight;
-    strcpy(reverseEdge->connectionType, connType);
-    reverseEdge->next = toNode->edges;
-    toNode->edges = reverseEdge;
-    edgeCount++;
+    return added;
 }
 
 // Get edges for a node
@@ -303,6 +473,7 @@ bool City::loadLocations(const char *filePath)
 
         removeQuotes(fields[5]);
         strcpy(node->locationType, fields[5]);
+        classifyNode(node);
 
         removeQuotes(fields[6]);
         node->nodeNo = atoi(fields[6]);
@@ -330,6 +501,7 @@ bool City::loadLocations(const char *filePath)
     }
 
     file.close();
+    freeze();
     std::cout << "Loaded " << nodeCount << " location nodes (list grew dynamically)" << std::endl;
     return true;
 }
@@ -424,6 +596,7 @@ bool City::loadPaths(const char *filePath)
             node->y = atof(fields[7]);
 
             strcpy(node->locationType, "street");
+            classifyNode(node);
             insertNode(node);
         }
 
@@ -455,6 +628,7 @@ bool City::loadPaths(const char *filePath)
             node->y = atof(fields[16]);
 
             strcpy(node->locationType, "street");
+            classifyNode(node);
             insertNode(node);
         }
 
@@ -464,13 +638,21 @@ bool City::loadPaths(const char *filePath)
     }
 
     file.close();
+    freeze();
     std::cout << "Loaded " << edgeCount << " edges (bidirectional, grown dynamically)" << std::endl;
     return true;
 }
 
-// Get node by ID (searches dynamic linked list)
+// Get node by ID (hash lookup once frozen, otherwise searches dynamic linked list)
 Node *City::getNode(const char *nodeId) const
 {
+    std::shared_ptr<const GraphIndex> gi = loadIndex();
+    if (gi)
+    {
+        int idx = gi->findIndex(nodeId);
+        return idx >= 0 ? gi->nodes[idx] : nullptr;
+    }
+
     Node *current = nodeListHead;
 
     while (current != nullptr)
@@ -484,12 +666,19 @@ Node *City::getNode(const char *nodeId) const
     return nullptr;
 }
 
-// Get nodes by location type (searches dynamic linked list)
+// Get nodes by location type (per-type index list once frozen, otherwise the linked list)
 void City::getNodesByType(const char *locationType, Node *results[], int &count, int maxResults) const
 {
     count = 0;
-    Node *current = nodeListHead;
+    if (isFrozen())
+    {
+        int typeId = getLocationTypeId(locationType);
+        if (typeId >= 0)
+            getNodesByType(typeId, results, count, maxResults);
+        return;
+    }
 
+    Node *current = nodeListHead;
     while (current != nullptr && count < maxResults)
     {
         if (strcmp(current->locationType, locationType) == 0)
@@ -500,6 +689,48 @@ void City::getNodesByType(const char *locationType, Node *results[], int &count,
     }
 }
 
+// Get nodes by type id from the contiguous per-type list (index order)
+void City::getNodesByType(int typeId, Node *results[], int &count, int maxResults) const
+{
+    count = 0;
+    std::shared_ptr<const GraphIndex> gi = loadIndex();
+    if (!gi || typeId < 0 || typeId >= gi->typeCount)
+        return;
+
+    for (int k = gi->typeOffset[typeId]; k < gi->typeOffset[typeId + 1] && count < maxResults; k++)
+        results[count++] = gi->nodes[gi->typeNodes[k]];
+}
+
+int City::getLocationTypeId(const char *locationType) const
+{
+    if (!locationType)
+        return -1;
+    for (int t = 0; t < typeCount; t++)
+    {
+        if (strcmp(typeNames[t], locationType) == 0)
+            return t;
+    }
+    return -1;
+}
+
+const char *City::getLocationTypeName(int typeId) const
+{
+    return (typeId >= 0 && typeId < typeCount) ? typeNames[typeId] : nullptr;
+}
+
+int City::getLocationTypeCount() const
+{
+    return typeCount;
+}
+
+bool City::isRouteNode(int index) const
+{
+    std::shared_ptr<const GraphIndex> gi = loadIndex();
+    if (!gi || index < 0 || index >= gi->nodeCount)
+        return false;
+    return (gi->nodeFlags[index] & NODE_FLAG_ROUTE) != 0;
+}
+
 // Get neighbors of a node (returns head of edge list)
 EdgeNode *City::getNeighbors(const char *nodeId) const
 {
@@ -582,48 +813,682 @@ Node *City::getFirstNode() const
     return nodeListHead;
 }
 
-// A* shortest path returning PathResult
-PathResult City::findShortestPathAStar(const char *startNodeId, const char *endNodeId) const
+// Hilbert curve distance of (x, y) on an n x n grid (n is a power of two)
+static unsigned long long hilbertKey(unsigned int n, unsigned int x, unsigned int y)
 {
-    PathResult result;
+    unsigned long long d = 0;
+    for (unsigned int s = n / 2; s > 0; s /= 2)
+    {
+        unsigned int rx = (x & s) > 0 ? 1 : 0;
+        unsigned int ry = (y & s) > 0 ? 1 : 0;
+        d += (unsigned long long)s * s * ((3 * rx) ^ ry);
+
+        // Rotate the quadrant so the curve stays continuous
+        if (ry == 0)
+        {
+            if (rx == 1)
+            {
+                x = n - 1 - x;
+                y = n - 1 - y;
+            }
+            unsigned int t = x;
+            x = y;
+            y = t;
+        }
+    }
+    return d;
+}
 
-    if (!startNodeId || !endNodeId || nodeCount <= 0)
+// Stable bottom-up merge sort of order[] by keys[order[i]]
+static void sortByKey(int *order, const unsigned long long *keys, int n)
+{
+    int *buffer = new int[n];
+    for (int width = 1; width < n; width *= 2)
     {
-        return result;
+        for (int lo = 0; lo < n; lo += 2 * width)
+        {
+            int mid = lo + width < n ? lo + width : n;
+            int hi = lo + 2 * width < n ? lo + 2 * width : n;
+            int a = lo, b = mid, k = lo;
+            while (a < mid && b < hi)
+                buffer[k++] = (keys[order[b]] < keys[order[a]]) ? order[b++] : order[a++];
+            while (a < mid)
+                buffer[k++] = order[a++];
+            while (b < hi)
+                buffer[k++] = order[b++];
+        }
+        for (int i = 0; i < n; i++)
+            order[i] = buffer[i];
     }
+    delete[] buffer;
+}
 
-    // Build indexable array of nodes
-    int n = nodeCount;
-    Node **nodes = new Node *[n];
-    int idx = 0;
-    Node *curNode = nodeListHead;
-    while (curNode && idx < n)
+// Route nodes are the only places a vehicle can be (street or highway)
+static bool isRouteType(const Node *node)
+{
+    return (node->flags & NODE_FLAG_ROUTE) != 0;
+}
+
+// Grid cells covered by the bounding box of segment seg
+static void segmentCellRange(const GraphIndex *gi, int seg, int &cx0, int &cy0, int &cx1, int &cy1)
+{
+    double ax = gi->x[gi->segFrom[seg]], ay = gi->y[gi->segFrom[seg]];
+    double bx = gi->x[gi->segTo[seg]], by = gi->y[gi->segTo[seg]];
+    cx0 = (int)(((ax < bx ? ax : bx) - gi->gridMinX) / gi->gridCellSize);
+    cx1 = (int)(((ax > bx ? ax : bx) - gi->gridMinX) / gi->gridCellSize);
+    cy0 = (int)(((ay < by ? ay : by) - gi->gridMinY) / gi->gridCellSize);
+    cy1 = (int)(((ay > by ? ay : by) - gi->gridMinY) / gi->gridCellSize);
+    if (cx0 < 0) cx0 = 0;
+    if (cy0 < 0) cy0 = 0;
+    if (cx1 >= gi->gridCols) cx1 = gi->gridCols - 1;
+    if (cy1 >= gi->gridRows) cy1 = gi->gridRows - 1;
+}
+
+// Collect road segments from the CSR rows and bucket them into a uniform grid
+static void buildRoadGrid(GraphIndex *gi)
+{
+    const double cellSize = 64.0;
+    int n = gi->nodeCount;
+
+    gi->segmentCount = 0;
+    for (int i = 0; i < n; i++)
     {
-        nodes[idx++] = curNode;
-        curNode = curNode->next;
+        for (int e = gi->adjOffset[i]; e < gi->adjOffset[i + 1]; e++)
+        {
+            int j = gi->adjTarget[e];
+            if (i < j && isRouteType(gi->nodes[i]) && isRouteType(gi->nodes[j]))
+                gi->segmentCount++;
+        }
     }
-    n = idx;
-    if (n == 0)
+    gi->segFrom = new int[gi->segmentCount > 0 ? gi->segmentCount : 1];
+    gi->segTo = new int[gi->segmentCount > 0 ? gi->segmentCount : 1];
+    int seg = 0;
+    for (int i = 0; i < n; i++)
     {
-        delete[] nodes;
-        return result;
+        for (int e = gi->adjOffset[i]; e < gi->adjOffset[i + 1]; e++)
+        {
+            int j = gi->adjTarget[e];
+            if (i < j && isRouteType(gi->nodes[i]) && isRouteType(gi->nodes[j]))
+            {
+                gi->segFrom[seg] = i;
+                gi->segTo[seg] = j;
+                seg++;
+            }
+        }
     }
 
-    // Linear search for node index by ID
-    auto findIndexById = [&](const char *id) -> int {
-        for (int i = 0; i < n; ++i)
+    double minX = gi->x[0], maxX = gi->x[0], minY = gi->y[0], maxY = gi->y[0];
+    for (int i = 1; i < n; i++)
+    {
+        if (gi->x[i] < minX) minX = gi->x[i];
+        if (gi->x[i] > maxX) maxX = gi->x[i];
+        if (gi->y[i] < minY) minY = gi->y[i];
+        if (gi->y[i] > maxY) maxY = gi->y[i];
+    }
+    gi->gridMinX = minX;
+    gi->gridMinY = minY;
+    gi->gridCellSize = cellSize;
+    gi->gridCols = (int)((maxX - minX) / cellSize) + 1;
+    gi->gridRows = (int)((maxY - minY) / cellSize) + 1;
+
+    int cells = gi->gridCols * gi->gridRows;
+    gi->gridOffset = new int[cells + 1];
+    for (int c = 0; c <= cells; c++)
+        gi->gridOffset[c] = 0;
+
+    int cx0, cy0, cx1, cy1;
+    for (int s = 0; s < gi->segmentCount; s++)
+    {
+        segmentCellRange(gi, s, cx0, cy0, cx1, cy1);
+        for (int cy = cy0; cy <= cy1; cy++)
+            for (int cx = cx0; cx <= cx1; cx++)
+                gi->gridOffset[cy * gi->gridCols + cx + 1]++;
+    }
+    for (int c = 0; c < cells; c++)
+        gi->gridOffset[c + 1] += gi->gridOffset[c];
+
+    int entries = gi->gridOffset[cells];
+    gi->gridSegments = new int[entries > 0 ? entries : 1];
+    int *fill = new int[cells];
+    for (int c = 0; c < cells; c++)
+        fill[c] = gi->gridOffset[c];
+    for (int s = 0; s < gi->segmentCount; s++)
+    {
+        segmentCellRange(gi, s, cx0, cy0, cx1, cy1);
+        for (int cy = cy0; cy <= cy1; cy++)
+            for (int cx = cx0; cx <= cx1; cx++)
+                gi->gridSegments[fill[cy * gi->gridCols + cx]++] = s;
+    }
+    delete[] fill;
+}
+
+// Append one segment to a copied index and splice it into the cells it covers
+static void appendRoadSegment(GraphIndex *gi, int from, int to)
+{
+    int seg = gi->segmentCount;
+    int *newFrom = new int[seg + 1];
+    int *newTo = new int[seg + 1];
+    memcpy(newFrom, gi->segFrom, sizeof(int) * seg);
+    memcpy(newTo, gi->segTo, sizeof(int) * seg);
+    newFrom[seg] = from;
+    newTo[seg] = to;
+    delete[] gi->segFrom;
+    delete[] gi->segTo;
+    gi->segFrom = newFrom;
+    gi->segTo = newTo;
+    gi->segmentCount = seg + 1;
+
+    int cx0, cy0, cx1, cy1;
+    segmentCellRange(gi, seg, cx0, cy0, cx1, cy1);
+    int cells = gi->gridCols * gi->gridRows;
+    int covered = (cx1 - cx0 + 1) * (cy1 - cy0 + 1);
+    int *newOffset = new int[cells + 1];
+    int *newSegments = new int[gi->gridOffset[cells] + covered];
+
+    int pos = 0;
+    for (int c = 0; c < cells; c++)
+    {
+        newOffset[c] = pos;
+        int rowLength = gi->gridOffset[c + 1] - gi->gridOffset[c];
+        memcpy(newSegments + pos, gi->gridSegments + gi->gridOffset[c], sizeof(int) * rowLength);
+        pos += rowLength;
+
+        int cx = c % gi->gridCols, cy = c / gi->gridCols;
+        if (cx >= cx0 && cx <= cx1 && cy >= cy0 && cy <= cy1)
+            newSegments[pos++] = seg;
+    }
+    newOffset[cells] = pos;
+
+    delete[] gi->gridOffset;
+    delete[] gi->gridSegments;
+    gi->gridOffset = newOffset;
+    gi->gridSegments = newSegments;
+}
+
+// Group node indices by type id (contiguous lists plus one bitset per type)
+static void buildTypeIndex(GraphIndex *gi, int typeCount)
+{
+    int n = gi->nodeCount;
+    gi->typeCount = typeCount;
+    gi->nodeFlags = new unsigned char[n > 0 ? n : 1];
+    gi->nodeType = new int[n > 0 ? n : 1];
+    gi->typeOffset = new int[typeCount + 1];
+    gi->typeNodes = new int[n > 0 ? n : 1];
+    for (int t = 0; t <= typeCount; t++)
+        gi->typeOffset[t] = 0;
+
+    for (int i = 0; i < n; i++)
+    {
+        gi->nodeFlags[i] = gi->nodes[i]->flags;
+        gi->nodeType[i] = gi->nodes[i]->typeId;
+        if (gi->nodeType[i] >= 0 && gi->nodeType[i] < typeCount)
+            gi->typeOffset[gi->nodeType[i] + 1]++;
+    }
+    for (int t = 0; t < typeCount; t++)
+        gi->typeOffset[t + 1] += gi->typeOffset[t];
+
+    int *fill = new int[typeCount > 0 ? typeCount : 1];
+    for (int t = 0; t < typeCount; t++)
+        fill[t] = gi->typeOffset[t];
+    for (int i = 0; i < n; i++)
+    {
+        if (gi->nodeType[i] >= 0 && gi->nodeType[i] < typeCount)
+            gi->typeNodes[fill[gi->nodeType[i]]++] = i;
+    }
+    delete[] fill;
+
+    gi->typeWords = (n + 63) / 64;
+    int words = typeCount * gi->typeWords;
+    gi->typeBits = new unsigned long long[words > 0 ? words : 1];
+    for (int w = 0; w < words; w++)
+        gi->typeBits[w] = 0;
+    for (int i = 0; i < n; i++)
+    {
+        if (gi->nodeType[i] >= 0 && gi->nodeType[i] < typeCount)
+            gi->typeBits[gi->nodeType[i] * gi->typeWords + i / 64] |= 1ULL << (i % 64);
+    }
+}
+
+// Weight / straight-line length of CSR slot e (a road out of node i), capped
+// at 1. Closed and zero-length roads never lower the scale, so they count as 1
+static double roadRatio(const GraphIndex *gi, int i, int e)
+{
+    if (gi->adjClosed[e])
+        return 1.0;
+    int j = gi->adjTarget[e];
+    double dx = gi->x[j] - gi->x[i];
+    double dy = gi->y[j] - gi->y[i];
+    double length = std::sqrt(dx * dx + dy * dy);
+    if (length <= 0.0 || gi->adjWeight[e] >= length)
+        return 1.0;
+    return gi->adjWeight[e] / length;
+}
+
+// Full O(E) pass, run once per freeze()
+static void computeHeuristicScale(GraphIndex *gi)
+{
+    double scale = 1.0;
+    for (int i = 0; i < gi->nodeCount; i++)
+    {
+        for (int e = gi->adjOffset[i]; e < gi->adjOffset[i + 1]; e++)
         {
-            if (std::strcmp(nodes[i]->id, id) == 0)
-                return i;
+            double ratio = roadRatio(gi, i, e);
+            if (ratio < scale)
+                scale = ratio;
         }
-        return -1;
-    };
+    }
+    gi->heuristicScale = scale;
+}
+
+// Carry the scale into the next version after a road change. A new, reopened
+// or shortened road can only lower it, which is a comparison; only loosening
+// the road that set the minimum (closing or lengthening a shortcut) needs the
+// full pass. before[k] is the slot's ratio in the previous version, 1 for a
+// slot that is new.
+static void updateHeuristicScale(const GraphIndex &cur, GraphIndex *next, const int *sources,
+                                 const int *slots, const double *before, int slotCount)
+{
+    double scale = cur.heuristicScale;
+    bool rescan = false;
+    for (int k = 0; k < slotCount; k++)
+    {
+        if (slots[k] < 0)
+            continue;
+        double after = roadRatio(next, sources[k], slots[k]);
+        if (after < scale)
+            scale = after;
+        else if (after > before[k] && before[k] <= cur.heuristicScale)
+            rescan = true;
+    }
+    if (rescan)
+        computeHeuristicScale(next);
+    else
+        next->heuristicScale = scale;
+}
+
+// Number nodes by zone prefix. Maps have a handful of zones, so a linear
+// search of the names seen so far is enough.
+static void buildZoneIndex(GraphIndex *gi)
+{
+    int n = gi->nodeCount;
+    gi->nodeZone = new int[n > 0 ? n : 1];
+    gi->zoneCount = 0;
+    const char **names = new const char *[n > 0 ? n : 1];   // First node ID of each zone
+    int *lengths = new int[n > 0 ? n : 1];
+    for (int i = 0; i < n; i++)
+    {
+        const char *id = gi->nodes[i]->id;
+        int len = 0;
+        while (id[len] && id[len] != '_' && len < MAX_STRING_LENGTH - 1)
+            len++;
+        int zone = 0;
+        while (zone < gi->zoneCount && (lengths[zone] != len || strncmp(names[zone], id, len) != 0))
+            zone++;
+        if (zone == gi->zoneCount)
+        {
+            names[zone] = id;
+            lengths[zone] = len;
+            gi->zoneCount++;
+        }
+        gi->nodeZone[i] = zone;
+    }
+    delete[] names;
+    delete[] lengths;
+}
+
+// Current published index (atomic w.r.t. concurrent publishers)
+std::shared_ptr<const GraphIndex> City::loadIndex() const
+{
+    return std::atomic_load(&graphIndex);
+}
+
+// Publish a new index version; readers holding the old one keep it alive
+void City::publishIndex(std::shared_ptr<const GraphIndex> index)
+{
+    std::atomic_store(&graphIndex, index);
+}
+
+// Drop the dense index; the graph is being edited
+void City::invalidateIndex()
+{
+    std::shared_ptr<const GraphIndex> gi = loadIndex();
+    if (!gi)
+        return;
+    for (int i = 0; i < gi->nodeCount; i++)
+        gi->nodes[i]->index = -1;
+    publishIndex(nullptr);
+}
+
+// Build the dense graph index: renumber nodes along a Hilbert curve over
+// their coordinates, then lay the adjacency lists out as CSR in that order.
+void City::freeze(bool spatialOrder)
+{
+    std::lock_guard<std::mutex> lock(mutationMutex);
+    invalidateIndex();
+    if (nodeCount <= 0)
+        return;
+
+    GraphIndex *gi = new GraphIndex();
+
+    // Collect nodes in list order
+    Node **listOrder = new Node *[nodeCount];
+    int n = 0;
+    for (Node *cur = nodeListHead; cur != nullptr && n < nodeCount; cur = cur->next)
+        listOrder[n++] = cur;
+
+    int *order = new int[n];
+    for (int i = 0; i < n; i++)
+        order[i] = i;
+
+    if (spatialOrder && n > 1)
+    {
+        double minX = listOrder[0]->x, maxX = listOrder[0]->x;
+        double minY = listOrder[0]->y, maxY = listOrder[0]->y;
+        for (int i = 1; i < n; i++)
+        {
+            if (listOrder[i]->x < minX) minX = listOrder[i]->x;
+            if (listOrder[i]->x > maxX) maxX = listOrder[i]->x;
+            if (listOrder[i]->y < minY) minY = listOrder[i]->y;
+            if (listOrder[i]->y > maxY) maxY = listOrder[i]->y;
+        }
+
+        const unsigned int gridSize = 1u << 16;
+        double spanX = (maxX > minX) ? (maxX - minX) : 1.0;
+        double spanY = (maxY > minY) ? (maxY - minY) : 1.0;
+
+        unsigned long long *keys = new unsigned long long[n];
+        for (int i = 0; i < n; i++)
+        {
+            unsigned int gx = (unsigned int)((listOrder[i]->x - minX) / spanX * (gridSize - 1));
+            unsigned int gy = (unsigned int)((listOrder[i]->y - minY) / spanY * (gridSize - 1));
+            keys[i] = hilbertKey(gridSize, gx, gy);
+        }
+        sortByKey(order, keys, n);
+        delete[] keys;
+    }
+
+    gi->nodeCount = n;
+    gi->nodes = new Node *[n];
+    gi->x = new double[n];
+    gi->y = new double[n];
+    for (int i = 0; i < n; i++)
+    {
+        Node *node = listOrder[order[i]];
+        node->index = i;
+        gi->nodes[i] = node;
+        gi->x[i] = node->x;
+        gi->y[i] = node->y;
+    }
+    delete[] order;
+    delete[] listOrder;
+
+    // ID hash table at load factor <= 0.5
+    gi->idCapacity = 1;
+    while (gi->idCapacity < 2 * n)
+        gi->idCapacity *= 2;
+    gi->idSlots = new int[gi->idCapacity];
+    for (int i = 0; i < gi->idCapacity; i++)
+        gi->idSlots[i] = -1;
+    unsigned int mask = (unsigned int)gi->idCapacity - 1;
+    for (int i = 0; i < n; i++)
+    {
+        unsigned int slot = hashNodeId(gi->nodes[i]->id) & mask;
+        while (gi->idSlots[slot] != -1)
+            slot = (slot + 1) & mask;
+        gi->idSlots[slot] = i;
+    }
+
+    // CSR adjacency: count degrees, prefix-sum, then fill rows
+    gi->adjOffset = new int[n + 1];
+    for (int i = 0; i <= n; i++)
+        gi->adjOffset[i] = 0;
+
+    AdjListNode **rows = new AdjListNode *[n];
+    for (int i = 0; i < n; i++)
+        rows[i] = nullptr;
+    for (AdjListNode *adj = adjacencyListHead; adj != nullptr; adj = adj->next)
+    {
+        int from = gi->findIndex(adj->nodeId);
+        if (from < 0)
+            continue;
+        rows[from] = adj;
+        for (EdgeNode *e = adj->edges; e != nullptr; e = e->next)
+        {
+            if (gi->findIndex(e->toNodeId) >= 0)
+                gi->adjOffset[from + 1]++;
+        }
+    }
+    for (int i = 0; i < n; i++)
+        gi->adjOffset[i + 1] += gi->adjOffset[i];
+
+    gi->edgeCount = gi->adjOffset[n];
+    gi->adjTarget = new int[gi->edgeCount > 0 ? gi->edgeCount : 1];
+    gi->adjWeight = new double[gi->edgeCount > 0 ? gi->edgeCount : 1];
+    gi->adjClosed = new unsigned char[gi->edgeCount > 0 ? gi->edgeCount : 1];
+    for (int i = 0; i < n; i++)
+    {
+        int pos = gi->adjOffset[i];
+        if (!rows[i])
+            continue;
+        for (EdgeNode *e = rows[i]->edges; e != nullptr; e = e->next)
+        {
+            int to = gi->findIndex(e->toNodeId);
+            if (to < 0)
+                continue;
+            gi->adjTarget[pos] = to;
+            gi->adjWeight[pos] = e->weight;
+            gi->adjClosed[pos] = e->closed ? 1 : 0;
+            pos++;
+        }
+    }
+    delete[] rows;
+
+    buildRoadGrid(gi);
+    buildTypeIndex(gi, typeCount);
+    buildZoneIndex(gi);
+    computeHeuristicScale(gi);
+
+    gi->version = ++graphVersion;
+    publishIndex(std::shared_ptr<const GraphIndex>(gi));
+}
 
-    int startIndex = findIndexById(startNodeId);
-    int goalIndex = findIndexById(endNodeId);
+bool City::isFrozen() const
+{
+    return loadIndex() != nullptr;
+}
+
+std::shared_ptr<const GraphIndex> City::getGraphIndex() const
+{
+    return loadIndex();
+}
+
+int City::getNodeIndex(const char *nodeId) const
+{
+    std::shared_ptr<const GraphIndex> gi = loadIndex();
+    return gi ? gi->findIndex(nodeId) : -1;
+}
+
+Node *City::getNodeByIndex(int index) const
+{
+    std::shared_ptr<const GraphIndex> gi = loadIndex();
+    if (!gi || index < 0 || index >= gi->nodeCount)
+        return nullptr;
+    return gi->nodes[index];
+}
+
+long City::getGraphVersion() const
+{
+    return graphVersion;
+}
+
+// Shared body of closeRoad / reopenRoad / setRoadWeight.
+// closedState: 1 = close, 0 = reopen, -1 = leave as is; weight < 0 = leave as is.
+bool City::updateRoad(const char *fromId, const char *toId, int closedState, double weight)
+{
+    if (!fromId || !toId)
+        return false;
+
+    std::lock_guard<std::mutex> lock(mutationMutex);
+    std::shared_ptr<const GraphIndex> current = loadIndex();
+    if (!current)
+        return false;
+
+    int from = current->findIndex(fromId);
+    int to = current->findIndex(toId);
+    int forward = current->findEdge(from, to);
+    int backward = current->findEdge(to, from);
+    if (forward < 0 && backward < 0)
+        return false;
+
+    // Keep the linked-list view in step with the index
+    const char *ends[2][2] = {{fromId, toId}, {toId, fromId}};
+    for (int d = 0; d < 2; d++)
+    {
+        for (EdgeNode *e = getEdges(ends[d][0]); e != nullptr; e = e->next)
+        {
+            if (strcmp(e->toNodeId, ends[d][1]) != 0)
+                continue;
+            if (closedState >= 0)
+                e->closed = (closedState == 1);
+            if (weight >= 0)
+                e->weight = weight;
+        }
+    }
+
+    // Only the two touched CSR slots change in the new version
+    GraphIndex *next = new GraphIndex(*current);
+    int sources[2] = {from, to};
+    int slots[2] = {forward, backward};
+    double before[2] = {1.0, 1.0};
+    for (int i = 0; i < 2; i++)
+    {
+        if (slots[i] < 0)
+            continue;
+        before[i] = roadRatio(current.get(), sources[i], slots[i]);
+        if (closedState >= 0)
+            next->adjClosed[slots[i]] = (unsigned char)closedState;
+        if (weight >= 0)
+            next->adjWeight[slots[i]] = weight;
+    }
+    updateHeuristicScale(*current, next, sources, slots, before, 2);
+    next->version = ++graphVersion;
+    publishIndex(std::shared_ptr<const GraphIndex>(next));
+    return true;
+}
+
+bool City::closeRoad(const char *fromId, const char *toId)
+{
+    return updateRoad(fromId, toId, 1, -1.0);
+}
+
+bool City::reopenRoad(const char *fromId, const char *toId)
+{
+    return updateRoad(fromId, toId, 0, -1.0);
+}
+
+bool City::setRoadWeight(const char *fromId, const char *toId, double weight)
+{
+    if (weight < 0)
+        return false;
+    return updateRoad(fromId, toId, -1, weight);
+}
+
+// Insert a new road between two existing nodes. The CSR rows of both
+// endpoints grow by one slot and the new segment is spliced into the cells
+// it covers; every other row and cell is copied, not rebuilt.
+bool City::addRoad(const char *fromId, const char *toId, double weight, const char *connType)
+{
+    if (!fromId || !toId || weight < 0 || strcmp(fromId, toId) == 0)
+        return false;
+
+    std::lock_guard<std::mutex> lock(mutationMutex);
+    std::shared_ptr<const GraphIndex> current = loadIndex();
+    if (!current)
+        return false;
+
+    int from = current->findIndex(fromId);
+    int to = current->findIndex(toId);
+    if (from < 0 || to < 0)
+        return false;
+
+    bool needForward = current->findEdge(from, to) < 0;
+    bool needBackward = current->findEdge(to, from) < 0;
+    if (!needForward && !needBackward)
+        return false;
+
+    addEdge(fromId, toId, weight, connType ? connType : "Street Edge");
+
+    const GraphIndex &cur = *current;
+    GraphIndex *next = new GraphIndex(cur);
+    int n = cur.nodeCount;
+    int added = (needForward ? 1 : 0) + (needBackward ? 1 : 0);
+
+    delete[] next->adjOffset;
+    delete[] next->adjTarget;
+    delete[] next->adjWeight;
+    delete[] next->adjClosed;
+    next->edgeCount = cur.edgeCount + added;
+    next->adjOffset = new int[n + 1];
+    next->adjTarget = new int[next->edgeCount];
+    next->adjWeight = new double[next->edgeCount];
+    next->adjClosed = new unsigned char[next->edgeCount];
+
+    int pos = 0;
+    for (int i = 0; i < n; i++)
+    {
+        next->adjOffset[i] = pos;
+        int rowStart = cur.adjOffset[i];
+        int rowLength = cur.adjOffset[i + 1] - rowStart;
+        memcpy(next->adjTarget + pos, cur.adjTarget + rowStart, sizeof(int) * rowLength);
+        memcpy(next->adjWeight + pos, cur.adjWeight + rowStart, sizeof(double) * rowLength);
+        memcpy(next->adjClosed + pos, cur.adjClosed + rowStart, sizeof(unsigned char) * rowLength);
+        pos += rowLength;
+
+        int newTarget = -1;
+        if (i == from && needForward)
+            newTarget = to;
+        else if (i == to && needBackward)
+            newTarget = from;
+        if (newTarget >= 0)
+        {
+            next->adjTarget[pos] = newTarget;
+            next->adjWeight[pos] = weight;
+            next->adjClosed[pos] = 0;
+            pos++;
+        }
+    }
+    next->adjOffset[n] = pos;
+
+    if (needForward && needBackward && isRouteType(cur.nodes[from]) && isRouteType(cur.nodes[to]))
+        appendRoadSegment(next, from < to ? from : to, from < to ? to : from);
+    int sources[2] = {from, to};
+    int slots[2] = {needForward ? next->findEdge(from, to) : -1, needBackward ? next->findEdge(to, from) : -1};
+    double before[2] = {1.0, 1.0};
+    updateHeuristicScale(cur, next, sources, slots, before, 2);
+
+    next->version = ++graphVersion;
+    publishIndex(std::shared_ptr<const GraphIndex>(next));
+    return true;
+}
+
+// A* shortest path returning PathResult (runs on the frozen CSR index)
+PathResult City::findShortestPathAStar(const char *startNodeId, const char *endNodeId) const
+{
+    PathResult result;
+
+    std::shared_ptr<const GraphIndex> index = loadIndex();
+    if (!startNodeId || !endNodeId || !index || index->nodeCount <= 0)
+    {
+        return result;
+    }
+
+    const GraphIndex *gi = index.get();
+    int n = gi->nodeCount;
+
+    int startIndex = gi->findIndex(startNodeId);
+    int goalIndex = gi->findIndex(endNodeId);
     if (startIndex < 0 || goalIndex < 0)
     {
-        delete[] nodes;
         return result;
     }
 
@@ -631,9 +1496,8 @@ PathResult City::findShortestPathAStar(const char *startNodeId, const char *endN
     {
         result.totalDistance = 0.0;
         result.pathLength = 1;
-        std::strncpy(result.path[0], nodes[startIndex]->id, MAX_STRING_LENGTH - 1);
+        std::strncpy(result.path[0], gi->nodes[startIndex]->id, MAX_STRING_LENGTH - 1);
         result.path[0][MAX_STRING_LENGTH - 1] = '\0';
-        delete[] nodes;
         return result;
     }
 
@@ -655,10 +1519,13 @@ PathResult City::findShortestPathAStar(const char *startNodeId, const char *endN
         inClosed[i] = 0;
     }
 
+    const double goalX = gi->x[goalIndex];
+    const double goalY = gi->y[goalIndex];
+    const double scale = gi->heuristicScale;
     auto heuristic = [&](int i) -> double {
-        double dx = nodes[i]->x - nodes[goalIndex]->x;
-        double dy = nodes[i]->y - nodes[goalIndex]->y;
-        return std::sqrt(dx * dx + dy * dy);
+        double dx = gi->x[i] - goalX;
+        double dy = gi->y[i] - goalY;
+        return scale * std::sqrt(dx * dx + dy * dy);
     };
 
     // Heap helpers (min-heap on fScore)
@@ -736,45 +1603,36 @@ PathResult City::findShortestPathAStar(const char *startNodeId, const char *endN
 
         inClosed[current] = 1;
 
-        EdgeNode *edge = getNeighbors(nodes[current]->id);
-        while (edge)
+        for (int e = gi->adjOffset[current]; e < gi->adjOffset[current + 1]; ++e)
         {
-            int nei = findIndexById(edge->toNodeId);
-            if (nei >= 0)
+            int nei = gi->adjTarget[e];
+            if (inClosed[nei] || gi->adjClosed[e])
+                continue;
+
+            double tentativeG = gScore[current] + gi->adjWeight[e];
+            if (tentativeG < gScore[nei])
             {
-                if (inClosed[nei])
+                parent[nei] = current;
+                gScore[nei] = tentativeG;
+                fScore[nei] = tentativeG + heuristic(nei);
+
+                if (heapPos[nei] == -1)
                 {
-                    edge = edge->next;
-                    continue;
+                    heap[heapSize] = nei;
+                    heapPos[nei] = heapSize;
+                    heapSize++;
+                    heapifyUp(heapPos[nei]);
                 }
-
-                double tentativeG = gScore[current] + edge->weight;
-                if (tentativeG < gScore[nei])
+                else
                 {
-                    parent[nei] = current;
-                    gScore[nei] = tentativeG;
-                    fScore[nei] = tentativeG + heuristic(nei);
-
-                    if (heapPos[nei] == -1)
-                    {
-                        heap[heapSize] = nei;
-                        heapPos[nei] = heapSize;
-                        heapSize++;
-                        heapifyUp(heapPos[nei]);
-                    }
-                    else
-                    {
-                        heapifyUp(heapPos[nei]);
-                    }
+                    heapifyUp(heapPos[nei]);
                 }
             }
-            edge = edge->next;
         }
     }
 
     if (!found)
     {
-        delete[] nodes;
         delete[] gScore;
         delete[] fScore;
         delete[] parent;
@@ -795,7 +1653,6 @@ PathResult City::findShortestPathAStar(const char *startNodeId, const char *endN
 
     if (length > 500 || (parent[goalIndex] == -1 && goalIndex != startIndex))
     {
-        delete[] nodes;
         delete[] gScore;
         delete[] fScore;
         delete[] parent;
@@ -818,12 +1675,11 @@ PathResult City::findShortestPathAStar(const char *startNodeId, const char *endN
     result.pathLength = length;
     for (int i = 0; i < length; ++i)
     {
-        std::strncpy(result.path[i], nodes[seq[i]]->id, MAX_STRING_LENGTH - 1);
+        std::strncpy(result.path[i], gi->nodes[seq[i]]->id, MAX_STRING_LENGTH - 1);
         result.path[i][MAX_STRING_LENGTH - 1] = '\0';
     }
 
     delete[] seq;
-    delete[] nodes;
     delete[] gScore;
     delete[] fScore;
     delete[] parent;
@@ -831,4 +1687,490 @@ PathResult City::findShortestPathAStar(const char *startNodeId, const char *endN
     delete[] heapPos;
     delete[] inClosed;
     return result;
-}
\ No newline at end of file
+}
+
+// Binary min-heap of node indices keyed by an external priority array, with
+// position tracking so a relaxed node can be moved up in place.
+struct IndexedMinHeap
+{
+    int *heap;
+    int *pos;
+    int size;
+    const double *key;
+
+    IndexedMinHeap(int capacity, const double *priority)
+        : heap(new int[capacity]), pos(new int[capacity]), size(0), key(priority)
+    {
+        for (int i = 0; i < capacity; i++)
+            pos[i] = -1;
+    }
+
+    ~IndexedMinHeap()
+    {
+        delete[] heap;
+        delete[] pos;
+    }
+
+    bool empty() const { return size == 0; }
+
+    void swapAt(int a, int b)
+    {
+        int tmp = heap[a];
+        heap[a] = heap[b];
+        heap[b] = tmp;
+        pos[heap[a]] = a;
+        pos[heap[b]] = b;
+    }
+
+    void siftUp(int i)
+    {
+        while (i > 0 && key[heap[i]] < key[heap[(i - 1) / 2]])
+        {
+            swapAt(i, (i - 1) / 2);
+            i = (i - 1) / 2;
+        }
+    }
+
+    void siftDown(int i)
+    {
+        while (true)
+        {
+            int left = 2 * i + 1, right = 2 * i + 2, smallest = i;
+            if (left < size && key[heap[left]] < key[heap[smallest]])
+                smallest = left;
+            if (right < size && key[heap[right]] < key[heap[smallest]])
+                smallest = right;
+            if (smallest == i)
+                break;
+            swapAt(i, smallest);
+            i = smallest;
+        }
+    }
+
+    // Insert v, or restore order after its key decreased
+    void push(int v)
+    {
+        if (pos[v] == -1)
+        {
+            heap[size] = v;
+            pos[v] = size;
+            size++;
+        }
+        siftUp(pos[v]);
+    }
+
+    int pop()
+    {
+        int top = heap[0];
+        size--;
+        pos[top] = -1;
+        if (size > 0)
+        {
+            heap[0] = heap[size];
+            pos[heap[0]] = 0;
+            siftDown(0);
+        }
+        return top;
+    }
+};
+
+// Snap (x, y) onto the nearest open road segment, searching grid rings
+// outward until no closer segment can exist
+RoadSnap City::snapToRoad(double x, double y, double maxRadius) const
+{
+    RoadSnap snap;
+    std::shared_ptr<const GraphIndex> index = loadIndex();
+    if (!index || index->segmentCount == 0)
+        return snap;
+
+    const GraphIndex *gi = index.get();
+
+    // Distances to grid cells are bounded from the point clamped into the grid
+    double maxGridX = gi->gridMinX + gi->gridCols * gi->gridCellSize;
+    double maxGridY = gi->gridMinY + gi->gridRows * gi->gridCellSize;
+    double cxp = x < gi->gridMinX ? gi->gridMinX : (x >= maxGridX ? maxGridX - 1e-9 : x);
+    double cyp = y < gi->gridMinY ? gi->gridMinY : (y >= maxGridY ? maxGridY - 1e-9 : y);
+    int cx = (int)((cxp - gi->gridMinX) / gi->gridCellSize);
+    int cy = (int)((cyp - gi->gridMinY) / gi->gridCellSize);
+    double outside = calculateDistance(x, y, cxp, cyp);
+
+    double best = maxRadius;
+    int bestSeg = -1;
+    double bestT = 0.0;
+    int maxRing = gi->gridCols > gi->gridRows ? gi->gridCols : gi->gridRows;
+
+    for (int r = 0; r <= maxRing; r++)
+    {
+        if (r > 0 && outside + (r - 1) * gi->gridCellSize > best)
+            break;
+
+        for (int gy = cy - r; gy <= cy + r; gy++)
+        {
+            if (gy < 0 || gy >= gi->gridRows)
+                continue;
+            for (int gx = cx - r; gx <= cx + r; gx++)
+            {
+                if (gx < 0 || gx >= gi->gridCols)
+                    continue;
+                if (gy != cy - r && gy != cy + r && gx != cx - r && gx != cx + r)
+                    continue; // interior cells were visited by earlier rings
+
+                int cell = gy * gi->gridCols + gx;
+                for (int k = gi->gridOffset[cell]; k < gi->gridOffset[cell + 1]; k++)
+                {
+                    int seg = gi->gridSegments[k];
+                    int a = gi->segFrom[seg], b = gi->segTo[seg];
+                    int slot = gi->findEdge(a, b);
+                    if (slot < 0 || gi->adjClosed[slot])
+                        continue;
+
+                    double dx = gi->x[b] - gi->x[a], dy = gi->y[b] - gi->y[a];
+                    double len2 = dx * dx + dy * dy;
+                    double t = len2 > 0 ? ((x - gi->x[a]) * dx + (y - gi->y[a]) * dy) / len2 : 0.0;
+                    if (t < 0.0) t = 0.0;
+                    if (t > 1.0) t = 1.0;
+                    double d = calculateDistance(x, y, gi->x[a] + t * dx, gi->y[a] + t * dy);
+                    if (d < best || (d == best && bestSeg < 0))
+                    {
+                        best = d;
+                        bestSeg = seg;
+                        bestT = t;
+                    }
+                }
+            }
+        }
+    }
+
+    if (bestSeg < 0)
+        return snap;
+
+    int a = gi->segFrom[bestSeg], b = gi->segTo[bestSeg];
+    snap.from = gi->nodes[a];
+    snap.to = gi->nodes[b];
+    snap.projX = gi->x[a] + bestT * (gi->x[b] - gi->x[a]);
+    snap.projY = gi->y[a] + bestT * (gi->y[b] - gi->y[a]);
+    snap.edgeWeight = gi->adjWeight[gi->findEdge(a, b)];
+    snap.offset = bestT * snap.edgeWeight;
+    snap.distance = best;
+    return snap;
+}
+
+// A* between two snapped points. Index n is the virtual source, n + 1 the
+// virtual target; they only exist in this search's scratch arrays.
+PathResult City::findShortestPathBetweenSnaps(const RoadSnap &source, const RoadSnap &target) const
+{
+    PathResult result;
+    std::shared_ptr<const GraphIndex> index = loadIndex();
+    if (!index || !source.isValid() || !target.isValid())
+        return result;
+
+    const GraphIndex *gi = index.get();
+    int n = gi->nodeCount;
+    int sf = source.from->index, st = source.to->index;
+    int tf = target.from->index, tt = target.to->index;
+    if (sf < 0 || st < 0 || tf < 0 || tt < 0 || sf >= n || st >= n || tf >= n || tt >= n)
+        return result;
+
+    const int VS = n, VT = n + 1;
+    const double INF = 1e18;
+    double *dist = new double[n + 2];
+    double *priority = new double[n + 2];
+    int *parent = new int[n + 2];
+    char *settled = new char[n + 2];
+    for (int i = 0; i < n + 2; i++)
+    {
+        dist[i] = INF;
+        priority[i] = INF;
+        parent[i] = -1;
+        settled[i] = 0;
+    }
+
+    auto heuristic = [&](int v) -> double {
+        if (v == VT)
+            return 0.0;
+        if (v == VS)
+            return gi->heuristicScale * calculateDistance(source.projX, source.projY, target.projX, target.projY);
+        return gi->heuristicScale * calculateDistance(gi->x[v], gi->y[v], target.projX, target.projY);
+    };
+
+    IndexedMinHeap open(n + 2, priority);
+    auto relax = [&](int v, double d, int from) {
+        if (settled[v] || d >= dist[v])
+            return;
+        dist[v] = d;
+        parent[v] = from;
+        priority[v] = d + heuristic(v);
+        open.push(v);
+    };
+
+    dist[VS] = 0.0;
+    priority[VS] = heuristic(VS);
+    open.push(VS);
+
+    bool found = false;
+    while (!open.empty())
+    {
+        int u = open.pop();
+        if (u == VT)
+        {
+            found = true;
+            break;
+        }
+        settled[u] = 1;
+
+        if (u == VS)
+        {
+            relax(sf, source.offset, VS);
+            relax(st, source.edgeWeight - source.offset, VS);
+
+            // Both points on the same segment: drive straight along it
+            if (sf == tf && st == tt)
+                relax(VT, std::fabs(source.offset - target.offset), VS);
+            else if (sf == tt && st == tf)
+                relax(VT, std::fabs(source.offset - (target.edgeWeight - target.offset)), VS);
+            continue;
+        }
+
+        for (int e = gi->adjOffset[u]; e < gi->adjOffset[u + 1]; e++)
+        {
+            if (!gi->adjClosed[e])
+                relax(gi->adjTarget[e], dist[u] + gi->adjWeight[e], u);
+        }
+        if (u == tf)
+            relax(VT, dist[u] + target.offset, u);
+        if (u == tt)
+            relax(VT, dist[u] + target.edgeWeight - target.offset, u);
+    }
+
+    if (found)
+    {
+        int length = 0;
+        for (int v = parent[VT]; v != VS && v != -1; v = parent[v])
+            length++;
+
+        if (length <= 500)
+        {
+            result.totalDistance = dist[VT];
+            result.pathLength = length;
+            int pos = length - 1;
+            for (int v = parent[VT]; v != VS && v != -1; v = parent[v])
+            {
+                std::snprintf(result.path[pos], MAX_STRING_LENGTH, "%s", gi->nodes[v]->id);
+                pos--;
+            }
+        }
+    }
+
+    delete[] dist;
+    delete[] priority;
+    delete[] parent;
+    delete[] settled;
+    return result;
+}
+
+// Bounded multi-target Dijkstra: settle nodes in road-distance order and
+// collect the first k whose bit is set in the type's bitset
+int City::findNearestByType(const char *locationType, const char *originNodeId, int k,
+                            Node *results[], double distances[], double maxDistance) const
+{
+    std::shared_ptr<const GraphIndex> index = loadIndex();
+    if (!index || !results || k <= 0)
+        return 0;
+
+    const GraphIndex *gi = index.get();
+    int typeId = getLocationTypeId(locationType);
+    int origin = gi->findIndex(originNodeId);
+    if (typeId < 0 || origin < 0)
+        return 0;
+
+    int n = gi->nodeCount;
+    const double INF = 1e18;
+    double *dist = new double[n];
+    char *settled = new char[n];
+    for (int i = 0; i < n; i++)
+    {
+        dist[i] = INF;
+        settled[i] = 0;
+    }
+
+    IndexedMinHeap open(n, dist);
+    dist[origin] = 0.0;
+    open.push(origin);
+
+    int found = 0;
+    while (!open.empty() && found < k)
+    {
+        int u = open.pop();
+        if (dist[u] > maxDistance)
+            break;
+        settled[u] = 1;
+
+        if (gi->hasType(u, typeId))
+        {
+            results[found] = gi->nodes[u];
+            if (distances)
+                distances[found] = dist[u];
+            found++;
+        }
+
+        for (int e = gi->adjOffset[u]; e < gi->adjOffset[u + 1]; e++)
+        {
+            int v = gi->adjTarget[e];
+            if (settled[v] || gi->adjClosed[e])
+                continue;
+            double d = dist[u] + gi->adjWeight[e];
+            if (d < dist[v])
+            {
+                dist[v] = d;
+                open.push(v);
+            }
+        }
+    }
+
+    delete[] dist;
+    delete[] settled;
+    return found;
+}
+
+// One-to-many road distances from a single Dijkstra search
+int City::findDistancesToNodes(const char *originNodeId, const int targets[], int targetCount,
+                               double distances[], double maxDistance) const
+{
+    if (!targets || !distances || targetCount <= 0)
+        return 0;
+    for (int t = 0; t < targetCount; t++)
+        distances[t] = -1.0;
+
+    std::shared_ptr<const GraphIndex> index = loadIndex();
+    if (!index)
+        return 0;
+
+    const GraphIndex *gi = index.get();
+    int origin = gi->findIndex(originNodeId);
+    if (origin < 0)
+        return 0;
+
+    int n = gi->nodeCount;
+    const double INF = 1e18;
+    double *dist = new double[n];
+    char *settled = new char[n];
+    char *wanted = new char[n];
+    for (int i = 0; i < n; i++)
+    {
+        dist[i] = INF;
+        settled[i] = 0;
+        wanted[i] = 0;
+    }
+
+    // Count distinct targets so the search can stop as soon as all are settled
+    int remaining = 0;
+    for (int t = 0; t < targetCount; t++)
+    {
+        if (targets[t] >= 0 && targets[t] < n && !wanted[targets[t]])
+        {
+            wanted[targets[t]] = 1;
+            remaining++;
+        }
+    }
+
+    IndexedMinHeap open(n, dist);
+    dist[origin] = 0.0;
+    open.push(origin);
+
+    while (!open.empty() && remaining > 0)
+    {
+        int u = open.pop();
+        if (dist[u] > maxDistance)
+            break;
+        settled[u] = 1;
+        if (wanted[u])
+            remaining--;
+
+        for (int e = gi->adjOffset[u]; e < gi->adjOffset[u + 1]; e++)
+        {
+            int v = gi->adjTarget[e];
+            if (settled[v] || gi->adjClosed[e])
+                continue;
+            double d = dist[u] + gi->adjWeight[e];
+            if (d < dist[v])
+            {
+                dist[v] = d;
+                open.push(v);
+            }
+        }
+    }
+
+    int reached = 0;
+    for (int t = 0; t < targetCount; t++)
+    {
+        if (targets[t] >= 0 && targets[t] < n && settled[targets[t]])
+        {
+            distances[t] = dist[targets[t]];
+            reached++;
+        }
+    }
+
+    delete[] dist;
+    delete[] settled;
+    delete[] wanted;
+    return reached;
+}
+
+int City::findDistancesWithin(const char *originNodeId, double maxDistance, int maxNodes,
+                              int nodes[], double distances[]) const
+{
+    if (!nodes || !distances || maxNodes <= 0)
+        return 0;
+
+    std::shared_ptr<const GraphIndex> index = loadIndex();
+    if (!index)
+        return 0;
+
+    const GraphIndex *gi = index.get();
+    int origin = gi->findIndex(originNodeId);
+    if (origin < 0)
+        return 0;
+
+    int n = gi->nodeCount;
+    const double INF = 1e18;
+    double *dist = new double[n];
+    char *settled = new char[n];
+    for (int i = 0; i < n; i++)
+    {
+        dist[i] = INF;
+        settled[i] = 0;
+    }
+
+    IndexedMinHeap open(n, dist);
+    dist[origin] = 0.0;
+    open.push(origin);
+
+    int count = 0;
+    while (!open.empty() && count < maxNodes)
+    {
+        int u = open.pop();
+        if (dist[u] > maxDistance)
+            break;
+        settled[u] = 1;
+        nodes[count] = u;
+        distances[count] = dist[u];
+        count++;
+
+        for (int e = gi->adjOffset[u]; e < gi->adjOffset[u + 1]; e++)
+        {
+            int v = gi->adjTarget[e];
+            if (settled[v] || gi->adjClosed[e])
+                continue;
+            double d = dist[u] + gi->adjWeight[e];
+            if (d < dist[v])
+            {
+                dist[v] = d;
+                open.push(v);
+            }
+        }
+    }
+
+    delete[] dist;
+    delete[] settled;
+    return count;
+}
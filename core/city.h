@@ -5,6 +5,9 @@
 #include <fstream>
 #include <cstring>
 #include <cmath>
+#include <atomic>
+#include <memory>
+#include <mutex>
 
 const int MAX_STRING_LENGTH = 256;
 
@@ -16,6 +19,23 @@ struct PathResult
     PathResult() : totalDistance(-1.0), pathLength(0) {}
 };
 
+// Built-in location types. Types not listed here are registered when the
+// CSV is loaded and get ids from LOCATION_TYPE_BUILTIN_COUNT upward.
+enum LocationType
+{
+    LOCATION_STREET,
+    LOCATION_HIGHWAY,
+    LOCATION_HOME,
+    LOCATION_HOSPITAL,
+    LOCATION_SCHOOL,
+    LOCATION_MALL,
+    LOCATION_TYPE_BUILTIN_COUNT
+};
+
+// Node::flags bits, derived from the location type at load time
+const unsigned char NODE_FLAG_ROUTE = 0x01;    // street/highway: drivers can stand here
+const unsigned char NODE_FLAG_LOCATION = 0x02; // rider-facing place (home, hospital, ...)
+
 // Represents a node in the city graph
 struct Node
 {
@@ -29,10 +49,14 @@ struct Node
     double y;                             // Y coordinate in meters
     char locationType[MAX_STRING_LENGTH]; // "street", "home", "hospital", "school", "mall", etc.
     char locationName[MAX_STRING_LENGTH]; // Name if it's a location
+    int typeId;                           // LocationType or a dynamically registered id
+    unsigned char flags;                  // NODE_FLAG_* bits
+    int index;                            // Dense index assigned by City::freeze(); -1 before
 
     Node *next; // For linked list
 
     Node();
+    bool isRoute() const { return (flags & NODE_FLAG_ROUTE) != 0; }
 };
 
 // Represents an edge in adjacency list
@@ -41,6 +65,7 @@ struct EdgeNode
     char toNodeId[MAX_STRING_LENGTH];
     double weight; // Distance in meters
     char connectionType[MAX_STRING_LENGTH];
+    bool closed;   // Road closed at runtime (see City::closeRoad)
     EdgeNode *next;
 
     EdgeNode();
@@ -56,6 +81,90 @@ struct AdjListNode
     AdjListNode();
 };
 
+// Dense, index-based snapshot of the graph built by City::freeze().
+// Node indices follow a Hilbert curve over (x, y), so nodes that are close
+// in space are also close in memory. Adjacency is stored in CSR form.
+// Snapshots are immutable once published; road changes publish a new version.
+struct GraphIndex
+{
+    long version;
+    int nodeCount;
+    int edgeCount;
+    Node **nodes;      // index -> Node
+    double *x;         // index -> X coordinate (hot copy for routing)
+    double *y;         // index -> Y coordinate
+    int *adjOffset;    // CSR row offsets, nodeCount + 1 entries
+    int *adjTarget;    // CSR neighbour indices
+    double *adjWeight; // CSR edge weights in meters
+    unsigned char *adjClosed; // 1 = road closed, skipped by routing
+    int *idSlots;      // Open-addressing hash of node IDs -> index, -1 = empty
+    int idCapacity;    // Power of two
+
+    // Road segments (undirected edges between route nodes) bucketed in a
+    // uniform grid for point-to-road snapping
+    int segmentCount;
+    int *segFrom;      // Segment endpoints (node indices)
+    int *segTo;
+    double gridMinX;
+    double gridMinY;
+    double gridCellSize;
+    int gridCols;
+    int gridRows;
+    int *gridOffset;   // Per-cell offsets into gridSegments, gridCols * gridRows + 1 entries
+    int *gridSegments; // Segment ids per cell
+
+    // Location types: per-node type/flags, contiguous per-type index lists
+    // (in index order) and one node bitset per type
+    unsigned char *nodeFlags;     // index -> NODE_FLAG_* bits
+    int *nodeType;                // index -> type id
+    int typeCount;
+    int *typeOffset;              // typeCount + 1 entries into typeNodes
+    int *typeNodes;               // node indices grouped by type
+    int typeWords;                // 64-bit words per bitset
+    unsigned long long *typeBits; // typeCount * typeWords words
+
+    // Zones: the node ID's prefix before the first '_' (as Trip::extractZone
+    // reads it), numbered in index order, so cross-zone checks compare ints
+    int *nodeZone;                // index -> zone id
+    int zoneCount;
+
+    // Lowest weight / straight-line length over open roads, at most 1. A*
+    // scales its straight-line heuristic by it, so a road shorter than the
+    // straight line between its ends (a shortcut) cannot make it overestimate.
+    // It is one value for the whole map: a single steep shortcut weakens the
+    // heuristic for every search, including ones nowhere near it, and A*
+    // settles more nodes until that road is closed or lengthened. Callers
+    // adding such roads can read it to see what they cost. Road changes
+    // update it by comparison; only loosening the road that sets it rescans
+    // every edge.
+    double heuristicScale;
+
+    GraphIndex();
+    GraphIndex(const GraphIndex &other); // Deep copy for copy-on-write versions
+    ~GraphIndex();
+    GraphIndex &operator=(const GraphIndex &) = delete;
+
+    int findIndex(const char *nodeId) const;
+    int findEdge(int from, int to) const; // CSR slot of from -> to, -1 if absent
+    bool hasType(int index, int typeId) const;
+};
+
+// A free (x, y) point projected onto the nearest open road segment
+struct RoadSnap
+{
+    Node *from;          // Segment endpoints; nullptr if no road within range
+    Node *to;
+    double projX;        // Projection point on the segment
+    double projY;
+    double offset;       // Road distance from 'from' to the projection (meters)
+    double edgeWeight;   // Full road length of the segment
+    double distance;     // Straight-line distance from the query point to the projection
+
+    RoadSnap() : from(nullptr), to(nullptr), projX(0.0), projY(0.0), offset(0.0),
+                 edgeWeight(0.0), distance(-1.0) {}
+    bool isValid() const { return from != nullptr && to != nullptr; }
+};
+
 class City
 {
 private:
@@ -63,6 +172,14 @@ private:
     AdjListNode *adjacencyListHead; // Dynamic linked list for adjacency entries
     int nodeCount;
     int edgeCount;
+    std::shared_ptr<const GraphIndex> graphIndex; // Built by freeze(); null while the graph is being edited
+    std::mutex mutationMutex;       // Serializes writers that publish new graph versions
+    std::atomic<long> graphVersion;
+
+    // Location type registry; built-ins first, unknown CSV types appended
+    char (*typeNames)[MAX_STRING_LENGTH];
+    int typeCount;
+    int typeCapacity;
 
     // Helper methods
     void trim(char *str) const;
@@ -72,9 +189,15 @@ private:
 
     // Node management - grows dynamically
     void insertNode(Node *node);
-    void addEdge(const char *fromId, const char *toId, double weight, const char *connType);
+    bool addEdge(const char *fromId, const char *toId, double weight, const char *connType);
     EdgeNode *getEdges(const char *nodeId) const;
     AdjListNode *findOrCreateAdjListNode(const char *nodeId);
+    void invalidateIndex();
+    std::shared_ptr<const GraphIndex> loadIndex() const;
+    void publishIndex(std::shared_ptr<const GraphIndex> index);
+    bool updateRoad(const char *fromId, const char *toId, int closedState, double weight);
+    int registerLocationType(const char *typeName);
+    void classifyNode(Node *node);
 
 public:
     City();
@@ -84,18 +207,69 @@ public:
     bool loadLocations(const char *filePath);
     bool loadPaths(const char *filePath);
 
+    // Build the dense graph index (Hilbert node order + CSR adjacency).
+    // Called automatically at the end of each load; spatialOrder = false keeps
+    // linked-list order and exists for benchmarking the reordering.
+    void freeze(bool spatialOrder = true);
+    bool isFrozen() const;
+    std::shared_ptr<const GraphIndex> getGraphIndex() const; // Hold for the whole query
+    int getNodeIndex(const char *nodeId) const;  // -1 if unknown or not frozen
+    Node *getNodeByIndex(int index) const;
+
+    // Runtime road network changes (both directions). Each call patches the
+    // current index and publishes it as a new version; routing already in
+    // flight keeps the version it started with, and active trips keep their
+    // planned paths.
+    bool closeRoad(const char *fromId, const char *toId);
+    bool reopenRoad(const char *fromId, const char *toId);
+    bool setRoadWeight(const char *fromId, const char *toId, double weight);
+    bool addRoad(const char *fromId, const char *toId, double weight,
+                 const char *connType = "Street Edge");
+    long getGraphVersion() const; // Bumped on every freeze() and road change
+
     // Query methods
     Node *getNode(const char *nodeId) const;
     void getNodesByType(const char *locationType, Node *results[], int &count, int maxResults) const;
+    void getNodesByType(int typeId, Node *results[], int &count, int maxResults) const;
+    int getLocationTypeId(const char *locationType) const; // -1 if unknown
+    const char *getLocationTypeName(int typeId) const;
+    int getLocationTypeCount() const;
+    bool isRouteNode(int index) const; // O(1) flag lookup on the frozen index
+
+    // k nearest nodes of a type by road distance from an origin node. One
+    // Dijkstra search stops once k matches are settled (or maxDistance is
+    // passed); results come back in increasing road distance.
+    int findNearestByType(const char *locationType, const char *originNodeId, int k,
+                          Node *results[], double distances[], double maxDistance = 1e18) const;
+
+    // Road distance from one origin to many nodes (graph indices) with a single
+    // Dijkstra search that stops once every target is settled. Unreached
+    // targets get -1. Returns the number of targets reached.
+    int findDistancesToNodes(const char *originNodeId, const int targets[], int targetCount,
+                             double distances[], double maxDistance = 1e18) const;
+    // Bounded Dijkstra ball: every node within maxDistance of the origin, up
+    // to maxNodes of them, in nondecreasing distance order. Returns the count.
+    int findDistancesWithin(const char *originNodeId, double maxDistance, int maxNodes,
+                            int nodes[], double distances[]) const;
     EdgeNode *getNeighbors(const char *nodeId) const;
 
     // Utility methods
     double getDistance(const char *nodeId1, const char *nodeId2) const;
     Node *findNearestNode(double x, double y) const;
 
+    // Snap a raw coordinate onto the nearest open road segment (street/highway
+    // edge) within maxRadius meters, using the segment grid of the index.
+    RoadSnap snapToRoad(double x, double y, double maxRadius = 500.0) const;
+
     // A* shortest path (no STL). Returns PathResult with path and cost.
     PathResult findShortestPathAStar(const char *startNodeId, const char *endNodeId) const;
 
+    // Shortest path between two mid-edge points. The snaps act as virtual
+    // source/target nodes; the graph is not modified. The path lists the real
+    // nodes passed in between (empty if both points share a segment) and
+    // totalDistance includes the partial segments at both ends.
+    PathResult findShortestPathBetweenSnaps(const RoadSnap &source, const RoadSnap &target) const;
+
     // Statistics
     int getNodeCount() const;
     int getEdgeCount() const;           // Returns total directional edges (both forward and backward)
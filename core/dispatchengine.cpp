@@ -1,52 +1,93 @@
 #include "dispatchengine.h"
 #include <iostream>
-#include <cstring>
+#include <cstdio>
 #include <cmath>
 
+// Double the capacity of a pointer array, keeping the first count entries
+template <typename T>
+static void growPointerArray(T **&items, int count, int &capacity)
+{
+    int newCapacity = capacity > 0 ? capacity * 2 : 16;
+    T **grown = new T *[newCapacity];
+    for (int i = 0; i < count; i++)
+        grown[i] = items[i];
+    for (int i = count; i < newCapacity; i++)
+        grown[i] = nullptr;
+    delete[] items;
+    items = grown;
+    capacity = newCapacity;
+}
+
 // Constructor
 DispatchEngine::DispatchEngine(City *c, int maxD, int maxT)
-    : city(c), driverCount(0), maxDrivers(maxD), tripCount(0), 
-      maxTrips(maxT), activeTripsHead(nullptr)
+    : city(c), tripCount(0), maxTrips(maxT > 0 ? maxT : 16), tripsCreated(0),
+      tripSlots(maxT * 2), tripPool(8), retiredTrips(nullptr), retiredHead(0), retiredCount(0),
+      retiredCapacity(0), terminalRetention(500), archive(nullptr), activeTrips(nullptr), activeCount(0),
+      activeCapacity(0), activeSlots(maxT > 0 ? maxT : 16), router(nullptr),
+      pendingRoutes(nullptr), pendingRouteCount(0), pendingRouteCapacity(0), batchTrips(nullptr),
+      batchCount(0), batchCapacity(0), batchWindowSeconds(2.0), batchCandidates(8),
+      streams(nullptr), streamCount(0), streamCapacity(0), streamSlots(16), offerListener(nullptr),
+      offerContext(nullptr), bookings(nullptr),
+      bookingCount(0), bookingCapacity(0), bookingSlots(64), plannedDrivers(64),
+      bookingLeadMs(15 * 60 * 1000), events(nullptr)
 {
-    drivers = new Driver *[maxDrivers];
+    fleet = new DriverFleet(city, maxD > 0 ? maxD : 16);
     trips = new Trip *[maxTrips];
     rollbackManager = new RollbackManager(500);  // Support up to 500 operations
+    freeDrivers = new FreeDriverIndex(city);
+    scheduler = new TripScheduler(this);
+    pool = new RidePool(city);
+    rebalancer = new Rebalancer(this, city);
+    reach = new DriverReach(city);
+    waiting = new RequestQueue();
+    events = new TripEventBus();
+    archive = new TripArchive();
     
-    for (int i = 0; i < maxDrivers; i++)
-        drivers[i] = nullptr;
     for (int i = 0; i < maxTrips; i++)
         trips[i] = nullptr;
+    for (int s = 0; s < TRIP_STATE_COUNT; s++)
+        stateCounts[s] = 0;
 }
 
 // Destructor
 DispatchEngine::~DispatchEngine()
 {
-    // Clean up active trips list
-    ActiveTrip *current = activeTripsHead;
-    while (current != nullptr)
-    {
-        ActiveTrip *temp = current;
-        current = current->next;
-        delete temp;
-    }
+    delete router;  // Joins the worker and deletes its jobs
+    delete[] pendingRoutes;
+    delete rebalancer;
+    delete reach;
+    delete waiting;
+    delete events;
+    delete archive;
+    for (int i = 0; i < streamCount; i++)
+        delete streams[i].stream;
+    delete[] streams;
+    delete[] bookings;
+    delete scheduler;
+    delete pool;
+    
+    delete[] activeTrips;
     
     // Clean up drivers
-    for (int i = 0; i < driverCount; i++)
-        delete drivers[i];
-    delete[] drivers;
+    for (int i = 0; i < fleet->size(); i++)
+        freeDrivers->detach(fleet->at(i));
+    delete fleet;
+    delete freeDrivers;
+    delete[] batchTrips;
     
     // Clean up trips
     for (int i = 0; i < tripCount; i++)
-        delete trips[i];
+        tripPool.destroy(trips[i]);
     delete[] trips;
+    delete[] retiredTrips;
     
     // Clean up rollback manager
     delete rollbackManager;
 }
 
-bool DispatchEngine::addDriver(int driverId, const char *nodeId, const char *zone)
+bool DispatchEngine::addDriver(int driverId, const char *nodeId, const char *zone, bool recordRollback)
 {
-    if (driverCount >= maxDrivers)
+    if (fleet->find(driverId))
         return false;
     
     // POLICY: Driver must be on a route node
@@ -58,320 +99,1776 @@ bool DispatchEngine::addDriver(int driverId, const char *nodeId, const char *zon
     
     // Record snapshot for rollback (driver creation)
     // Operation type can be extended; for now using custom type 10 for driver_add
-    rollbackManager->recordSnapshot(10, -1, driverId, REQUESTED, true, nodeId);
+    if (recordRollback)
+        rollbackManager->recordSnapshot(10, -1, driverId, REQUESTED, true, nodeId);
     
-    drivers[driverCount] = new Driver(driverId, nodeId, zone);
-    driverCount++;
+    Driver *driver = fleet->add(driverId, nodeId, zone);
+    freeDrivers->attach(driver);
+    serveWaitingRequests(driver);
     return true;
 }
 
 bool DispatchEngine::removeDriver(int driverId)
 {
-    for (int i = 0; i < driverCount; i++)
+    Driver *driver = fleet->find(driverId);
+    if (!driver)
+        return false;
+    
+    freeDrivers->detach(driver);
+    reach->forget(driverId);
+    return fleet->remove(driverId);
+}
+
+Driver *DispatchEngine::getDriver(int driverId) const
+{
+    return fleet->find(driverId);
+}
+
+Driver *DispatchEngine::getDriverByIndex(int index) const
+{
+    return fleet->at(index);
+}
+
+int DispatchEngine::getDriverCount() const
+{
+    return fleet->size();
+}
+
+const DriverFleet *DispatchEngine::getFleet() const
+{
+    return fleet;
+}
+
+// Number of available drivers, optionally only those currently in one zone
+int DispatchEngine::getAvailableDriverCount(const char *zone) const
+{
+    return zone ? freeDrivers->getFreeCount(zone) : freeDrivers->getFreeCount();
+}
+
+bool DispatchEngine::requestTrip(int tripId, int riderId, const char *pickupNodeId,
+                                const char *dropoffNodeId)
+{
+    int existing;
     {
-        if (drivers[i] && drivers[i]->getDriverId() == driverId)
+        std::lock_guard<std::mutex> guard(bookingLock);
+        if (bookingSlots.find(tripId, existing) && bookings[existing].stage == BOOKING_HELD)
+            return false;   // Id taken by a booking that is not due yet
+    }
+    
+    std::unique_lock<std::mutex> tableGuard(tripTableLock);
+    if (tripSlots.find(tripId, existing) || archive->contains(tripId))
+        return false;
+    if (tripCount == maxTrips)
+        growPointerArray(trips, tripCount, maxTrips);
+    Trip *trip = tripPool.create(tripId, riderId, pickupNodeId, dropoffNodeId);
+    trip->setRequestedAtMs(scheduler->getSimTimeMs());
+    // No other thread can see the trip yet, so its lock is free. Holding it
+    // until the REQUESTED event is out keeps every transition behind it.
+    std::lock_guard<std::mutex> tripGuard(trip->getLock());
+    trips[tripCount] = trip;
+    tripSlots.insert(tripId, tripCount);
+    tripCount++;
+    tripsCreated++;
+    tableGuard.unlock();
+    
+    stateCounts[REQUESTED]++;
+    rebalancer->recordRequest(pickupNodeId);
+    publishEvent(TRIP_EVENT_REQUESTED, trip);
+    return true;
+}
+
+int DispatchEngine::assignNearestDriver(int tripId)
+{
+    Trip *trip = getTrip(tripId);
+    if (!trip)
+        return -1;
+    int driverId = nearestCandidateFor(trip);
+    if (driverId < 0)
+        return -1;
+    return assignTrip(tripId, driverId) ? driverId : -1;
+}
+
+// A trip that has a candidate stream draws from it, so drivers the rider
+// excluded are not picked again
+int DispatchEngine::nearestCandidateFor(Trip *trip)
+{
+    {
+        std::lock_guard<std::mutex> guard(candidateLock);
+        int slot;
+        if (streamSlots.find(trip->getTripId(), slot))
+            return streams[slot].stream->next();
+    }
+    return findNearestAvailableDriver(trip->getPickupNodeId(), true);
+}
+
+// Nearest available driver from the free-driver index. With sameZone, drivers
+// currently in the pickup's zone are preferred; other zones are only searched
+// when that zone has no free driver.
+int DispatchEngine::findNearestAvailableDriver(const char *pickupNodeId, bool sameZone)
+{
+    Node *pickup = city->getNode(pickupNodeId);
+    if (!pickup)
+        return -1;
+    
+    Driver *best = nullptr;
+    if (sameZone && pickup->zone[0] != '\0')
+        best = freeDrivers->findNearest(pickup->x, pickup->y, pickup->zone);
+    if (!best)
+        best = freeDrivers->findNearest(pickup->x, pickup->y, nullptr);
+    
+    return best ? best->getDriverId() : -1;
+}
+
+Driver *DispatchEngine::selectBestDriver(Driver **candidates, int count,
+                                        const char *pickupNodeId, bool sameZonePref)
+{
+    if (count == 0)
+        return nullptr;
+    
+    Driver *best = candidates[0];
+    double minDist = city->getDistance(best->getCurrentNodeId(), pickupNodeId);
+    
+    for (int i = 1; i < count; i++)
+    {
+        double dist = city->getDistance(candidates[i]->getCurrentNodeId(), pickupNodeId);
+        if (dist < minDist)
         {
-            delete drivers[i];
-            drivers[i] = drivers[driverCount - 1];
-            drivers[driverCount - 1] = nullptr;
-            driverCount--;
-            return true;
+            best = candidates[i];
+            minDist = dist;
+        }
+    }
+    
+    return best;
+}
+
+// Moves a trip whose driver the caller has just reserved to ASSIGNED and
+// stores its legs, all under the trip's lock. Reservation and transition are
+// both compare-and-swap, so a concurrent reservation of the same driver or a
+// concurrent cancellation makes exactly one side lose, and a lost transition
+// hands the driver back. An asynchronous assignment passes empty legs and its
+// routing job, which is listed before the lock is released, so movement
+// never starts on legs still being routed. Nothing is recorded for rollback
+// unless the transition won.
+bool DispatchEngine::commitAssignment(Trip *trip, Driver *driver, const char *pickupNodeId,
+                                      const PathResult &driverPath, const PathResult &riderPath,
+                                      const PendingRoute *route)
+{
+    int tripId = trip->getTripId();
+    int driverId = driver->getDriverId();
+    std::lock_guard<std::mutex> guard(trip->getLock());
+    TripState previousState = trip->getState();
+    if (!transitionTrip(trip, ASSIGNED, driverId))
+    {
+        driver->releaseTrip(tripId);
+        return false;
+    }
+    // Snapshot of the state before the assignment; the driver was free
+    rollbackManager->recordSnapshot(0, tripId, driverId, previousState, true, driver->getCurrentNodeId());
+    {
+        std::lock_guard<std::mutex> waitingGuard(waitingLock);
+        waiting->remove(tripId);
+    }
+    
+    // Any routing still running for an earlier assignment of this trip is stale
+    abandonRouting(tripId);
+    if (route)
+    {
+        std::lock_guard<std::mutex> routeGuard(routeLock);
+        if (pendingRouteCount == pendingRouteCapacity)
+        {
+            int newCapacity = pendingRouteCapacity > 0 ? pendingRouteCapacity * 2 : 8;
+            PendingRoute *grown = new PendingRoute[newCapacity];
+            for (int i = 0; i < pendingRouteCount; i++)
+                grown[i] = pendingRoutes[i];
+            delete[] pendingRoutes;
+            pendingRoutes = grown;
+            pendingRouteCapacity = newCapacity;
+        }
+        pendingRoutes[pendingRouteCount++] = *route;
+    }
+    
+    trip->setEffectivePickupNodeId(pickupNodeId);
+    trip->setDriverToPickupPath(driverPath);
+    trip->setPickupToDropoffPath(riderPath);
+    
+    std::cout << "[PICKUP RESOLUTION] Rider at: " << trip->getPickupNodeId() 
+              << " -> Effective pickup: " << pickupNodeId << std::endl;
+    
+    // Record driver availability change snapshot (became unavailable)
+    rollbackManager->recordSnapshot(4, tripId, driverId, trip->getState(), 
+                                   true, driver->getCurrentNodeId(), -1, nullptr, false);
+    
+    addActiveTrip(trip, driver);
+    return true;
+}
+
+bool DispatchEngine::assignTrip(int tripId, int driverId)
+{
+    Trip *trip = getTrip(tripId);
+    Driver *driver = getDriver(driverId);
+    
+    if (!trip || !driver || !driver->isAvailable())
+        return false;
+    // The legs are searched before the trip is locked; skip the searches
+    // for a trip that can no longer be assigned
+    if (!Trip::isValidTransition(trip->getState(), ASSIGNED) || !driver->tryReserve(tripId))
+        return false;
+    
+    // POLICY: Resolve rider pickup node (route node enforcement)
+    const char *effectivePickupNode = resolveRiderPickupNode(trip->getPickupNodeId());
+    
+    // Compute path from driver to effective pickup
+    PathResult driverPath = city->findShortestPathAStar(driver->getCurrentNodeId(),
+                                                       effectivePickupNode);
+    
+    // Compute path from effective pickup to dropoff
+    PathResult riderPath = city->findShortestPathAStar(effectivePickupNode,
+                                                      trip->getDropoffNodeId());
+    
+    return commitAssignment(trip, driver, effectivePickupNode, driverPath, riderPath, nullptr);
+}
+
+// ============= ASYNCHRONOUS ASSIGNMENT =============
+
+bool DispatchEngine::assignTripAsync(int tripId, int driverId, AssignmentCallback callback, void *context)
+{
+    Trip *trip = getTrip(tripId);
+    Driver *driver = getDriver(driverId);
+    
+    if (!trip || !driver || !driver->isAvailable())
+        return false;
+    if (!Trip::isValidTransition(trip->getState(), ASSIGNED) || !driver->tryReserve(tripId))
+        return false;
+    
+    const char *effectivePickupNode = resolveRiderPickupNode(trip->getPickupNodeId());
+    RouteJob *job = new RouteJob();
+    job->tripId = tripId;
+    job->driverId = driverId;
+    snprintf(job->driverNodeId, sizeof(job->driverNodeId), "%s", driver->getCurrentNodeId());
+    snprintf(job->pickupNodeId, sizeof(job->pickupNodeId), "%s", effectivePickupNode);
+    snprintf(job->dropoffNodeId, sizeof(job->dropoffNodeId), "%s", trip->getDropoffNodeId());
+    
+    // Stale paths from an earlier assignment must not be used meanwhile
+    PathResult none;
+    PendingRoute pending = {job, callback, context};
+    if (!commitAssignment(trip, driver, effectivePickupNode, none, none, &pending))
+    {
+        delete job;
+        return false;
+    }
+    
+    std::lock_guard<std::mutex> guard(routeLock);
+    if (!router)
+        router = new RoutingWorker(city);
+    router->submit(job);
+    return true;
+}
+
+int DispatchEngine::assignNearestDriverAsync(int tripId, AssignmentCallback callback, void *context)
+{
+    Trip *trip = getTrip(tripId);
+    if (!trip)
+        return -1;
+    int driverId = nearestCandidateFor(trip);
+    if (driverId < 0)
+        return -1;
+    return assignTripAsync(tripId, driverId, callback, context) ? driverId : -1;
+}
+
+// Flags the trip's in-flight routing as cancelled; its result is discarded
+// when it comes back
+void DispatchEngine::abandonRouting(int tripId)
+{
+    std::lock_guard<std::mutex> guard(routeLock);
+    for (int i = 0; i < pendingRouteCount; i++)
+    {
+        if (pendingRoutes[i].job->tripId == tripId)
+            pendingRoutes[i].job->cancelled.store(true);
+    }
+}
+
+int DispatchEngine::deliverRoutedAssignments(int waitMs)
+{
+    RoutingWorker *worker;
+    {
+        std::lock_guard<std::mutex> guard(routeLock);
+        if (!router || pendingRouteCount == 0)
+            return 0;
+        worker = router;
+    }
+    
+    int delivered = 0;
+    RouteJob *job = worker->collect(waitMs);
+    while (job)
+    {
+        RouteJob *next = job->next;
+        // The job leaves the pending list under the trip's lock, so movement
+        // sees either routing pending or the routed legs
+        Trip *trip = getTrip(job->tripId);
+        std::unique_lock<std::mutex> tripGuard;
+        if (trip)
+            tripGuard = std::unique_lock<std::mutex>(trip->getLock());
+        PendingRoute pending = {job, nullptr, nullptr};
+        {
+            std::lock_guard<std::mutex> guard(routeLock);
+            for (int i = 0; i < pendingRouteCount; i++)
+            {
+                if (pendingRoutes[i].job == job)
+                {
+                    pending = pendingRoutes[i];
+                    pendingRoutes[i] = pendingRoutes[--pendingRouteCount];
+                    break;
+                }
+            }
+        }
+        
+        // The reservation still stands only if nothing touched the trip meanwhile
+        bool current = !job->cancelled.load() && job->routed && trip &&
+                       trip->getState() == ASSIGNED && trip->getDriverId() == job->driverId;
+        AssignmentResult result;
+        result.tripId = job->tripId;
+        result.driverId = job->driverId;
+        result.status = current ? ASSIGNMENT_ROUTED : ASSIGNMENT_CANCELLED;
+        result.pickupDistance = current ? job->driverPath.totalDistance : -1.0;
+        result.rideDistance = current ? job->riderPath.totalDistance : -1.0;
+        if (current)
+        {
+            trip->setDriverToPickupPath(job->driverPath);
+            trip->setPickupToDropoffPath(job->riderPath);
         }
+        if (tripGuard.owns_lock())
+            tripGuard.unlock();
+        delete job;
+        
+        if (pending.callback)
+            pending.callback(result, pending.context);
+        delivered++;
+        job = next;
+    }
+    return delivered;
+}
+
+bool DispatchEngine::isRoutingPending(int tripId) const
+{
+    std::lock_guard<std::mutex> guard(routeLock);
+    for (int i = 0; i < pendingRouteCount; i++)
+    {
+        if (pendingRoutes[i].job->tripId == tripId && !pendingRoutes[i].job->cancelled.load())
+            return true;
     }
     return false;
 }
 
-Driver *DispatchEngine::getDriver(int driverId) const
-{
-    for (int i = 0; i < driverCount; i++)
+int DispatchEngine::getPendingRouteCount() const
+{
+    std::lock_guard<std::mutex> guard(routeLock);
+    return pendingRouteCount;
+}
+
+void DispatchEngine::detachAssignmentCallbacks(void *context)
+{
+    {
+        std::lock_guard<std::mutex> guard(routeLock);
+        for (int i = 0; i < pendingRouteCount; i++)
+        {
+            if (pendingRoutes[i].context == context)
+                pendingRoutes[i].callback = nullptr;
+        }
+    }
+    std::lock_guard<std::mutex> guard(waitingLock);
+    waiting->detach(context);
+}
+
+// ============= BATCHED MATCHING =============
+
+// Cost given to unreachable driver/request pairs and padding columns
+static const double UNMATCHED_COST = 1e12;
+
+// Minimum-cost assignment of rows to distinct columns (Hungarian algorithm with
+// potentials, O(rows^2 * cols)). Requires rows <= cols. cost is row-major.
+// rowToCol[r] receives the column matched to row r.
+static void solveAssignment(const double *cost, int rows, int cols, int *rowToCol)
+{
+    // 1-based arrays as in the classic formulation; index 0 is the virtual start
+    double *u = new double[rows + 1];
+    double *v = new double[cols + 1];
+    int *p = new int[cols + 1];        // p[j] = row matched to column j
+    int *way = new int[cols + 1];
+    double *minv = new double[cols + 1];
+    char *used = new char[cols + 1];
+    for (int i = 0; i <= rows; i++)
+        u[i] = 0.0;
+    for (int j = 0; j <= cols; j++)
+    {
+        v[j] = 0.0;
+        p[j] = 0;
+    }
+
+    for (int i = 1; i <= rows; i++)
+    {
+        p[0] = i;
+        int j0 = 0;
+        for (int j = 0; j <= cols; j++)
+        {
+            minv[j] = 1e300;
+            used[j] = 0;
+        }
+        do
+        {
+            used[j0] = 1;
+            int i0 = p[j0];
+            int j1 = 0;
+            double delta = 1e300;
+            for (int j = 1; j <= cols; j++)
+            {
+                if (used[j])
+                    continue;
+                double cur = cost[(i0 - 1) * cols + (j - 1)] - u[i0] - v[j];
+                if (cur < minv[j])
+                {
+                    minv[j] = cur;
+                    way[j] = j0;
+                }
+                if (minv[j] < delta)
+                {
+                    delta = minv[j];
+                    j1 = j;
+                }
+            }
+            for (int j = 0; j <= cols; j++)
+            {
+                if (used[j])
+                {
+                    u[p[j]] += delta;
+                    v[j] -= delta;
+                }
+                else
+                {
+                    minv[j] -= delta;
+                }
+            }
+            j0 = j1;
+        } while (p[j0] != 0);
+
+        // Augment along the alternating path
+        do
+        {
+            int j1 = way[j0];
+            p[j0] = p[j1];
+            j0 = j1;
+        } while (j0 != 0);
+    }
+
+    for (int j = 1; j <= cols; j++)
+    {
+        if (p[j] != 0)
+            rowToCol[p[j] - 1] = j - 1;
+    }
+
+    delete[] u;
+    delete[] v;
+    delete[] p;
+    delete[] way;
+    delete[] minv;
+    delete[] used;
+}
+
+void DispatchEngine::setBatchWindow(double seconds)
+{
+    batchWindowSeconds = seconds >= 0.0 ? seconds : 0.0;
+}
+
+double DispatchEngine::getBatchWindow() const
+{
+    return batchWindowSeconds;
+}
+
+void DispatchEngine::setBatchCandidates(int perRequest)
+{
+    batchCandidates = perRequest > 0 ? perRequest : 1;
+}
+
+// Queue a REQUESTED trip for the next batch; the window opens with the first trip
+bool DispatchEngine::queueForBatch(int tripId)
+{
+    Trip *trip = getTrip(tripId);
+    if (!trip || trip->getState() != REQUESTED)
+        return false;
+    for (int i = 0; i < batchCount; i++)
+    {
+        if (batchTrips[i] == tripId)
+            return false;
+    }
+
+    if (batchCount == batchCapacity)
+    {
+        int newCapacity = batchCapacity > 0 ? batchCapacity * 2 : 16;
+        int *grown = new int[newCapacity];
+        for (int i = 0; i < batchCount; i++)
+            grown[i] = batchTrips[i];
+        delete[] batchTrips;
+        batchTrips = grown;
+        batchCapacity = newCapacity;
+    }
+
+    if (batchCount == 0)
+        batchOpenedAt = std::chrono::steady_clock::now();
+    batchTrips[batchCount++] = tripId;
+    return true;
+}
+
+int DispatchEngine::getBatchPendingCount() const
+{
+    return batchCount;
+}
+
+bool DispatchEngine::isBatchDue() const
+{
+    if (batchCount == 0)
+        return false;
+    std::chrono::duration<double> waited = std::chrono::steady_clock::now() - batchOpenedAt;
+    return waited.count() >= batchWindowSeconds;
+}
+
+int DispatchEngine::dispatchBatchIfDue()
+{
+    return isBatchDue() ? dispatchBatch() : 0;
+}
+
+// Match every queued trip at once. Candidate drivers are the union of each
+// request's nearest free drivers. Road distances come from the drivers'
+// shortest-path trees. A pickup outside a driver's tree gets the tree radius
+// as a lower bound instead. When the matching uses such a pair, that row runs
+// one Dijkstra for its missing distances and the matching is solved again.
+// The final matching uses only exact costs, and every other cost is exact or
+// a lower bound, so it is optimal. Trips left unmatched (no reachable free
+// driver) stay queued for the next batch.
+int DispatchEngine::dispatchBatch()
+{
+    // Drop trips that were cancelled or assigned elsewhere while queued
+    int rows = 0;
+    for (int i = 0; i < batchCount; i++)
+    {
+        Trip *trip = getTrip(batchTrips[i]);
+        if (trip && trip->getState() == REQUESTED)
+            batchTrips[rows++] = batchTrips[i];
+    }
+    batchCount = rows;
+    if (rows == 0)
+        return 0;
+
+    // Columns: union of each request's nearest free drivers
+    Driver **columns = new Driver *[rows * batchCandidates];
+    int *columnNodes = new int[rows * batchCandidates];
+    const char **pickups = new const char *[rows];
+    Driver **nearest = new Driver *[batchCandidates];
+    int cols = 0;
+    for (int r = 0; r < rows; r++)
+    {
+        pickups[r] = resolveRiderPickupNode(getTrip(batchTrips[r])->getPickupNodeId());
+        Node *pickup = pickups[r] ? city->getNode(pickups[r]) : nullptr;
+        if (!pickup)
+            continue;
+        int found = freeDrivers->findNearestK(pickup->x, pickup->y, nullptr, batchCandidates,
+                                              nearest, nullptr);
+        for (int k = 0; k < found; k++)
+        {
+            bool seen = false;
+            for (int c = 0; c < cols && !seen; c++)
+                seen = columns[c] == nearest[k];
+            if (!seen)
+            {
+                columns[cols] = nearest[k];
+                columnNodes[cols] = city->getNodeIndex(nearest[k]->getCurrentNodeId());
+                cols++;
+            }
+        }
+    }
+    delete[] nearest;
+
+    // Road-distance cost matrix, padded with dummy columns so rows <= width
+    int width = cols > rows ? cols : rows;
+    double *cost = new double[rows * width];
+    char *bounded = new char[rows * width];
+    for (int r = 0; r < rows; r++)
+    {
+        for (int c = 0; c < width; c++)
+        {
+            cost[r * width + c] = UNMATCHED_COST;
+            bounded[r * width + c] = 0;
+        }
+        int pickupIndex = pickups[r] ? city->getNodeIndex(pickups[r]) : -1;
+        if (pickupIndex < 0)
+            continue;
+        for (int c = 0; c < cols; c++)
+        {
+            double d = reach->getDistance(columns[c], pickupIndex);
+            if (d < 0.0)
+            {
+                d = reach->getCoveredRadius(columns[c]);
+                bounded[r * width + c] = 1;
+            }
+            cost[r * width + c] = d;
+        }
+    }
+
+    int *rowToCol = new int[rows];
+    double *rowDist = new double[cols > 0 ? cols : 1];
+    int *missColumns = new int[cols > 0 ? cols : 1];
+    int *missNodes = new int[cols > 0 ? cols : 1];
+    while (true)
+    {
+        for (int r = 0; r < rows; r++)
+            rowToCol[r] = -1;
+        solveAssignment(cost, rows, width, rowToCol);
+
+        // Resolve every row matched on a lower bound, then match again
+        int resolved = 0;
+        for (int r = 0; r < rows; r++)
+        {
+            int c = rowToCol[r];
+            if (c < 0 || c >= cols || !bounded[r * width + c])
+                continue;
+            int misses = 0;
+            for (int k = 0; k < cols; k++)
+            {
+                if (!bounded[r * width + k])
+                    continue;
+                missColumns[misses] = k;
+                missNodes[misses] = columnNodes[k];
+                misses++;
+                bounded[r * width + k] = 0;
+            }
+            city->findDistancesToNodes(pickups[r], missNodes, misses, rowDist);
+            for (int m = 0; m < misses; m++)
+                cost[r * width + missColumns[m]] = rowDist[m] >= 0.0 ? rowDist[m] : UNMATCHED_COST;
+            resolved++;
+        }
+        if (resolved == 0)
+            break;
+    }
+    delete[] rowDist;
+    delete[] missColumns;
+    delete[] missNodes;
+    delete[] bounded;
+
+    // Pair up driver ids first: assigning changes the free set
+    int *matchedDriver = new int[rows];
+    for (int r = 0; r < rows; r++)
+    {
+        int c = rowToCol[r];
+        bool real = c >= 0 && c < cols && cost[r * width + c] < UNMATCHED_COST;
+        matchedDriver[r] = real ? columns[c]->getDriverId() : -1;
+    }
+
+    int assigned = 0;
+    int remaining = 0;
+    for (int r = 0; r < rows; r++)
+    {
+        if (matchedDriver[r] >= 0 && assignTrip(batchTrips[r], matchedDriver[r]))
+            assigned++;
+        else
+            batchTrips[remaining++] = batchTrips[r];
+    }
+    batchCount = remaining;
+    if (batchCount > 0)
+        batchOpenedAt = std::chrono::steady_clock::now();
+
+    delete[] columns;
+    delete[] columnNodes;
+    delete[] pickups;
+    delete[] cost;
+    delete[] rowToCol;
+    delete[] matchedDriver;
+    return assigned;
+}
+
+// ============= RANKED CANDIDATES =============
+
+// Called with candidateLock held
+CandidateStream *DispatchEngine::findOrOpenStream(Trip *trip)
+{
+    int slot;
+    if (streamSlots.find(trip->getTripId(), slot))
+        return streams[slot].stream;
+    Node *pickup = city->getNode(trip->getPickupNodeId());
+    if (!pickup)
+        return nullptr;
+    
+    if (streamCount == streamCapacity)
+    {
+        int newCapacity = streamCapacity > 0 ? streamCapacity * 2 : 8;
+        TripCandidates *grown = new TripCandidates[newCapacity];
+        for (int i = 0; i < streamCount; i++)
+            grown[i] = streams[i];
+        delete[] streams;
+        streams = grown;
+        streamCapacity = newCapacity;
+    }
+    streams[streamCount].tripId = trip->getTripId();
+    streams[streamCount].stream = new CandidateStream(this, freeDrivers, pickup);
+    streamSlots.insert(trip->getTripId(), streamCount);
+    return streams[streamCount++].stream;
+}
+
+void DispatchEngine::dropCandidateStream(int tripId)
+{
+    std::lock_guard<std::mutex> guard(candidateLock);
+    int slot;
+    if (!streamSlots.find(tripId, slot))
+        return;
+    delete streams[slot].stream;
+    streamSlots.erase(tripId);
+    streams[slot] = streams[--streamCount];
+    if (slot < streamCount)
+        streamSlots.insert(streams[slot].tripId, slot);
+}
+
+int DispatchEngine::nextCandidate(int tripId)
+{
+    Trip *trip = getTrip(tripId);
+    std::lock_guard<std::mutex> guard(candidateLock);
+    CandidateStream *stream = trip ? findOrOpenStream(trip) : nullptr;
+    return stream ? stream->next() : -1;
+}
+
+bool DispatchEngine::excludeCandidate(int tripId, int driverId)
+{
+    Trip *trip = getTrip(tripId);
+    std::lock_guard<std::mutex> guard(candidateLock);
+    CandidateStream *stream = trip ? findOrOpenStream(trip) : nullptr;
+    return stream && stream->exclude(driverId);
+}
+
+int DispatchEngine::getExcludedCandidateCount(int tripId) const
+{
+    std::lock_guard<std::mutex> guard(candidateLock);
+    int slot;
+    return streamSlots.find(tripId, slot) ? streams[slot].stream->getExcludedCount() : 0;
+}
+
+int DispatchEngine::reassignToNextCandidate(int tripId, AssignmentCallback callback, void *context)
+{
+    Trip *trip = getTrip(tripId);
+    if (!trip || trip->getState() != ASSIGNED)
+        return -1;
+    CandidateStream *stream;
+    int driverId;
+    {
+        std::lock_guard<std::mutex> guard(candidateLock);
+        stream = findOrOpenStream(trip);
+        if (!stream)
+            return -1;
+        stream->exclude(trip->getDriverId());
+        driverId = stream->next();
+    }
+    if (driverId < 0)
+        return -1;   // Nobody else is free; the trip keeps its driver
+    
+    // Hand the trip back as a fresh request and assign the next candidate.
+    // The previous driver stays reserved until one is assigned, so it can
+    // take the trip back when every candidate is lost meanwhile.
+    Driver *previous = getDriver(trip->getDriverId());
+    int previousId = trip->getDriverId();
+    {
+        std::lock_guard<std::mutex> guard(trip->getLock());
+        setTripState(trip, REQUESTED);
+    }
+    while (driverId >= 0)
+    {
+        if (offerListener)
+            offerListener(tripId, driverId, offerContext);
+        bool assigned = callback ? assignTripAsync(tripId, driverId, callback, context)
+                                 : assignTrip(tripId, driverId);
+        if (assigned)
+            break;
+        std::lock_guard<std::mutex> guard(candidateLock);
+        driverId = stream->next();
+    }
+    if (driverId < 0)
+    {
+        std::lock_guard<std::mutex> guard(trip->getLock());
+        setTripState(trip, ASSIGNED);   // Still names the previous driver
+        std::cout << "[REASSIGN] Trip #" << tripId << ": driver " << previousId
+                  << " rejected, no other driver could be reserved; keeping driver " << previousId << std::endl;
+        return -1;
+    }
+    std::cout << "[REASSIGN] Trip #" << tripId << ": driver " << previousId
+              << " rejected, reassigned to driver " << driverId << std::endl;
+    if (previous)
+    {
+        previous->releaseTrip(tripId);
+        serveWaitingRequests(previous);
+    }
+    return driverId;
+}
+
+void DispatchEngine::setOfferListener(CandidateOfferListener listener, void *context)
+{
+    offerListener = listener;
+    offerContext = context;
+}
+
+// ============= WAITING FOR A DRIVER =============
+
+bool DispatchEngine::waitForDriver(int tripId, double maxWaitSeconds, int priority,
+                                   AssignmentCallback callback, void *context)
+{
+    Trip *trip = getTrip(tripId);
+    if (!trip || trip->getState() != REQUESTED)
+        return false;
+    
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() +
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(maxWaitSeconds > 0.0 ? maxWaitSeconds : 0.0));
+    std::lock_guard<std::mutex> guard(waitingLock);
+    waiting->push(tripId, priority, deadline, callback, context);
+    return true;
+}
+
+// Engine whose waiting trips this thread is serving, so a driver freed by an
+// expiry callback meanwhile does not start a second pass
+static thread_local const DispatchEngine *servingEngine = nullptr;
+
+// A driver just became free: hand it to the most urgent waiting trip. Stale
+// entries (trips no longer REQUESTED) are dropped and expired ones cancelled
+// on the way.
+void DispatchEngine::serveWaitingRequests(Driver *driver)
+{
+    if (!driver || servingEngine == this || getWaitingRequestCount() == 0)
+        return;
+    const DispatchEngine *outer = servingEngine;
+    servingEngine = this;
+    
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    WaitingRequest request;
+    while (driver->isAvailable())
+    {
+        {
+            std::lock_guard<std::mutex> guard(waitingLock);
+            if (!waiting->pop(request))
+                break;
+        }
+        Trip *trip = getTrip(request.tripId);
+        if (!trip || trip->getState() != REQUESTED)
+            continue;
+        if (request.deadline <= now)
+        {
+            expireWaitingRequest(trip, request);
+            continue;
+        }
+        
+        bool assigned = request.callback
+            ? assignTripAsync(request.tripId, driver->getDriverId(), request.callback, request.context)
+            : assignTrip(request.tripId, driver->getDriverId());
+        if (!assigned && trip->getState() != REQUESTED)
+            continue;   // Cancelled or assigned by another thread meanwhile
+        if (!assigned)
+        {
+            std::lock_guard<std::mutex> guard(waitingLock);
+            waiting->push(request.tripId, request.priority, request.deadline,
+                          request.callback, request.context);
+            break;
+        }
+        startBookedTrip(request.tripId);
+    }
+    servingEngine = outer;
+}
+
+void DispatchEngine::expireWaitingRequest(Trip *trip, const WaitingRequest &request)
+{
+    cancelTrip(trip->getTripId());
+    if (!request.callback)
+        return;
+    
+    AssignmentResult result;
+    result.tripId = request.tripId;
+    result.driverId = -1;
+    result.status = ASSIGNMENT_EXPIRED;
+    result.pickupDistance = -1.0;
+    result.rideDistance = -1.0;
+    request.callback(result, request.context);
+}
+
+int DispatchEngine::expireWaitingRequests()
+{
+    std::unique_lock<std::mutex> guard(waitingLock);
+    int queued = waiting->size();
+    if (queued == 0)
+        return 0;
+    
+    int *expired = new int[queued];
+    int count = waiting->collectExpired(std::chrono::steady_clock::now(), expired, queued);
+    guard.unlock();
+    int cancelled = 0;
+    WaitingRequest request;
+    for (int i = 0; i < count; i++)
+    {
+        guard.lock();
+        bool stillQueued = waiting->remove(expired[i], &request);
+        guard.unlock();
+        if (!stillQueued)
+            continue;  // Cancelled by an earlier callback
+        Trip *trip = getTrip(request.tripId);
+        if (!trip || trip->getState() != REQUESTED)
+            continue;
+        expireWaitingRequest(trip, request);
+        cancelled++;
+    }
+    delete[] expired;
+    return cancelled;
+}
+
+bool DispatchEngine::isWaitingForDriver(int tripId) const
+{
+    std::lock_guard<std::mutex> guard(waitingLock);
+    return waiting->contains(tripId);
+}
+
+int DispatchEngine::getWaitingRequestCount() const
+{
+    std::lock_guard<std::mutex> guard(waitingLock);
+    return waiting->size();
+}
+
+// ============= PRE-BOOKED RIDES =============
+
+bool DispatchEngine::bookTrip(int tripId, int riderId, const char *pickupNodeId,
+                              const char *dropoffNodeId, long long pickupAtMs)
+{
+    if (getTrip(tripId))
+        return false;
+    int pickupIndex = city->getNodeIndex(pickupNodeId);
+    int dropoffIndex = city->getNodeIndex(dropoffNodeId);
+    if (pickupIndex < 0 || dropoffIndex < 0)
+        return false;
+    
+    std::unique_lock<std::mutex> guard(bookingLock);
+    int existing;
+    if (bookingSlots.find(tripId, existing))
+        return false;
+    if (bookingCount == bookingCapacity)
+    {
+        int newCapacity = bookingCapacity > 0 ? bookingCapacity * 2 : 64;
+        Booking *grown = new Booking[newCapacity];
+        for (int i = 0; i < bookingCount; i++)
+            grown[i] = bookings[i];
+        delete[] bookings;
+        bookings = grown;
+        bookingCapacity = newCapacity;
+    }
+    Booking &booking = bookings[bookingCount];
+    booking.tripId = tripId;
+    booking.riderId = riderId;
+    booking.pickupIndex = pickupIndex;
+    booking.dropoffIndex = dropoffIndex;
+    booking.pickupAtMs = pickupAtMs;
+    booking.dispatchAtMs = -1;
+    booking.plannedDriverId = -1;
+    booking.stage = BOOKING_HELD;
+    bookingSlots.insert(tripId, bookingCount);
+    bookingCount++;
+    guard.unlock();
+    
+    scheduler->scheduleBooking(tripId, pickupAtMs - bookingLeadMs);
+    return true;
+}
+
+DispatchEngine::Booking *DispatchEngine::findBooking(int tripId)
+{
+    int slot;
+    return bookingSlots.find(tripId, slot) ? &bookings[slot] : nullptr;
+}
+
+bool DispatchEngine::removeBooking(int tripId)
+{
+    std::lock_guard<std::mutex> guard(bookingLock);
+    int slot;
+    if (!bookingSlots.find(tripId, slot))
+        return false;
+    int planned;
+    int driverId = bookings[slot].plannedDriverId;
+    if (driverId >= 0 && plannedDrivers.find(driverId, planned) && planned == tripId)
+        plannedDrivers.erase(driverId);
+    
+    bookingSlots.erase(tripId);
+    bookings[slot] = bookings[--bookingCount];
+    if (slot < bookingCount)
+        bookingSlots.insert(bookings[slot].tripId, slot);
+    return true;
+}
+
+void DispatchEngine::runBooking(int tripId)
+{
+    Booking *booking = findBooking(tripId);
+    if (!booking)
+        return;   // Cancelled or dispatched since the timer was armed
+    if (booking->stage == BOOKING_HELD)
+        planBooking(tripId);
+    else if (booking->stage == BOOKING_PLANNED)
+        dispatchBooking(tripId);
+    else
+        expireBooking(tripId);
+}
+
+// Requests the trip and picks the driver that reaches the pickup in time
+// with the shortest drive, counting from when and where each driver becomes
+// free; one search from the pickup prices every candidate
+void DispatchEngine::planBooking(int tripId)
+{
+    Booking *booking = findBooking(tripId);
+    std::shared_ptr<const GraphIndex> gi = city->getGraphIndex();
+    const Node *pickup = gi->nodes[booking->pickupIndex];
+    booking->stage = BOOKING_PLANNED;
+    if (!requestTrip(tripId, booking->riderId, pickup->id, gi->nodes[booking->dropoffIndex]->id))
+    {
+        removeBooking(tripId);
+        return;
+    }
+    
+    // Candidates: free drivers near the pickup, and solo drivers on a
+    // scheduled trip, from its drop-off
+    const int NEARBY = 16;
+    long long nowMs = scheduler->getSimTimeMs();
+    int capacity = NEARBY + activeCount;
+    int *candidateIds = new int[capacity];
+    long long *freeAtMs = new long long[capacity];
+    int *positions = new int[capacity];
+    double *distances = new double[capacity];
+    int count = 0;
+    int planned;
+    
+    Driver *nearby[NEARBY];
+    int found = freeDrivers->findNearestK(pickup->x, pickup->y, nullptr, NEARBY, nearby, nullptr);
+    for (int i = 0; i < found; i++)
+    {
+        positions[count] = city->getNodeIndex(nearby[i]->getCurrentNodeId());
+        if (positions[count] < 0 || plannedDrivers.find(nearby[i]->getDriverId(), planned))
+            continue;
+        candidateIds[count] = nearby[i]->getDriverId();
+        freeAtMs[count] = nowMs;
+        count++;
+    }
+    for (int i = 0; i < activeCount; i++)
+    {
+        int driverId = activeTrips[i].driver->getDriverId();
+        long long etaMs = scheduler->getDropoffEtaMs(activeTrips[i].trip->getTripId());
+        positions[count] = city->getNodeIndex(activeTrips[i].trip->getDropoffNodeId());
+        if (etaMs < 0 || positions[count] < 0 || pool->hasStops(driverId) ||
+            plannedDrivers.find(driverId, planned))
+            continue;
+        candidateIds[count] = driverId;
+        freeAtMs[count] = etaMs;
+        count++;
+    }
+    city->findDistancesToNodes(pickup->id, positions, count, distances);
+    
+    // Shortest drive among drivers on time; when none is, the earliest arrival
+    double metresPerMs = scheduler->getDriverSpeed() / 1000.0;
+    int best = -1;
+    bool bestOnTime = false;
+    double bestArrival = 0.0;
+    for (int c = 0; c < count; c++)
+    {
+        if (distances[c] < 0.0)
+            continue;
+        double arrival = freeAtMs[c] + distances[c] / metresPerMs;
+        bool onTime = arrival <= (double)booking->pickupAtMs;
+        bool better;
+        if (best < 0 || onTime != bestOnTime)
+            better = best < 0 || onTime;
+        else if (onTime)
+            better = distances[c] < distances[best] ||
+                     (distances[c] == distances[best] && freeAtMs[c] < freeAtMs[best]);
+        else
+            better = arrival < bestArrival;
+        if (better)
+        {
+            best = c;
+            bestOnTime = onTime;
+            bestArrival = arrival;
+        }
+    }
+    
+    booking->dispatchAtMs = booking->pickupAtMs;
+    if (best >= 0)
+    {
+        long long departMs = booking->pickupAtMs - (long long)(distances[best] / metresPerMs);
+        booking->dispatchAtMs = departMs > freeAtMs[best] ? departMs : freeAtMs[best];
+        booking->plannedDriverId = candidateIds[best];
+        plannedDrivers.insert(candidateIds[best], tripId);
+    }
+    scheduler->scheduleBooking(tripId, booking->dispatchAtMs);
+    
+    delete[] candidateIds;
+    delete[] freeAtMs;
+    delete[] positions;
+    delete[] distances;
+}
+
+void DispatchEngine::dispatchBooking(int tripId)
+{
+    Booking *booking = findBooking(tripId);
+    Trip *trip = getTrip(tripId);
+    if (!trip || trip->getState() != REQUESTED)
+    {
+        removeBooking(tripId);
+        return;
+    }
+    
+    Driver *planned = getDriver(booking->plannedDriverId);
+    bool assigned = planned && planned->isAvailable() && assignTrip(tripId, planned->getDriverId());
+    if (!assigned)
+        assigned = assignNearestDriver(tripId) >= 0;
+    if (assigned)
+    {
+        startBookedTrip(tripId);
+        return;
+    }
+    
+    // Nobody is free: first in line for the next driver released
+    booking = findBooking(tripId);
+    int driverId;
+    if (booking->plannedDriverId >= 0 && plannedDrivers.find(booking->plannedDriverId, driverId))
+        plannedDrivers.erase(booking->plannedDriverId);
+    booking->plannedDriverId = -1;
+    booking->stage = BOOKING_WAITING;
+    
+    // The wait is bounded on the simulated clock by a second timer, not by
+    // the queue's wall-clock deadline
+    {
+        std::lock_guard<std::mutex> guard(waitingLock);
+        waiting->push(tripId, 1, std::chrono::steady_clock::time_point::max(), nullptr, nullptr);
+    }
+    scheduler->scheduleBooking(tripId, scheduler->getSimTimeMs() + bookingLeadMs);
+}
+
+// Still no driver a lead time after dispatch: give up on the booking
+void DispatchEngine::expireBooking(int tripId)
+{
+    removeBooking(tripId);
+    Trip *trip = getTrip(tripId);
+    WaitingRequest request;
+    bool queued;
+    {
+        std::lock_guard<std::mutex> guard(waitingLock);
+        queued = waiting->remove(tripId, &request);
+    }
+    if (queued && trip && trip->getState() == REQUESTED)
+        expireWaitingRequest(trip, request);
+}
+
+// An assigned booking leaves the booking table and starts driving
+void DispatchEngine::startBookedTrip(int tripId)
+{
+    if (removeBooking(tripId))
+        scheduler->scheduleTrip(tripId);
+}
+
+void DispatchEngine::setBookingLeadTime(long long millis)
+{
+    bookingLeadMs = millis > 0 ? millis : 0;
+}
+
+long long DispatchEngine::getBookingLeadTime() const
+{
+    return bookingLeadMs;
+}
+
+int DispatchEngine::getBookingCount() const
+{
+    std::lock_guard<std::mutex> guard(bookingLock);
+    return bookingCount;
+}
+
+bool DispatchEngine::isBooked(int tripId) const
+{
+    std::lock_guard<std::mutex> guard(bookingLock);
+    int slot;
+    return bookingSlots.find(tripId, slot);
+}
+
+int DispatchEngine::getPlannedDriver(int tripId) const
+{
+    std::lock_guard<std::mutex> guard(bookingLock);
+    int slot;
+    return bookingSlots.find(tripId, slot) ? bookings[slot].plannedDriverId : -1;
+}
+
+long long DispatchEngine::getBookingDispatchMs(int tripId) const
+{
+    std::lock_guard<std::mutex> guard(bookingLock);
+    int slot;
+    return bookingSlots.find(tripId, slot) ? bookings[slot].dispatchAtMs : -1;
+}
+
+// ============= SHARED RIDES =============
+
+void DispatchEngine::setPoolingOptions(int seats, double maxDetourRatio, double maxPickupDistance)
+{
+    pool->setSeats(seats);
+    pool->setMaxDetourRatio(maxDetourRatio);
+    pool->setMaxPickupDistance(maxPickupDistance);
+}
+
+int DispatchEngine::assignPooled(int tripId)
+{
+    Trip *trip = getTrip(tripId);
+    if (!trip || trip->getState() != REQUESTED)
+        return -1;
+
+    const char *effectivePickupNode = resolveRiderPickupNode(trip->getPickupNodeId());
+    Node *pickup = city->getNode(effectivePickupNode);
+    int pickupIndex = city->getNodeIndex(effectivePickupNode);
+    int dropoffIndex = city->getNodeIndex(trip->getDropoffNodeId());
+    if (!pickup || pickupIndex < 0 || dropoffIndex < 0)
+        return -1;
+
+    // Idle drivers compete with existing pooled routes as empty routes
+    const int IDLE_CANDIDATES = 4;
+    Driver *idle[IDLE_CANDIDATES];
+    double idleDistances[IDLE_CANDIDATES];
+    int idleCount = freeDrivers->findNearestK(pickup->x, pickup->y, nullptr, IDLE_CANDIDATES,
+                                              idle, idleDistances);
+
+    PoolInsertion insertion;
+    {
+        std::lock_guard<std::mutex> guard(poolLock);
+        if (!pool->findInsertion(pickupIndex, dropoffIndex, idle, idleCount, insertion))
+            return -1;
+    }
+    Driver *driver = getDriver(insertion.driverId);
+    if (!driver)
+        return -1;
+
+    std::unique_lock<std::mutex> tripGuard(trip->getLock());
+    TripState previousState = trip->getState();
+    bool wasAvailable = driver->isAvailable();
+    if (!transitionTrip(trip, ASSIGNED, driver->getDriverId()))
+        return -1;
+    rollbackManager->recordSnapshot(0, tripId, driver->getDriverId(), previousState,
+                                    wasAvailable, driver->getCurrentNodeId());
+    trip->setEffectivePickupNodeId(effectivePickupNode);
+
+    // Paths for display and fares; pooling itself only uses the cached legs
+    trip->setDriverToPickupPath(city->findShortestPathAStar(driver->getCurrentNodeId(), effectivePickupNode));
+    trip->setPickupToDropoffPath(city->findShortestPathAStar(effectivePickupNode, trip->getDropoffNodeId()));
+
+    if (driver->isAvailable())
     {
-        if (drivers[i] && drivers[i]->getDriverId() == driverId)
-            return drivers[i];
+        rollbackManager->recordSnapshot(4, tripId, driver->getDriverId(), trip->getState(),
+                                        true, driver->getCurrentNodeId(), -1, nullptr, false);
+        driver->setAvailable(false);
     }
-    return nullptr;
-}
-
-bool DispatchEngine::requestTrip(int tripId, int riderId, const char *pickupNodeId,
-                                const char *dropoffNodeId)
-{
-    if (tripCount >= maxTrips)
-        return false;
-    
-    trips[tripCount] = new Trip(tripId, riderId, pickupNodeId, dropoffNodeId);
-    tripCount++;
-    return true;
+    driver->setAssignedTripId(tripId);
+    addActiveTrip(trip, driver);
+    tripGuard.unlock();
+    std::lock_guard<std::mutex> guard(poolLock);
+    pool->commitInsertion(tripId, pickupIndex, dropoffIndex, insertion);
+    return driver->getDriverId();
 }
 
-int DispatchEngine::assignNearestDriver(int tripId)
+int DispatchEngine::advancePooledStop(int driverId)
 {
-    Trip *trip = getTrip(tripId);
-    if (!trip)
+    Driver *driver = getDriver(driverId);
+    PoolStop stop;
+    if (!driver)
         return -1;
-    int driverId = findNearestAvailableDriver(trip->getPickupNodeId(), true);
-    if (driverId < 0)
+    {
+        std::lock_guard<std::mutex> guard(poolLock);
+        if (!pool->popNextStop(driverId, stop))
+            return -1;
+    }
+    Trip *trip = getTrip(stop.tripId);
+    Node *node = city->getNodeByIndex(stop.nodeIndex);
+    if (!trip || !node)
         return -1;
-    return assignTrip(tripId, driverId) ? driverId : -1;
-}
 
-int DispatchEngine::findNearestAvailableDriver(const char *pickupNodeId, bool sameZone)
-{
-    Driver *best = nullptr;
-    double minDist = 1e9;
-    
-    for (int i = 0; i < driverCount; i++)
+    rollbackManager->recordSnapshot(11, stop.tripId, driverId, trip->getState(), false,
+                                    driver->getCurrentNodeId());
+    driver->setCurrentNodeId(node->id);
+    trip->setDriverCurrentNodeId(node->id);
+
+    if (stop.isPickup)
     {
-        if (!drivers[i] || !drivers[i]->isAvailable())
-            continue;
-        
-        double dist = city->getDistance(drivers[i]->getCurrentNodeId(), pickupNodeId);
-        if (dist < 0)
-            continue;
-        
-        if (best == nullptr || dist < minDist)
-        {
-            best = drivers[i];
-            minDist = dist;
-        }
+        startPickupMovement(stop.tripId);
+        trip->setRiderCurrentNodeId(node->id);
+        startTrip(stop.tripId);
     }
-    
-    return best ? best->getDriverId() : -1;
+    else
+    {
+        trip->setRiderCurrentNodeId(node->id);
+        completeTrip(stop.tripId);
+    }
+    return stop.tripId;
 }
 
-Driver *DispatchEngine::selectBestDriver(Driver **candidates, int count,
-                                        const char *pickupNodeId, bool sameZonePref)
+const PoolRoute *DispatchEngine::getPoolRoute(int driverId) const
 {
-    if (count == 0)
-        return nullptr;
-    
-    Driver *best = candidates[0];
-    double minDist = city->getDistance(best->getCurrentNodeId(), pickupNodeId);
-    
-    for (int i = 1; i < count; i++)
-    {
-        double dist = city->getDistance(candidates[i]->getCurrentNodeId(), pickupNodeId);
-        if (dist < minDist)
-        {
-            best = candidates[i];
-            minDist = dist;
-        }
-    }
-    
-    return best;
+    return pool->getRoute(driverId);
 }
 
-bool DispatchEngine::assignTrip(int tripId, int driverId)
+RidePool *DispatchEngine::getRidePool() const
 {
-    Trip *trip = getTrip(tripId);
-    Driver *driver = getDriver(driverId);
-    
-    if (!trip || !driver || !driver->isAvailable())
-        return false;
-    
-    // Record snapshot before assignment
-    rollbackManager->recordSnapshot(0, tripId, driverId, trip->getState(), driver->isAvailable(), driver->getCurrentNodeId());
-    
-    if (!trip->transitionToAssigned(driverId))
-        return false;
-    
-    // POLICY: Resolve rider pickup node (route node enforcement)
-    const char *effectivePickupNode = resolveRiderPickupNode(trip->getPickupNodeId());
-    trip->setEffectivePickupNodeId(effectivePickupNode);
-    
-    std::cout << "[PICKUP RESOLUTION] Rider at: " << trip->getPickupNodeId() 
-              << " -> Effective pickup: " << effectivePickupNode << std::endl;
-    
-    // Compute path from driver to effective pickup
-    PathResult driverPath = city->findShortestPathAStar(driver->getCurrentNodeId(),
-                                                       effectivePickupNode);
-    trip->setDriverToPickupPath(driverPath);
-    
-    // Compute path from effective pickup to dropoff
-    PathResult riderPath = city->findShortestPathAStar(effectivePickupNode,
-                                                      trip->getDropoffNodeId());
-    trip->setPickupToDropoffPath(riderPath);
-    
-    // Record driver availability change snapshot (becoming unavailable)
-    rollbackManager->recordSnapshot(4, tripId, driverId, trip->getState(), 
-                                   true, driver->getCurrentNodeId(), -1, nullptr, false);
-    
-    driver->setAvailable(false);
-    driver->setAssignedTripId(tripId);
-    addActiveTrip(trip, driver);
-    
-    return true;
+    return pool;
 }
 
 bool DispatchEngine::startTrip(int tripId)
 {
     Trip *trip = getTrip(tripId);
-    if (!trip || !trip->transitionToOngoing())
+    if (!trip)
         return false;
     
-    return true;
+    std::lock_guard<std::mutex> guard(trip->getLock());
+    return transitionTrip(trip, ONGOING);
 }
 
+// The trip's lock covers the transition, the driver's relocation and its
+// release; the trip is retired and the freed driver matched after it is let go
 bool DispatchEngine::completeTrip(int tripId)
 {
     Trip *trip = getTrip(tripId);
-    if (!trip || !trip->transitionToCompleted())
+    if (!trip)
         return false;
     
-    Driver *driver = getDriver(trip->getDriverId());
-    if (driver)
+    Driver *freed = nullptr;
     {
-        // Record snapshot BEFORE any changes - capture current state
-        const char *currentDriverLocation = driver->getCurrentNodeId();
-        rollbackManager->recordSnapshot(2, tripId, trip->getDriverId(), 
-                          ONGOING, driver->isAvailable(), currentDriverLocation);
+        std::lock_guard<std::mutex> guard(trip->getLock());
+        if (!transitionTrip(trip, COMPLETED))
+            return false;
+        trip->setFinishedAtMs(scheduler->getSimTimeMs());
         
-        // POLICY: Driver relocation after drop-off
-        Node *dropNode = city->getNode(trip->getDropoffNodeId());
-        if (dropNode)
+        Driver *driver = getDriver(trip->getDriverId());
+        int nextPooledTrip = -1;
+        if (driver)
         {
-            if (strcmp(dropNode->locationType, "street") == 0 || 
-                strcmp(dropNode->locationType, "highway") == 0)
-            {
-                // Drop location is a route node - driver stays there
-                driver->setCurrentNodeId(trip->getDropoffNodeId());
-                std::cout << "[COMPLETION] Driver remains at route node: " 
-                         << trip->getDropoffNodeId() << std::endl;
-            }
-            else
+            std::lock_guard<std::mutex> poolGuard(poolLock);
+            pool->removeTrip(driver->getDriverId(), tripId);  // Completed ahead of its drop-off stop
+            if (pool->hasStops(driver->getDriverId()))
+                nextPooledTrip = pool->getRoute(driver->getDriverId())->stops[0].tripId;
+        }
+        if (driver && nextPooledTrip >= 0)
+        {
+            // Pooled vehicle with riders still to serve stays busy where it is
+            rollbackManager->recordSnapshot(2, tripId, trip->getDriverId(), 
+                              ONGOING, driver->isAvailable(), driver->getCurrentNodeId());
+            if (driver->getAssignedTripId() == tripId)
+                driver->setAssignedTripId(nextPooledTrip);
+        }
+        else if (driver)
+        {
+            // Record snapshot BEFORE any changes - capture current state
+            const char *currentDriverLocation = driver->getCurrentNodeId();
+            rollbackManager->recordSnapshot(2, tripId, trip->getDriverId(), 
+                              ONGOING, driver->isAvailable(), currentDriverLocation);
+            
+            // POLICY: Driver relocation after drop-off
+            Node *dropNode = city->getNode(trip->getDropoffNodeId());
+            if (dropNode)
             {
-                // Drop location is not a route node - relocate to nearest route node
-                const char *nearestRoute = findNearestRouteNode(dropNode->x, dropNode->y);
-                if (nearestRoute)
+                if (dropNode->isRoute())
                 {
-                    driver->setCurrentNodeId(nearestRoute);
-                    std::cout << "[COMPLETION] Driver relocated from " << trip->getDropoffNodeId() 
-                             << " to nearest route node: " << nearestRoute << std::endl;
+                    // Drop location is a route node - driver stays there
+                    driver->setCurrentNodeId(trip->getDropoffNodeId());
+                    std::cout << "[COMPLETION] Driver remains at route node: " 
+                             << trip->getDropoffNodeId() << std::endl;
                 }
                 else
                 {
-                    // Fallback: keep at drop location (shouldn't happen in valid graph)
-                    driver->setCurrentNodeId(trip->getDropoffNodeId());
+                    // Drop location is not a route node - relocate to nearest route node
+                    const char *nearestRoute = findNearestRouteNode(dropNode->x, dropNode->y);
+                    if (nearestRoute)
+                    {
+                        driver->setCurrentNodeId(nearestRoute);
+                        std::cout << "[COMPLETION] Driver relocated from " << trip->getDropoffNodeId() 
+                                 << " to nearest route node: " << nearestRoute << std::endl;
+                    }
+                    else
+                    {
+                        // Fallback: keep at drop location (shouldn't happen in valid graph)
+                        driver->setCurrentNodeId(trip->getDropoffNodeId());
+                    }
                 }
             }
+            
+            // Record driver availability change snapshot (becoming available after trip completion)
+            rollbackManager->recordSnapshot(4, tripId, driver->getDriverId(), COMPLETED, 
+                               false, currentDriverLocation, -1, nullptr, true);
+            
+            driver->release();
+            freed = driver;
         }
         
-        // Record driver availability change snapshot (becoming available after trip completion)
-        rollbackManager->recordSnapshot(4, tripId, driver->getDriverId(), COMPLETED, 
-                           false, currentDriverLocation, -1, nullptr, true);
-        
-        driver->setAvailable(true);
-        driver->setAssignedTripId(-1);
+        removeActiveTrip(tripId);
+        dropCandidateStream(tripId);
     }
-    
-    removeActiveTrip(tripId);
+    retireTrip(tripId);
+    serveWaitingRequests(freed);
     return true;
 }
 
 bool DispatchEngine::cancelTrip(int tripId)
 {
     Trip *trip = getTrip(tripId);
-    if (!trip || !trip->transitionToCancelled())
-        return false;
+    if (!trip)
+        return removeBooking(tripId);   // A booking not planned yet has no trip
     
-    Driver *driver = getDriver(trip->getDriverId());
-    if (driver && driver->getAssignedTripId() == tripId)
+    Driver *freed = nullptr;
     {
-        // Record snapshot BEFORE cancellation - capture current state
-        const char *currentDriverLocation = driver->getCurrentNodeId();
-        rollbackManager->recordSnapshot(1, tripId, trip->getDriverId(), 
-                          trip->getState(), driver->isAvailable(), currentDriverLocation);
+        std::lock_guard<std::mutex> guard(trip->getLock());
+        if (!transitionTrip(trip, CANCELLED))
+            return false;
+        trip->setFinishedAtMs(scheduler->getSimTimeMs());
+        
+        abandonRouting(tripId);
+        {
+            std::lock_guard<std::mutex> waitingGuard(waitingLock);
+            waiting->remove(tripId);
+        }
+        removeBooking(tripId);
         
-        // Record driver availability change snapshot (becoming available after cancellation)
-        rollbackManager->recordSnapshot(4, tripId, driver->getDriverId(), trip->getState(), 
-                           false, currentDriverLocation, -1, nullptr, true);
+        Driver *driver = getDriver(trip->getDriverId());
+        bool pooled = false;
+        int nextPooledTrip = -1;
+        if (driver)
+        {
+            std::lock_guard<std::mutex> poolGuard(poolLock);
+            pooled = pool->removeTrip(driver->getDriverId(), tripId);
+            if (pooled && pool->hasStops(driver->getDriverId()))
+                nextPooledTrip = pool->getRoute(driver->getDriverId())->stops[0].tripId;
+        }
+        if (nextPooledTrip >= 0)
+        {
+            // Other riders keep the pooled vehicle busy
+            rollbackManager->recordSnapshot(1, tripId, trip->getDriverId(), 
+                              trip->getState(), driver->isAvailable(), driver->getCurrentNodeId());
+            if (driver->getAssignedTripId() == tripId)
+                driver->setAssignedTripId(nextPooledTrip);
+        }
+        else if (driver && (pooled || driver->getAssignedTripId() == tripId))
+        {
+            // Record snapshot BEFORE cancellation - capture current state
+            const char *currentDriverLocation = driver->getCurrentNodeId();
+            rollbackManager->recordSnapshot(1, tripId, trip->getDriverId(), 
+                              trip->getState(), driver->isAvailable(), currentDriverLocation);
+            
+            // Record driver availability change snapshot (becoming available after cancellation)
+            rollbackManager->recordSnapshot(4, tripId, driver->getDriverId(), trip->getState(), 
+                               false, currentDriverLocation, -1, nullptr, true);
+            
+            // A solo driver is freed only if it is still on this trip
+            if (pooled)
+                driver->release();
+            else
+                driver->releaseTrip(tripId);
+            freed = driver;
+        }
         
-        driver->setAvailable(true);
-        driver->setAssignedTripId(-1);
+        removeActiveTrip(tripId);
+        dropCandidateStream(tripId);
     }
-    
-    removeActiveTrip(tripId);
+    retireTrip(tripId);
+    serveWaitingRequests(freed);
     return true;
 }
 
 int DispatchEngine::getTripCount() const
 {
+    std::lock_guard<std::mutex> guard(tripTableLock);
+    return tripsCreated;
+}
+
+int DispatchEngine::getStoredTripCount() const
+{
+    std::lock_guard<std::mutex> guard(tripTableLock);
     return tripCount;
 }
 
 Trip *DispatchEngine::getTrip(int tripId) const
 {
-    for (int i = 0; i < tripCount; i++)
+    std::lock_guard<std::mutex> guard(tripTableLock);
+    int slot;
+    return tripSlots.find(tripId, slot) ? trips[slot] : nullptr;
+}
+
+bool DispatchEngine::findTripRecord(int tripId, TripRecord &record) const
+{
+    Trip *trip = getTrip(tripId);
+    if (!trip)
+    {
+        std::lock_guard<std::mutex> guard(tripTableLock);
+        return archive->find(tripId, record);
+    }
+    std::lock_guard<std::mutex> guard(trip->getLock());
+    makeTripRecord(trip, record);
+    return true;
+}
+
+void DispatchEngine::makeTripRecord(const Trip *trip, TripRecord &record) const
+{
+    record.tripId = trip->getTripId();
+    record.riderId = trip->getRiderId();
+    record.driverId = trip->getDriverId();
+    record.state = trip->getState();
+    record.pickupIndex = city->getNodeIndex(trip->getPickupNodeId());
+    record.dropoffIndex = city->getNodeIndex(trip->getDropoffNodeId());
+    record.fare = trip->calculateTotalFare();
+    record.rideDistance = trip->getRideDistance();
+    record.totalDistance = trip->getTotalDistance();
+    record.requestedAtMs = trip->getRequestedAtMs();
+    record.finishedAtMs = trip->getFinishedAtMs();
+}
+
+bool DispatchEngine::setTripArchiveFile(const char *path)
+{
+    std::lock_guard<std::mutex> guard(tripTableLock);
+    return path && archive->openFile(path);
+}
+
+int DispatchEngine::getArchivedTripCount() const
+{
+    std::lock_guard<std::mutex> guard(tripTableLock);
+    return archive->size();
+}
+
+void DispatchEngine::setTerminalTripRetention(int count)
+{
+    std::lock_guard<std::mutex> guard(tripTableLock);
+    terminalRetention = count >= 0 ? count : 0;
+    trimRetiredTrips();
+}
+
+int DispatchEngine::getTerminalTripRetention() const
+{
+    std::lock_guard<std::mutex> guard(tripTableLock);
+    return terminalRetention;
+}
+
+// Recycle the oldest terminal trips beyond the retention limit; called with
+// tripTableLock held
+void DispatchEngine::trimRetiredTrips()
+{
+    while (retiredCount > terminalRetention)
+    {
+        int oldest = retiredTrips[retiredHead];
+        retiredHead = (retiredHead + 1) % retiredCapacity;
+        retiredCount--;
+        recycleTrip(oldest);
+    }
+}
+
+// Queue a trip that just reached COMPLETED/CANCELLED (its finish time already
+// set under its lock); recycle the oldest terminal trips beyond the limit
+void DispatchEngine::retireTrip(int tripId)
+{
+    std::lock_guard<std::mutex> guard(tripTableLock);
+    if (retiredCount == retiredCapacity)
     {
-        if (trips[i] && trips[i]->getTripId() == tripId)
-            return trips[i];
+        int newCapacity = retiredCapacity > 0 ? retiredCapacity * 2 : 64;
+        int *grown = new int[newCapacity];
+        for (int i = 0; i < retiredCount; i++)
+            grown[i] = retiredTrips[(retiredHead + i) % retiredCapacity];
+        delete[] retiredTrips;
+        retiredTrips = grown;
+        retiredHead = 0;
+        retiredCapacity = newCapacity;
     }
-    return nullptr;
+    retiredTrips[(retiredHead + retiredCount) % retiredCapacity] = tripId;
+    retiredCount++;
+
+    trimRetiredTrips();
+}
+
+// Archive a terminal trip and return its storage to the pool. Trips revived
+// by a rollback since they were retired are left alone. Called with
+// tripTableLock held.
+bool DispatchEngine::recycleTrip(int tripId)
+{
+    int slot;
+    if (!tripSlots.find(tripId, slot))
+        return false;
+    TripState state = trips[slot]->getState();
+    if (state != COMPLETED && state != CANCELLED)
+        return false;
+
+    TripRecord record;
+    makeTripRecord(trips[slot], record);
+    archive->append(record);
+    tripPool.destroy(trips[slot]);
+    tripSlots.erase(tripId);
+    trips[slot] = trips[tripCount - 1];
+    trips[tripCount - 1] = nullptr;
+    tripCount--;
+    if (slot < tripCount)
+        tripSlots.insert(trips[slot]->getTripId(), slot);
+    return true;
 }
 
+// Insert or update; a reassigned trip keeps its slot with the new driver
 void DispatchEngine::addActiveTrip(Trip *trip, Driver *driver)
 {
-    ActiveTrip *newTrip = new ActiveTrip(trip, driver);
-    newTrip->next = activeTripsHead;
-    activeTripsHead = newTrip;
+    std::lock_guard<std::mutex> guard(activeLock);
+    int slot;
+    if (activeSlots.find(trip->getTripId(), slot))
+    {
+        activeTrips[slot].driver = driver;
+        return;
+    }
+    if (activeCount == activeCapacity)
+    {
+        int newCapacity = activeCapacity > 0 ? activeCapacity * 2 : 32;
+        ActiveTrip *grown = new ActiveTrip[newCapacity];
+        for (int i = 0; i < activeCount; i++)
+            grown[i] = activeTrips[i];
+        delete[] activeTrips;
+        activeTrips = grown;
+        activeCapacity = newCapacity;
+    }
+    activeTrips[activeCount].trip = trip;
+    activeTrips[activeCount].driver = driver;
+    activeSlots.insert(trip->getTripId(), activeCount);
+    activeCount++;
 }
 
+// Swap the last entry into the freed slot
 void DispatchEngine::removeActiveTrip(int tripId)
 {
-    ActiveTrip *current = activeTripsHead;
-    ActiveTrip *prev = nullptr;
-    
-    while (current != nullptr)
+    std::lock_guard<std::mutex> guard(activeLock);
+    int slot;
+    if (!activeSlots.find(tripId, slot))
+        return;
+    activeSlots.erase(tripId);
+    activeCount--;
+    if (slot < activeCount)
     {
-        if (current->trip && current->trip->getTripId() == tripId)
-        {
-            if (prev)
-                prev->next = current->next;
-            else
-                activeTripsHead = current->next;
-            delete current;
-            return;
-        }
-        prev = current;
-        current = current->next;
+        activeTrips[slot] = activeTrips[activeCount];
+        activeSlots.insert(activeTrips[slot].trip->getTripId(), slot);
     }
 }
 
 ActiveTrip *DispatchEngine::findActiveTrip(int tripId)
 {
-    ActiveTrip *current = activeTripsHead;
-    while (current != nullptr)
+    std::lock_guard<std::mutex> guard(activeLock);
+    int slot;
+    return activeSlots.find(tripId, slot) ? &activeTrips[slot] : nullptr;
+}
+
+// Membership follows the trip's state: in the set while ASSIGNED .. ONGOING
+void DispatchEngine::syncActiveTrip(Trip *trip)
+{
+    TripState state = trip->getState();
+    Driver *driver = getDriver(trip->getDriverId());
+    if (driver && (state == ASSIGNED || state == PICKUP_IN_PROGRESS || state == ONGOING))
+        addActiveTrip(trip, driver);
+    else
+        removeActiveTrip(trip->getTripId());
+}
+
+// Every lifecycle transition of an engine trip goes through here so the
+// per-state counters stay current. The caller holds the trip's lock, so the
+// state read before the transition is its source.
+bool DispatchEngine::transitionTrip(Trip *trip, TripState to, int driverId)
+{
+    TripState from = trip->getState();
+    bool moved = false;
+    switch (to)
     {
-        if (current->trip && current->trip->getTripId() == tripId)
-            return current;
-        current = current->next;
+    case ASSIGNED:
+        moved = trip->transitionToAssigned(driverId);
+        break;
+    case PICKUP_IN_PROGRESS:
+        moved = trip->transitionToPickupInProgress();
+        break;
+    case ONGOING:
+        moved = trip->transitionToOngoing();
+        break;
+    case COMPLETED:
+        moved = trip->transitionToCompleted();
+        break;
+    case CANCELLED:
+        moved = trip->transitionToCancelled();
+        break;
+    default:
+        break;
+    }
+    if (!moved)
+        return false;
+    stateCounts[from]--;
+    stateCounts[to]++;
+    
+    if (events->hasSubscribers())
+    {
+        if (to == ASSIGNED)
+            publishEvent(TRIP_EVENT_ASSIGNED, trip);
+        else if (to == COMPLETED)
+            publishEvent(TRIP_EVENT_COMPLETED, trip);
+        else if (to == CANCELLED)
+            publishEvent(TRIP_EVENT_CANCELLED, trip);
+        else
+            publishEvent(TRIP_EVENT_MOVED, trip, trip->getDriverCurrentNodeId());
     }
-    return nullptr;
+    return true;
+}
+
+void DispatchEngine::setTripState(Trip *trip, TripState state)
+{
+    stateCounts[trip->getState()]--;
+    stateCounts[state]++;
+    trip->setState(state);
+    syncActiveTrip(trip);
+}
+
+void DispatchEngine::restoreTripState(Trip *trip, TripState state)
+{
+    std::lock_guard<std::mutex> guard(trip->getLock());
+    setTripState(trip, state);
+    publishEvent(TRIP_EVENT_ROLLED_BACK, trip);
+}
+
+// An engine nobody subscribes to pays one branch per event
+void DispatchEngine::publishEvent(TripEventType type, const Trip *trip, const char *driverNodeId)
+{
+    if (!events->hasSubscribers())
+        return;
+    std::lock_guard<std::mutex> guard(eventLock);
+    TripEvent event;
+    event.sequence = 0;
+    event.simTimeMs = scheduler->getSimTimeMs();
+    event.type = type;
+    event.state = trip->getState();
+    event.tripId = trip->getTripId();
+    event.driverId = trip->getDriverId();
+    event.nodeIndex = driverNodeId ? city->getNodeIndex(driverNodeId) : -1;
+    events->publish(event);
+}
+
+TripEventBus *DispatchEngine::getEventBus() const
+{
+    return events;
 }
 
-ActiveTrip *DispatchEngine::getActiveTripsHead() const
+const ActiveTrip *DispatchEngine::getActiveTrip(int index) const
 {
-    return activeTripsHead;
+    std::lock_guard<std::mutex> guard(activeLock);
+    return (index >= 0 && index < activeCount) ? &activeTrips[index] : nullptr;
 }
 
 int DispatchEngine::getActiveTripsCount() const
 {
-    int count = 0;
-    ActiveTrip *current = activeTripsHead;
-    while (current != nullptr)
-    {
-        count++;
-        current = current->next;
-    }
-    return count;
+    std::lock_guard<std::mutex> guard(activeLock);
+    return activeCount;
+}
+
+int DispatchEngine::getTripCountInState(TripState state) const
+{
+    return (state >= 0 && state < TRIP_STATE_COUNT) ? stateCounts[state].load() : 0;
 }
 
 void DispatchEngine::displayDrivers() const
 {
-    std::cout << "\n=== DRIVERS (" << driverCount << ") ===" << std::endl;
-    for (int i = 0; i < driverCount; i++)
-    {
-        if (drivers[i])
-            drivers[i]->display();
-    }
+    std::cout << "\n=== DRIVERS (" << fleet->size() << ") ===" << std::endl;
+    for (int i = 0; i < fleet->size(); i++)
+        fleet->at(i)->display();
 }
 
 void DispatchEngine::displayTrips() const
@@ -387,13 +1884,8 @@ void DispatchEngine::displayTrips() const
 void DispatchEngine::displayActiveTrips() const
 {
     std::cout << "\n=== ACTIVE TRIPS (" << getActiveTripsCount() << ") ===" << std::endl;
-    ActiveTrip *current = activeTripsHead;
-    while (current != nullptr)
-    {
-        if (current->trip)
-            current->trip->display();
-        current = current->next;
-    }
+    for (int i = 0; i < activeCount; i++)
+        activeTrips[i].trip->display();
 }
 
 // ============= NEW HELPER METHODS =============
@@ -406,8 +1898,7 @@ bool DispatchEngine::validateDriverNode(const char *nodeId) const
         return false;
     
     // Driver can only be on route nodes: street or highway
-    return (strcmp(node->locationType, "street") == 0 || 
-            strcmp(node->locationType, "highway") == 0);
+    return node->isRoute();
 }
 
 // Finds nearest route node to given coordinates
@@ -420,8 +1911,7 @@ const char *DispatchEngine::findNearestRouteNode(double x, double y) const
     while (current != nullptr)
     {
         // Only consider route nodes
-        if (strcmp(current->locationType, "street") == 0 || 
-            strcmp(current->locationType, "highway") == 0)
+        if (current->isRoute())
         {
             double dx = current->x - x;
             double dy = current->y - y;
@@ -447,8 +1937,7 @@ const char *DispatchEngine::resolveRiderPickupNode(const char *riderNodeId)
         return riderNodeId;  // Return as-is if not found
     
     // If already a route node, use it directly
-    if (strcmp(node->locationType, "street") == 0 || 
-        strcmp(node->locationType, "highway") == 0)
+    if (node->isRoute())
     {
         return node->id;
     }
@@ -461,7 +1950,10 @@ const char *DispatchEngine::resolveRiderPickupNode(const char *riderNodeId)
 bool DispatchEngine::startPickupMovement(int tripId)
 {
     Trip *trip = getTrip(tripId);
-    if (!trip || !trip->transitionToPickupInProgress())
+    if (!trip)
+        return false;
+    std::lock_guard<std::mutex> guard(trip->getLock());
+    if (isRoutingPending(tripId) || !transitionTrip(trip, PICKUP_IN_PROGRESS))
         return false;
     
     Driver *driver = getDriver(trip->getDriverId());
@@ -483,6 +1975,7 @@ bool DispatchEngine::advanceTripMovement(int tripId)
     Trip *trip = getTrip(tripId);
     if (!trip)
         return false;
+    std::lock_guard<std::mutex> guard(trip->getLock());
     
     Driver *driver = getDriver(trip->getDriverId());
     if (!driver)
@@ -507,7 +2000,7 @@ bool DispatchEngine::advanceTripMovement(int tripId)
             driver->setCurrentNodeId(trip->getEffectivePickupNodeId());
             
             // Transition to ONGOING
-            trip->transitionToOngoing();
+            transitionTrip(trip, ONGOING);
             trip->setCurrentPathIndex(0);
             
             std::cout << "[MOVEMENT] Driver reached pickup for Trip #" << tripId << std::endl;
@@ -525,6 +2018,7 @@ bool DispatchEngine::advanceTripMovement(int tripId)
             trip->setCurrentPathIndex(currentIndex);
             trip->setDriverCurrentNodeId(path.path[currentIndex]);
             driver->setCurrentNodeId(path.path[currentIndex]);
+            publishEvent(TRIP_EVENT_MOVED, trip, path.path[currentIndex]);
             
             return true;
         }
@@ -552,6 +2046,7 @@ bool DispatchEngine::advanceTripMovement(int tripId)
             trip->setDriverCurrentNodeId(path.path[currentIndex]);
             trip->setRiderCurrentNodeId(path.path[currentIndex]);
             driver->setCurrentNodeId(path.path[currentIndex]);
+            publishEvent(TRIP_EVENT_MOVED, trip, path.path[currentIndex]);
             
             return true;
         }
@@ -560,6 +2055,80 @@ bool DispatchEngine::advanceTripMovement(int tripId)
     return false;
 }
 
+int DispatchEngine::quoteFares(const char *pickupNodeId, const int *dropoffIndices, int count,
+                               FareQuote *quotes, double maxDistance)
+{
+    if (!pickupNodeId || !dropoffIndices || !quotes || count <= 0)
+        return 0;
+    for (int i = 0; i < count; i++)
+    {
+        quotes[i].dropoffIndex = dropoffIndices[i];
+        quotes[i].rideDistance = -1.0;
+        quotes[i].fare = -1.0;
+        quotes[i].crossZone = false;
+        quotes[i].rideMs = -1;
+        quotes[i].dropoffEtaMs = -1;
+    }
+    std::shared_ptr<const GraphIndex> gi = city->getGraphIndex();
+    const char *pickup = resolveRiderPickupNode(pickupNodeId);
+    int pickupIndex = (gi && pickup) ? gi->findIndex(pickup) : -1;
+    if (pickupIndex < 0)
+        return 0;
+
+    double *distances = new double[count];
+    int reached = city->findDistancesToNodes(pickup, dropoffIndices, count, distances, maxDistance);
+
+    // Drive of the driver an immediate request would get
+    double metresPerMs = scheduler->getDriverSpeed() / 1000.0;
+    double pickupMs = -1.0;
+    Driver *driver = getDriver(findNearestAvailableDriver(pickupNodeId, true));
+    if (driver)
+    {
+        double drive = reach->getDistance(driver, pickupIndex);
+        if (drive < 0.0)
+            drive = city->findShortestPathAStar(driver->getCurrentNodeId(), pickup).totalDistance;
+        if (drive >= 0.0)
+            pickupMs = drive / metresPerMs;
+    }
+
+    double nowMs = (double)scheduler->getSimTimeMs();
+    int pickupZone = gi->nodeZone[pickupIndex];
+    for (int i = 0; i < count; i++)
+    {
+        if (distances[i] < 0.0)
+            continue;
+        FareQuote &quote = quotes[i];
+        quote.crossZone = gi->nodeZone[dropoffIndices[i]] != pickupZone;
+        quote.rideDistance = distances[i];
+        quote.fare = Trip::fareFor(distances[i], quote.crossZone);
+        quote.rideMs = (long long)std::ceil(distances[i] / metresPerMs);
+        if (pickupMs >= 0.0)
+            quote.dropoffEtaMs = (long long)std::ceil(nowMs + pickupMs + distances[i] / metresPerMs);
+    }
+    delete[] distances;
+    return reached;
+}
+
+TripScheduler *DispatchEngine::getScheduler() const
+{
+    return scheduler;
+}
+
+City *DispatchEngine::getCity() const
+{
+    return city;
+}
+
+Rebalancer *DispatchEngine::getRebalancer() const
+{
+    return rebalancer;
+}
+
+DriverReach *DispatchEngine::getDriverReach() const
+{
+    return reach;
+}
+
 // Get rollback manager
 RollbackManager *DispatchEngine::getRollbackManager() const
 {
@@ -3,34 +3,188 @@
 
 #include "city.h"
 #include "driver.h"
+#include "driverfleet.h"
 #include "rider.h"
 #include "trip.h"
 #include "rollbackmanager.h"
+#include "freedriverindex.h"
+#include "registry.h"
+#include "tripscheduler.h"
+#include "ridepool.h"
+#include "rebalancer.h"
+#include "routingworker.h"
+#include "driverreach.h"
+#include "requestqueue.h"
+#include "candidatestream.h"
+#include "tripevents.h"
+#include "triparchive.h"
+#include <chrono>
+#include <mutex>
+#include <atomic>
 
-// Structure to hold active trip information
+// A trip with a driver that has not yet finished (ASSIGNED .. ONGOING)
 struct ActiveTrip
 {
     Trip *trip;
     Driver *driver;
-    ActiveTrip *next;
-    
-    ActiveTrip(Trip *t, Driver *d) : trip(t), driver(d), next(nullptr) {}
 };
 
+// Outcome of an asynchronous assignment
+enum AssignmentStatus
+{
+    ASSIGNMENT_ROUTED,      // Both legs are on the trip
+    ASSIGNMENT_CANCELLED,   // Trip was cancelled, reassigned or rolled back while routing
+    ASSIGNMENT_EXPIRED      // No driver freed up before the deadline; the trip is cancelled
+};
+
+struct AssignmentResult
+{
+    int tripId;
+    int driverId;
+    AssignmentStatus status;
+    double pickupDistance;  // Driver -> pickup, -1 if unreachable or not routed
+    double rideDistance;    // Pickup -> drop-off, -1 if unreachable or not routed
+};
+
+// Called on the engine's thread from deliverRoutedAssignments(), and with
+// ASSIGNMENT_EXPIRED from the engine call that finds a waiting trip expired
+typedef void (*AssignmentCallback)(const AssignmentResult &result, void *context);
+
+// Called when reassignment offers a trip to a candidate, before the candidate
+// is reserved; the driver may already be gone by then
+typedef void (*CandidateOfferListener)(int tripId, int driverId, void *context);
+
+// Price and arrival estimate for one candidate drop-off, see quoteFares
+struct FareQuote
+{
+    int dropoffIndex;           // Graph node index, as passed in
+    double rideDistance;        // Resolved pickup -> drop-off by road, -1 if unreachable
+    double fare;                // What Trip::calculateTotalFare will charge, -1 if unreachable
+    bool crossZone;
+    long long rideMs;           // Drive time at the scheduler's speed, -1 if unreachable
+    long long dropoffEtaMs;     // Sim time of arrival if requested now, -1 if no driver is free
+};
+
+// Threading. Dispatch, movement and cancellation may run on different
+// threads at once: requestTrip, assignTrip(Async), assignNearestDriver(Async),
+// startPickupMovement, advanceTripMovement, startTrip, completeTrip,
+// cancelTrip, the waiting-queue and candidate-stream calls and the queries
+// (except getActiveTrip and the display calls). A trip's work runs under its
+// own lock (Trip::getLock), so work on different trips never waits on it;
+// drivers are reserved by compare-and-swap, the per-state counters are
+// atomic, and each shared table below has a short lock of its own, taken
+// after the trip's lock and never two at once. Everything else (drivers
+// joining or leaving, deliverRoutedAssignments, batches, bookings, pooling,
+// reassignment, rollback, the scheduler and rebalancer ticks, settings and
+// display) belongs to the owning thread and must not overlap those calls.
+// A Trip pointer stays valid until terminalRetention later trips have finished.
 class DispatchEngine
 {
 private:
     City *city;
-    Driver **drivers;       // Array of driver pointers
-    int driverCount;
-    int maxDrivers;
+    DriverFleet *fleet;     // Driver state in columns, handles by id and slot
     
-    Trip **trips;           // Array of trip pointers
-    int tripCount;
-    int maxTrips;
+    Trip **trips;           // Dense array of stored trip pointers (grows on demand)
+    int tripCount;          // Trips currently stored
+    int maxTrips;           // Current capacity of trips[]
+    int tripsCreated;       // Trips ever requested
+    IdMap tripSlots;        // trip id -> index in trips[]
+    SlabPool<Trip> tripPool;
+    mutable std::mutex tripTableLock;  // The trip table, the retired ring and the archive
     
-    ActiveTrip *activeTripsHead;  // Linked list of active trips
+    // Terminal trips in the order they finished; the oldest are recycled once
+    // more than terminalRetention are kept
+    int *retiredTrips;
+    int retiredHead;
+    int retiredCount;
+    int retiredCapacity;
+    int terminalRetention;
+    TripArchive *archive;   // Compact records of recycled trips
+    
+    ActiveTrip *activeTrips;      // Dense array of active trips, unordered
+    int activeCount;
+    int activeCapacity;
+    IdMap activeSlots;            // trip id -> index in activeTrips[]
+    mutable std::mutex activeLock;
+    std::atomic<int> stateCounts[TRIP_STATE_COUNT];  // Trips ever requested, by current (or last) state
     RollbackManager *rollbackManager;  // Integrated rollback system
+    FreeDriverIndex *freeDrivers;      // Available drivers by zone and position
+    TripScheduler *scheduler;          // Moves all scheduled trips on a shared clock
+    RidePool *pool;                    // Stop lists of vehicles carrying pooled trips
+    std::mutex poolLock;
+    Rebalancer *rebalancer;            // Moves idle drivers towards demand
+    DriverReach *reach;                // Road-distance trees around ranked drivers
+    
+    // Asynchronous assignment: reserved trips whose legs are being routed
+    struct PendingRoute
+    {
+        RouteJob *job;
+        AssignmentCallback callback;
+        void *context;
+    };
+    RoutingWorker *router;             // Started on the first async assignment
+    PendingRoute *pendingRoutes;
+    int pendingRouteCount;
+    int pendingRouteCapacity;
+    mutable std::mutex routeLock;      // pendingRoutes[] and starting the router
+    
+    // Batched matching: trips queued over a window, then matched together
+    int *batchTrips;
+    int batchCount;
+    int batchCapacity;
+    double batchWindowSeconds;
+    int batchCandidates;               // Nearest free drivers considered per request
+    std::chrono::steady_clock::time_point batchOpenedAt;
+    
+    // Ranked driver candidates of requests that have used them; dropped
+    // when the trip finishes
+    struct TripCandidates
+    {
+        int tripId;
+        CandidateStream *stream;
+    };
+    TripCandidates *streams;
+    int streamCount;
+    int streamCapacity;
+    IdMap streamSlots;                 // trip id -> index in streams[]
+    mutable std::mutex candidateLock;  // The stream table and the streams themselves
+    CandidateOfferListener offerListener;
+    void *offerContext;
+    
+    // Pre-booked rides. A held booking is only this record and a timer in
+    // the scheduler's wheel; its trip is created when it is planned.
+    enum BookingStage
+    {
+        BOOKING_HELD,        // Waiting for its planning time
+        BOOKING_PLANNED,     // Trip requested, driver chosen, dispatch timer armed
+        BOOKING_WAITING      // Dispatched with no free driver; queued for one until the expiry timer
+    };
+    struct Booking
+    {
+        int tripId;
+        int riderId;
+        int pickupIndex;            // Graph indices
+        int dropoffIndex;
+        long long pickupAtMs;       // Requested pickup time (simulated clock)
+        long long dispatchAtMs;     // -1 until planned
+        int plannedDriverId;        // -1 when no driver was found
+        BookingStage stage;
+    };
+    Booking *bookings;
+    int bookingCount;
+    int bookingCapacity;
+    IdMap bookingSlots;                // trip id -> index in bookings[]
+    IdMap plannedDrivers;              // driver id -> trip id of the booking it is planned for
+    mutable std::mutex bookingLock;
+    long long bookingLeadMs;
+    
+    // Trips waiting for a driver to become free, most urgent first
+    RequestQueue *waiting;
+    mutable std::mutex waitingLock;
+    
+    // Lifecycle events for asynchronous consumers (UI, analytics, journal)
+    TripEventBus *events;
+    std::mutex eventLock;              // Publishers take turns; each ring has one producer
     
     // Helper methods
     int findNearestAvailableDriver(const char *pickupNodeId, bool sameZone);
@@ -39,6 +193,30 @@ private:
     void addActiveTrip(Trip *trip, Driver *driver);
     void removeActiveTrip(int tripId);
     ActiveTrip *findActiveTrip(int tripId);
+    void syncActiveTrip(Trip *trip);
+    // Both called with the trip's lock held
+    bool transitionTrip(Trip *trip, TripState to, int driverId = -1);
+    void setTripState(Trip *trip, TripState state);
+    void makeTripRecord(const Trip *trip, TripRecord &record) const;
+    void publishEvent(TripEventType type, const Trip *trip, const char *driverNodeId = nullptr);
+    void retireTrip(int tripId);
+    void trimRetiredTrips();
+    bool recycleTrip(int tripId);
+    bool commitAssignment(Trip *trip, Driver *driver, const char *pickupNodeId,
+                          const PathResult &driverPath, const PathResult &riderPath,
+                          const PendingRoute *route);
+    void abandonRouting(int tripId);
+    void serveWaitingRequests(Driver *driver);
+    Booking *findBooking(int tripId);
+    bool removeBooking(int tripId);
+    void planBooking(int tripId);
+    void dispatchBooking(int tripId);
+    void expireBooking(int tripId);
+    void startBookedTrip(int tripId);
+    int nearestCandidateFor(Trip *trip);
+    CandidateStream *findOrOpenStream(Trip *trip);
+    void dropCandidateStream(int tripId);
+    void expireWaitingRequest(Trip *trip, const WaitingRequest &request);
     
     // NEW: Location and validation helpers
     const char *resolveRiderPickupNode(const char *riderNodeId);
@@ -46,13 +224,19 @@ private:
     const char *findNearestRouteNode(double x, double y) const;
 
 public:
-    DispatchEngine(City *c, int maxD = 50, int maxT = 100);
+    DispatchEngine(City *c, int maxD = 50, int maxT = 100);  // Initial capacities
     ~DispatchEngine();
 
     // Driver management
-    bool addDriver(int driverId, const char *nodeId, const char *zone);
+    // recordRollback = false for drivers handed over from another engine
+    bool addDriver(int driverId, const char *nodeId, const char *zone, bool recordRollback = true);
     bool removeDriver(int driverId);
     Driver *getDriver(int driverId) const;
+    Driver *getDriverByIndex(int index) const;  // 0..getDriverCount()-1; order changes on removal
+    int getAvailableDriverCount(const char *zone = nullptr) const;
+    int getDriverCount() const;
+    // Column view of the fleet for scans over every driver
+    const DriverFleet *getFleet() const;
 
     // Trip management
     bool requestTrip(int tripId, int riderId, const char *pickupNodeId, 
@@ -62,17 +246,139 @@ public:
     bool startTrip(int tripId);
     bool completeTrip(int tripId);
     bool cancelTrip(int tripId);
+    
+    // Asynchronous assignment. The driver is reserved and the trip becomes
+    // ASSIGNED before the call returns; both legs are routed on a worker
+    // thread. deliverRoutedAssignments() (called from the owner's event loop)
+    // stores the paths and runs the callback. Cancelling, reassigning or
+    // rolling back the trip meanwhile discards the routes and reports
+    // ASSIGNMENT_CANCELLED. Pickup movement cannot start until routing is done.
+    bool assignTripAsync(int tripId, int driverId, AssignmentCallback callback, void *context);
+    int assignNearestDriverAsync(int tripId, AssignmentCallback callback, void *context);
+    int deliverRoutedAssignments(int waitMs = 0);   // Returns callbacks run
+    bool isRoutingPending(int tripId) const;
+    int getPendingRouteCount() const;
+    void detachAssignmentCallbacks(void *context);  // Owner of context is going away
+
+    // Batched dispatch. Queued trips are matched to drivers all at once by
+    // minimising total road distance to pickup (Hungarian algorithm).
+    void setBatchWindow(double seconds);
+    double getBatchWindow() const;
+    void setBatchCandidates(int perRequest);
+    bool queueForBatch(int tripId);
+    int getBatchPendingCount() const;
+    bool isBatchDue() const;
+    int dispatchBatch();          // Match everything queued now; returns trips assigned
+    int dispatchBatchIfDue();     // dispatchBatch() once the window has elapsed
+
+    // Pre-booked rides on the scheduler's simulated clock. bookTrip only
+    // stores a compact record and arms a timer in the scheduler's timing wheel
+    // (O(1) insert and expiry), so tens of thousands of future bookings cost
+    // no trips and no searches. At pickup time minus the lead time the trip is
+    // requested and a driver is planned for it: the one with the shortest
+    // drive among those that can reach the pickup in time. Free drivers
+    // become free now, at their node; drivers on a scheduled trip become free
+    // at its drop-off ETA, at the drop-off. At pickup time minus that drive
+    // the trip is assigned to the planned driver and handed to the scheduler.
+    // If that driver is not free then (an immediate request may take a free
+    // planned driver), the nearest free driver goes instead, or the trip
+    // waits for one, for at most the lead time on the simulated clock.
+    // cancelTrip also cancels a booking not yet planned.
+    bool bookTrip(int tripId, int riderId, const char *pickupNodeId,
+                  const char *dropoffNodeId, long long pickupAtMs);
+    void setBookingLeadTime(long long millis);
+    long long getBookingLeadTime() const;
+    int getBookingCount() const;                   // Not yet dispatched
+    bool isBooked(int tripId) const;
+    int getPlannedDriver(int tripId) const;        // -1 until planned or when none fits
+    long long getBookingDispatchMs(int tripId) const;   // -1 until planned
+    void runBooking(int tripId);                   // Called by the scheduler when a booking timer fires
+
+    // Fares and ETAs for many candidate drop-offs (graph indices) from one
+    // pickup, for showing prices before a trip exists. One Dijkstra search
+    // from the resolved pickup, stopping once every drop-off is settled or
+    // maxDistance is passed, prices them all. The cross-zone surcharge
+    // compares the index's precomputed zone ids. The fare is what the trip
+    // would be charged; the ETA adds the drive of the driver
+    // assignNearestDriver would pick. Returns how many drop-offs are reachable.
+    int quoteFares(const char *pickupNodeId, const int *dropoffIndices, int count, FareQuote *quotes,
+                   double maxDistance = 1e18);
+
+    // Ranked candidates per request. Each request gets a lazy stream of free
+    // drivers, nearest first, in the same order as assignNearestDriver.
+    // Drivers excluded for the request (rejected by the rider) and drivers
+    // already offered are skipped, so asking for the next best never rescans
+    // the fleet. Once a trip has a stream, assignNearestDriver(Async) draws
+    // from it too. reassignToNextCandidate excludes the trip's current driver
+    // and moves an ASSIGNED trip to the next candidate. When no candidate is
+    // left, or every one offered is lost before it can be reserved, it
+    // returns -1 and the trip keeps its driver. The offer listener hears of
+    // each candidate as it is offered.
+    int nextCandidate(int tripId);                  // -1 when none is left
+    bool excludeCandidate(int tripId, int driverId);
+    int getExcludedCandidateCount(int tripId) const;
+    int reassignToNextCandidate(int tripId, AssignmentCallback callback = nullptr, void *context = nullptr);
+    void setOfferListener(CandidateOfferListener listener, void *context);
+
+    // Requests that found no free driver. A waiting trip stays REQUESTED
+    // until a driver is freed (a trip completed or cancelled, or a driver
+    // added); that driver is assigned at once to the most urgent waiting trip:
+    // higher priority first, then earlier deadline. Assignment goes through
+    // assignTripAsync, or assignTrip when there is no callback. A trip still
+    // waiting at its deadline is cancelled and reported as ASSIGNMENT_EXPIRED.
+    bool waitForDriver(int tripId, double maxWaitSeconds, int priority = 0,
+                       AssignmentCallback callback = nullptr, void *context = nullptr);
+    int expireWaitingRequests();  // Returns trips cancelled
+    bool isWaitingForDriver(int tripId) const;
+    int getWaitingRequestCount() const;
+
+    // Shared rides. assignPooled inserts the trip into the route (or an idle
+    // driver) that grows least while respecting seats and detour bounds;
+    // advancePooledStop moves a pooled vehicle to its next stop and picks up
+    // or drops off there. Both return a driver / trip id, or -1.
+    void setPoolingOptions(int seats, double maxDetourRatio, double maxPickupDistance);
+    int assignPooled(int tripId);
+    int advancePooledStop(int driverId);
+    const PoolRoute *getPoolRoute(int driverId) const;
+    RidePool *getRidePool() const;
+
+    // Terminal trip recycling: how many completed/cancelled trips stay as
+    // full Trip objects. Older ones are archived as TripRecords and freed.
+    void setTerminalTripRetention(int count);
+    int getTerminalTripRetention() const;
+    bool setTripArchiveFile(const char *path);   // Archive to disk from now on
+    int getArchivedTripCount() const;
 
     // Queries
-    int getTripCount() const;
-    Trip *getTrip(int tripId) const;
-    ActiveTrip *getActiveTripsHead() const;
+    int getTripCount() const;         // Trips ever requested
+    int getStoredTripCount() const;   // Trips still held (active + retained terminal)
+    Trip *getTrip(int tripId) const;  // Stored trips only; nullptr once archived
+    // Summary of any trip ever requested, stored or archived
+    bool findTripRecord(int tripId, TripRecord &record) const;
+    const ActiveTrip *getActiveTrip(int index) const;  // 0..getActiveTripsCount()-1; order changes on removal
     int getActiveTripsCount() const;
+    int getTripCountInState(TripState state) const;   // Recycled trips keep counting in their final state
+    
+    // Used by the rollback manager: set a trip's state, keeping counters and
+    // the active set consistent. Published as TRIP_EVENT_ROLLED_BACK.
+    void restoreTripState(Trip *trip, TripState state);
+    
+    // Trip lifecycle events. Subscribe from the engine's thread, then drain
+    // the subscription from any one consumer thread.
+    TripEventBus *getEventBus() const;
     
     // Movement simulation
     bool startPickupMovement(int tripId);
     bool advanceTripMovement(int tripId);  // Advances one step, returns true if more remain
     
+    // Central movement scheduler (replaces per-trip timers)
+    TripScheduler *getScheduler() const;
+    City *getCity() const;
+    
+    // Idle-driver repositioning (disabled until setEnabled(true))
+    Rebalancer *getRebalancer() const;
+    DriverReach *getDriverReach() const;
+    
     // Rollback access
     RollbackManager *getRollbackManager() const;
     
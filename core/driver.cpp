@@ -1,18 +1,43 @@
 #include "driver.h"
+#include "driverfleet.h"
+#include "freedriverindex.h"
 #include <iostream>
 #include <cstring>
 
 Driver::Driver(int id, const char *nodeId, const char *driverZone)
-    : driverId(id), available(true), assignedTripId(-1)
+    : driverId(id), reservation((1ULL << 32) | 0xFFFFFFFFULL), freeIndex(nullptr), indexZone(-1),
+      indexCell(-1), indexX(0.0), indexY(0.0), zonePrev(nullptr), zoneNext(nullptr),
+      cellPrev(nullptr), cellNext(nullptr), fleet(nullptr), fleetSlot(-1)
+{
+    ownedNodeId = new char[MAX_STRING_LENGTH];
+    ownedZone = new char[MAX_STRING_LENGTH];
+    strncpy(ownedNodeId, nodeId, MAX_STRING_LENGTH - 1);
+    ownedNodeId[MAX_STRING_LENGTH - 1] = '\0';
+    strncpy(ownedZone, driverZone, MAX_STRING_LENGTH - 1);
+    ownedZone[MAX_STRING_LENGTH - 1] = '\0';
+    currentNodeId = ownedNodeId;
+    zone = ownedZone;
+}
+
+Driver::Driver(int id, DriverFleet *owner, int slot, const char *nodeId, const char *driverZone)
+    : driverId(id), currentNodeId(nodeId), zone(driverZone), ownedNodeId(nullptr),
+      ownedZone(nullptr), reservation((1ULL << 32) | 0xFFFFFFFFULL), freeIndex(nullptr),
+      indexZone(-1), indexCell(-1), indexX(0.0), indexY(0.0), zonePrev(nullptr),
+      zoneNext(nullptr), cellPrev(nullptr), cellNext(nullptr), fleet(owner), fleetSlot(slot)
 {
-    strncpy(currentNodeId, nodeId, MAX_STRING_LENGTH - 1);
-    currentNodeId[MAX_STRING_LENGTH - 1] = '\0';
-    strncpy(zone, driverZone, MAX_STRING_LENGTH - 1);
-    zone[MAX_STRING_LENGTH - 1] = '\0';
 }
 
 Driver::~Driver()
 {
+    delete[] ownedNodeId;
+    delete[] ownedZone;
+}
+
+// Mirrors the reservation word into the fleet's columns
+void Driver::syncFleet()
+{
+    if (fleet)
+        fleet->refresh(this);
 }
 
 int Driver::getDriverId() const
@@ -32,39 +57,101 @@ const char *Driver::getZone() const
 
 bool Driver::isAvailable() const
 {
-    return available;
+    return (reservation.load() >> 32) != 0;
 }
 
 int Driver::getAssignedTripId() const
 {
-    return assignedTripId;
+    return (int)(unsigned int)(reservation.load() & 0xFFFFFFFFULL);
 }
 
 void Driver::setCurrentNodeId(const char *nodeId)
 {
-    strncpy(currentNodeId, nodeId, MAX_STRING_LENGTH - 1);
-    currentNodeId[MAX_STRING_LENGTH - 1] = '\0';
+    if (fleet)
+        fleet->place(this, nodeId);
+    else if (nodeId != ownedNodeId)
+    {
+        strncpy(ownedNodeId, nodeId, MAX_STRING_LENGTH - 1);
+        ownedNodeId[MAX_STRING_LENGTH - 1] = '\0';
+    }
+    if (freeIndex)
+        freeIndex->refresh(this);
 }
 
 void Driver::setZone(const char *driverZone)
 {
-    strncpy(zone, driverZone, MAX_STRING_LENGTH - 1);
-    zone[MAX_STRING_LENGTH - 1] = '\0';
+    if (fleet)
+        fleet->rezone(this, driverZone);
+    else if (driverZone != ownedZone)
+    {
+        strncpy(ownedZone, driverZone, MAX_STRING_LENGTH - 1);
+        ownedZone[MAX_STRING_LENGTH - 1] = '\0';
+    }
 }
 
 void Driver::setAvailable(bool avail)
 {
-    available = avail;
+    unsigned long long current = reservation.load();
+    while (!reservation.compare_exchange_weak(current, (current & 0xFFFFFFFFULL) | (avail ? 1ULL << 32 : 0ULL)))
+    {
+    }
+    syncFleet();
+    if (freeIndex)
+        freeIndex->refresh(this);
 }
 
 void Driver::setAssignedTripId(int tripId)
 {
-    assignedTripId = tripId;
+    unsigned long long current = reservation.load();
+    while (!reservation.compare_exchange_weak(current, (current & (1ULL << 32)) | (unsigned int)tripId))
+    {
+    }
+    syncFleet();
+}
+
+bool Driver::tryReserve(int tripId)
+{
+    unsigned long long current = reservation.load();
+    while (current >> 32)
+    {
+        if (reservation.compare_exchange_weak(current, (unsigned int)tripId))
+        {
+            syncFleet();
+            if (freeIndex)
+                freeIndex->refresh(this);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Driver::releaseTrip(int tripId)
+{
+    unsigned long long current = reservation.load();
+    while ((unsigned int)(current & 0xFFFFFFFFULL) == (unsigned int)tripId)
+    {
+        if (reservation.compare_exchange_weak(current, (1ULL << 32) | 0xFFFFFFFFULL))
+        {
+            syncFleet();
+            if (freeIndex)
+                freeIndex->refresh(this);
+            return true;
+        }
+    }
+    return false;
+}
+
+void Driver::release()
+{
+    reservation.store((1ULL << 32) | 0xFFFFFFFFULL);
+    syncFleet();
+    if (freeIndex)
+        freeIndex->refresh(this);
 }
 
 void Driver::display() const
 {
-    std::cout << "Driver #" << driverId << " | Node: " << currentNodeId
-              << " | Zone: " << zone << " | Available: " << (available ? "YES" : "NO")
-              << " | Trip: " << (assignedTripId == -1 ? "NONE" : std::to_string(assignedTripId)) << std::endl;
+    std::cout << "Driver #" << driverId << " | Node: " << currentNodeId.load()
+              << " | Zone: " << zone << " | Available: " << (isAvailable() ? "YES" : "NO")
+              << " | Trip: " << (getAssignedTripId() == -1 ? "NONE" : std::to_string(getAssignedTripId())) << std::endl;
 }
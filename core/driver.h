@@ -2,19 +2,50 @@
 #define DRIVER_H
 
 #include "city.h"
+#include <atomic>
 
+class FreeDriverIndex;
+class DriverFleet;
+
+// A driver's handle. Inside an engine the fleet holds the driver's state in
+// columns (see DriverFleet), the strings point at the city's node id and the
+// fleet's zone name, and every setter writes through to the columns. A
+// driver created on its own keeps the strings in buffers of its own.
 class Driver
 {
 private:
     int driverId;
-    char currentNodeId[MAX_STRING_LENGTH];
-    char zone[MAX_STRING_LENGTH];
-    bool available;
-    int assignedTripId; // -1 if no trip assigned
+    std::atomic<const char *> currentNodeId;   // Moved by whichever thread drives the trip
+    const char *zone;
+    char *ownedNodeId;           // Standalone drivers only
+    char *ownedZone;
+    // Availability (bit 32) and assigned trip id (bits 0-31, -1 if none) in
+    // one word, so reserving a driver for a trip is a single compare-and-swap
+    std::atomic<unsigned long long> reservation;
+
+    // Free-driver index membership (maintained by FreeDriverIndex)
+    FreeDriverIndex *freeIndex;
+    int indexZone;               // -1 if not listed
+    int indexCell;
+    double indexX, indexY;
+    Driver *zonePrev, *zoneNext;
+    Driver *cellPrev, *cellNext;
+    friend class FreeDriverIndex;
+
+    // Fleet membership (maintained by DriverFleet)
+    DriverFleet *fleet;
+    int fleetSlot;
+    friend class DriverFleet;
+
+    void syncFleet();
 
 public:
     Driver(int id, const char *nodeId, const char *driverZone);
+    // Fleet-owned handle; both strings are interned by the fleet
+    Driver(int id, DriverFleet *owner, int slot, const char *nodeId, const char *driverZone);
     ~Driver();
+    Driver(const Driver &) = delete;
+    Driver &operator=(const Driver &) = delete;
 
     // Getters
     int getDriverId() const;
@@ -29,6 +60,13 @@ public:
     void setAvailable(bool avail);
     void setAssignedTripId(int tripId);
 
+    // Atomic reservation. tryReserve takes an available driver for tripId and
+    // fails if another caller got there first; releaseTrip frees the driver
+    // only while it is still busy on tripId; release frees it unconditionally.
+    bool tryReserve(int tripId);
+    bool releaseTrip(int tripId);
+    void release();
+
     // Display
     void display() const;
 };
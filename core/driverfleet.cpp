@@ -0,0 +1,311 @@
+#include "driverfleet.h"
+#include <bitset>
+#include <cstring>
+
+DriverFleet::DriverFleet(City *c, int initialCapacity)
+    : city(c), count(0), capacity(initialCapacity > 0 ? initialCapacity : 64),
+      slots(capacity * 2), handlePool(64), zoneNames(nullptr), zoneCount(0), zoneCapacity(0),
+      strayNodeIds(nullptr), strayCount(0), strayCapacity(0)
+{
+    ids = new int[capacity];
+    nodeIndices = new int[capacity];
+    zoneIds = new int[capacity];
+    assignedTrips = new int[capacity];
+    int words = (capacity + 63) / 64;
+    availableBits = new unsigned long long[words];
+    for (int w = 0; w < words; w++)
+        availableBits[w] = 0;
+    handles = new Driver *[capacity];
+}
+
+DriverFleet::~DriverFleet()
+{
+    for (int s = 0; s < count; s++)
+        handlePool.destroy(handles[s]);
+    delete[] ids;
+    delete[] nodeIndices;
+    delete[] zoneIds;
+    delete[] assignedTrips;
+    delete[] availableBits;
+    delete[] handles;
+    for (int z = 0; z < zoneCount; z++)
+        delete[] zoneNames[z];
+    delete[] zoneNames;
+    for (int i = 0; i < strayCount; i++)
+        delete[] strayNodeIds[i];
+    delete[] strayNodeIds;
+}
+
+template <typename T>
+static void growColumn(T *&column, int used, int newCapacity)
+{
+    T *grown = new T[newCapacity];
+    for (int i = 0; i < used; i++)
+        grown[i] = column[i];
+    delete[] column;
+    column = grown;
+}
+
+void DriverFleet::grow()
+{
+    int newCapacity = capacity * 2;
+    growColumn(ids, count, newCapacity);
+    growColumn(nodeIndices, count, newCapacity);
+    growColumn(zoneIds, count, newCapacity);
+    growColumn(assignedTrips, count, newCapacity);
+    growColumn(handles, count, newCapacity);
+    int oldWords = (capacity + 63) / 64;
+    int newWords = (newCapacity + 63) / 64;
+    growColumn(availableBits, oldWords, newWords);
+    for (int w = oldWords; w < newWords; w++)
+        availableBits[w] = 0;
+    capacity = newCapacity;
+}
+
+// Fleets see a handful of zones, so a linear search is enough
+int DriverFleet::internZone(const char *zone)
+{
+    if (!zone)
+        zone = "";
+    for (int z = 0; z < zoneCount; z++)
+    {
+        if (strcmp(zoneNames[z], zone) == 0)
+            return z;
+    }
+    if (zoneCount == zoneCapacity)
+    {
+        zoneCapacity = zoneCapacity > 0 ? zoneCapacity * 2 : 8;
+        growColumn(zoneNames, zoneCount, zoneCapacity);
+    }
+    int length = (int)strnlen(zone, MAX_STRING_LENGTH - 1);
+    zoneNames[zoneCount] = new char[length + 1];
+    memcpy(zoneNames[zoneCount], zone, length);
+    zoneNames[zoneCount][length] = '\0';
+    return zoneCount++;
+}
+
+// A refrozen city numbers its nodes afresh; the handles' node ids are
+// stable, so the column is rebuilt from them the first time it is needed
+void DriverFleet::syncNodeIndices() const
+{
+    std::shared_ptr<const GraphIndex> gi = city ? city->getGraphIndex() : nullptr;
+    if (gi == indexedFor)
+        return;
+    for (int s = 0; s < count; s++)
+        nodeIndices[s] = gi ? gi->findIndex(handles[s]->currentNodeId) : -1;
+    indexedFor = gi;
+}
+
+// The city's own copy of the node id, so a handle needs no buffer. Ids the
+// city does not know are kept once each.
+const char *DriverFleet::internNode(const char *nodeId, int &nodeIndex)
+{
+    nodeIndex = -1;
+    if (!nodeId)
+        nodeId = "";
+    Node *node = nullptr;
+    std::shared_ptr<const GraphIndex> gi = city ? city->getGraphIndex() : nullptr;
+    if (gi)
+    {
+        nodeIndex = gi->findIndex(nodeId);
+        node = nodeIndex >= 0 ? gi->nodes[nodeIndex] : nullptr;
+    }
+    else if (city)
+        node = city->getNode(nodeId);
+    if (node)
+        return node->id;
+
+    for (int i = 0; i < strayCount; i++)
+    {
+        if (strcmp(strayNodeIds[i], nodeId) == 0)
+            return strayNodeIds[i];
+    }
+    if (strayCount == strayCapacity)
+    {
+        strayCapacity = strayCapacity > 0 ? strayCapacity * 2 : 8;
+        growColumn(strayNodeIds, strayCount, strayCapacity);
+    }
+    int length = (int)strnlen(nodeId, MAX_STRING_LENGTH - 1);
+    strayNodeIds[strayCount] = new char[length + 1];
+    memcpy(strayNodeIds[strayCount], nodeId, length);
+    strayNodeIds[strayCount][length] = '\0';
+    return strayNodeIds[strayCount++];
+}
+
+void DriverFleet::setAvailableBit(int slot, bool available)
+{
+    unsigned long long bit = 1ULL << (slot % 64);
+    if (available)
+        availableBits[slot / 64] |= bit;
+    else
+        availableBits[slot / 64] &= ~bit;
+}
+
+Driver *DriverFleet::add(int driverId, const char *nodeId, const char *zone)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    int existing;
+    if (slots.find(driverId, existing))
+        return nullptr;
+    if (count == capacity)
+        grow();
+
+    syncNodeIndices();
+    int slot = count;
+    int nodeIndex;
+    const char *node = internNode(nodeId, nodeIndex);
+    int zoneId = internZone(zone);
+    Driver *driver = handlePool.create(driverId, this, slot, node, zoneNames[zoneId]);
+    ids[slot] = driverId;
+    nodeIndices[slot] = nodeIndex;
+    zoneIds[slot] = zoneId;
+    assignedTrips[slot] = -1;
+    setAvailableBit(slot, true);
+    handles[slot] = driver;
+    slots.insert(driverId, slot);
+    count++;
+    return driver;
+}
+
+// The caller detaches the driver from the free-driver index first
+bool DriverFleet::remove(int driverId)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    int slot;
+    if (!slots.find(driverId, slot))
+        return false;
+    handlePool.destroy(handles[slot]);
+    slots.erase(driverId);
+
+    // Swap-remove keeps every column dense
+    int last = count - 1;
+    if (slot < last)
+    {
+        ids[slot] = ids[last];
+        nodeIndices[slot] = nodeIndices[last];
+        zoneIds[slot] = zoneIds[last];
+        assignedTrips[slot] = assignedTrips[last];
+        setAvailableBit(slot, (availableBits[last / 64] >> (last % 64)) & 1);
+        handles[slot] = handles[last];
+        handles[slot]->fleetSlot = slot;
+        slots.insert(ids[slot], slot);
+    }
+    setAvailableBit(last, false);
+    handles[last] = nullptr;
+    count--;
+    return true;
+}
+
+Driver *DriverFleet::find(int driverId) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    int slot;
+    return slots.find(driverId, slot) ? handles[slot] : nullptr;
+}
+
+Driver *DriverFleet::at(int slot) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return (slot >= 0 && slot < count) ? handles[slot] : nullptr;
+}
+
+int DriverFleet::size() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return count;
+}
+
+int DriverFleet::countAvailable() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    int words = (count + 63) / 64;
+    int available = 0;
+    for (int w = 0; w < words; w++)
+        available += (int)std::bitset<64>(availableBits[w]).count();
+    return available;
+}
+
+int DriverFleet::collectAvailable(int *driverIds, int *nodes, int maxCount) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    syncNodeIndices();
+    int words = (count + 63) / 64;
+    int found = 0;
+    for (int w = 0; w < words && found < maxCount; w++)
+    {
+        unsigned long long bits = availableBits[w];
+        for (int b = 0; bits != 0 && found < maxCount; b++, bits >>= 1)
+        {
+            if ((bits & 1) == 0)
+                continue;
+            int slot = w * 64 + b;
+            if (driverIds)
+                driverIds[found] = ids[slot];
+            if (nodes)
+                nodes[found] = nodeIndices[slot];
+            found++;
+        }
+    }
+    return found;
+}
+
+int DriverFleet::getZoneId(const char *zone) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (int z = 0; zone && z < zoneCount; z++)
+    {
+        if (strcmp(zoneNames[z], zone) == 0)
+            return z;
+    }
+    return -1;
+}
+
+// Branch-free over the zone and availability columns
+int DriverFleet::countAvailableInZone(int zoneId) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    int available = 0;
+    for (int s = 0; s < count; s++)
+        available += (int)((availableBits[s / 64] >> (s % 64)) & 1) & (zoneIds[s] == zoneId);
+    return available;
+}
+
+int DriverFleet::getNodeIndex(int driverId) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    syncNodeIndices();
+    int slot;
+    return slots.find(driverId, slot) ? nodeIndices[slot] : -1;
+}
+
+int DriverFleet::getZoneIdOf(int driverId) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    int slot;
+    return slots.find(driverId, slot) ? zoneIds[slot] : -1;
+}
+
+void DriverFleet::place(Driver *driver, const char *nodeId)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    syncNodeIndices();
+    int nodeIndex;
+    driver->currentNodeId = internNode(nodeId, nodeIndex);
+    nodeIndices[driver->fleetSlot] = nodeIndex;
+}
+
+void DriverFleet::rezone(Driver *driver, const char *zone)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    int zoneId = internZone(zone);
+    driver->zone = zoneNames[zoneId];
+    zoneIds[driver->fleetSlot] = zoneId;
+}
+
+void DriverFleet::refresh(Driver *driver)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    unsigned long long state = driver->reservation.load();
+    setAvailableBit(driver->fleetSlot, (state >> 32) != 0);
+    assignedTrips[driver->fleetSlot] = (int)(unsigned int)(state & 0xFFFFFFFFULL);
+}
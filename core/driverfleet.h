@@ -0,0 +1,83 @@
+#ifndef DRIVERFLEET_H
+#define DRIVERFLEET_H
+
+#include "city.h"
+#include "driver.h"
+#include "registry.h"
+#include <mutex>
+
+// The engine's drivers, stored column by column. Each driver has a dense
+// slot; its id, graph node index, zone id and assigned trip sit in parallel
+// int arrays, and availability is one bit per slot. A scan over the fleet
+// ("how many are free", "which free drivers stand in these colonies") reads
+// a few contiguous arrays instead of following a pointer to a ~600-byte
+// object per driver. Driver objects remain as small handles for callers:
+// their setters write through to the columns, and their node id and zone
+// strings point at the city's node ids and the fleet's zone names rather
+// than holding copies. Removal swaps the last slot into the freed one, so
+// slots change; driver ids and handles do not. Every call holds the fleet's
+// mutex, as drivers may be reserved and released from several threads.
+class DriverFleet
+{
+private:
+    City *city;
+    int count;
+    int capacity;
+
+    // Hot columns, indexed by slot
+    int *ids;
+    int *nodeIndices;             // Graph index of the current node, -1 if unknown
+    mutable std::shared_ptr<const GraphIndex> indexedFor;   // Index nodeIndices refer to
+    int *zoneIds;                 // Into zoneNames
+    int *assignedTrips;           // -1 when none
+    unsigned long long *availableBits;
+
+    Driver **handles;             // slot -> handle
+    IdMap slots;                  // driver id -> slot
+    SlabPool<Driver> handlePool;
+
+    // Interned strings, each allocated once so handles can point at them
+    char **zoneNames;
+    int zoneCount;
+    int zoneCapacity;
+    char **strayNodeIds;          // Node ids the city does not know
+    int strayCount;
+    int strayCapacity;
+
+    mutable std::mutex mutex;
+
+    void grow();
+    int internZone(const char *zone);
+    const char *internNode(const char *nodeId, int &nodeIndex);
+    void setAvailableBit(int slot, bool available);
+    void syncNodeIndices() const;
+
+public:
+    explicit DriverFleet(City *c, int initialCapacity = 64);
+    ~DriverFleet();
+    DriverFleet(const DriverFleet &) = delete;
+    DriverFleet &operator=(const DriverFleet &) = delete;
+
+    Driver *add(int driverId, const char *nodeId, const char *zone);   // nullptr if the id is taken
+    bool remove(int driverId);
+    Driver *find(int driverId) const;
+    Driver *at(int slot) const;       // 0..size()-1; order changes on removal
+    int size() const;
+
+    // Column scans
+    int countAvailable() const;
+    int collectAvailable(int *driverIds, int *nodeIndices, int maxCount) const;  // Slot order
+    int getZoneId(const char *zone) const;   // -1 if no driver was ever in it
+    int countAvailableInZone(int zoneId) const;
+
+    // Column reads for one driver; -1 when the id is unknown
+    int getNodeIndex(int driverId) const;
+    int getZoneIdOf(int driverId) const;
+
+    // Write-through from Driver's setters
+    void place(Driver *driver, const char *nodeId);
+    void rezone(Driver *driver, const char *zone);
+    void refresh(Driver *driver);     // Availability or assigned trip changed
+};
+
+#endif // DRIVERFLEET_H
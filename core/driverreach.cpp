@@ -0,0 +1,154 @@
+#include "driverreach.h"
+
+DriverReach::DriverReach(City *c, double radiusMeters, int labelCap)
+    : city(c), radius(radiusMeters > 0.0 ? radiusMeters : 1500.0),
+      maxLabels(labelCap > 0 ? labelCap : 512), trees(nullptr), treeCount(0), treeCapacity(0),
+      treeSlots(64), rebuilds(0), lookups(0)
+{
+    labelNodes = new int[maxLabels];
+    labelDist = new double[maxLabels];
+}
+
+DriverReach::~DriverReach()
+{
+    for (int t = 0; t < treeCount; t++)
+    {
+        delete[] trees[t]->keys;
+        delete[] trees[t]->dist;
+        delete trees[t];
+    }
+    delete[] trees;
+    delete[] labelNodes;
+    delete[] labelDist;
+}
+
+DriverReach::ReachTree *DriverReach::findOrCreate(int driverId)
+{
+    int slot;
+    if (treeSlots.find(driverId, slot))
+        return trees[slot];
+
+    if (treeCount == treeCapacity)
+    {
+        int newCapacity = treeCapacity > 0 ? treeCapacity * 2 : 32;
+        ReachTree **grown = new ReachTree *[newCapacity];
+        for (int t = 0; t < treeCount; t++)
+            grown[t] = trees[t];
+        delete[] trees;
+        trees = grown;
+        treeCapacity = newCapacity;
+    }
+    ReachTree *tree = new ReachTree();
+    tree->driverId = driverId;
+    tree->rootIndex = -1;
+    tree->version = -1;
+    tree->coveredRadius = 0.0;
+    tree->keys = nullptr;
+    tree->dist = nullptr;
+    tree->capacity = 0;
+    trees[treeCount] = tree;
+    treeSlots.insert(driverId, treeCount);
+    treeCount++;
+    return tree;
+}
+
+// One bounded Dijkstra from the root; labels go into a table at most half full
+void DriverReach::rebuild(ReachTree *tree, const char *rootNodeId, int rootIndex, long version)
+{
+    int count = city->findDistancesWithin(rootNodeId, radius, maxLabels, labelNodes, labelDist);
+
+    int capacity = 16;
+    while (capacity < count * 2)
+        capacity *= 2;
+    if (capacity != tree->capacity)
+    {
+        delete[] tree->keys;
+        delete[] tree->dist;
+        tree->keys = new int[capacity];
+        tree->dist = new double[capacity];
+        tree->capacity = capacity;
+    }
+    for (int s = 0; s < capacity; s++)
+        tree->keys[s] = -1;
+    for (int i = 0; i < count; i++)
+    {
+        int s = (int)((unsigned int)labelNodes[i] * 2654435761u) & (capacity - 1);
+        while (tree->keys[s] != -1)
+            s = (s + 1) & (capacity - 1);
+        tree->keys[s] = labelNodes[i];
+        tree->dist[s] = labelDist[i];
+    }
+
+    // A capped search only covers up to its last label
+    tree->coveredRadius = count == maxLabels ? labelDist[count - 1] : radius;
+    tree->rootIndex = rootIndex;
+    tree->version = version;
+    rebuilds++;
+}
+
+double DriverReach::getDistance(const Driver *driver, int nodeIndex)
+{
+    if (!driver || nodeIndex < 0)
+        return -1.0;
+    lookups++;
+
+    int rootIndex = city->getNodeIndex(driver->getCurrentNodeId());
+    if (rootIndex < 0)
+        return -1.0;
+    if (rootIndex == nodeIndex)
+        return 0.0;
+
+    ReachTree *tree = findOrCreate(driver->getDriverId());
+    long version = city->getGraphVersion();
+    if (tree->rootIndex != rootIndex || tree->version != version)
+        rebuild(tree, driver->getCurrentNodeId(), rootIndex, version);
+
+    int s = (int)((unsigned int)nodeIndex * 2654435761u) & (tree->capacity - 1);
+    while (tree->keys[s] != -1)
+    {
+        if (tree->keys[s] == nodeIndex)
+            return tree->dist[s];
+        s = (s + 1) & (tree->capacity - 1);
+    }
+    return -1.0;
+}
+
+double DriverReach::getCoveredRadius(const Driver *driver) const
+{
+    int slot;
+    if (!driver || !treeSlots.find(driver->getDriverId(), slot))
+        return 0.0;
+    return trees[slot]->coveredRadius;
+}
+
+void DriverReach::forget(int driverId)
+{
+    int slot;
+    if (!treeSlots.find(driverId, slot))
+        return;
+    treeSlots.erase(driverId);
+    delete[] trees[slot]->keys;
+    delete[] trees[slot]->dist;
+    delete trees[slot];
+    treeCount--;
+    if (slot < treeCount)
+    {
+        trees[slot] = trees[treeCount];
+        treeSlots.insert(trees[slot]->driverId, slot);
+    }
+}
+
+int DriverReach::getTreeCount() const
+{
+    return treeCount;
+}
+
+long DriverReach::getRebuildCount() const
+{
+    return rebuilds;
+}
+
+long DriverReach::getLookupCount() const
+{
+    return lookups;
+}
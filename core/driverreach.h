@@ -0,0 +1,67 @@
+#ifndef DRIVERREACH_H
+#define DRIVERREACH_H
+
+#include "city.h"
+#include "driver.h"
+#include "registry.h"
+
+// Bounded shortest-path trees around drivers, for ranking candidates by road
+// distance without a search per request. A driver's tree holds exact road
+// distances from its node to every node within the radius (up to a label
+// cap) in an open-addressing table, so a lookup is O(1). A tree is tied to
+// the root node and the city's graph version it was built for. Moving the
+// driver or changing a road makes it stale, and it is rebuilt on the next
+// lookup. A driver that moves several times between dispatches is searched
+// once, and one search serves every request that ranks it in the meantime.
+class DriverReach
+{
+private:
+    struct ReachTree
+    {
+        int driverId;
+        int rootIndex;
+        long version;
+        double coveredRadius;   // Every node closer than this has a label
+        int *keys;              // Node index per slot, -1 = empty
+        double *dist;
+        int capacity;           // Power of two
+    };
+
+    City *city;
+    double radius;
+    int maxLabels;
+    ReachTree **trees;
+    int treeCount;
+    int treeCapacity;
+    IdMap treeSlots;            // driver id -> index in trees[]
+
+    // Search output, reused across rebuilds
+    int *labelNodes;
+    double *labelDist;
+
+    long rebuilds;
+    long lookups;
+
+    ReachTree *findOrCreate(int driverId);
+    void rebuild(ReachTree *tree, const char *rootNodeId, int rootIndex, long version);
+
+public:
+    DriverReach(City *c, double radiusMeters = 1500.0, int labelCap = 512);
+    ~DriverReach();
+    DriverReach(const DriverReach &) = delete;
+    DriverReach &operator=(const DriverReach &) = delete;
+
+    // Road distance from the driver's current node to a node (graph index).
+    // -1 when the node lies outside the driver's tree; callers fall back to
+    // a search of their own.
+    double getDistance(const Driver *driver, int nodeIndex);
+    // After a -1 from getDistance: the node is at least this far by road
+    double getCoveredRadius(const Driver *driver) const;
+    void forget(int driverId);   // Driver removed from the fleet
+
+    int getTreeCount() const;
+    long getRebuildCount() const;
+    long getLookupCount() const;
+};
+
+#endif // DRIVERREACH_H
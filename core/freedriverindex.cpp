@@ -0,0 +1,361 @@
+#include "freedriverindex.h"
+#include "driver.h"
+#include <cstring>
+#include <cmath>
+
+// Zones with at most this many free drivers are scanned directly
+static const int SMALL_ZONE_SCAN = 32;
+
+FreeDriverIndex::FreeDriverIndex(City *c, double bucketSize)
+    : city(c), zoneNames(nullptr), zoneHeads(nullptr), zoneFreeCounts(nullptr), zoneCount(0),
+      zoneCapacity(0), gridMinX(0.0), gridMinY(0.0), cellSize(bucketSize > 0 ? bucketSize : 250.0),
+      gridCols(0), gridRows(0), cellHeads(nullptr), freeCount(0)
+{
+}
+
+FreeDriverIndex::~FreeDriverIndex()
+{
+    delete[] zoneNames;
+    delete[] zoneHeads;
+    delete[] zoneFreeCounts;
+    delete[] cellHeads;
+}
+
+// Return the id of a zone, registering it if it is new
+int FreeDriverIndex::registerZone(const char *zoneName)
+{
+    int existing = findZone(zoneName);
+    if (existing >= 0)
+        return existing;
+
+    if (zoneCount == zoneCapacity)
+    {
+        int newCapacity = zoneCapacity > 0 ? zoneCapacity * 2 : 8;
+        char (*names)[MAX_STRING_LENGTH] = new char[newCapacity][MAX_STRING_LENGTH];
+        Driver **heads = new Driver *[newCapacity];
+        int *counts = new int[newCapacity];
+        for (int z = 0; z < zoneCount; z++)
+        {
+            strcpy(names[z], zoneNames[z]);
+            heads[z] = zoneHeads[z];
+            counts[z] = zoneFreeCounts[z];
+        }
+        delete[] zoneNames;
+        delete[] zoneHeads;
+        delete[] zoneFreeCounts;
+        zoneNames = names;
+        zoneHeads = heads;
+        zoneFreeCounts = counts;
+        zoneCapacity = newCapacity;
+    }
+
+    strncpy(zoneNames[zoneCount], zoneName, MAX_STRING_LENGTH - 1);
+    zoneNames[zoneCount][MAX_STRING_LENGTH - 1] = '\0';
+    zoneHeads[zoneCount] = nullptr;
+    zoneFreeCounts[zoneCount] = 0;
+    return zoneCount++;
+}
+
+int FreeDriverIndex::getZoneId(const char *zoneName) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return findZone(zoneName);
+}
+
+int FreeDriverIndex::findZone(const char *zoneName) const
+{
+    if (!zoneName)
+        return -1;
+    for (int z = 0; z < zoneCount; z++)
+    {
+        if (strcmp(zoneNames[z], zoneName) == 0)
+            return z;
+    }
+    return -1;
+}
+
+bool FreeDriverIndex::containsPoint(double x, double y) const
+{
+    return cellHeads != nullptr && x >= gridMinX && y >= gridMinY &&
+           x < gridMinX + gridCols * cellSize && y < gridMinY + gridRows * cellSize;
+}
+
+int FreeDriverIndex::cellOf(double x, double y) const
+{
+    int cx = (int)floor((x - gridMinX) / cellSize);
+    int cy = (int)floor((y - gridMinY) / cellSize);
+    if (cx < 0) cx = 0;
+    if (cy < 0) cy = 0;
+    if (cx >= gridCols) cx = gridCols - 1;
+    if (cy >= gridRows) cy = gridRows - 1;
+    return cy * gridCols + cx;
+}
+
+// (Re)build the bucket grid over the given bounds and re-bucket every listed driver
+void FreeDriverIndex::buildGrid(double minX, double minY, double maxX, double maxY)
+{
+    gridMinX = minX;
+    gridMinY = minY;
+    gridCols = (int)((maxX - minX) / cellSize) + 1;
+    gridRows = (int)((maxY - minY) / cellSize) + 1;
+
+    delete[] cellHeads;
+    cellHeads = new Driver *[gridCols * gridRows];
+    for (int c = 0; c < gridCols * gridRows; c++)
+        cellHeads[c] = nullptr;
+
+    for (int z = 0; z < zoneCount; z++)
+    {
+        for (Driver *d = zoneHeads[z]; d != nullptr; d = d->zoneNext)
+        {
+            d->indexCell = cellOf(d->indexX, d->indexY);
+            d->cellPrev = nullptr;
+            d->cellNext = cellHeads[d->indexCell];
+            if (d->cellNext)
+                d->cellNext->cellPrev = d;
+            cellHeads[d->indexCell] = d;
+        }
+    }
+}
+
+void FreeDriverIndex::link(Driver *driver, int zoneId, int cell)
+{
+    driver->indexZone = zoneId;
+    driver->zonePrev = nullptr;
+    driver->zoneNext = zoneHeads[zoneId];
+    if (driver->zoneNext)
+        driver->zoneNext->zonePrev = driver;
+    zoneHeads[zoneId] = driver;
+    zoneFreeCounts[zoneId]++;
+
+    driver->indexCell = cell;
+    driver->cellPrev = nullptr;
+    driver->cellNext = cellHeads[cell];
+    if (driver->cellNext)
+        driver->cellNext->cellPrev = driver;
+    cellHeads[cell] = driver;
+
+    freeCount++;
+}
+
+void FreeDriverIndex::unlink(Driver *driver)
+{
+    if (driver->indexZone < 0)
+        return;
+
+    if (driver->zonePrev)
+        driver->zonePrev->zoneNext = driver->zoneNext;
+    else
+        zoneHeads[driver->indexZone] = driver->zoneNext;
+    if (driver->zoneNext)
+        driver->zoneNext->zonePrev = driver->zonePrev;
+    zoneFreeCounts[driver->indexZone]--;
+
+    if (driver->cellPrev)
+        driver->cellPrev->cellNext = driver->cellNext;
+    else
+        cellHeads[driver->indexCell] = driver->cellNext;
+    if (driver->cellNext)
+        driver->cellNext->cellPrev = driver->cellPrev;
+
+    driver->indexZone = -1;
+    driver->indexCell = -1;
+    driver->zonePrev = driver->zoneNext = nullptr;
+    driver->cellPrev = driver->cellNext = nullptr;
+    freeCount--;
+}
+
+void FreeDriverIndex::attach(Driver *driver)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    driver->freeIndex = this;
+    driver->indexZone = -1;
+    refreshLocked(driver);
+}
+
+void FreeDriverIndex::detach(Driver *driver)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (driver->freeIndex != this)
+        return;
+    unlink(driver);
+    driver->freeIndex = nullptr;
+}
+
+// Called whenever a tracked driver's availability or node changes. Reads the
+// driver's current availability under the lock, so the last of several
+// racing refreshes always leaves the index matching the driver.
+void FreeDriverIndex::refresh(Driver *driver)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    refreshLocked(driver);
+}
+
+void FreeDriverIndex::refreshLocked(Driver *driver)
+{
+    if (driver->freeIndex != this)
+        return;
+
+    // Drivers on unknown nodes cannot be measured, so they are never candidates
+    Node *node = driver->isAvailable() ? city->getNode(driver->currentNodeId) : nullptr;
+    if (!node)
+    {
+        unlink(driver);
+        return;
+    }
+
+    int zoneId = registerZone(node->zone[0] != '\0' ? node->zone : driver->zone);
+
+    if (!containsPoint(node->x, node->y))
+    {
+        // First driver, or one outside the current bounds: size the grid to the
+        // city (when frozen) plus every point seen so far, then re-bucket
+        double minX = node->x, minY = node->y, maxX = node->x, maxY = node->y;
+        std::shared_ptr<const GraphIndex> gi = city->getGraphIndex();
+        for (int i = 0; gi && i < gi->nodeCount; i++)
+        {
+            minX = fmin(minX, gi->x[i]);
+            minY = fmin(minY, gi->y[i]);
+            maxX = fmax(maxX, gi->x[i]);
+            maxY = fmax(maxY, gi->y[i]);
+        }
+        if (cellHeads)
+        {
+            minX = fmin(minX, gridMinX);
+            minY = fmin(minY, gridMinY);
+            maxX = fmax(maxX, gridMinX + gridCols * cellSize);
+            maxY = fmax(maxY, gridMinY + gridRows * cellSize);
+        }
+        buildGrid(minX, minY, maxX, maxY);
+    }
+
+    unlink(driver);
+    driver->indexX = node->x;
+    driver->indexY = node->y;
+    link(driver, zoneId, cellOf(node->x, node->y));
+}
+
+int FreeDriverIndex::getFreeCount() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return freeCount;
+}
+
+int FreeDriverIndex::getFreeCount(const char *zoneName) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    int zoneId = findZone(zoneName);
+    return zoneId >= 0 ? zoneFreeCounts[zoneId] : 0;
+}
+
+double FreeDriverIndex::distanceTo(const Driver *driver, double x, double y)
+{
+    double dx = driver->indexX - x;
+    double dy = driver->indexY - y;
+    return sqrt(dx * dx + dy * dy);
+}
+
+Driver *FreeDriverIndex::findNearest(double x, double y, const char *zoneName) const
+{
+    Driver *best = nullptr;
+    return findNearestK(x, y, zoneName, 1, &best, nullptr) > 0 ? best : nullptr;
+}
+
+int FreeDriverIndex::findNearestK(double x, double y, const char *zoneName, int k,
+                                  Driver *results[], double distances[]) const
+{
+    if (!results || k <= 0)
+        return 0;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    int zoneId = -1;
+    if (zoneName)
+    {
+        zoneId = findZone(zoneName);
+        if (zoneId < 0 || zoneFreeCounts[zoneId] == 0)
+            return 0;
+    }
+    if (freeCount == 0 || !cellHeads)
+        return 0;
+
+    // results[0..found) kept sorted by (distance, driver id)
+    double *bestDist = new double[k];
+    int found = 0;
+    auto consider = [&](Driver *d) {
+        double dist = distanceTo(d, x, y);
+        int pos = found;
+        while (pos > 0 && (dist < bestDist[pos - 1] ||
+                           (dist == bestDist[pos - 1] &&
+                            d->getDriverId() < results[pos - 1]->getDriverId())))
+            pos--;
+        if (pos >= k)
+            return;
+        int last = found < k ? found : k - 1;
+        for (int m = last; m > pos; m--)
+        {
+            results[m] = results[m - 1];
+            bestDist[m] = bestDist[m - 1];
+        }
+        results[pos] = d;
+        bestDist[pos] = dist;
+        if (found < k)
+            found++;
+    };
+
+    // A thinly populated zone is cheaper to walk than to search spatially
+    if (zoneId >= 0 && zoneFreeCounts[zoneId] <= SMALL_ZONE_SCAN)
+    {
+        for (Driver *d = zoneHeads[zoneId]; d != nullptr; d = d->zoneNext)
+            consider(d);
+    }
+    else
+    {
+        // Ring search outward from the query cell. After ring r every unvisited
+        // bucket lies outside the square of cells [c-r, c+r], so once the k-th
+        // best distance is within the query's distance to that square's border
+        // the answer cannot improve.
+        int cx = (int)floor((x - gridMinX) / cellSize);
+        int cy = (int)floor((y - gridMinY) / cellSize);
+
+        for (int r = 0;; r++)
+        {
+            for (int j = cy - r; j <= cy + r; j++)
+            {
+                if (j < 0 || j >= gridRows)
+                    continue;
+                bool edgeRow = (j == cy - r || j == cy + r);
+                int step = edgeRow ? 1 : 2 * r;
+                for (int i = cx - r; i <= cx + r; i += step)
+                {
+                    if (i < 0 || i >= gridCols)
+                        continue;
+                    for (Driver *d = cellHeads[j * gridCols + i]; d != nullptr; d = d->cellNext)
+                    {
+                        if (zoneId < 0 || d->indexZone == zoneId)
+                            consider(d);
+                    }
+                }
+            }
+
+            if (found == k)
+            {
+                double border = x - (gridMinX + (cx - r) * cellSize);
+                border = fmin(border, gridMinX + (cx + r + 1) * cellSize - x);
+                border = fmin(border, y - (gridMinY + (cy - r) * cellSize));
+                border = fmin(border, gridMinY + (cy + r + 1) * cellSize - y);
+                if (bestDist[k - 1] <= border)
+                    break;
+            }
+            if (cx - r <= 0 && cy - r <= 0 && cx + r >= gridCols - 1 && cy + r >= gridRows - 1)
+                break;  // Every bucket visited
+        }
+    }
+
+    if (distances)
+    {
+        for (int m = 0; m < found; m++)
+            distances[m] = bestDist[m];
+    }
+    delete[] bestDist;
+    return found;
+}
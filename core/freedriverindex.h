@@ -0,0 +1,69 @@
+#ifndef FREEDRIVERINDEX_H
+#define FREEDRIVERINDEX_H
+
+#include "city.h"
+#include <mutex>
+
+class Driver;
+
+// Index of available drivers, kept up to date by Driver::setAvailable and
+// Driver::setCurrentNodeId. Free drivers are linked into one list per zone
+// (the zone of the node they stand on) and into a uniform grid of buckets
+// over their coordinates, so a nearest-driver lookup only touches nearby
+// candidates instead of the whole fleet. Every public call holds the index's
+// own mutex, so drivers may be reserved and released from several threads.
+class FreeDriverIndex
+{
+private:
+    City *city;
+
+    // Zone registry: zone name -> id, with an intrusive list of free drivers per zone
+    char (*zoneNames)[MAX_STRING_LENGTH];
+    Driver **zoneHeads;
+    int *zoneFreeCounts;
+    int zoneCount;
+    int zoneCapacity;
+
+    // Spatial buckets (row-major cells of cellSize metres)
+    double gridMinX, gridMinY;
+    double cellSize;
+    int gridCols, gridRows;
+    Driver **cellHeads;
+
+    int freeCount;
+    mutable std::mutex mutex;
+
+    int registerZone(const char *zoneName);
+    int findZone(const char *zoneName) const;
+    void refreshLocked(Driver *driver);
+    int cellOf(double x, double y) const;
+    void buildGrid(double minX, double minY, double maxX, double maxY);
+    bool containsPoint(double x, double y) const;
+    void link(Driver *driver, int zoneId, int cell);
+    void unlink(Driver *driver);
+    static double distanceTo(const Driver *driver, double x, double y);
+
+public:
+    FreeDriverIndex(City *c, double bucketSize = 250.0);
+    ~FreeDriverIndex();
+
+    // Membership
+    void attach(Driver *driver);   // Start tracking a driver (listed if available)
+    void detach(Driver *driver);   // Stop tracking (driver removed from the fleet)
+    void refresh(Driver *driver);  // Re-evaluate after availability or position changed
+
+    // Queries
+    int getZoneId(const char *zoneName) const;
+    int getFreeCount() const;
+    int getFreeCount(const char *zoneName) const;
+
+    // Nearest free driver to (x, y) by straight-line distance.
+    // zoneName restricts the search to one zone (nullptr = any zone).
+    Driver *findNearest(double x, double y, const char *zoneName) const;
+
+    // Up to k nearest free drivers, closest first; distances may be nullptr
+    int findNearestK(double x, double y, const char *zoneName, int k,
+                     Driver *results[], double distances[]) const;
+};
+
+#endif // FREEDRIVERINDEX_H
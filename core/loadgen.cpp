@@ -0,0 +1,291 @@
+#include "city.h"
+#include "dispatchengine.h"
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
+
+// Headless load generator: places a fleet on route nodes, then feeds the
+// engine rider requests with Poisson arrivals between random locations. Every
+// served request is assigned to the nearest driver and handed to the
+// scheduler, which drives pickup, ride and completion on the simulated clock.
+// Simulated time runs as fast as the engine allows; the report gives request
+// throughput against wall time, assignment latency percentiles and memory.
+// Usage: loadgen [drivers] [requests] [requestsPerSecond] [gridSize]
+// A gridSize > 0 runs on a synthetic gridSize x gridSize city instead of the
+// city data files.
+
+std::string getDataFilePath(const std::string &filename)
+{
+    std::string paths[] = {
+        std::string("../city_locations_path_data/") + filename,
+        std::string("./city_locations_path_data/") + filename,
+        std::string("../../city_locations_path_data/") + filename
+    };
+
+    for (const auto &path : paths)
+    {
+        std::ifstream file(path);
+        if (file.good())
+            return path;
+    }
+    return paths[0];
+}
+
+static unsigned int nextRandom(unsigned int &state)
+{
+    state = state * 1103515245u + 12345u;
+    return (state >> 8) & 0xFFFFFF;
+}
+
+// Uniform in (0, 1]
+static double nextUniform(unsigned int &state)
+{
+    return (nextRandom(state) + 1.0) / 16777216.0;
+}
+
+struct NullBuffer : std::streambuf
+{
+    int overflow(int c) override { return c; }
+};
+
+// Street grid in four zones with one home beside every street node, written
+// in the city data format so it loads through the regular loaders
+static bool writeSyntheticCity(int grid, const char *locationsPath, const char *pathsPath)
+{
+    std::ofstream paths(pathsPath);
+    std::ofstream locations(locationsPath);
+    if (!paths.is_open() || !locations.is_open())
+        return false;
+
+    const int SPACING = 40;
+    paths << "Zone Name,Colony Name,Street No,Street Name,Node No,Node ID,X Coordinate (m),"
+             "Y Coordinate (m),Connection Type,Connected To Zone,Connected To Colony,"
+             "Connected To Street,Connected To Street No,Connected To Node No,Connected Node ID,"
+             "Connected Node X (m),Connected Node Y (m),Edge Weight (m)\n";
+    locations << "Zone Name,Colony Name,Street No,Street Name,Location Name,Location Type,"
+                 "Location Node No (on street),Location ID,X Coordinate (m),Y Coordinate (m),"
+                 "Connected To Zone,Connected To Colony,Connected To Street,Connected To Street No,"
+                 "Connected To Node No,Connected Street Node ID,Connected Node X (m),"
+                 "Connected Node Y (m),Edge Weight (m)\n";
+
+    char id[64];
+    char next[64];
+    for (int row = 0; row < grid; row++)
+    {
+        for (int col = 0; col < grid; col++)
+        {
+            int zone = 1 + (row * 2 / grid) * 2 + (col * 2 / grid);
+            snprintf(id, sizeof(id), "zone%d_grid_S%d_N%d", zone, row + 1, col + 1);
+            int x = col * SPACING;
+            int y = row * SPACING;
+            for (int dir = 0; dir < 2; dir++)
+            {
+                int nrow = row + dir;
+                int ncol = col + 1 - dir;
+                if (nrow >= grid || ncol >= grid)
+                    continue;
+                int nzone = 1 + (nrow * 2 / grid) * 2 + (ncol * 2 / grid);
+                snprintf(next, sizeof(next), "zone%d_grid_S%d_N%d", nzone, nrow + 1, ncol + 1);
+                paths << "zone" << zone << ",grid," << row + 1 << ",grid - Street " << row + 1 << ","
+                      << col + 1 << "," << id << "," << x << "," << y << ",Street Edge,zone" << nzone
+                      << ",grid,grid - Street " << nrow + 1 << "," << nrow + 1 << "," << ncol + 1 << ","
+                      << next << "," << ncol * SPACING << "," << nrow * SPACING << "," << SPACING << "\n";
+            }
+            locations << "\"zone" << zone << "\",\"grid\"," << row + 1 << ",\"grid - Street " << row + 1
+                      << "\",\"Home " << row * grid + col + 1 << "\",\"home\"," << col + 1
+                      << ",\"zone" << zone << "_grid_S" << row + 1 << "_Loc" << col + 1 << "\"," << x << ","
+                      << y + 20 << ",\"zone" << zone << "\",\"grid\",\"grid - Street " << row + 1 << "\","
+                      << row + 1 << "," << col + 1 << ",\"" << id << "\"," << x << "," << y << ",20\n";
+        }
+    }
+    return true;
+}
+
+// k-th smallest of values[0..count-1]; reorders the array
+static double selectKth(double *values, int count, int k)
+{
+    int lo = 0;
+    int hi = count - 1;
+    while (lo < hi)
+    {
+        double pivot = values[(lo + hi) / 2];
+        int i = lo;
+        int j = hi;
+        while (i <= j)
+        {
+            while (values[i] < pivot)
+                i++;
+            while (values[j] > pivot)
+                j--;
+            if (i <= j)
+            {
+                double t = values[i];
+                values[i] = values[j];
+                values[j] = t;
+                i++;
+                j--;
+            }
+        }
+        if (k <= j)
+            hi = j;
+        else if (k >= i)
+            lo = i;
+        else
+            break;
+    }
+    return values[k];
+}
+
+// Resident and peak resident set size in kB from /proc, or -1 where unavailable
+static void readMemory(long &residentKb, long &peakKb)
+{
+    residentKb = peakKb = -1;
+    std::ifstream status("/proc/self/status");
+    char line[256];
+    while (status.getline(line, sizeof(line)))
+    {
+        if (strncmp(line, "VmRSS:", 6) == 0)
+            residentKb = atol(line + 6);
+        else if (strncmp(line, "VmHWM:", 6) == 0)
+            peakKb = atol(line + 6);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int driverCount = (argc > 1) ? atoi(argv[1]) : 1000;
+    int requestCount = (argc > 2) ? atoi(argv[2]) : 5000;
+    double perSecond = (argc > 3) ? atof(argv[3]) : 1.0;
+    int grid = (argc > 4) ? atoi(argv[4]) : 0;
+    if (driverCount <= 0) driverCount = 1000;
+    if (requestCount <= 0) requestCount = 5000;
+    if (perSecond <= 0.0) perSecond = 1.0;
+
+    std::string locationsPath = getDataFilePath("city-locations.csv");
+    std::string pathsPath = getDataFilePath("paths.csv");
+    if (grid > 0)
+    {
+        locationsPath = "loadgen-locations.csv";
+        pathsPath = "loadgen-paths.csv";
+        if (!writeSyntheticCity(grid, locationsPath.c_str(), pathsPath.c_str()))
+        {
+            std::cerr << "Failed to write the synthetic city" << std::endl;
+            return 1;
+        }
+    }
+
+    NullBuffer nullBuffer;
+    std::streambuf *saved = std::cout.rdbuf(&nullBuffer);
+    City city;
+    bool loaded = city.loadLocations(locationsPath.c_str()) && city.loadPaths(pathsPath.c_str());
+    std::cout.rdbuf(saved);
+    if (!loaded)
+    {
+        std::cerr << "Failed to load city data" << std::endl;
+        return 1;
+    }
+
+    std::shared_ptr<const GraphIndex> gi = city.getGraphIndex();
+    int *routeNodes = new int[gi->nodeCount];
+    int *locationNodes = new int[gi->nodeCount];
+    int routeCount = 0;
+    int locationCount = 0;
+    for (int i = 0; i < gi->nodeCount; i++)
+    {
+        if (city.isRouteNode(i))
+            routeNodes[routeCount++] = i;
+        else
+            locationNodes[locationCount++] = i;
+    }
+    if (routeCount == 0 || locationCount == 0)
+    {
+        std::cerr << "City has no route or location nodes" << std::endl;
+        return 1;
+    }
+
+    long baseResidentKb;
+    long basePeakKb;
+    readMemory(baseResidentKb, basePeakKb);
+
+    DispatchEngine engine(&city, driverCount, 1024);
+    engine.setTerminalTripRetention(256);
+    TripScheduler *scheduler = engine.getScheduler();
+    scheduler->setUpdateInterval(1000);
+    unsigned int seed = 29;
+    for (int id = 1; id <= driverCount; id++)
+    {
+        Node *n = gi->nodes[routeNodes[nextRandom(seed) % routeCount]];
+        engine.addDriver(id, n->id, n->zone);
+    }
+
+    double *latencies = new double[requestCount];
+    int served = 0;
+    int unserved = 0;
+    double arrivalMs = 0.0;
+    int peakActive = 0;
+
+    saved = std::cout.rdbuf(&nullBuffer);
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    for (int tripId = 1; tripId <= requestCount; tripId++)
+    {
+        // Exponential gaps give a Poisson arrival process
+        arrivalMs += -std::log(nextUniform(seed)) / perSecond * 1000.0;
+        scheduler->advanceTo((long long)arrivalMs);
+
+        const char *pickup = gi->nodes[locationNodes[nextRandom(seed) % locationCount]]->id;
+        const char *dropoff = gi->nodes[locationNodes[nextRandom(seed) % locationCount]]->id;
+        engine.requestTrip(tripId, tripId, pickup, dropoff);
+
+        std::chrono::steady_clock::time_point assignBegin = std::chrono::steady_clock::now();
+        int driverId = engine.assignNearestDriver(tripId);
+        std::chrono::steady_clock::time_point assignEnd = std::chrono::steady_clock::now();
+        if (driverId < 0 || !scheduler->scheduleTrip(tripId))
+        {
+            engine.cancelTrip(tripId);
+            unserved++;
+            continue;
+        }
+        latencies[served++] = std::chrono::duration<double, std::micro>(assignEnd - assignBegin).count();
+        if (engine.getActiveTripsCount() > peakActive)
+            peakActive = engine.getActiveTripsCount();
+    }
+    scheduler->runUntilIdle();
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    std::cout.rdbuf(saved);
+
+    long residentKb;
+    long peakKb;
+    readMemory(residentKb, peakKb);
+    double wallSeconds = std::chrono::duration<double>(end - begin).count();
+
+    std::cout << "\n=== Dispatch Load Generator (" << (grid > 0 ? "synthetic " : "")
+              << gi->nodeCount << " nodes, " << locationCount << " locations, " << driverCount
+              << " drivers) ===" << std::endl;
+    std::cout << "Requests: " << requestCount << " at " << perSecond << "/s simulated ("
+              << served << " served, " << unserved << " without a free driver), "
+              << engine.getTripCountInState(COMPLETED) << " completed" << std::endl;
+    std::cout << "Simulated: " << scheduler->getSimTimeMs() / 1000.0 << " s, peak " << peakActive
+              << " active trips, " << scheduler->getTotalSteps() << " movement updates" << std::endl;
+    std::cout << "Wall time: " << wallSeconds * 1000.0 << " ms, "
+              << (wallSeconds > 0.0 ? requestCount / wallSeconds : 0.0) << " requests/s" << std::endl;
+    if (served > 0)
+    {
+        double p50 = selectKth(latencies, served, served / 2);
+        double p99 = selectKth(latencies, served, (int)(served * 0.99) < served ? (int)(served * 0.99) : served - 1);
+        std::cout << "Assignment latency: p50 " << p50 << " us, p99 " << p99 << " us" << std::endl;
+    }
+    if (residentKb >= 0)
+        std::cout << "Memory: " << residentKb / 1024.0 << " MB resident (" << (residentKb - baseResidentKb) / 1024.0
+                  << " MB after loading the city), peak " << peakKb / 1024.0 << " MB" << std::endl;
+    else
+        std::cout << "Memory: not available on this platform" << std::endl;
+
+    delete[] latencies;
+    delete[] locationNodes;
+    delete[] routeNodes;
+    return 0;
+}
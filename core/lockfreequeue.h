@@ -0,0 +1,174 @@
+#ifndef LOCKFREEQUEUE_H
+#define LOCKFREEQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+
+// Bounded multi-producer/multi-consumer queue without locks. Each cell carries
+// a sequence number telling producers and consumers whose turn it is, so a
+// push or pop is one compare-and-swap on the shared position plus plain
+// copies. Capacity is rounded up to a power of two; tryPush fails when full.
+template <typename T>
+class LockFreeQueue
+{
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    Cell *cells;
+    size_t mask;
+    alignas(64) std::atomic<size_t> enqueuePos;
+    alignas(64) std::atomic<size_t> dequeuePos;
+
+public:
+    explicit LockFreeQueue(int capacity = 1024)
+        : cells(nullptr), mask(0), enqueuePos(0), dequeuePos(0)
+    {
+        size_t size = 2;
+        while (size < (size_t)capacity)
+            size *= 2;
+        cells = new Cell[size];
+        for (size_t i = 0; i < size; i++)
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        mask = size - 1;
+    }
+
+    ~LockFreeQueue()
+    {
+        delete[] cells;
+    }
+
+    LockFreeQueue(const LockFreeQueue &) = delete;
+    LockFreeQueue &operator=(const LockFreeQueue &) = delete;
+
+    bool tryPush(const T &item)
+    {
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Cell *cell = &cells[pos & mask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            long long diff = (long long)seq - (long long)pos;
+            if (diff == 0)
+            {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    cell->value = item;
+                    cell->sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;  // Full
+            }
+            else
+            {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool tryPop(T &item)
+    {
+        size_t pos = dequeuePos.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Cell *cell = &cells[pos & mask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            long long diff = (long long)seq - (long long)(pos + 1);
+            if (diff == 0)
+            {
+                if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    item = cell->value;
+                    cell->sequence.store(pos + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;  // Empty
+            }
+            else
+            {
+                pos = dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    int getCapacity() const { return (int)(mask + 1); }
+};
+
+// Bounded single-producer/single-consumer ring. The producer only writes
+// tail and the consumer only writes head, each on its own cache line, and
+// each side keeps a cached copy of the other's index, so a push or pop reads
+// the other side's line only when its cached view says full or empty. No
+// compare-and-swap at all. Capacity is rounded up to a power of two.
+template <typename T>
+class SpscRing
+{
+private:
+    T *items;
+    size_t mask;
+    alignas(64) std::atomic<size_t> head;   // Next slot to read; written by the consumer
+    size_t cachedTail;                      // Consumer's view of tail
+    alignas(64) std::atomic<size_t> tail;   // Next slot to write; written by the producer
+    size_t cachedHead;                      // Producer's view of head
+
+public:
+    explicit SpscRing(int capacity = 1024)
+        : items(nullptr), mask(0), head(0), cachedTail(0), tail(0), cachedHead(0)
+    {
+        size_t size = 2;
+        while (size < (size_t)capacity)
+            size *= 2;
+        items = new T[size];
+        mask = size - 1;
+    }
+
+    ~SpscRing()
+    {
+        delete[] items;
+    }
+
+    SpscRing(const SpscRing &) = delete;
+    SpscRing &operator=(const SpscRing &) = delete;
+
+    // Producer thread only
+    bool tryPush(const T &item)
+    {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        if (pos - cachedHead > mask)
+        {
+            cachedHead = head.load(std::memory_order_acquire);
+            if (pos - cachedHead > mask)
+                return false;  // Full
+        }
+        items[pos & mask] = item;
+        tail.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer thread only
+    bool tryPop(T &item)
+    {
+        size_t pos = head.load(std::memory_order_relaxed);
+        if (pos == cachedTail)
+        {
+            cachedTail = tail.load(std::memory_order_acquire);
+            if (pos == cachedTail)
+                return false;  // Empty
+        }
+        item = items[pos & mask];
+        head.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    int getCapacity() const { return (int)(mask + 1); }
+};
+
+#endif // LOCKFREEQUEUE_H
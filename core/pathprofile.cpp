@@ -0,0 +1,119 @@
+#include "pathprofile.h"
+#include <cmath>
+
+PathProfile::PathProfile() : nodes(nullptr), cumulative(nullptr), count(0), capacity(0)
+{
+}
+
+PathProfile::~PathProfile()
+{
+    delete[] nodes;
+    delete[] cumulative;
+}
+
+void PathProfile::clear()
+{
+    count = 0;
+}
+
+bool PathProfile::build(const City *city, const PathResult &path)
+{
+    count = 0;
+    std::shared_ptr<const GraphIndex> gi = city->getGraphIndex();
+    if (!gi || path.pathLength <= 0)
+        return path.pathLength == 0;
+
+    if (path.pathLength > capacity)
+    {
+        delete[] nodes;
+        delete[] cumulative;
+        capacity = path.pathLength;
+        nodes = new int[capacity];
+        cumulative = new double[capacity];
+    }
+
+    for (int k = 0; k < path.pathLength; k++)
+    {
+        int index = gi->findIndex(path.path[k]);
+        if (index < 0)
+        {
+            count = 0;
+            return false;
+        }
+        nodes[k] = index;
+        if (k == 0)
+        {
+            cumulative[k] = 0.0;
+            continue;
+        }
+        int edge = gi->findEdge(nodes[k - 1], index);
+        double length;
+        if (edge >= 0)
+        {
+            length = gi->adjWeight[edge];
+        }
+        else
+        {
+            double dx = gi->x[index] - gi->x[nodes[k - 1]];
+            double dy = gi->y[index] - gi->y[nodes[k - 1]];
+            length = std::sqrt(dx * dx + dy * dy);
+        }
+        cumulative[k] = cumulative[k - 1] + length;
+    }
+    count = path.pathLength;
+    return true;
+}
+
+int PathProfile::getNodeCount() const
+{
+    return count;
+}
+
+double PathProfile::getLength() const
+{
+    return count > 0 ? cumulative[count - 1] : 0.0;
+}
+
+int PathProfile::getNodeIndex(int k) const
+{
+    return (k >= 0 && k < count) ? nodes[k] : -1;
+}
+
+double PathProfile::getDistanceAt(int k) const
+{
+    if (count == 0)
+        return 0.0;
+    if (k <= 0)
+        return 0.0;
+    return cumulative[k < count ? k : count - 1];
+}
+
+void PathProfile::locate(double distance, int &edge, double &offset) const
+{
+    if (count <= 1 || distance >= cumulative[count - 1])
+    {
+        edge = count > 0 ? count - 1 : 0;
+        offset = 0.0;
+        return;
+    }
+    if (distance <= 0.0)
+    {
+        edge = 0;
+        offset = 0.0;
+        return;
+    }
+
+    // Last node whose cumulative distance is <= distance
+    int lo = 0;
+    int hi = count - 1;
+    while (hi - lo > 1)
+    {
+        int mid = (lo + hi) / 2;
+        if (cumulative[mid] <= distance)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    edge = lo;
+    offset = distance - cumulative[lo];
+}
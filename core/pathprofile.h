@@ -0,0 +1,38 @@
+#ifndef PATHPROFILE_H
+#define PATHPROFILE_H
+
+#include "city.h"
+
+// Cumulative road distance along a planned path. A distance travelled maps
+// to an exact (edge, offset) position by binary search, so positions and
+// arrival times follow from departure time and speed alone.
+class PathProfile
+{
+private:
+    int *nodes;           // Graph index of path[k]
+    double *cumulative;   // Road distance from path[0] to path[k]
+    int count;
+    int capacity;
+
+public:
+    PathProfile();
+    ~PathProfile();
+    PathProfile(const PathProfile &) = delete;
+    PathProfile &operator=(const PathProfile &) = delete;
+
+    // Edge lengths come from the graph's road weights (straight-line distance
+    // for a pair that is no longer adjacent). False if a node is unknown.
+    bool build(const City *city, const PathResult &path);
+    void clear();
+
+    int getNodeCount() const;
+    double getLength() const;
+    int getNodeIndex(int k) const;      // Graph index of path[k]
+    double getDistanceAt(int k) const;  // Road distance from path[0] to path[k]
+
+    // Segment edge runs path[edge] -> path[edge + 1]; offset is metres along it.
+    // Distances past the end give the last node with offset 0.
+    void locate(double distance, int &edge, double &offset) const;
+};
+
+#endif // PATHPROFILE_H
@@ -0,0 +1,571 @@
+#include "rebalancer.h"
+#include "dispatchengine.h"
+#include <cmath>
+#include <cstring>
+#include <cstdio>
+
+static const double REBALANCE_INF = 1e18;
+
+Rebalancer::Rebalancer(DispatchEngine *e, City *c)
+    : engine(e), city(c), colonyCount(0), colonyNames(nullptr), colonyAnchor(nullptr),
+      nodeColony(nullptr), indexedNodes(0), indexedVersion(-1), colonyDistance(nullptr),
+      demand(nullptr), demandStamp(nullptr), enabled(false), halfLifeSeconds(600.0),
+      intervalSeconds(60.0), driverSpeed(10.0), maxMoveDistance(4000.0), maxMovesPerRound(20),
+      lastRebalance(-1e18), lastUpdate(0.0), moves(nullptr), moveCount(0), moveCapacity(0),
+      movesIssued(0)
+{
+}
+
+Rebalancer::~Rebalancer()
+{
+    for (int m = 0; m < moveCount; m++)
+        delete[] moves[m].path;
+    delete[] moves;
+    releaseColonies();
+    delete[] demand;
+    delete[] demandStamp;
+}
+
+void Rebalancer::releaseColonies()
+{
+    delete[] colonyNames;
+    delete[] colonyAnchor;
+    delete[] nodeColony;
+    delete[] colonyDistance;
+    colonyNames = nullptr;
+    colonyAnchor = nullptr;
+    nodeColony = nullptr;
+    colonyDistance = nullptr;
+}
+
+// Colonies, anchors and the anchor distance matrix for the current graph.
+// Demand carries over by colony name when the graph is re-indexed.
+void Rebalancer::buildColonies()
+{
+    std::shared_ptr<const GraphIndex> gi = city->getGraphIndex();
+    if (!gi || gi->version == indexedVersion)
+        return;
+
+    int oldCount = colonyCount;
+    char (*oldNames)[COLONY_KEY_LENGTH] = colonyNames;
+    double *oldDemand = demand;
+    double *oldStamp = demandStamp;
+    colonyNames = nullptr;
+    releaseColonies();
+
+    int n = gi->nodeCount;
+    nodeColony = new int[n > 0 ? n : 1];
+    colonyNames = new char[n > 0 ? n : 1][COLONY_KEY_LENGTH];
+    colonyCount = 0;
+    int last = -1;
+    char key[COLONY_KEY_LENGTH];
+    for (int i = 0; i < n; i++)
+    {
+        Node *node = gi->nodes[i];
+        snprintf(key, sizeof(key), "%s/%s", node->zone, node->colony);
+        if (last < 0 || strcmp(colonyNames[last], key) != 0)
+        {
+            last = -1;
+            for (int c = 0; c < colonyCount && last < 0; c++)
+            {
+                if (strcmp(colonyNames[c], key) == 0)
+                    last = c;
+            }
+            if (last < 0)
+            {
+                last = colonyCount++;
+                strcpy(colonyNames[last], key);
+            }
+        }
+        nodeColony[i] = last;
+    }
+    indexedNodes = n;
+    indexedVersion = gi->version;
+
+    // Anchor: the colony's route node closest to its centroid
+    double *sumX = new double[colonyCount > 0 ? colonyCount : 1];
+    double *sumY = new double[colonyCount > 0 ? colonyCount : 1];
+    int *members = new int[colonyCount > 0 ? colonyCount : 1];
+    double *best = new double[colonyCount > 0 ? colonyCount : 1];
+    colonyAnchor = new int[colonyCount > 0 ? colonyCount : 1];
+    for (int c = 0; c < colonyCount; c++)
+    {
+        sumX[c] = sumY[c] = 0.0;
+        members[c] = 0;
+        best[c] = REBALANCE_INF;
+        colonyAnchor[c] = -1;
+    }
+    for (int i = 0; i < n; i++)
+    {
+        sumX[nodeColony[i]] += gi->nodes[i]->x;
+        sumY[nodeColony[i]] += gi->nodes[i]->y;
+        members[nodeColony[i]]++;
+    }
+    for (int i = 0; i < n; i++)
+    {
+        if (!city->isRouteNode(i))
+            continue;
+        int c = nodeColony[i];
+        double dx = gi->nodes[i]->x - sumX[c] / members[c];
+        double dy = gi->nodes[i]->y - sumY[c] / members[c];
+        if (dx * dx + dy * dy < best[c])
+        {
+            best[c] = dx * dx + dy * dy;
+            colonyAnchor[c] = i;
+        }
+    }
+    delete[] sumX;
+    delete[] sumY;
+    delete[] members;
+    delete[] best;
+
+    demand = new double[colonyCount > 0 ? colonyCount : 1];
+    demandStamp = new double[colonyCount > 0 ? colonyCount : 1];
+    for (int c = 0; c < colonyCount; c++)
+    {
+        demand[c] = 0.0;
+        demandStamp[c] = 0.0;
+        for (int o = 0; o < oldCount; o++)
+        {
+            if (strcmp(oldNames[o], colonyNames[c]) == 0)
+            {
+                demand[c] = oldDemand[o];
+                demandStamp[c] = oldStamp[o];
+                break;
+            }
+        }
+    }
+    delete[] oldNames;
+    delete[] oldDemand;
+    delete[] oldStamp;
+}
+
+// One search per anchor gives the whole colony distance matrix; built on the
+// first rebalance so recording demand never waits for it
+void Rebalancer::buildDistances()
+{
+    colonyDistance = new double[colonyCount * colonyCount > 0 ? colonyCount * colonyCount : 1];
+    int *anchors = new int[colonyCount > 0 ? colonyCount : 1];
+    double *distances = new double[colonyCount > 0 ? colonyCount : 1];
+    for (int c = 0; c < colonyCount; c++)
+        anchors[c] = colonyAnchor[c] >= 0 ? colonyAnchor[c] : 0;
+    for (int a = 0; a < colonyCount; a++)
+    {
+        if (colonyAnchor[a] >= 0)
+            city->findDistancesToNodes(city->getNodeByIndex(colonyAnchor[a])->id, anchors, colonyCount, distances);
+        for (int b = 0; b < colonyCount; b++)
+            colonyDistance[a * colonyCount + b] = (colonyAnchor[a] >= 0 && colonyAnchor[b] >= 0) ? distances[b] : -1.0;
+    }
+    delete[] anchors;
+    delete[] distances;
+}
+
+double Rebalancer::nowSeconds() const
+{
+    return engine->getScheduler()->getSimTimeMs() / 1000.0;
+}
+
+double Rebalancer::decayedDemand(int colony, double now)
+{
+    if (now > demandStamp[colony])
+    {
+        demand[colony] *= std::pow(0.5, (now - demandStamp[colony]) / halfLifeSeconds);
+        demandStamp[colony] = now;
+    }
+    return demand[colony];
+}
+
+void Rebalancer::setEnabled(bool on)
+{
+    enabled = on;
+}
+
+bool Rebalancer::isEnabled() const
+{
+    return enabled;
+}
+
+void Rebalancer::setHalfLife(double seconds)
+{
+    halfLifeSeconds = seconds > 0.0 ? seconds : 600.0;
+}
+
+void Rebalancer::setInterval(double seconds)
+{
+    intervalSeconds = seconds >= 0.0 ? seconds : 60.0;
+}
+
+void Rebalancer::setDriverSpeed(double metresPerSecond)
+{
+    driverSpeed = metresPerSecond > 0.0 ? metresPerSecond : 10.0;
+}
+
+void Rebalancer::setMaxMoveDistance(double metres)
+{
+    maxMoveDistance = metres > 0.0 ? metres : 4000.0;
+}
+
+void Rebalancer::setMaxMovesPerRound(int count)
+{
+    maxMovesPerRound = count >= 0 ? count : 0;
+}
+
+void Rebalancer::recordRequest(const char *pickupNodeId)
+{
+    std::lock_guard<std::mutex> guard(demandLock);
+    int colony = getColonyId(pickupNodeId);
+    if (colony < 0)
+        return;
+    decayedDemand(colony, nowSeconds());
+    demand[colony] += 1.0;
+}
+
+int Rebalancer::findMove(int driverId) const
+{
+    for (int m = 0; m < moveCount; m++)
+    {
+        if (moves[m].driverId == driverId)
+            return m;
+    }
+    return -1;
+}
+
+void Rebalancer::removeMove(int slot)
+{
+    delete[] moves[slot].path;
+    moves[slot] = moves[moveCount - 1];
+    moveCount--;
+}
+
+bool Rebalancer::startMove(int driverId, int targetColony)
+{
+    Driver *driver = engine->getDriver(driverId);
+    int anchor = colonyAnchor[targetColony];
+    if (!driver || anchor < 0)
+        return false;
+    PathResult route = city->findShortestPathAStar(driver->getCurrentNodeId(),
+                                                   city->getNodeByIndex(anchor)->id);
+    if (route.pathLength < 2)
+        return false;
+
+    if (moveCount == moveCapacity)
+    {
+        int newCapacity = moveCapacity > 0 ? moveCapacity * 2 : 16;
+        RepositionMove *grown = new RepositionMove[newCapacity];
+        for (int m = 0; m < moveCount; m++)
+            grown[m] = moves[m];
+        delete[] moves;
+        moves = grown;
+        moveCapacity = newCapacity;
+    }
+    RepositionMove &move = moves[moveCount++];
+    move.driverId = driverId;
+    move.targetColony = targetColony;
+    move.path = new int[route.pathLength];
+    move.pathLength = route.pathLength;
+    for (int k = 0; k < route.pathLength; k++)
+        move.path[k] = city->getNodeIndex(route.path[k]);
+    move.position = 0;
+    move.progress = 0.0;
+    movesIssued++;
+    return true;
+}
+
+// Drive every move along its path at driverSpeed; dispatched drivers drop out
+void Rebalancer::stepMoves(double elapsedSeconds)
+{
+    double budget = driverSpeed * elapsedSeconds;
+    for (int m = moveCount - 1; m >= 0; m--)
+    {
+        RepositionMove &move = moves[m];
+        Driver *driver = engine->getDriver(move.driverId);
+        if (!driver || !driver->isAvailable())
+        {
+            removeMove(m);
+            continue;
+        }
+
+        int start = move.position;
+        move.progress += budget;
+        while (move.position + 1 < move.pathLength)
+        {
+            Node *from = city->getNodeByIndex(move.path[move.position]);
+            Node *to = city->getNodeByIndex(move.path[move.position + 1]);
+            double edge = (from && to) ? city->getDistance(from->id, to->id) : 0.0;
+            if (move.progress < edge)
+                break;
+            move.progress -= edge;
+            move.position++;
+        }
+        if (move.position != start)
+        {
+            Node *at = city->getNodeByIndex(move.path[move.position]);
+            if (at)
+                driver->setCurrentNodeId(at->id);
+        }
+        if (move.position + 1 >= move.pathLength)
+            removeMove(m);
+    }
+}
+
+// Target idle drivers per colony follow the decayed demand share. Whole
+// surplus drivers flow to whole deficits along the cheapest anchor distances
+// (successive shortest paths), capped at maxMovesPerRound.
+int Rebalancer::computeMoves(double now)
+{
+    buildColonies();
+    int count = engine->getDriverCount();
+    if (colonyCount == 0 || count == 0 || maxMovesPerRound == 0)
+        return 0;
+    if (!colonyDistance)
+        buildDistances();
+
+    // Free drivers straight from the fleet's columns; busy ones never count
+    int *driverColony = new int[count];
+    int *driverIds = new int[count];
+    int *driverNodes = new int[count];
+    count = engine->getFleet()->collectAvailable(driverIds, driverNodes, count);
+    double *supply = new double[colonyCount];
+    int *movable = new int[colonyCount];
+    for (int c = 0; c < colonyCount; c++)
+    {
+        supply[c] = 0.0;
+        movable[c] = 0;
+    }
+    int idle = 0;
+    for (int i = 0; i < count; i++)
+    {
+        driverColony[i] = -1;
+        int move = findMove(driverIds[i]);
+        int node = driverNodes[i];
+        int colony = move >= 0 ? moves[move].targetColony
+                               : (node >= 0 && node < indexedNodes ? nodeColony[node] : -1);
+        if (colony < 0)
+            continue;
+        supply[colony] += 1.0;
+        idle++;
+        if (move < 0)
+        {
+            driverColony[i] = colony;
+            movable[colony]++;
+        }
+    }
+
+    double total = 0.0;
+    for (int c = 0; c < colonyCount; c++)
+        total += colonyAnchor[c] >= 0 ? decayedDemand(c, now) : 0.0;
+
+    // Flow network: 0 = source, 1..C surplus side, C+1..2C deficit side, 2C+1 = sink
+    int nodes = 2 * colonyCount + 2;
+    int sink = nodes - 1;
+    int maxEdges = 2 * (colonyCount * colonyCount + 2 * colonyCount);
+    int *head = new int[nodes];
+    int *edgeTo = new int[maxEdges];
+    int *edgeNext = new int[maxEdges];
+    int *edgeCap = new int[maxEdges];
+    double *edgeCost = new double[maxEdges];
+    int edges = 0;
+    for (int v = 0; v < nodes; v++)
+        head[v] = -1;
+    auto addEdge = [&](int from, int to, int cap, double cost)
+    {
+        edgeTo[edges] = to; edgeCap[edges] = cap; edgeCost[edges] = cost;
+        edgeNext[edges] = head[from]; head[from] = edges++;
+        edgeTo[edges] = from; edgeCap[edges] = 0; edgeCost[edges] = -cost;
+        edgeNext[edges] = head[to]; head[to] = edges++;
+    };
+
+    if (total > 1e-9 && idle > 0)
+    {
+        for (int c = 0; c < colonyCount; c++)
+        {
+            double target = colonyAnchor[c] >= 0 ? idle * demand[c] / total : 0.0;
+            int surplus = (int)std::floor(supply[c] - target);
+            int deficit = (int)std::floor(target - supply[c]);
+            if (surplus > movable[c])
+                surplus = movable[c];
+            if (surplus > 0)
+                addEdge(0, 1 + c, surplus, 0.0);
+            if (deficit > 0 && colonyAnchor[c] >= 0)
+                addEdge(1 + colonyCount + c, sink, deficit, 0.0);
+        }
+        for (int a = 0; a < colonyCount; a++)
+        {
+            for (int b = 0; b < colonyCount; b++)
+            {
+                double distance = colonyDistance[a * colonyCount + b];
+                if (a != b && distance >= 0.0 && distance <= maxMoveDistance)
+                    addEdge(1 + a, 1 + colonyCount + b, maxMovesPerRound, distance);
+            }
+        }
+    }
+
+    // Successive shortest paths with Bellman-Ford (queue based)
+    double *dist = new double[nodes];
+    int *viaEdge = new int[nodes];
+    bool *queued = new bool[nodes];
+    int *queue = new int[nodes];
+    int flow = 0;
+    while (flow < maxMovesPerRound)
+    {
+        for (int v = 0; v < nodes; v++)
+        {
+            dist[v] = REBALANCE_INF;
+            viaEdge[v] = -1;
+            queued[v] = false;
+        }
+        dist[0] = 0.0;
+        int qHead = 0;
+        int qSize = 1;
+        queue[0] = 0;
+        queued[0] = true;
+        while (qSize > 0)
+        {
+            int u = queue[qHead];
+            qHead = (qHead + 1) % nodes;
+            qSize--;
+            queued[u] = false;
+            for (int e = head[u]; e >= 0; e = edgeNext[e])
+            {
+                int v = edgeTo[e];
+                if (edgeCap[e] > 0 && dist[u] + edgeCost[e] < dist[v] - 1e-9)
+                {
+                    dist[v] = dist[u] + edgeCost[e];
+                    viaEdge[v] = e;
+                    if (!queued[v])
+                    {
+                        queue[(qHead + qSize) % nodes] = v;
+                        qSize++;
+                        queued[v] = true;
+                    }
+                }
+            }
+        }
+        if (viaEdge[sink] < 0)
+            break;
+
+        int push = maxMovesPerRound - flow;
+        for (int v = sink; v != 0; v = edgeTo[viaEdge[v] ^ 1])
+            push = edgeCap[viaEdge[v]] < push ? edgeCap[viaEdge[v]] : push;
+        for (int v = sink; v != 0; v = edgeTo[viaEdge[v] ^ 1])
+        {
+            edgeCap[viaEdge[v]] -= push;
+            edgeCap[viaEdge[v] ^ 1] += push;
+        }
+        flow += push;
+    }
+
+    // Turn colony-to-colony flow into moves of the idle drivers closest to each target
+    int started = 0;
+    for (int a = 0; a < colonyCount; a++)
+    {
+        for (int e = head[1 + a]; e >= 0; e = edgeNext[e])
+        {
+            int b = edgeTo[e] - 1 - colonyCount;
+            if (b < 0 || b >= colonyCount || (e & 1))
+                continue;
+            int units = edgeCap[e ^ 1];
+            Node *anchor = city->getNodeByIndex(colonyAnchor[b]);
+            for (int u = 0; u < units && anchor; u++)
+            {
+                int chosen = -1;
+                double bestDistance = REBALANCE_INF;
+                for (int i = 0; i < count; i++)
+                {
+                    if (driverColony[i] != a)
+                        continue;
+                    Node *at = city->getNodeByIndex(driverNodes[i]);
+                    double dx = at ? at->x - anchor->x : 0.0;
+                    double dy = at ? at->y - anchor->y : 0.0;
+                    if (dx * dx + dy * dy < bestDistance)
+                    {
+                        bestDistance = dx * dx + dy * dy;
+                        chosen = i;
+                    }
+                }
+                if (chosen < 0)
+                    break;
+                driverColony[chosen] = -1;
+                started += startMove(driverIds[chosen], b) ? 1 : 0;
+            }
+        }
+    }
+
+    delete[] dist;
+    delete[] viaEdge;
+    delete[] queued;
+    delete[] queue;
+    delete[] head;
+    delete[] edgeTo;
+    delete[] edgeNext;
+    delete[] edgeCap;
+    delete[] edgeCost;
+    delete[] driverColony;
+    delete[] driverIds;
+    delete[] driverNodes;
+    delete[] supply;
+    delete[] movable;
+    return started;
+}
+
+int Rebalancer::update()
+{
+    double now = nowSeconds();
+    if (now > lastUpdate)
+    {
+        stepMoves(now - lastUpdate);
+        lastUpdate = now;
+    }
+    if (!enabled || now - lastRebalance < intervalSeconds)
+        return 0;
+    lastRebalance = now;
+    return computeMoves(now);
+}
+
+int Rebalancer::rebalanceNow()
+{
+    double now = nowSeconds();
+    lastRebalance = now;
+    return computeMoves(now);
+}
+
+int Rebalancer::getColonyCount() const
+{
+    return colonyCount;
+}
+
+int Rebalancer::getColonyId(const char *nodeId)
+{
+    buildColonies();
+    int index = nodeId ? city->getNodeIndex(nodeId) : -1;
+    if (index < 0 || index >= indexedNodes)
+        return -1;
+    return nodeColony[index];
+}
+
+const char *Rebalancer::getColonyName(int colony) const
+{
+    return (colony >= 0 && colony < colonyCount) ? colonyNames[colony] : "";
+}
+
+double Rebalancer::getDemand(int colony)
+{
+    if (colony < 0 || colony >= colonyCount)
+        return 0.0;
+    return decayedDemand(colony, nowSeconds());
+}
+
+int Rebalancer::getActiveMoveCount() const
+{
+    return moveCount;
+}
+
+long long Rebalancer::getMovesIssued() const
+{
+    return movesIssued;
+}
+
+bool Rebalancer::isRepositioning(int driverId) const
+{
+    return findMove(driverId) >= 0;
+}
@@ -0,0 +1,106 @@
+#ifndef REBALANCER_H
+#define REBALANCER_H
+
+#include "city.h"
+#include <mutex>
+
+class DispatchEngine;
+
+// Idle driver driving towards another colony
+struct RepositionMove
+{
+    int driverId;
+    int targetColony;
+    int *path;          // Graph indices from the start node to the colony anchor
+    int pathLength;
+    int position;       // Index of the node the driver is at
+    double progress;    // Metres travelled towards path[position + 1]
+};
+
+// Moves idle drivers towards demand, owned by DispatchEngine. Every request
+// adds to its pickup colony's demand, which decays exponentially over
+// simulated time. Every interval, idle supply is compared with each
+// colony's share of the decayed demand. Surplus drivers go to deficit
+// colonies along a min-cost flow over road distance between colony anchors.
+// The moves then drive at a fixed speed as the clock advances. A driver that
+// is dispatched mid-move simply stops repositioning.
+class Rebalancer
+{
+private:
+    // "zone/colony" fits both names in full, so distinct colonies never collide
+    static const int COLONY_KEY_LENGTH = 2 * MAX_STRING_LENGTH;
+
+    DispatchEngine *engine;
+    City *city;
+
+    // Colonies (zone + colony name) and their anchor route nodes
+    int colonyCount;
+    char (*colonyNames)[COLONY_KEY_LENGTH];
+    int *colonyAnchor;          // Graph index, -1 when the colony has no route node
+    int *nodeColony;            // Graph index -> colony id
+    int indexedNodes;
+    long indexedVersion;        // Graph version the tables were built for
+    double *colonyDistance;     // colonyCount x colonyCount road distances, -1 unreachable
+
+    double *demand;
+    double *demandStamp;        // Time demand[c] was last decayed to
+    std::mutex demandLock;      // Requests are recorded from every thread that requests trips
+
+    bool enabled;
+    double halfLifeSeconds;
+    double intervalSeconds;
+    double driverSpeed;         // Metres per second while repositioning
+    double maxMoveDistance;
+    int maxMovesPerRound;
+    double lastRebalance;
+    double lastUpdate;
+
+    RepositionMove *moves;
+    int moveCount;
+    int moveCapacity;
+    long long movesIssued;
+
+    void buildColonies();
+    void releaseColonies();
+    void buildDistances();
+    double nowSeconds() const;
+    double decayedDemand(int colony, double now);
+    int computeMoves(double now);
+    bool startMove(int driverId, int targetColony);
+    void stepMoves(double elapsedSeconds);
+    int findMove(int driverId) const;
+    void removeMove(int slot);
+
+public:
+    Rebalancer(DispatchEngine *e, City *c);
+    ~Rebalancer();
+    Rebalancer(const Rebalancer &) = delete;
+    Rebalancer &operator=(const Rebalancer &) = delete;
+
+    void setEnabled(bool on);
+    bool isEnabled() const;
+    void setHalfLife(double seconds);
+    void setInterval(double seconds);
+    void setDriverSpeed(double metresPerSecond);
+    void setMaxMoveDistance(double metres);
+    void setMaxMovesPerRound(int count);
+
+    // Demand signal (DispatchEngine::requestTrip calls this)
+    void recordRequest(const char *pickupNodeId);
+
+    // Advance repositioning to the engine's simulated clock and, once the
+    // interval has passed, plan a new round. Returns moves started.
+    int update();
+    int rebalanceNow();
+
+    // Queries
+    int getColonyCount() const;
+    int getColonyId(const char *nodeId);
+    const char *getColonyName(int colony) const;
+    double getDemand(int colony);
+    int getActiveMoveCount() const;
+    long long getMovesIssued() const;
+    bool isRepositioning(int driverId) const;
+};
+
+#endif // REBALANCER_H
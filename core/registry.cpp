@@ -0,0 +1,112 @@
+#include "registry.h"
+
+static unsigned int hashId(int key)
+{
+    unsigned int h = (unsigned int)key * 2654435761u;
+    return h ^ (h >> 16);
+}
+
+IdMap::IdMap(int initialCapacity)
+    : keys(nullptr), values(nullptr), states(nullptr), capacity(0), used(0), erased(0)
+{
+    int cap = 16;
+    while (cap < initialCapacity)
+        cap *= 2;
+    rehash(cap);
+}
+
+IdMap::~IdMap()
+{
+    delete[] keys;
+    delete[] values;
+    delete[] states;
+}
+
+int IdMap::probe(int key) const
+{
+    int mask = capacity - 1;
+    for (int i = (int)(hashId(key) & mask);; i = (i + 1) & mask)
+    {
+        if (states[i] == 0)
+            return -1;
+        if (states[i] == 1 && keys[i] == key)
+            return i;
+    }
+}
+
+void IdMap::rehash(int newCapacity)
+{
+    int *oldKeys = keys;
+    int *oldValues = values;
+    unsigned char *oldStates = states;
+    int oldCapacity = capacity;
+
+    keys = new int[newCapacity];
+    values = new int[newCapacity];
+    states = new unsigned char[newCapacity];
+    for (int i = 0; i < newCapacity; i++)
+        states[i] = 0;
+    capacity = newCapacity;
+    used = 0;
+    erased = 0;
+
+    for (int i = 0; i < oldCapacity; i++)
+    {
+        if (oldStates[i] == 1)
+            insert(oldKeys[i], oldValues[i]);
+    }
+
+    delete[] oldKeys;
+    delete[] oldValues;
+    delete[] oldStates;
+}
+
+bool IdMap::find(int key, int &value) const
+{
+    int slot = probe(key);
+    if (slot < 0)
+        return false;
+    value = values[slot];
+    return true;
+}
+
+void IdMap::insert(int key, int value)
+{
+    int slot = probe(key);
+    if (slot >= 0)
+    {
+        values[slot] = value;
+        return;
+    }
+
+    // Keep the table at most half full (tombstones included)
+    if ((used + erased + 1) * 2 > capacity)
+        rehash(used * 4 > capacity ? capacity * 2 : capacity);
+
+    int mask = capacity - 1;
+    int i = (int)(hashId(key) & mask);
+    while (states[i] == 1)
+        i = (i + 1) & mask;
+    if (states[i] == 2)
+        erased--;
+    keys[i] = key;
+    values[i] = value;
+    states[i] = 1;
+    used++;
+}
+
+bool IdMap::erase(int key)
+{
+    int slot = probe(key);
+    if (slot < 0)
+        return false;
+    states[slot] = 2;
+    used--;
+    erased++;
+    return true;
+}
+
+int IdMap::size() const
+{
+    return used;
+}
@@ -0,0 +1,122 @@
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#include <new>
+
+// Open-addressing hash map from integer ids (driver/trip ids) to integer
+// values such as array slots. Grows by doubling; erased entries leave
+// tombstones that are dropped on the next rehash.
+class IdMap
+{
+private:
+    int *keys;
+    int *values;
+    unsigned char *states;  // 0 = empty, 1 = used, 2 = erased
+    int capacity;           // Power of two
+    int used;
+    int erased;
+
+    int probe(int key) const;  // Slot holding key, or -1
+    void rehash(int newCapacity);
+
+public:
+    IdMap(int initialCapacity = 64);
+    ~IdMap();
+    IdMap(const IdMap &) = delete;
+    IdMap &operator=(const IdMap &) = delete;
+
+    bool find(int key, int &value) const;
+    void insert(int key, int value);  // Inserts or overwrites
+    bool erase(int key);
+    int size() const;
+};
+
+// Chunked object storage. Objects are constructed in place inside fixed-size
+// chunks, so growing never moves existing objects and pointers stay valid.
+// Destroyed slots go onto a free list and are reused by the next create().
+template <typename T>
+class SlabPool
+{
+private:
+    union Slot
+    {
+        alignas(T) unsigned char storage[sizeof(T)];
+        Slot *nextFree;
+    };
+
+    Slot **chunks;
+    int chunkCount;
+    int chunkCapacity;
+    int slotsPerChunk;
+    Slot *freeList;
+    int liveCount;
+
+    Slot *acquire()
+    {
+        if (!freeList)
+        {
+            if (chunkCount == chunkCapacity)
+            {
+                int newCapacity = chunkCapacity > 0 ? chunkCapacity * 2 : 4;
+                Slot **grown = new Slot *[newCapacity];
+                for (int i = 0; i < chunkCount; i++)
+                    grown[i] = chunks[i];
+                delete[] chunks;
+                chunks = grown;
+                chunkCapacity = newCapacity;
+            }
+            Slot *chunk = new Slot[slotsPerChunk];
+            chunks[chunkCount++] = chunk;
+            for (int i = slotsPerChunk - 1; i >= 0; i--)
+            {
+                chunk[i].nextFree = freeList;
+                freeList = &chunk[i];
+            }
+        }
+        Slot *slot = freeList;
+        freeList = slot->nextFree;
+        liveCount++;
+        return slot;
+    }
+
+public:
+    explicit SlabPool(int chunkSlots = 64)
+        : chunks(nullptr), chunkCount(0), chunkCapacity(0),
+          slotsPerChunk(chunkSlots > 0 ? chunkSlots : 64), freeList(nullptr), liveCount(0)
+    {
+    }
+
+    // Frees the chunks; live objects must have been destroy()ed by the owner
+    ~SlabPool()
+    {
+        for (int i = 0; i < chunkCount; i++)
+            delete[] chunks[i];
+        delete[] chunks;
+    }
+
+    SlabPool(const SlabPool &) = delete;
+    SlabPool &operator=(const SlabPool &) = delete;
+
+    template <typename... Args>
+    T *create(Args... args)
+    {
+        Slot *slot = acquire();
+        return new (slot->storage) T(args...);
+    }
+
+    void destroy(T *object)
+    {
+        if (!object)
+            return;
+        object->~T();
+        Slot *slot = reinterpret_cast<Slot *>(object);
+        slot->nextFree = freeList;
+        freeList = slot;
+        liveCount--;
+    }
+
+    int getLiveCount() const { return liveCount; }
+    int getSlotCapacity() const { return chunkCount * slotsPerChunk; }
+};
+
+#endif // REGISTRY_H
@@ -0,0 +1,160 @@
+#include "requestqueue.h"
+
+RequestQueue::RequestQueue() : heap(nullptr), count(0), capacity(0), positions(64), nextSequence(0)
+{
+}
+
+RequestQueue::~RequestQueue()
+{
+    delete[] heap;
+}
+
+bool RequestQueue::before(const WaitingRequest &a, const WaitingRequest &b) const
+{
+    if (a.priority != b.priority)
+        return a.priority > b.priority;
+    if (a.deadline != b.deadline)
+        return a.deadline < b.deadline;
+    return a.sequence < b.sequence;
+}
+
+void RequestQueue::place(int index, const WaitingRequest &request)
+{
+    heap[index] = request;
+    positions.insert(request.tripId, index);
+}
+
+void RequestQueue::siftUp(int index)
+{
+    WaitingRequest moving = heap[index];
+    while (index > 0)
+    {
+        int parent = (index - 1) / 2;
+        if (!before(moving, heap[parent]))
+            break;
+        place(index, heap[parent]);
+        index = parent;
+    }
+    place(index, moving);
+}
+
+void RequestQueue::siftDown(int index)
+{
+    WaitingRequest moving = heap[index];
+    while (true)
+    {
+        int child = index * 2 + 1;
+        if (child >= count)
+            break;
+        if (child + 1 < count && before(heap[child + 1], heap[child]))
+            child++;
+        if (!before(heap[child], moving))
+            break;
+        place(index, heap[child]);
+        index = child;
+    }
+    place(index, moving);
+}
+
+void RequestQueue::push(int tripId, int priority, std::chrono::steady_clock::time_point deadline,
+                        AssignmentCallback callback, void *context)
+{
+    WaitingRequest request;
+    request.tripId = tripId;
+    request.priority = priority;
+    request.deadline = deadline;
+    request.sequence = nextSequence++;
+    request.callback = callback;
+    request.context = context;
+
+    // Re-queueing keeps the original arrival order
+    int index;
+    if (positions.find(tripId, index))
+    {
+        request.sequence = heap[index].sequence;
+        heap[index] = request;
+        siftUp(index);
+        positions.find(tripId, index);
+        siftDown(index);
+        return;
+    }
+
+    if (count == capacity)
+    {
+        int newCapacity = capacity > 0 ? capacity * 2 : 16;
+        WaitingRequest *grown = new WaitingRequest[newCapacity];
+        for (int i = 0; i < count; i++)
+            grown[i] = heap[i];
+        delete[] heap;
+        heap = grown;
+        capacity = newCapacity;
+    }
+    heap[count] = request;
+    count++;
+    siftUp(count - 1);
+}
+
+const WaitingRequest *RequestQueue::top() const
+{
+    return count > 0 ? &heap[0] : nullptr;
+}
+
+bool RequestQueue::pop(WaitingRequest &request)
+{
+    if (count == 0)
+        return false;
+    return remove(heap[0].tripId, &request);
+}
+
+bool RequestQueue::remove(int tripId, WaitingRequest *removed)
+{
+    int index;
+    if (!positions.find(tripId, index))
+        return false;
+    if (removed)
+        *removed = heap[index];
+    positions.erase(tripId);
+
+    // The last request fills the hole and moves whichever way restores order
+    count--;
+    if (index < count)
+    {
+        int filler = heap[count].tripId;
+        place(index, heap[count]);
+        siftUp(index);
+        positions.find(filler, index);
+        siftDown(index);
+    }
+    return true;
+}
+
+bool RequestQueue::contains(int tripId) const
+{
+    int index;
+    return positions.find(tripId, index);
+}
+
+int RequestQueue::size() const
+{
+    return count;
+}
+
+int RequestQueue::collectExpired(std::chrono::steady_clock::time_point now, int *tripIds, int maxCount) const
+{
+    int found = 0;
+    for (int i = 0; i < count && found < maxCount; i++)
+    {
+        if (heap[i].deadline <= now)
+            tripIds[found++] = heap[i].tripId;
+    }
+    return found;
+}
+
+void RequestQueue::detach(void *context)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (heap[i].context == context)
+            heap[i].callback = nullptr;
+    }
+}
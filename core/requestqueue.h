@@ -0,0 +1,61 @@
+#ifndef REQUESTQUEUE_H
+#define REQUESTQUEUE_H
+
+#include "registry.h"
+#include <chrono>
+
+// Same callback type as in dispatchengine.h
+struct AssignmentResult;
+typedef void (*AssignmentCallback)(const AssignmentResult &result, void *context);
+
+// A trip waiting for a driver to become free
+struct WaitingRequest
+{
+    int tripId;
+    int priority;                                   // Higher is served first
+    std::chrono::steady_clock::time_point deadline; // Cancelled once this passes
+    long sequence;                                  // Arrival order, breaks ties
+    AssignmentCallback callback;                    // Run with the assignment or the expiry
+    void *context;
+};
+
+// Requests that found no free driver, ordered by urgency: higher priority
+// first, then earlier deadline, then arrival. A binary heap with every trip's
+// heap position in an IdMap, so the most urgent request is found in O(1) and
+// any request can be removed in O(log n) when its trip is cancelled or
+// assigned by other means.
+class RequestQueue
+{
+private:
+    WaitingRequest *heap;
+    int count;
+    int capacity;
+    IdMap positions;        // trip id -> index in heap[]
+    long nextSequence;
+
+    bool before(const WaitingRequest &a, const WaitingRequest &b) const;
+    void place(int index, const WaitingRequest &request);
+    void siftUp(int index);
+    void siftDown(int index);
+
+public:
+    RequestQueue();
+    ~RequestQueue();
+    RequestQueue(const RequestQueue &) = delete;
+    RequestQueue &operator=(const RequestQueue &) = delete;
+
+    // Queues a trip, or updates priority and deadline if it is already queued
+    void push(int tripId, int priority, std::chrono::steady_clock::time_point deadline,
+              AssignmentCallback callback, void *context);
+    const WaitingRequest *top() const;     // Most urgent, nullptr when empty
+    bool pop(WaitingRequest &request);
+    bool remove(int tripId, WaitingRequest *removed = nullptr);
+    bool contains(int tripId) const;
+    int size() const;
+
+    // Trip ids of requests whose deadline is at or before now; returns how many
+    int collectExpired(std::chrono::steady_clock::time_point now, int *tripIds, int maxCount) const;
+    void detach(void *context);            // Drops callbacks into context
+};
+
+#endif // REQUESTQUEUE_H
@@ -0,0 +1,508 @@
+#include "ridepool.h"
+#include <cstring>
+
+RidePool::RidePool(City *c, int seatCount, double detourRatio, double pickupDistance)
+    : city(c), seats(4), maxDetourRatio(0.5), maxPickupDistance(3000.0),
+      routes(nullptr), routeCount(0), routeCapacity(0), routeSlots(16), searchCount(0),
+      startScratch(nullptr), scratchCapacity(0)
+{
+    setSeats(seatCount);
+    setMaxDetourRatio(detourRatio);
+    setMaxPickupDistance(pickupDistance);
+}
+
+RidePool::~RidePool()
+{
+    for (int r = 0; r < routeCount; r++)
+    {
+        delete[] routes[r]->stops;
+        delete[] routes[r]->legs;
+        delete[] routes[r]->riders;
+        delete routes[r];
+    }
+    delete[] routes;
+    delete[] startScratch;
+}
+
+void RidePool::setSeats(int count)
+{
+    seats = count < 1 ? 1 : (count > MAX_SEATS ? MAX_SEATS : count);
+}
+
+void RidePool::setMaxDetourRatio(double ratio)
+{
+    maxDetourRatio = ratio >= 0.0 ? ratio : 0.0;
+}
+
+void RidePool::setMaxPickupDistance(double distance)
+{
+    maxPickupDistance = distance > 0.0 ? distance : 0.0;
+}
+
+int RidePool::getSeats() const
+{
+    return seats;
+}
+
+double RidePool::getMaxDetourRatio() const
+{
+    return maxDetourRatio;
+}
+
+double RidePool::getMaxPickupDistance() const
+{
+    return maxPickupDistance;
+}
+
+PoolRoute *RidePool::createRoute(int driverId, int originIndex)
+{
+    PoolRoute *route = new PoolRoute();
+    route->driverId = driverId;
+    route->originIndex = originIndex;
+    route->load = 0;
+    route->stops = nullptr;
+    route->legs = nullptr;
+    route->stopCount = 0;
+    route->riders = nullptr;
+    route->capacity = 0;
+    growRoute(route, 4);
+
+    if (routeCount == routeCapacity)
+    {
+        int newCapacity = routeCapacity > 0 ? routeCapacity * 2 : 8;
+        PoolRoute **grown = new PoolRoute *[newCapacity];
+        for (int r = 0; r < routeCount; r++)
+            grown[r] = routes[r];
+        delete[] routes;
+        routes = grown;
+        routeCapacity = newCapacity;
+    }
+    routeSlots.insert(driverId, routeCount);
+    routes[routeCount++] = route;
+    return route;
+}
+
+void RidePool::destroyRoute(int driverId)
+{
+    int slot;
+    if (!routeSlots.find(driverId, slot))
+        return;
+    PoolRoute *route = routes[slot];
+    delete[] route->stops;
+    delete[] route->legs;
+    delete[] route->riders;
+    delete route;
+
+    routeSlots.erase(driverId);
+    routes[slot] = routes[routeCount - 1];
+    routes[routeCount - 1] = nullptr;
+    routeCount--;
+    if (slot < routeCount)
+        routeSlots.insert(routes[slot]->driverId, slot);
+}
+
+void RidePool::growRoute(PoolRoute *route, int needed)
+{
+    if (needed <= route->capacity)
+        return;
+    int newCapacity = route->capacity > 0 ? route->capacity : 4;
+    while (newCapacity < needed)
+        newCapacity *= 2;
+
+    PoolStop *stops = new PoolStop[newCapacity];
+    double *legs = new double[newCapacity];
+    PoolRider *riders = new PoolRider[newCapacity];
+    for (int k = 0; k < route->stopCount; k++)
+    {
+        stops[k] = route->stops[k];
+        legs[k] = route->legs[k];
+    }
+    for (int s = 0; s < newCapacity; s++)
+    {
+        if (s < route->capacity)
+            riders[s] = route->riders[s];
+        else
+            riders[s].tripId = -1;
+    }
+    delete[] route->stops;
+    delete[] route->legs;
+    delete[] route->riders;
+    route->stops = stops;
+    route->legs = legs;
+    route->riders = riders;
+    route->capacity = newCapacity;
+}
+
+// Every rider has at least one stop left, so a free slot always exists once
+// the route can hold the new rider's two stops
+int RidePool::allocRider(PoolRoute *route)
+{
+    for (int s = 0; s < route->capacity; s++)
+    {
+        if (route->riders[s].tripId < 0)
+            return s;
+    }
+    return -1;
+}
+
+double RidePool::roadDistance(int fromIndex, int toIndex)
+{
+    Node *from = city->getNodeByIndex(fromIndex);
+    double distance = -1.0;
+    if (from)
+    {
+        city->findDistancesToNodes(from->id, &toIndex, 1, &distance);
+        searchCount++;
+    }
+    return distance >= 0.0 ? distance : 0.0;
+}
+
+// Walk the route as it would be after inserting the request: pickup before
+// old stop pickupPos and drop-off before old stop dropoffPos. Checks seats,
+// the pickup wait bound and every rider's detour against cached legs.
+bool RidePool::feasible(const PoolRoute *route, int pickupPos, int dropoffPos,
+                        double pickupLeg, double afterPickupLeg, double dropoffLeg,
+                        double afterDropoffLeg, double directDistance)
+{
+    int n = route ? route->stopCount : 0;
+    if (route && route->capacity > scratchCapacity)
+    {
+        delete[] startScratch;
+        scratchCapacity = route->capacity;
+        startScratch = new double[scratchCapacity];
+    }
+
+    double rideLimit = directDistance * (1.0 + maxDetourRatio);
+    double travelled = 0.0;
+    double newStart = 0.0;
+    int load = route ? route->load : 0;
+    for (int k = 0; k <= n; k++)
+    {
+        double legIntoStop = k < n ? route->legs[k] : 0.0;
+        if (k == pickupPos)
+        {
+            travelled += pickupLeg;
+            if (travelled > maxPickupDistance || ++load > seats)
+                return false;
+            newStart = travelled;
+            if (pickupPos == dropoffPos)
+            {
+                travelled += directDistance;
+                load--;
+                legIntoStop = afterDropoffLeg;
+            }
+            else
+            {
+                legIntoStop = afterPickupLeg;
+            }
+        }
+        else if (k == dropoffPos)
+        {
+            travelled += dropoffLeg;
+            if (travelled - newStart > rideLimit)
+                return false;
+            load--;
+            legIntoStop = afterDropoffLeg;
+        }
+        if (k == n)
+            break;
+
+        travelled += legIntoStop;
+        const PoolStop &stop = route->stops[k];
+        const PoolRider &rider = route->riders[stop.riderSlot];
+        if (stop.isPickup)
+        {
+            if (travelled > maxPickupDistance || ++load > seats)
+                return false;
+            startScratch[stop.riderSlot] = travelled;
+        }
+        else
+        {
+            double ride = rider.onBoard ? rider.ridden + travelled : travelled - startScratch[stop.riderSlot];
+            if (ride > rider.rideLimit)
+                return false;
+            load--;
+        }
+    }
+    return true;
+}
+
+// fromPickup / fromDropoff hold road distances to the route origin (index 0)
+// and to stop k (index k + 1); the graph is undirected, so they serve both ways
+bool RidePool::evaluateRoute(const PoolRoute *route, int driverId, int originIndex,
+                             const double *fromPickup, const double *fromDropoff,
+                             double directDistance, PoolInsertion &best)
+{
+    int n = route ? route->stopCount : 0;
+    bool found = false;
+    for (int i = 0; i <= n; i++)
+    {
+        double pickupLeg = fromPickup[i];
+        if (pickupLeg < 0.0 || pickupLeg > maxPickupDistance)
+            continue;
+        double afterPickupLeg = i < n ? fromPickup[i + 1] : -1.0;
+
+        for (int j = i; j <= n; j++)
+        {
+            double afterDropoffLeg = j < n ? fromDropoff[j + 1] : 0.0;
+            double replacedLeg = j < n ? route->legs[j] : 0.0;
+            if (afterDropoffLeg < 0.0)
+                continue;
+
+            double dropoffLeg;
+            double added;
+            if (i == j)
+            {
+                dropoffLeg = directDistance;
+                added = pickupLeg + directDistance + afterDropoffLeg - replacedLeg;
+            }
+            else
+            {
+                dropoffLeg = fromDropoff[j];
+                if (afterPickupLeg < 0.0 || dropoffLeg < 0.0)
+                    continue;
+                added = pickupLeg + afterPickupLeg - route->legs[i] +
+                        dropoffLeg + afterDropoffLeg - replacedLeg;
+            }
+            if (added >= best.addedDistance)
+                continue;
+            if (!feasible(route, i, j, pickupLeg, afterPickupLeg, dropoffLeg, afterDropoffLeg, directDistance))
+                continue;
+
+            best.driverId = driverId;
+            best.originIndex = originIndex;
+            best.pickupPos = i;
+            best.dropoffPos = j;
+            best.addedDistance = added;
+            best.directDistance = directDistance;
+            best.pickupLeg = pickupLeg;
+            best.afterPickupLeg = afterPickupLeg;
+            best.dropoffLeg = dropoffLeg;
+            best.afterDropoffLeg = j < n ? afterDropoffLeg : -1.0;
+            found = true;
+        }
+    }
+    return found;
+}
+
+bool RidePool::findInsertion(int pickupIndex, int dropoffIndex, Driver *const idleDrivers[], int idleCount,
+                             PoolInsertion &best)
+{
+    Node *pickup = city->getNodeByIndex(pickupIndex);
+    Node *dropoff = city->getNodeByIndex(dropoffIndex);
+    if (!pickup || !dropoff)
+        return false;
+
+    // Targets: [dropoff] then, per candidate, origin followed by its stops
+    int targetCount = 1 + idleCount;
+    for (int r = 0; r < routeCount; r++)
+        targetCount += 1 + routes[r]->stopCount;
+    int *targets = new int[targetCount];
+    double *fromPickup = new double[targetCount];
+    double *fromDropoff = new double[targetCount];
+    int t = 0;
+    double longestLeg = 0.0;
+    targets[t++] = dropoffIndex;
+    for (int r = 0; r < routeCount; r++)
+    {
+        targets[t++] = routes[r]->originIndex;
+        for (int k = 0; k < routes[r]->stopCount; k++)
+        {
+            targets[t++] = routes[r]->stops[k].nodeIndex;
+            longestLeg = routes[r]->legs[k] > longestLeg ? routes[r]->legs[k] : longestLeg;
+        }
+    }
+    int *idleOrigins = new int[idleCount > 0 ? idleCount : 1];
+    for (int d = 0; d < idleCount; d++)
+    {
+        idleOrigins[d] = city->getNodeIndex(idleDrivers[d]->getCurrentNodeId());
+        targets[t++] = idleOrigins[d] >= 0 ? idleOrigins[d] : dropoffIndex;
+    }
+
+    // Two searches price every insertion position of every candidate. The
+    // stop before a feasible drop-off is within maxPickupDistance + ride limit
+    // of it, so by the triangle inequality the stop after it is within that
+    // plus the leg between them: the drop-off search can stop there.
+    city->findDistancesToNodes(pickup->id, targets, targetCount, fromPickup);
+    double directDistance = fromPickup[0];
+    double radius = maxPickupDistance + (directDistance > 0.0 ? directDistance : 0.0) * (1.0 + maxDetourRatio) +
+                    longestLeg;
+    city->findDistancesToNodes(dropoff->id, targets, targetCount, fromDropoff, radius);
+    searchCount += 2;
+
+    bool found = false;
+    best.driverId = -1;
+    best.addedDistance = 1e18;
+    if (directDistance >= 0.0)
+    {
+        t = 1;
+        for (int r = 0; r < routeCount; r++)
+        {
+            found = evaluateRoute(routes[r], routes[r]->driverId, routes[r]->originIndex,
+                                  fromPickup + t, fromDropoff + t, directDistance, best) || found;
+            t += 1 + routes[r]->stopCount;
+        }
+        for (int d = 0; d < idleCount; d++, t++)
+        {
+            int existing;
+            if (idleOrigins[d] < 0 || routeSlots.find(idleDrivers[d]->getDriverId(), existing))
+                continue;
+            found = evaluateRoute(nullptr, idleDrivers[d]->getDriverId(), idleOrigins[d],
+                                  fromPickup + t, fromDropoff + t, directDistance, best) || found;
+        }
+    }
+
+    delete[] targets;
+    delete[] fromPickup;
+    delete[] fromDropoff;
+    delete[] idleOrigins;
+    return found;
+}
+
+void RidePool::commitInsertion(int tripId, int pickupIndex, int dropoffIndex, const PoolInsertion &insertion)
+{
+    int slot;
+    PoolRoute *route = routeSlots.find(insertion.driverId, slot)
+                           ? routes[slot]
+                           : createRoute(insertion.driverId, insertion.originIndex);
+    growRoute(route, route->stopCount + 2);
+
+    int rider = allocRider(route);
+    route->riders[rider].tripId = tripId;
+    route->riders[rider].onBoard = false;
+    route->riders[rider].ridden = 0.0;
+    route->riders[rider].rideLimit = insertion.directDistance * (1.0 + maxDetourRatio);
+
+    // Drop-off first so the pickup position is unaffected
+    int i = insertion.pickupPos;
+    int j = insertion.dropoffPos;
+    for (int k = route->stopCount; k > j; k--)
+    {
+        route->stops[k] = route->stops[k - 1];
+        route->legs[k] = route->legs[k - 1];
+    }
+    route->stops[j].tripId = tripId;
+    route->stops[j].isPickup = false;
+    route->stops[j].nodeIndex = dropoffIndex;
+    route->stops[j].riderSlot = rider;
+    route->legs[j] = i == j ? insertion.directDistance : insertion.dropoffLeg;
+    route->stopCount++;
+    if (j + 1 < route->stopCount)
+        route->legs[j + 1] = insertion.afterDropoffLeg;
+
+    for (int k = route->stopCount; k > i; k--)
+    {
+        route->stops[k] = route->stops[k - 1];
+        route->legs[k] = route->legs[k - 1];
+    }
+    route->stops[i].tripId = tripId;
+    route->stops[i].isPickup = true;
+    route->stops[i].nodeIndex = pickupIndex;
+    route->stops[i].riderSlot = rider;
+    route->legs[i] = insertion.pickupLeg;
+    route->stopCount++;
+    if (i != j)
+        route->legs[i + 1] = insertion.afterPickupLeg;
+}
+
+bool RidePool::popNextStop(int driverId, PoolStop &stop)
+{
+    int slot;
+    if (!routeSlots.find(driverId, slot))
+        return false;
+    PoolRoute *route = routes[slot];
+    stop = route->stops[0];
+
+    double leg = route->legs[0];
+    for (int s = 0; s < route->capacity; s++)
+    {
+        if (route->riders[s].tripId >= 0 && route->riders[s].onBoard)
+            route->riders[s].ridden += leg;
+    }
+    PoolRider &rider = route->riders[stop.riderSlot];
+    if (stop.isPickup)
+    {
+        rider.onBoard = true;
+        rider.ridden = 0.0;
+        route->load++;
+    }
+    else
+    {
+        rider.tripId = -1;
+        route->load--;
+    }
+
+    route->originIndex = stop.nodeIndex;
+    for (int k = 1; k < route->stopCount; k++)
+    {
+        route->stops[k - 1] = route->stops[k];
+        route->legs[k - 1] = route->legs[k];
+    }
+    route->stopCount--;
+    if (route->stopCount == 0)
+        destroyRoute(driverId);
+    return true;
+}
+
+bool RidePool::removeTrip(int driverId, int tripId)
+{
+    int slot;
+    if (!routeSlots.find(driverId, slot))
+        return false;
+    PoolRoute *route = routes[slot];
+
+    bool removed = false;
+    for (int k = 0; k < route->stopCount;)
+    {
+        if (route->stops[k].tripId != tripId)
+        {
+            k++;
+            continue;
+        }
+        PoolRider &rider = route->riders[route->stops[k].riderSlot];
+        if (!route->stops[k].isPickup)
+        {
+            if (rider.onBoard)
+                route->load--;
+            rider.tripId = -1;
+        }
+        for (int m = k + 1; m < route->stopCount; m++)
+        {
+            route->stops[m - 1] = route->stops[m];
+            route->legs[m - 1] = route->legs[m];
+        }
+        route->stopCount--;
+        if (k < route->stopCount)
+        {
+            int previous = k == 0 ? route->originIndex : route->stops[k - 1].nodeIndex;
+            route->legs[k] = roadDistance(previous, route->stops[k].nodeIndex);
+        }
+        removed = true;
+    }
+
+    if (route->stopCount == 0)
+        destroyRoute(driverId);
+    return removed;
+}
+
+const PoolRoute *RidePool::getRoute(int driverId) const
+{
+    int slot;
+    return routeSlots.find(driverId, slot) ? routes[slot] : nullptr;
+}
+
+bool RidePool::hasStops(int driverId) const
+{
+    int slot;
+    return routeSlots.find(driverId, slot);
+}
+
+int RidePool::getRouteCount() const
+{
+    return routeCount;
+}
+
+long long RidePool::getSearchCount() const
+{
+    return searchCount;
+}
@@ -0,0 +1,123 @@
+#ifndef RIDEPOOL_H
+#define RIDEPOOL_H
+
+#include "city.h"
+#include "driver.h"
+#include "registry.h"
+
+// One stop on a pooled vehicle's route
+struct PoolStop
+{
+    int tripId;
+    bool isPickup;
+    int nodeIndex;    // Graph index of the stop node
+    int riderSlot;    // Index into PoolRoute::riders
+};
+
+// Rider sharing a vehicle. Detour is bounded by rideLimit on the distance
+// actually ridden between pickup and drop-off.
+struct PoolRider
+{
+    int tripId;       // -1 when the slot is free
+    bool onBoard;
+    double ridden;    // Distance travelled since pickup (while on board)
+    double rideLimit; // Direct distance * (1 + max detour ratio)
+};
+
+// Ordered stop list of one vehicle with the road distance of every leg cached.
+// legs[k] is the distance into stops[k] from the previous stop (k = 0: from
+// originIndex, the node the vehicle last served or started from).
+struct PoolRoute
+{
+    int driverId;
+    int originIndex;
+    int load;         // Riders on board
+    PoolStop *stops;
+    double *legs;
+    int stopCount;
+    PoolRider *riders;
+    int capacity;     // Size of stops[], legs[] and riders[]
+};
+
+// Best insertion found for a request, with the new leg distances the commit needs
+struct PoolInsertion
+{
+    int driverId;
+    int originIndex;        // Vehicle position when the route is new
+    int pickupPos;          // Insert pickup before stops[pickupPos]
+    int dropoffPos;         // Insert drop-off before stops[dropoffPos] (>= pickupPos)
+    double addedDistance;
+    double directDistance;  // Pickup -> drop-off
+    double pickupLeg;       // Into the pickup
+    double afterPickupLeg;  // Pickup -> old stops[pickupPos] (pickupPos < dropoffPos)
+    double dropoffLeg;      // Into the drop-off
+    double afterDropoffLeg; // Drop-off -> old stops[dropoffPos] (-1 when appended)
+};
+
+// Shared-ride routes, owned by DispatchEngine. A request is evaluated by
+// cheapest insertion of its pickup and drop-off into every candidate route:
+// two one-to-many searches (from the pickup and from the drop-off) give the
+// distance to every stop, so each (pickup, drop-off) position pair costs
+// O(1) to price and O(stops) to check seats, pickup wait and rider detours
+// against the cached legs. No path search runs per candidate position.
+class RidePool
+{
+private:
+    City *city;
+    int seats;
+    double maxDetourRatio;
+    double maxPickupDistance;
+
+    PoolRoute **routes;
+    int routeCount;
+    int routeCapacity;
+    IdMap routeSlots;       // driver id -> index in routes[]
+    long long searchCount;  // One-to-many searches run
+    double *startScratch;   // Pickup distance per rider slot during a feasibility walk
+    int scratchCapacity;
+
+    PoolRoute *createRoute(int driverId, int originIndex);
+    void destroyRoute(int driverId);
+    void growRoute(PoolRoute *route, int needed);
+    int allocRider(PoolRoute *route);
+    double roadDistance(int fromIndex, int toIndex);
+    bool feasible(const PoolRoute *route, int pickupPos, int dropoffPos,
+                  double pickupLeg, double afterPickupLeg, double dropoffLeg,
+                  double afterDropoffLeg, double directDistance);
+    bool evaluateRoute(const PoolRoute *route, int driverId, int originIndex,
+                       const double *fromPickup, const double *fromDropoff,
+                       double directDistance, PoolInsertion &best);
+
+public:
+    static const int MAX_SEATS = 8;
+
+    RidePool(City *c, int seatCount = 4, double detourRatio = 0.5, double pickupDistance = 3000.0);
+    ~RidePool();
+    RidePool(const RidePool &) = delete;
+    RidePool &operator=(const RidePool &) = delete;
+
+    void setSeats(int count);
+    void setMaxDetourRatio(double ratio);
+    void setMaxPickupDistance(double distance);
+    int getSeats() const;
+    double getMaxDetourRatio() const;
+    double getMaxPickupDistance() const;
+
+    // Cheapest feasible insertion over all pooled routes and the given idle
+    // drivers (as empty routes). False when nothing satisfies the bounds.
+    bool findInsertion(int pickupIndex, int dropoffIndex, Driver *const idleDrivers[], int idleCount,
+                       PoolInsertion &best);
+    void commitInsertion(int tripId, int pickupIndex, int dropoffIndex, const PoolInsertion &insertion);
+
+    // Vehicle reached its next stop: pop it and update loads and ridden distances
+    bool popNextStop(int driverId, PoolStop &stop);
+    // Drop a trip's remaining stops (cancellation); joined legs are re-measured
+    bool removeTrip(int driverId, int tripId);
+
+    const PoolRoute *getRoute(int driverId) const;
+    bool hasStops(int driverId) const;
+    int getRouteCount() const;
+    long long getSearchCount() const;
+};
+
+#endif // RIDEPOOL_H
@@ -5,7 +5,7 @@
 RideShareSystem::RideShareSystem(City *c)
     : city(c), nextTripId(1), nextRiderId(1)
 {
-    dispatchEngine = new DispatchEngine(c, 100, 200);
+    dispatchEngine = new DispatchEngine(c, 100, 200);  // Initial capacities; both grow
 }
 
 RideShareSystem::~RideShareSystem()
@@ -94,13 +94,7 @@ bool RideShareSystem::rollbackLastOperation()
     if (!rollback || !rollback->canRollback())
         return false;
 
-    Trip **trips = new Trip *[dispatchEngine->getTripCount()];
-    for (int i = 0; i < dispatchEngine->getTripCount(); i++)
-        trips[i] = dispatchEngine->getTrip(i + 1);
-
-    bool result = rollback->rollbackLast(trips, dispatchEngine->getTripCount(),
-                                        dispatchEngine);
-    delete[] trips;
+    bool result = rollback->rollbackLast(dispatchEngine);
 
     if (result)
         std::cout << "[ROLLBACK] Last operation rolled back" << std::endl;
@@ -114,13 +108,7 @@ bool RideShareSystem::rollbackLastKOperations(int k)
     if (!rollback || !rollback->canRollback())
         return false;
 
-    Trip **trips = new Trip *[dispatchEngine->getTripCount()];
-    for (int i = 0; i < dispatchEngine->getTripCount(); i++)
-        trips[i] = dispatchEngine->getTrip(i + 1);
-
-    bool result = rollback->rollbackLastK(k, trips, dispatchEngine->getTripCount(),
-                                         dispatchEngine);
-    delete[] trips;
+    bool result = rollback->rollbackLastK(k, dispatchEngine);
 
     if (result)
         std::cout << "[ROLLBACK] Last " << k << " operations rolled back" << std::endl;
@@ -135,15 +123,16 @@ AnalyticsData RideShareSystem::getAnalytics() const
 
     for (int i = 1; i <= dispatchEngine->getTripCount(); i++)
     {
-        Trip *trip = dispatchEngine->getTrip(i);
-        if (trip)
+        // Archived trips count too
+        TripRecord record;
+        if (dispatchEngine->findTripRecord(i, record))
         {
             data.totalTrips++;
-            if (trip->getState() == COMPLETED)
+            if (record.state == COMPLETED)
                 data.completedTrips++;
-            else if (trip->getState() == CANCELLED)
+            else if (record.state == CANCELLED)
                 data.cancelledTrips++;
-            data.totalDistance += trip->getTotalDistance();
+            data.totalDistance += record.totalDistance;
         }
     }
 
@@ -162,15 +151,7 @@ double RideShareSystem::getDriverUtilizationPercentage() const
 {
     // Percentage of drivers with assigned trips
     int activeCount = dispatchEngine->getActiveTripsCount();
-    int totalDrivers = 0;
-
-    for (int i = 1; i <= 100; i++)
-    {
-        if (getDriver(i))
-            totalDrivers++;
-        else
-            break;
-    }
+    int totalDrivers = dispatchEngine->getDriverCount();
 
     if (totalDrivers == 0)
         return 0.0;
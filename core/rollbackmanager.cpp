@@ -4,7 +4,8 @@
 #include <cstring>
 
 RollbackManager::RollbackManager(int maxOps)
-    : snapshotStack(nullptr), operationCount(0), maxOperations(maxOps)
+    : snapshotStack(nullptr), operationCount(0), maxOperations(maxOps),
+      sequenceSource(nullptr), localSequence(0)
 {
 }
 
@@ -13,10 +14,29 @@ RollbackManager::~RollbackManager()
     clearHistory();
 }
 
+long long RollbackManager::nextSequence()
+{
+    if (sequenceSource)
+        return sequenceSource->fetch_add(1);
+    return localSequence++;
+}
+
+void RollbackManager::setSequenceSource(std::atomic<long long> *source)
+{
+    sequenceSource = source;
+}
+
+long long RollbackManager::getLastSequence() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return snapshotStack ? snapshotStack->sequence : -1;
+}
+
 void RollbackManager::recordSnapshot(int opType, int tripId, int driverId,
                                     TripState state, bool driverAvail, const char *driverLoc,
                                     int riderId, const char *riderLoc, bool driverNewAvail, const char *riderCode)
 {
+    std::lock_guard<std::mutex> guard(lock);
     if (operationCount >= maxOperations)
         return;
 
@@ -47,6 +67,7 @@ void RollbackManager::recordSnapshot(int opType, int tripId, int driverId,
         snap->riderCode[sizeof(snap->riderCode) - 1] = '\0';
     }
     
+    snap->sequence = nextSequence();
     snap->next = snapshotStack;
     
     snapshotStack = snap;
@@ -58,6 +79,7 @@ void RollbackManager::recordHistorySnapshot(int tripId, int riderId, int driverI
                                             const char *status, double fare, double distance,
                                             const char *riderCode)
 {
+    std::lock_guard<std::mutex> guard(lock);
     if (operationCount >= maxOperations)
         return;
 
@@ -89,31 +111,23 @@ void RollbackManager::recordHistorySnapshot(int tripId, int riderId, int driverI
         snap->riderCode[sizeof(snap->riderCode) - 1] = '\0';
     }
 
+    snap->sequence = nextSequence();
     snap->next = snapshotStack;
     snapshotStack = snap;
     operationCount++;
 }
 
-bool RollbackManager::rollbackLast(Trip **trips, int tripCount,
-                                  DispatchEngine *engine)
+bool RollbackManager::rollbackLast(DispatchEngine *engine)
 {
-    if (!snapshotStack || !engine)
+    std::unique_lock<std::mutex> guard(lock);
+    OperationSnapshot *snap = snapshotStack;
+    guard.unlock();
+    if (!snap || !engine)
         return false;
 
-    OperationSnapshot *snap = snapshotStack;
-    Trip *trip = nullptr;
+    Trip *trip = engine->getTrip(snap->tripId);
     Driver *driver = nullptr;
 
-    // Find trip
-    for (int i = 0; i < tripCount; i++)
-    {
-        if (trips[i] && trips[i]->getTripId() == snap->tripId)
-        {
-            trip = trips[i];
-            break;
-        }
-    }
-
     if (!trip)
         return false;
 
@@ -122,7 +136,7 @@ bool RollbackManager::rollbackLast(Trip **trips, int tripCount,
     // Restore based on operation type
     if (snap->operationType == 0) // ASSIGN
     {
-        trip->setState(snap->previousState);
+        engine->restoreTripState(trip, snap->previousState);
         if (driver)
         {
             driver->setAvailable(snap->driverWasAvailable);
@@ -136,7 +150,7 @@ bool RollbackManager::rollbackLast(Trip **trips, int tripCount,
     }
     else if (snap->operationType == 1) // CANCEL
     {
-        trip->setState(snap->previousState);
+        engine->restoreTripState(trip, snap->previousState);
         if (driver && snap->driverId != -1)
         {
             driver->setAvailable(snap->driverWasAvailable);
@@ -151,7 +165,7 @@ bool RollbackManager::rollbackLast(Trip **trips, int tripCount,
     }
     else if (snap->operationType == 2) // COMPLETE
     {
-        trip->setState(snap->previousState);
+        engine->restoreTripState(trip, snap->previousState);
         if (driver)
         {
             driver->setAvailable(snap->driverWasAvailable);
@@ -189,20 +203,21 @@ bool RollbackManager::rollbackLast(Trip **trips, int tripCount,
         }
     }
 
-    // Pop snapshot
+    // Pop snapshot; nothing records during a rollback, so it is still on top
+    guard.lock();
     snapshotStack = snap->next;
-    delete snap;
     operationCount--;
+    guard.unlock();
+    delete snap;
 
     return true;
 }
 
-bool RollbackManager::rollbackLastK(int k, Trip **trips, int tripCount,
-                                   DispatchEngine *engine)
+bool RollbackManager::rollbackLastK(int k, DispatchEngine *engine)
 {
     for (int i = 0; i < k; i++)
     {
-        if (!rollbackLast(trips, tripCount, engine))
+        if (!rollbackLast(engine))
             return false;
     }
     return true;
@@ -210,6 +225,7 @@ bool RollbackManager::rollbackLastK(int k, Trip **trips, int tripCount,
 
 void RollbackManager::clearHistory()
 {
+    std::lock_guard<std::mutex> guard(lock);
     OperationSnapshot *current = snapshotStack;
     while (current != nullptr)
     {
@@ -223,16 +239,19 @@ void RollbackManager::clearHistory()
 
 int RollbackManager::getOperationCount() const
 {
+    std::lock_guard<std::mutex> guard(lock);
     return operationCount;
 }
 
 bool RollbackManager::canRollback() const
 {
+    std::lock_guard<std::mutex> guard(lock);
     return snapshotStack != nullptr;
 }
 
 void RollbackManager::displayHistory() const
 {
+    std::lock_guard<std::mutex> guard(lock);
     std::cout << "\n=== OPERATION HISTORY (" << operationCount << ") ===" << std::endl;
     OperationSnapshot *current = snapshotStack;
     int idx = 1;
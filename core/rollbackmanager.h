@@ -3,6 +3,8 @@
 
 #include "trip.h"
 #include "driver.h"
+#include <atomic>
+#include <mutex>
 
 // Snapshot of an operation for rollback
 struct OperationSnapshot
@@ -23,10 +25,11 @@ struct OperationSnapshot
     double fare;
     double distance;
     char riderCode[16];       // e.g., R07
+    long long sequence;       // Order across all managers sharing a sequence source
     OperationSnapshot *next;
     
     OperationSnapshot() : operationType(-1), tripId(-1), riderId(-1), driverId(-1), 
-                         previousState(REQUESTED), driverWasAvailable(true), driverNewAvailable(true), fare(0.0), distance(0.0), next(nullptr) {
+                         previousState(REQUESTED), driverWasAvailable(true), driverNewAvailable(true), fare(0.0), distance(0.0), sequence(-1), next(nullptr) {
         driverLocation[0] = '\0';
         riderLocation[0] = '\0';
         details[0] = '\0';
@@ -42,6 +45,11 @@ private:
     OperationSnapshot *snapshotStack;
     int operationCount;
     int maxOperations;
+    std::atomic<long long> *sequenceSource;  // Shared counter, or null for a local one
+    long long localSequence;
+    mutable std::mutex lock;   // Snapshots are recorded by every thread the engine runs on
+
+    long long nextSequence();
 
 public:
     RollbackManager(int maxOps = 100);
@@ -59,13 +67,16 @@ public:
                                const char *status, double fare, double distance,
                                const char *riderCode);
 
-    // Rollback last operation
-    bool rollbackLast(Trip **trips, int tripCount, 
-                     class DispatchEngine *engine);
+    // Rollback last operation (trip and driver looked up by id in the engine)
+    bool rollbackLast(class DispatchEngine *engine);
 
     // Rollback last k operations
-    bool rollbackLastK(int k, Trip **trips, int tripCount,
-                      class DispatchEngine *engine);
+    bool rollbackLastK(int k, class DispatchEngine *engine);
+
+    // Stamp snapshots from a counter shared with other managers (zone shards),
+    // so the newest operation across all of them can be found
+    void setSequenceSource(std::atomic<long long> *source);
+    long long getLastSequence() const;  // -1 when empty
 
     // Clear history
     void clearHistory();
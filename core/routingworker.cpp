@@ -0,0 +1,97 @@
+#include "routingworker.h"
+#include <chrono>
+
+RoutingWorker::RoutingWorker(City *c)
+    : city(c), queueHead(nullptr), queueTail(nullptr), doneHead(nullptr), doneTail(nullptr),
+      queued(0), stopping(false)
+{
+    thread = std::thread(&RoutingWorker::run, this);
+}
+
+RoutingWorker::~RoutingWorker()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    thread.join();
+
+    RouteJob *lists[2] = {queueHead, doneHead};
+    for (int l = 0; l < 2; l++)
+    {
+        while (lists[l])
+        {
+            RouteJob *job = lists[l];
+            lists[l] = job->next;
+            delete job;
+        }
+    }
+}
+
+void RoutingWorker::run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        wake.wait(lock, [this]() { return stopping || queueHead != nullptr; });
+        if (stopping)
+            return;
+
+        RouteJob *job = queueHead;
+        queueHead = job->next;
+        if (!queueHead)
+            queueTail = nullptr;
+        job->next = nullptr;
+        lock.unlock();
+
+        // A cancellation that lands between the two searches skips the second
+        if (!job->cancelled.load())
+            job->driverPath = city->findShortestPathAStar(job->driverNodeId, job->pickupNodeId);
+        if (!job->cancelled.load())
+        {
+            job->riderPath = city->findShortestPathAStar(job->pickupNodeId, job->dropoffNodeId);
+            job->routed = true;
+        }
+
+        lock.lock();
+        queued--;
+        if (doneTail)
+            doneTail->next = job;
+        else
+            doneHead = job;
+        doneTail = job;
+        finished.notify_all();
+    }
+}
+
+void RoutingWorker::submit(RouteJob *job)
+{
+    job->next = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (queueTail)
+            queueTail->next = job;
+        else
+            queueHead = job;
+        queueTail = job;
+        queued++;
+    }
+    wake.notify_one();
+}
+
+RouteJob *RoutingWorker::collect(int waitMs)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!doneHead && waitMs > 0)
+        finished.wait_for(lock, std::chrono::milliseconds(waitMs), [this]() { return doneHead != nullptr; });
+    RouteJob *jobs = doneHead;
+    doneHead = doneTail = nullptr;
+    return jobs;
+}
+
+int RoutingWorker::getQueuedCount()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return queued;
+}
@@ -0,0 +1,64 @@
+#ifndef ROUTINGWORKER_H
+#define ROUTINGWORKER_H
+
+#include "city.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// Both legs of one reserved assignment, routed off the caller's thread
+struct RouteJob
+{
+    int tripId;
+    int driverId;
+    char driverNodeId[MAX_STRING_LENGTH];
+    char pickupNodeId[MAX_STRING_LENGTH];    // Effective (route node) pickup
+    char dropoffNodeId[MAX_STRING_LENGTH];
+    std::atomic<bool> cancelled;             // Set by the owner; the worker skips remaining searches
+    bool routed;                             // Both searches ran
+    PathResult driverPath;                   // Driver -> pickup
+    PathResult riderPath;                    // Pickup -> drop-off
+    RouteJob *next;
+
+    RouteJob() : tripId(-1), driverId(-1), cancelled(false), routed(false), next(nullptr)
+    {
+        driverNodeId[0] = pickupNodeId[0] = dropoffNodeId[0] = '\0';
+    }
+};
+
+// One background thread running A* for queued jobs, first in first out. The
+// city graph is read through its published snapshot, so searches need no lock
+// against the owner. Jobs are allocated by the owner, handed over by submit()
+// and handed back through collect(); the worker never touches engine state.
+class RoutingWorker
+{
+private:
+    City *city;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;       // Worker: a job was queued or stop was requested
+    std::condition_variable finished;   // Owner: a job was routed
+    RouteJob *queueHead;
+    RouteJob *queueTail;
+    RouteJob *doneHead;
+    RouteJob *doneTail;
+    int queued;
+    bool stopping;
+
+    void run();
+
+public:
+    RoutingWorker(City *c);
+    ~RoutingWorker();   // Stops the thread and deletes jobs not yet collected
+    RoutingWorker(const RoutingWorker &) = delete;
+    RoutingWorker &operator=(const RoutingWorker &) = delete;
+
+    void submit(RouteJob *job);
+    // Routed jobs in completion order (linked by next), or nullptr. Waits up
+    // to waitMs for the first one when none is ready.
+    RouteJob *collect(int waitMs = 0);
+    int getQueuedCount();
+};
+
+#endif // ROUTINGWORKER_H
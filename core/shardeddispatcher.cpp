@@ -0,0 +1,459 @@
+#include "shardeddispatcher.h"
+#include <cstring>
+#include <chrono>
+
+static const char *SHARD_ZONES[] = {"zone1", "zone2", "zone3", "zone4", "Highway Zone"};
+
+ShardedDispatcher::ShardedDispatcher(City *c, int count, int maxT, int inboxCapacity)
+    : city(c), shards(nullptr), shardCount(count > 0 ? count : ZONE_COUNT),
+      maxTrips(maxT > 0 ? maxT : 10000), running(false), pauseRequested(false), outstanding(0),
+      nextTripId(1), nextDriverId(1), operationSequence(0), tripOwner(nullptr),
+      assignedCount(0), unassignedCount(0), handoffCount(0), migrationCount(0)
+{
+    shards = new Shard[shardCount];
+    for (int i = 0; i < shardCount; i++)
+    {
+        shards[i].engine = new DispatchEngine(city, 64, 256);
+        shards[i].engine->getRollbackManager()->setSequenceSource(&operationSequence);
+        shards[i].inbox = new LockFreeQueue<ShardCommand>(inboxCapacity > 0 ? inboxCapacity : INBOX_CAPACITY);
+        shards[i].paused.store(false);
+        shards[i].processed.store(0);
+        shards[i].overflow = nullptr;
+        shards[i].overflowTarget = nullptr;
+        shards[i].overflowCount = 0;
+        shards[i].overflowCapacity = 0;
+    }
+
+    tripOwner = new std::atomic<int>[maxTrips + 1];
+    for (int i = 0; i <= maxTrips; i++)
+        tripOwner[i].store(TRIP_PENDING, std::memory_order_relaxed);
+}
+
+ShardedDispatcher::~ShardedDispatcher()
+{
+    stop();
+    for (int i = 0; i < shardCount; i++)
+    {
+        delete shards[i].engine;
+        delete shards[i].inbox;
+        delete[] shards[i].overflow;
+        delete[] shards[i].overflowTarget;
+    }
+    delete[] shards;
+    delete[] tripOwner;
+}
+
+// Zones map to shards round-robin; nodes outside the known zones go to shard 0
+int ShardedDispatcher::shardForNode(const char *nodeId) const
+{
+    Node *node = nodeId ? city->getNode(nodeId) : nullptr;
+    if (!node)
+        return 0;
+    for (int z = 0; z < ZONE_COUNT; z++)
+    {
+        if (strcmp(node->zone, SHARD_ZONES[z]) == 0)
+            return z % shardCount;
+    }
+    return 0;
+}
+
+void ShardedDispatcher::push(int shard, const ShardCommand &command)
+{
+    outstanding.fetch_add(1);
+    while (!shards[shard].inbox->tryPush(command))
+        std::this_thread::yield();  // Inbox full: wait for the worker to catch up
+}
+
+// Shard-to-shard traffic from a worker. Waiting here could deadlock a ring of
+// workers whose inboxes are all full, so a command that does not fit goes to
+// the sender's overflow list instead. Commands already waiting there go
+// first, which keeps each target's commands in order.
+void ShardedDispatcher::forward(int from, int to, const ShardCommand &command)
+{
+    Shard &self = shards[from];
+    outstanding.fetch_add(1);
+    if (self.overflowCount == 0 && shards[to].inbox->tryPush(command))
+        return;
+
+    if (self.overflowCount == self.overflowCapacity)
+    {
+        int newCapacity = self.overflowCapacity > 0 ? self.overflowCapacity * 2 : 64;
+        ShardCommand *newOverflow = new ShardCommand[newCapacity];
+        int *newTarget = new int[newCapacity];
+        for (int i = 0; i < self.overflowCount; i++)
+        {
+            newOverflow[i] = self.overflow[i];
+            newTarget[i] = self.overflowTarget[i];
+        }
+        delete[] self.overflow;
+        delete[] self.overflowTarget;
+        self.overflow = newOverflow;
+        self.overflowTarget = newTarget;
+        self.overflowCapacity = newCapacity;
+    }
+    self.overflow[self.overflowCount] = command;
+    self.overflowTarget[self.overflowCount] = to;
+    self.overflowCount++;
+}
+
+// Retry the overflow list in order. Once a target refuses a command, its
+// later commands stay behind it.
+void ShardedDispatcher::flushOverflow(int shard)
+{
+    Shard &self = shards[shard];
+    bool *blocked = nullptr;
+    int kept = 0;
+    for (int i = 0; i < self.overflowCount; i++)
+    {
+        int to = self.overflowTarget[i];
+        if ((!blocked || !blocked[to]) && shards[to].inbox->tryPush(self.overflow[i]))
+            continue;
+        if (!blocked)
+        {
+            blocked = new bool[shardCount];
+            for (int s = 0; s < shardCount; s++)
+                blocked[s] = false;
+        }
+        blocked[to] = true;
+        self.overflow[kept] = self.overflow[i];
+        self.overflowTarget[kept] = to;
+        kept++;
+    }
+    self.overflowCount = kept;
+    delete[] blocked;
+}
+
+void ShardedDispatcher::start()
+{
+    if (running.exchange(true))
+        return;
+    for (int i = 0; i < shardCount; i++)
+        shards[i].worker = std::thread(&ShardedDispatcher::workerLoop, this, i);
+}
+
+void ShardedDispatcher::stop()
+{
+    if (!running.exchange(false))
+        return;
+    for (int i = 0; i < shardCount; i++)
+    {
+        if (shards[i].worker.joinable())
+            shards[i].worker.join();
+    }
+}
+
+void ShardedDispatcher::drain()
+{
+    while (running.load() && outstanding.load() > 0)
+        std::this_thread::yield();
+}
+
+void ShardedDispatcher::workerLoop(int shard)
+{
+    Shard &self = shards[shard];
+    int idleSpins = 0;
+    while (running.load())
+    {
+        if (pauseRequested.load())
+        {
+            self.paused.store(true);
+            while (pauseRequested.load() && running.load())
+                std::this_thread::yield();
+            self.paused.store(false);
+            continue;
+        }
+
+        if (self.overflowCount > 0)
+            flushOverflow(shard);
+
+        ShardCommand command;
+        if (!self.inbox->tryPop(command))
+        {
+            if (++idleSpins < 64)
+                std::this_thread::yield();
+            else
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            continue;
+        }
+        idleSpins = 0;
+        handle(shard, command);
+        self.processed.fetch_add(1, std::memory_order_relaxed);
+        outstanding.fetch_sub(1);
+    }
+}
+
+void ShardedDispatcher::handle(int shard, ShardCommand &command)
+{
+    DispatchEngine *engine = shards[shard].engine;
+    switch (command.type)
+    {
+        case SHARD_ADD_DRIVER:
+        {
+            Node *node = city->getNode(command.pickupNodeId);
+            engine->addDriver(command.driverId, command.pickupNodeId, node ? node->zone : "",
+                              !command.migrated);
+            break;
+        }
+        case SHARD_REQUEST_TRIP:
+            handleRequest(shard, command);
+            break;
+        case SHARD_COMPLETE_TRIP:
+            handleComplete(shard, command);
+            break;
+        case SHARD_CANCEL_TRIP:
+            engine->cancelTrip(command.tripId);
+            break;
+    }
+}
+
+// Assign from this shard's drivers, or hand the request to the next shard
+void ShardedDispatcher::handleRequest(int shard, ShardCommand &command)
+{
+    DispatchEngine *engine = shards[shard].engine;
+    int driverId = -1;
+    if (engine->getAvailableDriverCount() > 0 &&
+        engine->requestTrip(command.tripId, command.riderId, command.pickupNodeId, command.dropoffNodeId))
+    {
+        driverId = engine->assignNearestDriver(command.tripId);
+        if (driverId < 0)
+            engine->cancelTrip(command.tripId);  // No reachable driver here
+    }
+
+    if (driverId >= 0)
+    {
+        tripOwner[command.tripId].store(shard);
+        assignedCount.fetch_add(1);
+        return;
+    }
+
+    command.hops++;
+    if (command.hops >= shardCount)
+    {
+        tripOwner[command.tripId].store(TRIP_UNASSIGNED);
+        unassignedCount.fetch_add(1);
+        return;
+    }
+    handoffCount.fetch_add(1);
+    forward(shard, (shard + 1) % shardCount, command);
+}
+
+// Drive an assigned trip straight to its drop-off; a driver that ends up in
+// another zone moves to that zone's shard
+void ShardedDispatcher::handleComplete(int shard, const ShardCommand &command)
+{
+    DispatchEngine *engine = shards[shard].engine;
+    Trip *trip = engine->getTrip(command.tripId);
+    if (!trip)
+        return;
+    if (trip->getState() == ASSIGNED)
+        engine->startPickupMovement(command.tripId);
+    if (trip->getState() == PICKUP_IN_PROGRESS)
+        engine->startTrip(command.tripId);
+
+    int driverId = trip->getDriverId();
+    if (!engine->completeTrip(command.tripId))
+        return;
+
+    Driver *driver = engine->getDriver(driverId);
+    if (!driver)
+        return;
+    int target = shardForNode(driver->getCurrentNodeId());
+    if (target == shard)
+        return;
+
+    ShardCommand move;
+    move.type = SHARD_ADD_DRIVER;
+    move.tripId = -1;
+    move.riderId = -1;
+    move.driverId = driverId;
+    move.hops = 0;
+    move.migrated = true;
+    strcpy(move.pickupNodeId, driver->getCurrentNodeId());
+    move.dropoffNodeId[0] = '\0';
+    engine->removeDriver(driverId);
+    migrationCount.fetch_add(1);
+    forward(shard, target, move);
+}
+
+int ShardedDispatcher::addDriver(const char *nodeId)
+{
+    if (!nodeId || strlen(nodeId) >= MAX_STRING_LENGTH)
+        return -1;
+    ShardCommand command;
+    command.type = SHARD_ADD_DRIVER;
+    command.tripId = -1;
+    command.riderId = -1;
+    command.driverId = nextDriverId.fetch_add(1);
+    command.hops = 0;
+    command.migrated = false;
+    strcpy(command.pickupNodeId, nodeId);
+    command.dropoffNodeId[0] = '\0';
+    push(shardForNode(nodeId), command);
+    return command.driverId;
+}
+
+int ShardedDispatcher::requestTrip(int riderId, const char *pickupNodeId, const char *dropoffNodeId)
+{
+    if (!pickupNodeId || !dropoffNodeId ||
+        strlen(pickupNodeId) >= MAX_STRING_LENGTH || strlen(dropoffNodeId) >= MAX_STRING_LENGTH)
+        return -1;
+    int tripId = nextTripId.fetch_add(1);
+    if (tripId > maxTrips)
+        return -1;
+
+    ShardCommand command;
+    command.type = SHARD_REQUEST_TRIP;
+    command.tripId = tripId;
+    command.riderId = riderId;
+    command.driverId = -1;
+    command.hops = 0;
+    command.migrated = false;
+    strcpy(command.pickupNodeId, pickupNodeId);
+    strcpy(command.dropoffNodeId, dropoffNodeId);
+    push(shardForNode(pickupNodeId), command);
+    return tripId;
+}
+
+bool ShardedDispatcher::completeTrip(int tripId)
+{
+    int owner = getTripOwner(tripId);
+    if (owner < 0)
+        return false;
+    ShardCommand command;
+    command.type = SHARD_COMPLETE_TRIP;
+    command.tripId = tripId;
+    command.riderId = -1;
+    command.driverId = -1;
+    command.hops = 0;
+    command.migrated = false;
+    command.pickupNodeId[0] = '\0';
+    command.dropoffNodeId[0] = '\0';
+    push(owner, command);
+    return true;
+}
+
+bool ShardedDispatcher::cancelTrip(int tripId)
+{
+    int owner = getTripOwner(tripId);
+    if (owner < 0)
+        return false;
+    ShardCommand command;
+    command.type = SHARD_CANCEL_TRIP;
+    command.tripId = tripId;
+    command.riderId = -1;
+    command.driverId = -1;
+    command.hops = 0;
+    command.migrated = false;
+    command.pickupNodeId[0] = '\0';
+    command.dropoffNodeId[0] = '\0';
+    push(owner, command);
+    return true;
+}
+
+void ShardedDispatcher::pauseWorkers()
+{
+    pauseRequested.store(true);
+    if (!running.load())
+        return;
+    for (int i = 0; i < shardCount; i++)
+    {
+        while (!shards[i].paused.load())
+            std::this_thread::yield();
+    }
+}
+
+void ShardedDispatcher::resumeWorkers()
+{
+    pauseRequested.store(false);
+}
+
+// Bring a driver that migrated after the operation back to the shard whose
+// snapshot refers to it, so the rollback can restore it there
+void ShardedDispatcher::reclaimDriver(int shard, int driverId)
+{
+    DispatchEngine *engine = shards[shard].engine;
+    if (driverId < 0 || engine->getDriver(driverId))
+        return;
+    for (int i = 0; i < shardCount; i++)
+    {
+        Driver *driver = shards[i].engine->getDriver(driverId);
+        if (!driver)
+            continue;
+        char nodeId[MAX_STRING_LENGTH];
+        strcpy(nodeId, driver->getCurrentNodeId());
+        Node *node = city->getNode(nodeId);
+        shards[i].engine->removeDriver(driverId);
+        engine->addDriver(driverId, nodeId, node ? node->zone : "", false);
+        return;
+    }
+}
+
+// With every worker parked, the shard holding the highest sequence number
+// has the newest operation in the system
+bool ShardedDispatcher::rollbackLast()
+{
+    pauseWorkers();
+    int best = -1;
+    long long bestSequence = -1;
+    for (int i = 0; i < shardCount; i++)
+    {
+        long long sequence = shards[i].engine->getRollbackManager()->getLastSequence();
+        if (sequence > bestSequence)
+        {
+            bestSequence = sequence;
+            best = i;
+        }
+    }
+    if (best >= 0)
+        reclaimDriver(best, shards[best].engine->getRollbackManager()->getSnapshotStack()->driverId);
+    bool ok = best >= 0 &&
+              shards[best].engine->getRollbackManager()->rollbackLast(shards[best].engine);
+    resumeWorkers();
+    return ok;
+}
+
+int ShardedDispatcher::getShardCount() const
+{
+    return shardCount;
+}
+
+int ShardedDispatcher::getTripOwner(int tripId) const
+{
+    if (tripId < 1 || tripId > maxTrips)
+        return TRIP_UNASSIGNED;
+    return tripOwner[tripId].load();
+}
+
+int ShardedDispatcher::getAssignedCount() const
+{
+    return assignedCount.load();
+}
+
+int ShardedDispatcher::getUnassignedCount() const
+{
+    return unassignedCount.load();
+}
+
+int ShardedDispatcher::getHandoffCount() const
+{
+    return handoffCount.load();
+}
+
+int ShardedDispatcher::getMigrationCount() const
+{
+    return migrationCount.load();
+}
+
+long long ShardedDispatcher::getProcessedCount(int shard) const
+{
+    if (shard < 0 || shard >= shardCount)
+        return 0;
+    return shards[shard].processed.load();
+}
+
+DispatchEngine *ShardedDispatcher::getShardEngine(int shard) const
+{
+    if (shard < 0 || shard >= shardCount)
+        return nullptr;
+    return shards[shard].engine;
+}
@@ -0,0 +1,132 @@
+#ifndef SHARDEDDISPATCHER_H
+#define SHARDEDDISPATCHER_H
+
+#include "city.h"
+#include "dispatchengine.h"
+#include "lockfreequeue.h"
+#include <atomic>
+#include <thread>
+
+// Work item for a shard worker
+enum ShardCommandType
+{
+    SHARD_ADD_DRIVER,
+    SHARD_REQUEST_TRIP,
+    SHARD_COMPLETE_TRIP,  // Fast-forward an assigned trip to its drop-off
+    SHARD_CANCEL_TRIP
+};
+
+struct ShardCommand
+{
+    int type;
+    int tripId;
+    int riderId;
+    int driverId;
+    int hops;                           // Shards that already tried this request
+    bool migrated;                      // Driver handed over from another shard
+    char pickupNodeId[MAX_STRING_LENGTH];
+    char dropoffNodeId[MAX_STRING_LENGTH];
+};
+
+// Dispatch split by zone (zone1-zone4 and the Highway Zone). Each shard is a
+// DispatchEngine owned by one worker thread, so engine state needs no locks.
+// Callers submit commands into the shard's lock-free inbox:
+//   - requests go to the pickup zone's shard; a shard without a reachable
+//     free driver hands the request to the next shard until all have tried
+//   - drivers that finish a trip in another zone move to that zone's shard
+// A worker never waits on another shard's inbox: when the target is full,
+// the hand-off or migration goes to the worker's own overflow list and is
+// retried on its next loop, so a ring of busy shards cannot stall.
+// Trip and driver ids come from global atomic counters, and all shard
+// rollback managers stamp snapshots from one shared sequence, so
+// rollbackLast() undoes the newest operation across the whole system.
+class ShardedDispatcher
+{
+private:
+    static const int ZONE_COUNT = 5;
+    static const int INBOX_CAPACITY = 4096;
+
+    struct Shard
+    {
+        DispatchEngine *engine;
+        LockFreeQueue<ShardCommand> *inbox;
+        std::thread worker;
+        std::atomic<bool> paused;
+        std::atomic<long long> processed;
+
+        // Commands this shard's worker could not forward yet (worker-only)
+        ShardCommand *overflow;
+        int *overflowTarget;
+        int overflowCount;
+        int overflowCapacity;
+    };
+
+    City *city;
+    Shard *shards;
+    int shardCount;
+    int maxTrips;
+
+    std::atomic<bool> running;
+    std::atomic<bool> pauseRequested;
+    std::atomic<int> outstanding;       // Commands pushed but not yet handled
+    std::atomic<int> nextTripId;
+    std::atomic<int> nextDriverId;
+    std::atomic<long long> operationSequence;
+
+    // Trip id -> owning shard, TRIP_PENDING or TRIP_UNASSIGNED
+    std::atomic<int> *tripOwner;
+    std::atomic<int> assignedCount;
+    std::atomic<int> unassignedCount;
+    std::atomic<int> handoffCount;
+    std::atomic<int> migrationCount;
+
+    int shardForNode(const char *nodeId) const;
+    void push(int shard, const ShardCommand &command);
+    void forward(int from, int to, const ShardCommand &command);
+    void flushOverflow(int shard);
+    void workerLoop(int shard);
+    void handle(int shard, ShardCommand &command);
+    void handleRequest(int shard, ShardCommand &command);
+    void handleComplete(int shard, const ShardCommand &command);
+    void reclaimDriver(int shard, int driverId);
+    void pauseWorkers();
+    void resumeWorkers();
+
+public:
+    static const int TRIP_PENDING = -1;
+    static const int TRIP_UNASSIGNED = -2;
+
+    // shardCount 5 gives one shard per zone; fewer shards share zones round-robin
+    ShardedDispatcher(City *c, int shardCount = ZONE_COUNT, int maxTrips = 10000,
+                      int inboxCapacity = INBOX_CAPACITY);
+    ~ShardedDispatcher();
+    ShardedDispatcher(const ShardedDispatcher &) = delete;
+    ShardedDispatcher &operator=(const ShardedDispatcher &) = delete;
+
+    void start();
+    void stop();
+    void drain();  // Wait until every submitted command has been handled
+
+    // Submission (any thread). Return the new id, or -1 when out of ids.
+    int addDriver(const char *nodeId);
+    int requestTrip(int riderId, const char *pickupNodeId, const char *dropoffNodeId);
+    bool completeTrip(int tripId);
+    bool cancelTrip(int tripId);
+
+    // Undo the newest recorded operation across all shards
+    bool rollbackLast();
+
+    // Queries
+    int getShardCount() const;
+    int getTripOwner(int tripId) const;
+    int getAssignedCount() const;
+    int getUnassignedCount() const;
+    int getHandoffCount() const;        // Requests passed on to another shard
+    int getMigrationCount() const;      // Drivers moved to another shard
+    long long getProcessedCount(int shard) const;
+
+    // Direct engine access; only safe after drain() or stop()
+    DispatchEngine *getShardEngine(int shard) const;
+};
+
+#endif // SHARDEDDISPATCHER_H
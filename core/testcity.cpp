@@ -1,6 +1,7 @@
 #include "city.h"
 #include <iostream>
 #include <cstring>
+#include <cstdio>
 #include <fstream>
 
 void printSeparator()
@@ -172,6 +173,18 @@ std::string getDataFilePath(const std::string &filename)
     return paths[0];
 }
 
+// Directional edges as the adjacency lists hold them
+static int countListEdges(const City &city)
+{
+    int count = 0;
+    for (Node *n = city.getFirstNode(); n != nullptr; n = n->next)
+    {
+        for (EdgeNode *e = city.getNeighbors(n->id); e != nullptr; e = e->next)
+            count++;
+    }
+    return count;
+}
+
 int main()
 {
     std::cout << "=== City Graph System Test ===" << std::endl;
@@ -698,6 +711,305 @@ int main()
     }
     printSeparator();
 
+    // Test 16: Frozen graph index (Hilbert order + CSR) is consistent with the lists
+    std::cout << "Test 16: Graph index consistency" << std::endl;
+    std::shared_ptr<const GraphIndex> gi = city.getGraphIndex();
+    bool indexOk = gi != nullptr && gi->nodeCount == city.getNodeCount() &&
+                   gi->edgeCount == city.getEdgeCount();
+    for (int i = 0; indexOk && i < gi->nodeCount; ++i)
+    {
+        Node *n = gi->nodes[i];
+        if (n->index != i || city.getNodeIndex(n->id) != i)
+        {
+            indexOk = false;
+            break;
+        }
+
+        int listDegree = 0;
+        for (EdgeNode *e = city.getNeighbors(n->id); e != nullptr; e = e->next)
+            listDegree++;
+        if (listDegree != gi->adjOffset[i + 1] - gi->adjOffset[i])
+            indexOk = false;
+    }
+
+    // Spatial locality: mean distance between consecutive indices
+    double stepSum = 0.0;
+    for (int i = 1; indexOk && i < gi->nodeCount; ++i)
+    {
+        double dx = gi->x[i] - gi->x[i - 1];
+        double dy = gi->y[i] - gi->y[i - 1];
+        stepSum += std::sqrt(dx * dx + dy * dy);
+    }
+    if (indexOk && gi->nodeCount > 1)
+    {
+        std::cout << "Mean distance between consecutive node indices: "
+                  << stepSum / (gi->nodeCount - 1) << "m" << std::endl;
+    }
+    std::cout << (indexOk ? "✓ Graph index matches node and adjacency lists."
+                          : "✗ Graph index is inconsistent with the lists.") << std::endl;
+    printSeparator();
+
+    // Test 17: Runtime road closure, reopening, reweighting and insertion
+    std::cout << "Test 17: Runtime road network changes" << std::endl;
+    PathResult before = city.findShortestPathAStar(zone1HospId, zone4HospId);
+    bool roadsOk = before.pathLength > 2;
+    if (roadsOk)
+    {
+        const char *a = before.path[before.pathLength / 2];
+        const char *b = before.path[before.pathLength / 2 + 1];
+        long versionBefore = city.getGraphVersion();
+        std::shared_ptr<const GraphIndex> oldVersion = city.getGraphIndex();
+
+        roadsOk = city.closeRoad(a, b) && city.getGraphVersion() == versionBefore + 1;
+        PathResult detour = city.findShortestPathAStar(zone1HospId, zone4HospId);
+        for (int i = 0; roadsOk && i + 1 < detour.pathLength; ++i)
+        {
+            if ((strcmp(detour.path[i], a) == 0 && strcmp(detour.path[i + 1], b) == 0) ||
+                (strcmp(detour.path[i], b) == 0 && strcmp(detour.path[i + 1], a) == 0))
+                roadsOk = false;
+        }
+        roadsOk = roadsOk && detour.totalDistance >= before.totalDistance;
+        std::cout << "Closed " << a << " <-> " << b << ": " << before.totalDistance
+                  << "m -> " << detour.totalDistance << "m" << std::endl;
+
+        // A reader holding the previous version still sees the road open
+        int ia = oldVersion->findIndex(a), ib = oldVersion->findIndex(b);
+        roadsOk = roadsOk && oldVersion->adjClosed[oldVersion->findEdge(ia, ib)] == 0;
+
+        roadsOk = roadsOk && city.reopenRoad(a, b);
+        PathResult reopened = city.findShortestPathAStar(zone1HospId, zone4HospId);
+        roadsOk = roadsOk && std::fabs(reopened.totalDistance - before.totalDistance) < 1e-6;
+
+        roadsOk = roadsOk && city.setRoadWeight(a, b, 100000.0);
+        PathResult heavy = city.findShortestPathAStar(zone1HospId, zone4HospId);
+        roadsOk = roadsOk && heavy.totalDistance >= before.totalDistance;
+
+        // A direct shortcut becomes the shortest path
+        int edgesBefore = city.getEdgeCount();
+        double scaleBefore = city.getGraphIndex()->heuristicScale;
+        roadsOk = roadsOk && city.addRoad(zone1HospId, zone4HospId, 5.0) &&
+                  city.getEdgeCount() == edgesBefore + 2 &&
+                  city.getGraphIndex()->edgeCount == edgesBefore + 2;
+        PathResult shortcut = city.findShortestPathAStar(zone4HospId, zone1HospId);
+        roadsOk = roadsOk && shortcut.pathLength == 2 && std::fabs(shortcut.totalDistance - 5.0) < 1e-6;
+        std::cout << "Shortcut path length: " << shortcut.pathLength
+                  << " (" << shortcut.totalDistance << "m)" << std::endl;
+
+        // Routes from all over the city to the neighbourhoods of the
+        // shortcut's ends must still match Dijkstra. A* may reach the
+        // shortcut only by first moving away from the goal, which a
+        // straight-line heuristic overestimates unless it is scaled.
+        std::shared_ptr<const GraphIndex> withShortcut = city.getGraphIndex();
+        const int MAX_AROUND = 32;
+        int around[MAX_AROUND];
+        int aroundCount = 0;
+        const char *ends[2] = {zone1HospId, zone4HospId};
+        for (int side = 0; side < 2; ++side)
+        {
+            int end = withShortcut->findIndex(ends[side]);
+            for (int e = withShortcut->adjOffset[end]; e < withShortcut->adjOffset[end + 1]; ++e)
+            {
+                int hop = withShortcut->adjTarget[e];
+                for (int f = withShortcut->adjOffset[hop]; f < withShortcut->adjOffset[hop + 1]; ++f)
+                {
+                    if (aroundCount < MAX_AROUND)
+                        around[aroundCount++] = withShortcut->adjTarget[f];
+                }
+            }
+        }
+        double dijkstra[MAX_AROUND];
+        int compared = 0;
+        double worstGap = 0.0;
+        int originStep = withShortcut->nodeCount / 40 + 1;
+        for (int origin = 0; origin < withShortcut->nodeCount; origin += originStep)
+        {
+            const char *originId = withShortcut->nodes[origin]->id;
+            city.findDistancesToNodes(originId, around, aroundCount, dijkstra);
+            for (int j = 0; j < aroundCount; ++j)
+            {
+                if (dijkstra[j] < 0)
+                    continue;
+                PathResult aStar = city.findShortestPathAStar(originId, withShortcut->nodes[around[j]]->id);
+                double gap = std::fabs(aStar.totalDistance - dijkstra[j]);
+                worstGap = gap > worstGap ? gap : worstGap;
+                compared++;
+            }
+        }
+        roadsOk = roadsOk && compared > 0 && worstGap < 1e-6 && withShortcut->heuristicScale < 1.0;
+        std::cout << compared << " routes towards the shortcut checked against Dijkstra (heuristic scale "
+                  << withShortcut->heuristicScale << ", largest gap " << worstGap << "m)" << std::endl;
+
+        // Closing the shortcut rescans for the next lowest ratio; reopening
+        // it only compares against the current one
+        roadsOk = roadsOk && city.closeRoad(zone1HospId, zone4HospId) &&
+                  city.getGraphIndex()->heuristicScale == scaleBefore &&
+                  city.reopenRoad(zone1HospId, zone4HospId) &&
+                  city.getGraphIndex()->heuristicScale == withShortcut->heuristicScale;
+    }
+    std::cout << (roadsOk ? "✓ Road changes publish new graph versions correctly."
+                          : "✗ Road change handling is broken.") << std::endl;
+    printSeparator();
+
+    // Test 18: Point-to-road snapping and routing between mid-edge points
+    std::cout << "Test 18: Point-to-road snapping" << std::endl;
+    Node *segA = city.getNode("zone1_gulberg-T1_S1_N1");
+    Node *segB = city.getNode("zone1_gulberg-T1_S1_N2");
+    Node *farC = city.getNode("zone3_johar_town-B7_S6_N9");
+    Node *farD = city.getNode("zone3_johar_town-B7_S6_N10");
+    bool snapOk = segA && segB && farC && farD;
+    if (snapOk)
+    {
+        // 3m beside the middle of A-B
+        RoadSnap s1 = city.snapToRoad((segA->x + segB->x) / 2.0, (segA->y + segB->y) / 2.0 + 3.0);
+        bool onAB = (s1.from == segA && s1.to == segB) || (s1.from == segB && s1.to == segA);
+        snapOk = s1.isValid() && onAB && std::fabs(s1.distance - 3.0) < 1e-6 &&
+                 std::fabs(s1.offset - s1.edgeWeight / 2.0) < 1e-6;
+        std::cout << "Snapped to " << (s1.from ? s1.from->id : "-") << " -> " << (s1.to ? s1.to->id : "-")
+                  << " at offset " << s1.offset << "m (" << s1.distance << "m away)" << std::endl;
+
+        // Same segment: straight along the road
+        RoadSnap s2 = city.snapToRoad(segA->x + (segB->x - segA->x) * 0.9, segA->y - 2.0);
+        PathResult along = city.findShortestPathBetweenSnaps(s1, s2);
+        snapOk = snapOk && along.pathLength == 0 && std::fabs(along.totalDistance - std::fabs(s1.offset - s2.offset)) < 1e-6;
+
+        // Different segments: must equal the best combination of node-level routes
+        RoadSnap s3 = city.snapToRoad((farC->x + farD->x) / 2.0, (farC->y + farD->y) / 2.0);
+        PathResult mid = city.findShortestPathBetweenSnaps(s1, s3);
+        double expected = 1e18;
+        Node *srcEnds[2] = {s1.from, s1.to};
+        double srcCost[2] = {s1.offset, s1.edgeWeight - s1.offset};
+        Node *dstEnds[2] = {s3.from, s3.to};
+        double dstCost[2] = {s3.offset, s3.edgeWeight - s3.offset};
+        for (int i = 0; i < 2; ++i)
+            for (int j = 0; j < 2; ++j)
+            {
+                PathResult leg = city.findShortestPathAStar(srcEnds[i]->id, dstEnds[j]->id);
+                if (leg.totalDistance >= 0 && srcCost[i] + leg.totalDistance + dstCost[j] < expected)
+                    expected = srcCost[i] + leg.totalDistance + dstCost[j];
+            }
+        snapOk = snapOk && s3.isValid() && std::fabs(mid.totalDistance - expected) < 1e-6;
+        std::cout << "Mid-edge route: " << mid.totalDistance << "m over " << mid.pathLength
+                  << " nodes (node-level best: " << expected << "m)" << std::endl;
+
+        // A closed road is no longer a snapping candidate
+        city.closeRoad(segA->id, segB->id);
+        RoadSnap s4 = city.snapToRoad((segA->x + segB->x) / 2.0, (segA->y + segB->y) / 2.0 + 3.0);
+        snapOk = snapOk && s4.isValid() && !((s4.from == segA && s4.to == segB) || (s4.from == segB && s4.to == segA));
+        city.reopenRoad(segA->id, segB->id);
+    }
+    std::cout << (snapOk ? "✓ Snapping and mid-edge routing are consistent."
+                         : "✗ Snapping or mid-edge routing is wrong.") << std::endl;
+    printSeparator();
+
+    // Test 19: Nearest-K POIs by road distance
+    std::cout << "Test 19: Nearest 3 hospitals by road distance" << std::endl;
+    const char *homeId = "zone2_DHA-M4_S1_Loc3";
+    Node *nearestHospitals[3];
+    double hospitalDistances[3];
+    int nearestCount = city.findNearestByType("hospital", homeId, 3, nearestHospitals, hospitalDistances);
+    bool poiOk = city.getNode(homeId) != nullptr && nearestCount == 3;
+    for (int i = 0; poiOk && i < nearestCount; ++i)
+    {
+        PathResult check = city.findShortestPathAStar(homeId, nearestHospitals[i]->id);
+        std::cout << "  " << (i + 1) << ". " << nearestHospitals[i]->id << " - "
+                  << hospitalDistances[i] << "m" << std::endl;
+        if (std::fabs(check.totalDistance - hospitalDistances[i]) > 1e-6 ||
+            (i > 0 && hospitalDistances[i] < hospitalDistances[i - 1]))
+            poiOk = false;
+    }
+    // No other hospital may be closer than the third result
+    for (int i = 0; poiOk && i < hospitalCount; ++i)
+    {
+        bool listed = false;
+        for (int j = 0; j < nearestCount; ++j)
+            listed = listed || nearestHospitals[j] == hospitals[i];
+        if (listed)
+            continue;
+        PathResult other = city.findShortestPathAStar(homeId, hospitals[i]->id);
+        if (other.totalDistance >= 0 && other.totalDistance < hospitalDistances[nearestCount - 1] - 1e-6)
+            poiOk = false;
+    }
+    std::cout << (poiOk ? "✓ Nearest-K POI query matches per-destination A*."
+                        : "✗ Nearest-K POI query is wrong.") << std::endl;
+    printSeparator();
+
+    // Test 20: Location type ids, flags and per-type lists
+    std::cout << "Test 20: Location type ids and route flags" << std::endl;
+    bool typesOk = city.getLocationTypeId("street") == LOCATION_STREET &&
+                   city.getLocationTypeId("hospital") == LOCATION_HOSPITAL &&
+                   city.getLocationTypeId("no-such-type") == -1;
+    std::shared_ptr<const GraphIndex> typeIndex = city.getGraphIndex();
+    int typedTotal = 0;
+    Node **typed = new Node *[typeIndex->nodeCount];
+    for (int t = 0; typesOk && t < city.getLocationTypeCount(); ++t)
+    {
+        int typedCount = 0;
+        city.getNodesByType(t, typed, typedCount, typeIndex->nodeCount);
+        typedTotal += typedCount;
+        for (int i = 0; typesOk && i < typedCount; ++i)
+            typesOk = typed[i]->typeId == t &&
+                      strcmp(typed[i]->locationType, city.getLocationTypeName(t)) == 0;
+    }
+    for (int i = 0; typesOk && i < typeIndex->nodeCount; ++i)
+    {
+        Node *n = typeIndex->nodes[i];
+        bool byName = strcmp(n->locationType, "street") == 0 || strcmp(n->locationType, "highway") == 0;
+        typesOk = n->isRoute() == byName && city.isRouteNode(i) == byName;
+    }
+    delete[] typed;
+    typesOk = typesOk && typedTotal == typeIndex->nodeCount;
+    std::cout << "Registered types: " << city.getLocationTypeCount() << std::endl;
+    std::cout << (typesOk ? "✓ Type ids, route flags and per-type lists agree with type names."
+                          : "✗ Location type index is inconsistent.") << std::endl;
+    printSeparator();
+
+    // Test 21: addRoad fills in a road's missing reverse direction
+    std::cout << "Test 21: Adding the missing direction of a one-way road" << std::endl;
+    City lopsided;
+    bool reverseOk = lopsided.loadLocations(locationsPath.c_str()) && lopsided.loadPaths(pathsPath.c_str());
+    char oneWayFrom[MAX_STRING_LENGTH] = "";
+    const char *oneWayTo = nullptr;
+    double oneWayWeight = 0.0;
+    // Unlink the second entry of some node's list, so only the other
+    // direction of that road remains, and rebuild the index from the lists
+    for (Node *n = lopsided.getFirstNode(); reverseOk && n != nullptr && !oneWayTo; n = n->next)
+    {
+        EdgeNode *first = lopsided.getNeighbors(n->id);
+        if (!first || !first->next)
+            continue;
+        EdgeNode *dropped = first->next;
+        first->next = dropped->next;
+        snprintf(oneWayFrom, sizeof(oneWayFrom), "%s", dropped->toNodeId);
+        oneWayTo = n->id;
+        oneWayWeight = dropped->weight;
+        delete dropped;
+    }
+    reverseOk = reverseOk && oneWayTo != nullptr;
+    if (reverseOk)
+    {
+        lopsided.freeze();
+        int listBefore = countListEdges(lopsided);
+        int countBefore = lopsided.getEdgeCount();
+        int indexBefore = lopsided.getGraphIndex()->edgeCount;
+        reverseOk = listBefore == indexBefore && lopsided.addRoad(oneWayFrom, oneWayTo, oneWayWeight);
+
+        std::shared_ptr<const GraphIndex> mended = lopsided.getGraphIndex();
+        bool listed = false;
+        for (EdgeNode *e = lopsided.getNeighbors(oneWayTo); e != nullptr; e = e->next)
+            listed = listed || strcmp(e->toNodeId, oneWayFrom) == 0;
+        int from = mended->findIndex(oneWayFrom);
+        int to = mended->findIndex(oneWayTo);
+        reverseOk = reverseOk && listed && mended->findEdge(to, from) >= 0 && mended->findEdge(from, to) >= 0 &&
+                    countListEdges(lopsided) == listBefore + 1 &&
+                    lopsided.getEdgeCount() == countBefore + 1 &&
+                    mended->edgeCount == indexBefore + 1;
+        std::cout << "Restored " << oneWayTo << " -> " << oneWayFrom << ": list " << countListEdges(lopsided)
+                  << ", index " << mended->edgeCount << " edges" << std::endl;
+    }
+    std::cout << (reverseOk ? "✓ Adjacency lists, edge count and index agree after adding the reverse edge."
+                            : "✗ Adding a missing reverse edge left the graph views out of step.") << std::endl;
+    printSeparator();
+
     std::cout << "\n=== All Tests Completed Successfully! ===" << std::endl;
 
     return 0;
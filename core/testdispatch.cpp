@@ -0,0 +1,2005 @@
+#include "city.h"
+#include "dispatchengine.h"
+#include "shardeddispatcher.h"
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <fstream>
+#include <string>
+#include <sstream>
+#include <chrono>
+#include <thread>
+#include <atomic>
+
+// Dispatch engine tests: driver lookup structures are cross-checked against
+// brute-force scans over the same fleet.
+
+void printSeparator()
+{
+    std::cout << "\n================================================\n"
+              << std::endl;
+}
+
+std::string getDataFilePath(const std::string &filename)
+{
+    std::string paths[] = {
+        std::string("../city_locations_path_data/") + filename,
+        std::string("./city_locations_path_data/") + filename,
+        std::string("../../city_locations_path_data/") + filename
+    };
+
+    for (const auto &path : paths)
+    {
+        std::ifstream file(path);
+        if (file.good())
+            return path;
+    }
+    return paths[0];
+}
+
+// Small deterministic LCG so runs are reproducible
+static unsigned int nextRandom(unsigned int &state)
+{
+    state = state * 1103515245u + 12345u;
+    return (state >> 8) & 0xFFFFFF;
+}
+
+// Brute-force nearest available driver (optionally only those standing in a zone)
+static Driver *bruteForceNearest(const City &city, DispatchEngine &engine, int maxDriverId,
+                                 double x, double y, const char *zone)
+{
+    Driver *best = nullptr;
+    double bestDist = 0.0;
+    for (int id = 1; id <= maxDriverId; id++)
+    {
+        Driver *d = engine.getDriver(id);
+        if (!d || !d->isAvailable())
+            continue;
+        Node *n = city.getNode(d->getCurrentNodeId());
+        if (!n || (zone && strcmp(n->zone, zone) != 0))
+            continue;
+        double dist = std::sqrt((n->x - x) * (n->x - x) + (n->y - y) * (n->y - y));
+        if (!best || dist < bestDist)
+        {
+            best = d;
+            bestDist = dist;
+        }
+    }
+    return best;
+}
+
+static double roadDistance(const City &city, int fromIndex, int toIndex)
+{
+    double distance = -1.0;
+    city.findDistancesToNodes(city.getNodeByIndex(fromIndex)->id, &toIndex, 1, &distance);
+    return distance;
+}
+
+// Brute-force cheapest insertion for Test 6: tries every (pickup, drop-off)
+// position pair of a route, measuring every leg with its own search and
+// walking the whole route for seats, pickup wait and every rider's detour.
+// Returns the smallest added distance, or -1 when no pair is feasible.
+static double bruteForceInsertion(const City &city, const PoolRoute *route, int pickup, int dropoff,
+                                  int seats, double detour, double maxPickup)
+{
+    int n = route->stopCount;
+    double oldLength = 0.0;
+    for (int k = 0; k < n; k++)
+        oldLength += route->legs[k];
+    double rideLimit = roadDistance(city, pickup, dropoff) * (1.0 + detour);
+
+    int *nodes = new int[n + 2];
+    int *slots = new int[n + 2];       // Rider slot, -1 for the new rider
+    bool *pickups = new bool[n + 2];
+    double *starts = new double[route->capacity + 1];
+    double best = -1.0;
+    for (int i = 0; i <= n; i++)
+    {
+        for (int j = i; j <= n; j++)
+        {
+            int m = 0;
+            for (int k = 0; k <= n; k++)
+            {
+                if (k == i)
+                {
+                    nodes[m] = pickup;
+                    slots[m] = -1;
+                    pickups[m++] = true;
+                }
+                if (k == j)
+                {
+                    nodes[m] = dropoff;
+                    slots[m] = -1;
+                    pickups[m++] = false;
+                }
+                if (k < n)
+                {
+                    nodes[m] = route->stops[k].nodeIndex;
+                    slots[m] = route->stops[k].riderSlot;
+                    pickups[m++] = route->stops[k].isPickup;
+                }
+            }
+
+            bool ok = true;
+            double travelled = 0.0;
+            int load = route->load;
+            int from = route->originIndex;
+            for (int k = 0; ok && k < m; k++)
+            {
+                travelled += roadDistance(city, from, nodes[k]);
+                from = nodes[k];
+                int slot = slots[k] < 0 ? route->capacity : slots[k];
+                if (pickups[k])
+                {
+                    ok = travelled <= maxPickup && ++load <= seats;
+                    starts[slot] = travelled;
+                    continue;
+                }
+                const PoolRider *rider = slots[k] < 0 ? nullptr : &route->riders[slots[k]];
+                double ride = rider && rider->onBoard ? rider->ridden + travelled : travelled - starts[slot];
+                ok = ride <= (rider ? rider->rideLimit : rideLimit);
+                load--;
+            }
+            double added = travelled - oldLength;
+            if (ok && (best < 0.0 || added < best))
+                best = added;
+        }
+    }
+    delete[] nodes;
+    delete[] slots;
+    delete[] pickups;
+    delete[] starts;
+    return best;
+}
+
+// Movement listener for Test 4: counts deltas and completions
+struct MovementTally
+{
+    long long deltas;
+    int completed;
+};
+
+static void tallyMovement(const MovementDelta *deltas, int count, long long, void *context)
+{
+    MovementTally *tally = (MovementTally *)context;
+    tally->deltas += count;
+    for (int i = 0; i < count; i++)
+        tally->completed += deltas[i].state == COMPLETED ? 1 : 0;
+}
+
+// Assignment callback for Test 8: counts outcomes and checks the trip ids
+struct RoutedTally
+{
+    int routed;
+    int cancelled;
+    int cancelledTripId;
+    bool cancelledReported;
+};
+
+static void tallyRouted(const AssignmentResult &result, void *context)
+{
+    RoutedTally *tally = (RoutedTally *)context;
+    if (result.status == ASSIGNMENT_ROUTED)
+        tally->routed++;
+    else
+        tally->cancelled++;
+    if (result.tripId == tally->cancelledTripId)
+        tally->cancelledReported = result.status == ASSIGNMENT_CANCELLED;
+}
+
+// Dispatcher thread for Test 9: reserves the first free driver for every
+// trip, handing the driver back when the trip was cancelled first
+static void raceAssign(Trip **trips, int tripCount, Driver **drivers, int driverCount)
+{
+    for (int t = 0; t < tripCount; t++)
+    {
+        for (int d = 0; d < driverCount; d++)
+        {
+            if (!drivers[d]->tryReserve(trips[t]->getTripId()))
+                continue;
+            if (!trips[t]->transitionToAssigned(drivers[d]->getDriverId()))
+                drivers[d]->releaseTrip(trips[t]->getTripId());
+            break;
+        }
+    }
+}
+
+// Rider thread for Test 9: cancels every other trip, whatever state it reached
+static void raceCancel(Trip **trips, int tripCount, Driver **drivers)
+{
+    for (int t = 0; t < tripCount; t += 2)
+    {
+        while (!trips[t]->transitionToCancelled())
+        {
+        }
+        int driverId = trips[t]->getDriverId();
+        if (driverId >= 0)
+            drivers[driverId]->releaseTrip(trips[t]->getTripId());
+    }
+}
+
+// Movement thread for Test 9: starts pickup on assigned trips and finishes
+// trips it is allowed to, releasing their drivers
+static void raceMove(Trip **trips, int tripCount, Driver **drivers)
+{
+    for (int pass = 0; pass < 4; pass++)
+    {
+        for (int t = 1; t < tripCount; t += 2)
+        {
+            if (trips[t]->transitionToPickupInProgress() && trips[t]->transitionToOngoing() &&
+                trips[t]->transitionToCompleted())
+                drivers[trips[t]->getDriverId()]->releaseTrip(trips[t]->getTripId());
+        }
+    }
+}
+
+// Test 9: the same three actors through one DispatchEngine
+struct EngineRace
+{
+    DispatchEngine *engine;
+    int tripCount;
+    const char **pickups;           // By trip id - 1
+    const char **dropoffs;
+    std::atomic<bool> dispatched;   // Every trip requested, then assigned or queued
+    std::atomic<bool> cancelled;    // The rider has cancelled every odd trip it could
+};
+
+// Dispatcher: requests each trip and gives it the nearest free driver, or
+// queues it for the next one freed
+static void engineDispatch(EngineRace *race)
+{
+    for (int id = 1; id <= race->tripCount; id++)
+    {
+        race->engine->requestTrip(id, id, race->pickups[id - 1], race->dropoffs[id - 1]);
+        if (race->engine->assignNearestDriver(id) < 0)
+            race->engine->waitForDriver(id, 600.0);
+    }
+    race->dispatched.store(true);
+}
+
+// Rider: cancels every odd trip, preferably once a driver is on the way
+static void engineCancel(EngineRace *race)
+{
+    for (int id = 1; id <= race->tripCount; id += 2)
+    {
+        while (!race->dispatched.load())
+        {
+            Trip *trip = race->engine->getTrip(id);
+            if (trip && trip->getState() != REQUESTED)
+                break;
+            std::this_thread::yield();
+        }
+        race->engine->cancelTrip(id);
+    }
+    race->cancelled.store(true);
+}
+
+// Mover: steps every trip with a driver towards its drop-off and completes
+// it there, until the other actors are done and nothing moves any more
+static void engineMove(EngineRace *race)
+{
+    bool done = false;
+    while (!done)
+    {
+        // A pass that starts after the others finished and moves nothing is the last
+        bool othersFinished = race->dispatched.load() && race->cancelled.load();
+        bool moved = false;
+        for (int id = 1; id <= race->tripCount; id++)
+        {
+            Trip *trip = race->engine->getTrip(id);
+            TripState state = trip ? trip->getState() : REQUESTED;
+            if (state == ASSIGNED)
+                moved = race->engine->startPickupMovement(id) || moved;
+            else if (state == PICKUP_IN_PROGRESS || state == ONGOING)
+                moved = race->engine->advanceTripMovement(id) || race->engine->completeTrip(id) || moved;
+        }
+        if (!moved)
+            std::this_thread::yield();
+        done = othersFinished && !moved;
+    }
+}
+
+// Movement listener for Test 10: records when each trip completed
+static void logCompletions(const MovementDelta *deltas, int count, long long simTimeMs, void *context)
+{
+    long long *completedAt = (long long *)context;
+    for (int i = 0; i < count; i++)
+    {
+        if (deltas[i].state == COMPLETED)
+            completedAt[deltas[i].tripId] = simTimeMs;
+    }
+}
+
+// Test 11: recounts stored trips by state and checks the active set against them
+static bool activeSetMatches(DispatchEngine &engine, int tripIds)
+{
+    int counts[TRIP_STATE_COUNT] = {0, 0, 0, 0, 0, 0};
+    int active = 0;
+    for (int id = 1; id <= tripIds; id++)
+    {
+        Trip *trip = engine.getTrip(id);
+        if (!trip)
+            continue;
+        TripState state = trip->getState();
+        counts[state]++;
+        active += (state == ASSIGNED || state == PICKUP_IN_PROGRESS || state == ONGOING) ? 1 : 0;
+    }
+    bool ok = engine.getActiveTripsCount() == active;
+    for (int s = 0; s < TRIP_STATE_COUNT; s++)
+        ok = ok && engine.getTripCountInState((TripState)s) == counts[s];
+    for (int i = 0; ok && i < engine.getActiveTripsCount(); i++)
+    {
+        const ActiveTrip *entry = engine.getActiveTrip(i);
+        TripState state = entry->trip->getState();
+        ok = entry->driver->getDriverId() == entry->trip->getDriverId() &&
+             (state == ASSIGNED || state == PICKUP_IN_PROGRESS || state == ONGOING);
+    }
+    return ok;
+}
+
+// Test 12: compares tree lookups for every driver against a fresh search
+// from the driver's node; counts the lookups the trees answered
+static bool reachMatchesSearch(const City &city, DispatchEngine &engine, const int *targets,
+                               int targetCount, int &answered)
+{
+    double *expected = new double[targetCount];
+    bool ok = true;
+    for (int i = 0; ok && i < engine.getDriverCount(); i++)
+    {
+        Driver *driver = engine.getDriverByIndex(i);
+        city.findDistancesToNodes(driver->getCurrentNodeId(), targets, targetCount, expected);
+        for (int t = 0; ok && t < targetCount; t++)
+        {
+            double d = engine.getDriverReach()->getDistance(driver, targets[t]);
+            if (d < 0.0)
+                continue;
+            answered++;
+            ok = std::fabs(d - expected[t]) < 1e-9;
+        }
+    }
+    delete[] expected;
+    return ok;
+}
+
+// Test 13: random pushes, re-queues and removals; every pop must return the
+// most urgent queued request found by a scan over a mirror of the queue
+static bool requestQueueOrderHolds(unsigned int seed)
+{
+    const int IDS = 64;
+    bool queued[IDS];
+    int priority[IDS];
+    long deadline[IDS];
+    for (int id = 0; id < IDS; id++)
+        queued[id] = false;
+    RequestQueue queue;
+    std::chrono::steady_clock::time_point base = std::chrono::steady_clock::now();
+    bool ok = true;
+    for (int op = 0; ok && op < 2000; op++)
+    {
+        int id = nextRandom(seed) % IDS;
+        int action = nextRandom(seed) % 4;
+        if (action <= 1)
+        {
+            priority[id] = nextRandom(seed) % 3;
+            deadline[id] = nextRandom(seed) % 50;
+            queue.push(id, priority[id], base + std::chrono::seconds(deadline[id]), nullptr, nullptr);
+            queued[id] = true;
+        }
+        else if (action == 2)
+        {
+            ok = queue.remove(id) == queued[id];
+            queued[id] = false;
+        }
+        else
+        {
+            // Ties on priority and deadline may pop in either order; compare keys
+            int best = -1;
+            for (int i = 0; i < IDS; i++)
+            {
+                if (queued[i] && (best < 0 || priority[i] > priority[best] ||
+                                  (priority[i] == priority[best] && deadline[i] < deadline[best])))
+                    best = i;
+            }
+            WaitingRequest request;
+            bool popped = queue.pop(request);
+            ok = popped == (best >= 0);
+            if (popped && ok)
+            {
+                ok = priority[request.tripId] == priority[best] &&
+                     deadline[request.tripId] == deadline[best] && queued[request.tripId];
+                queued[request.tripId] = false;
+            }
+        }
+        int expected = 0;
+        for (int i = 0; i < IDS; i++)
+            expected += queued[i] ? 1 : 0;
+        ok = ok && queue.size() == expected;
+    }
+    return ok;
+}
+
+static void tallyExpired(const AssignmentResult &result, void *context)
+{
+    if (result.status == ASSIGNMENT_EXPIRED)
+        (*(int *)context)++;
+}
+
+// Test 14: drains a fresh trip's candidate stream and compares it with the
+// brute-force ranking: free drivers in the pickup zone nearest first (ties by
+// id), then every other free driver the same way
+static bool candidateOrderMatches(const City &city, DispatchEngine &engine, int maxDriverId, int tripId)
+{
+    Node *pickup = city.getNode(engine.getTrip(tripId)->getPickupNodeId());
+    bool *listed = new bool[maxDriverId + 1];
+    for (int id = 0; id <= maxDriverId; id++)
+        listed[id] = false;
+    bool ok = true;
+    int offered = 0;
+    for (int phase = 0; ok && phase < 2; phase++)
+    {
+        while (ok)
+        {
+            int best = -1;
+            double bestDist = 0.0;
+            for (int id = 1; id <= maxDriverId; id++)
+            {
+                Driver *d = engine.getDriver(id);
+                if (listed[id] || !d || !d->isAvailable())
+                    continue;
+                Node *n = city.getNode(d->getCurrentNodeId());
+                if (phase == 0 && strcmp(n->zone, pickup->zone) != 0)
+                    continue;
+                double dist = std::sqrt((n->x - pickup->x) * (n->x - pickup->x) +
+                                        (n->y - pickup->y) * (n->y - pickup->y));
+                if (best < 0 || dist < bestDist)
+                {
+                    best = id;
+                    bestDist = dist;
+                }
+            }
+            if (best < 0)
+                break;
+            listed[best] = true;
+            ok = engine.nextCandidate(tripId) == best;
+            offered++;
+        }
+    }
+    ok = ok && engine.nextCandidate(tripId) == -1 && offered == engine.getAvailableDriverCount();
+    delete[] listed;
+    return ok;
+}
+
+// Test 14: offer listener standing in for another thread that takes the
+// offered driver after it was offered and before the engine reserves it
+static void takeOfferedDriver(int, int driverId, void *context)
+{
+    DispatchEngine *engine = static_cast<DispatchEngine *>(context);
+    engine->getDriver(driverId)->tryReserve(1 << 30);
+}
+
+// Test 16: consumer thread replaying the event stream into per-trip states
+struct EventReplay
+{
+    int *states;              // Trip state by trip id, -1 before its first event
+    int maxTripId;
+    long long events;
+    bool inOrder;             // Sequences contiguous, every trip starts with REQUESTED
+};
+
+static void replayEvents(TripEventSubscription *subscription, std::atomic<bool> *producerDone,
+                         EventReplay *replay)
+{
+    TripEvent batch[256];
+    while (true)
+    {
+        bool finished = producerDone->load(std::memory_order_acquire);
+        int count = subscription->poll(batch, 256);
+        for (int i = 0; i < count; i++)
+        {
+            const TripEvent &event = batch[i];
+            replay->events++;
+            if (event.sequence != replay->events || event.tripId < 1 || event.tripId > replay->maxTripId ||
+                (event.type == TRIP_EVENT_REQUESTED) != (replay->states[event.tripId] == -1))
+                replay->inOrder = false;
+            else
+                replay->states[event.tripId] = event.state;
+        }
+        if (count == 0 && finished)
+            return;
+        if (count == 0)
+            std::this_thread::yield();
+    }
+}
+
+// Test 17: runs rounds of trips to completion with a small retention, then
+// checks every trip's record against the fare and driver seen at assignment
+static bool runArchivedTrips(DispatchEngine &engine, const GraphIndex *gi, const int *routeNodes,
+                             int routeCount, unsigned int &seed, int rounds, int &maxStored)
+{
+    int drivers = engine.getDriverCount();
+    int tripIds = rounds * drivers;
+    double *fares = new double[tripIds + 1];
+    int *driverIds = new int[tripIds + 1];
+    TripScheduler *clock = engine.getScheduler();
+    maxStored = 0;
+    int id = 0;
+    for (int r = 0; r < rounds; r++)
+    {
+        for (int t = 0; t < drivers; t++)
+        {
+            id++;
+            engine.requestTrip(id, id, gi->nodes[routeNodes[nextRandom(seed) % routeCount]]->id,
+                               gi->nodes[routeNodes[nextRandom(seed) % routeCount]]->id);
+            driverIds[id] = engine.assignNearestDriver(id);
+            fares[id] = engine.getTrip(id)->calculateTotalFare();
+            if (driverIds[id] < 0 || !clock->scheduleTrip(id))
+                engine.cancelTrip(id);
+        }
+        clock->runUntilIdle();
+        if (engine.getStoredTripCount() > maxStored)
+            maxStored = engine.getStoredTripCount();
+    }
+
+    // Every trip is either stored or archived, never both
+    int stored = 0;
+    for (int t = 1; t <= tripIds; t++)
+        stored += engine.getTrip(t) ? 1 : 0;
+    bool ok = stored == engine.getStoredTripCount() &&
+              engine.getArchivedTripCount() == tripIds - stored;
+    for (int t = 1; ok && t <= tripIds; t++)
+    {
+        TripRecord record;
+        ok = engine.findTripRecord(t, record) && record.tripId == t && record.riderId == t &&
+             record.driverId == driverIds[t] && record.fare == fares[t] &&
+             record.state == (driverIds[t] >= 0 ? COMPLETED : CANCELLED) &&
+             record.finishedAtMs >= record.requestedAtMs && record.pickupIndex >= 0;
+    }
+    delete[] fares;
+    delete[] driverIds;
+    return ok;
+}
+
+// Test 19: every fleet column agrees with the driver handles, node ids are
+// the city's own strings, and the free count agrees with the free-driver index
+static bool fleetColumnsMatch(const City &city, DispatchEngine &engine)
+{
+    const DriverFleet *fleet = engine.getFleet();
+    int available = 0;
+    for (int slot = 0; slot < fleet->size(); slot++)
+    {
+        Driver *driver = fleet->at(slot);
+        int id = driver->getDriverId();
+        int index = city.getNodeIndex(driver->getCurrentNodeId());
+        Node *node = city.getNodeByIndex(index);
+        if (fleet->find(id) != driver || fleet->getNodeIndex(id) != index || !node ||
+            node->id != driver->getCurrentNodeId() ||
+            fleet->getZoneIdOf(id) != fleet->getZoneId(driver->getZone()))
+            return false;
+        available += driver->isAvailable() ? 1 : 0;
+    }
+    int *freeIds = new int[fleet->size() + 1];
+    int *freeNodes = new int[fleet->size() + 1];
+    int collected = fleet->collectAvailable(freeIds, freeNodes, fleet->size() + 1);
+    bool ok = collected == available && fleet->countAvailable() == available &&
+              engine.getAvailableDriverCount() == available;
+    for (int i = 0; ok && i < collected; i++)
+    {
+        Driver *driver = engine.getDriver(freeIds[i]);
+        ok = driver && driver->isAvailable() && driver->getAssignedTripId() == -1 &&
+             freeNodes[i] == city.getNodeIndex(driver->getCurrentNodeId());
+    }
+    delete[] freeIds;
+    delete[] freeNodes;
+    return ok;
+}
+
+// Test 10: drives the same trips at one update interval, recording ETAs taken
+// at scheduling time and completion times. A position queried ahead of time
+// must match the one queried once the clock gets there.
+static bool runKinematicTrips(City &city, const GraphIndex *gi, const int *routeNodes, int routeCount,
+                              int tripCount, long long updateMs, long long *pickupEta,
+                              long long *dropoffEta, long long *completedAt)
+{
+    DispatchEngine engine(&city, tripCount, tripCount);
+    TripScheduler *scheduler = engine.getScheduler();
+    scheduler->setUpdateInterval(updateMs);
+    scheduler->setListener(logCompletions, completedAt);
+    unsigned int seed = 23;
+    for (int id = 1; id <= tripCount; id++)
+    {
+        Node *n = gi->nodes[routeNodes[nextRandom(seed) % routeCount]];
+        engine.addDriver(id, n->id, n->zone);
+    }
+
+    bool ok = true;
+    for (int id = 1; id <= tripCount; id++)
+    {
+        const char *pickup = gi->nodes[routeNodes[nextRandom(seed) % routeCount]]->id;
+        const char *dropoff = gi->nodes[routeNodes[nextRandom(seed) % routeCount]]->id;
+        completedAt[id] = -1;
+        ok = ok && engine.requestTrip(id, id, pickup, dropoff) && engine.assignNearestDriver(id) >= 0 &&
+             scheduler->scheduleTrip(id);
+        pickupEta[id] = scheduler->getPickupEtaMs(id);
+        dropoffEta[id] = scheduler->getDropoffEtaMs(id);
+        ok = ok && pickupEta[id] >= 0 && pickupEta[id] <= dropoffEta[id];
+    }
+
+    // Probe every trip halfway through its ride, before and after the clock gets there
+    TripPosition ahead;
+    TripPosition now;
+    for (int id = 1; ok && id <= tripCount; id++)
+    {
+        long long probeMs = (pickupEta[id] + dropoffEta[id]) / 2;
+        if (probeMs <= scheduler->getSimTimeMs() || !scheduler->getTripPosition(id, probeMs, ahead))
+            continue;
+        scheduler->advanceTo(probeMs);
+        if (!scheduler->getTripPosition(id, -1, now))
+            continue;
+        Trip *trip = engine.getTrip(id);
+        ok = ahead.edge == now.edge && ahead.offset == now.offset && ahead.x == now.x && ahead.y == now.y &&
+             (now.state == ONGOING || now.state == COMPLETED) &&
+             (!trip || trip->getState() != ONGOING || trip->getCurrentPathIndex() <= now.edge);
+    }
+    scheduler->runUntilIdle();
+    return ok && scheduler->getPendingCount() == 0;
+}
+
+// Discards output without shared state, so worker threads may log concurrently
+struct NullBuffer : std::streambuf
+{
+    int overflow(int c) override { return c; }
+};
+
+// Producer for Test 5: submits requests between random route nodes
+static void submitRequests(ShardedDispatcher *dispatcher, const GraphIndex *gi,
+                           const int *routeNodes, int routeCount, int count, unsigned int seed)
+{
+    for (int i = 0; i < count; i++)
+    {
+        const char *pickup = gi->nodes[routeNodes[nextRandom(seed) % routeCount]]->id;
+        const char *dropoff = gi->nodes[routeNodes[nextRandom(seed) % routeCount]]->id;
+        dispatcher->requestTrip((int)seed % 1000, pickup, dropoff);
+    }
+}
+
+int main()
+{
+    std::cout << "=== Dispatch Engine Test ===" << std::endl;
+    printSeparator();
+
+    City city;
+    if (!city.loadLocations(getDataFilePath("city-locations.csv").c_str()) ||
+        !city.loadPaths(getDataFilePath("paths.csv").c_str()))
+    {
+        std::cerr << "Failed to load city data" << std::endl;
+        return 1;
+    }
+    printSeparator();
+
+    // Route nodes to place drivers on
+    std::shared_ptr<const GraphIndex> gi = city.getGraphIndex();
+    int *routeNodes = new int[gi->nodeCount];
+    int routeCount = 0;
+    for (int i = 0; i < gi->nodeCount; i++)
+    {
+        if (city.isRouteNode(i))
+            routeNodes[routeCount++] = i;
+    }
+
+    // Test 1: Free-driver index against a brute-force scan
+    std::cout << "Test 1: Free-driver index vs brute-force nearest driver" << std::endl;
+    const int FLEET = 1000;
+    DispatchEngine engine(&city, FLEET, 200);
+    unsigned int seed = 7;
+    for (int id = 1; id <= FLEET; id++)
+    {
+        Node *n = gi->nodes[routeNodes[nextRandom(seed) % routeCount]];
+        engine.addDriver(id, n->id, n->zone);
+    }
+    // Most of the fleet is busy, some drivers move around
+    for (int id = 1; id <= FLEET; id++)
+    {
+        if (nextRandom(seed) % 4 != 0)
+            engine.getDriver(id)->setAvailable(false);
+        if (nextRandom(seed) % 4 == 0)
+            engine.getDriver(id)->setCurrentNodeId(gi->nodes[routeNodes[nextRandom(seed) % routeCount]]->id);
+    }
+
+    int freeCount = 0;
+    for (int id = 1; id <= FLEET; id++)
+        freeCount += engine.getDriver(id)->isAvailable() ? 1 : 0;
+    int zoneTotal = 0;
+    const char *zones[] = {"zone1", "zone2", "zone3", "zone4", "Highway Zone"};
+    for (int z = 0; z < 5; z++)
+        zoneTotal += engine.getAvailableDriverCount(zones[z]);
+    bool indexOk = engine.getAvailableDriverCount() == freeCount && zoneTotal == freeCount;
+    std::cout << "Free drivers: " << freeCount << " of " << FLEET << std::endl;
+
+    // Each assignment must pick the nearest free driver in the pickup's zone,
+    // or the nearest anywhere when that zone has none
+    for (int q = 0; indexOk && q < 200; q++)
+    {
+        Node *pickup = gi->nodes[routeNodes[nextRandom(seed) % routeCount]];
+        Driver *expected = bruteForceNearest(city, engine, FLEET, pickup->x, pickup->y, pickup->zone);
+        if (!expected)
+            expected = bruteForceNearest(city, engine, FLEET, pickup->x, pickup->y, nullptr);
+
+        engine.requestTrip(q + 1, 100 + q, pickup->id, pickup->id);
+        int chosen = engine.assignNearestDriver(q + 1);
+        if (!expected || chosen < 0)
+        {
+            indexOk = !expected && chosen < 0;
+            continue;
+        }
+        Node *a = city.getNode(expected->getCurrentNodeId());
+        Node *b = city.getNode(engine.getDriver(chosen)->getCurrentNodeId());
+        indexOk = strcmp(a->zone, b->zone) == 0 &&
+                  std::fabs(city.getDistance(a->id, pickup->id) - city.getDistance(b->id, pickup->id)) < 1e-9;
+
+        // Keep the free set changing between queries
+        Driver *mover = engine.getDriver(1 + nextRandom(seed) % FLEET);
+        mover->setCurrentNodeId(gi->nodes[routeNodes[nextRandom(seed) % routeCount]]->id);
+    }
+    indexOk = indexOk && engine.getAvailableDriverCount() == freeCount - 200;
+    std::cout << (indexOk ? "✓ Free-driver index matches brute-force scan."
+                          : "✗ Free-driver index disagrees with brute-force scan.") << std::endl;
+    printSeparator();
+
+    // Test 2: Batched matching is optimal on a small instance
+    std::cout << "Test 2: Batched matching vs exhaustive search" << std::endl;
+    const int BATCH_DRIVERS = 6, BATCH_TRIPS = 5;
+    DispatchEngine batchEngine(&city, BATCH_DRIVERS, BATCH_TRIPS);
+    batchEngine.setBatchCandidates(BATCH_DRIVERS);
+    const char *driverNodes[BATCH_DRIVERS];
+    const char *pickupNodes[BATCH_TRIPS];
+    for (int d = 0; d < BATCH_DRIVERS; d++)
+    {
+        Node *n = gi->nodes[routeNodes[nextRandom(seed) % routeCount]];
+        driverNodes[d] = n->id;
+        batchEngine.addDriver(d + 1, n->id, n->zone);
+    }
+    for (int t = 0; t < BATCH_TRIPS; t++)
+    {
+        pickupNodes[t] = gi->nodes[routeNodes[nextRandom(seed) % routeCount]]->id;
+        batchEngine.requestTrip(t + 1, 200 + t, pickupNodes[t], pickupNodes[t]);
+        batchEngine.queueForBatch(t + 1);
+    }
+
+    double pairCost[BATCH_TRIPS][BATCH_DRIVERS];
+    for (int t = 0; t < BATCH_TRIPS; t++)
+        for (int d = 0; d < BATCH_DRIVERS; d++)
+            pairCost[t][d] = city.findShortestPathAStar(driverNodes[d], pickupNodes[t]).totalDistance;
+
+    // Exhaustive minimum over injective trip -> driver maps
+    double bestTotal = 1e18;
+    int choice[BATCH_TRIPS];
+    for (int code = 0; code < 7776; code++)   // 6^5
+    {
+        int used = 0, c = code;
+        bool injective = true;
+        double total = 0.0;
+        for (int t = 0; t < BATCH_TRIPS; t++, c /= BATCH_DRIVERS)
+        {
+            choice[t] = c % BATCH_DRIVERS;
+            injective = injective && !(used & (1 << choice[t]));
+            used |= 1 << choice[t];
+            total += pairCost[t][choice[t]];
+        }
+        if (injective && total < bestTotal)
+            bestTotal = total;
+    }
+
+    int batchAssigned = batchEngine.dispatchBatch();
+    double batchTotal = 0.0;
+    for (int t = 0; t < BATCH_TRIPS; t++)
+        batchTotal += batchEngine.getTrip(t + 1)->getDriverToPickupPath().totalDistance;
+    std::cout << "Optimal total: " << bestTotal << "m, batch total: " << batchTotal << "m" << std::endl;
+    bool batchOk = batchAssigned == BATCH_TRIPS && batchEngine.getBatchPendingCount() == 0 &&
+                   std::fabs(batchTotal - bestTotal) < 1e-6;
+    std::cout << (batchOk ? "✓ Batched matching finds the minimum total pickup distance."
+                          : "✗ Batched matching is not optimal.") << std::endl;
+    printSeparator();
+
+    // Test 3: Registries grow past their initial capacity and recycle terminal trips
+    std::cout << "Test 3: Growable registries and trip recycling" << std::endl;
+    DispatchEngine growEngine(&city, 2, 2);
+    const char *homeNode = gi->nodes[routeNodes[0]]->id;
+    growEngine.addDriver(1, homeNode, "zone1");
+    Driver *firstDriver = growEngine.getDriver(1);
+    for (int id = 2; id <= 300; id++)
+        growEngine.addDriver(id, homeNode, "zone1");
+    bool registryOk = growEngine.getDriverCount() == 300 && growEngine.getDriver(1) == firstDriver &&
+                      !growEngine.addDriver(7, homeNode, "zone1");  // Duplicate id
+    for (int id = 2; id <= 300; id += 2)
+        growEngine.removeDriver(id);
+    for (int id = 1; registryOk && id <= 300; id++)
+    {
+        Driver *d = growEngine.getDriver(id);
+        registryOk = (id % 2 == 1) ? (d && d->getDriverId() == id) : d == nullptr;
+    }
+
+    growEngine.setTerminalTripRetention(50);
+    for (int id = 1; registryOk && id <= 1000; id++)
+    {
+        registryOk = growEngine.requestTrip(id, id, homeNode, homeNode) &&
+                     growEngine.cancelTrip(id);
+    }
+    registryOk = registryOk && growEngine.getTripCount() == 1000 &&
+                 growEngine.getStoredTripCount() == 50 &&
+                 growEngine.getTrip(1) == nullptr && growEngine.getTrip(950) == nullptr &&
+                 growEngine.getTrip(951) != nullptr && growEngine.getTrip(1000) != nullptr &&
+                 growEngine.getTrip(1000)->getState() == CANCELLED;
+    std::cout << "Drivers: " << growEngine.getDriverCount() << ", trips requested: "
+              << growEngine.getTripCount() << ", trips stored: " << growEngine.getStoredTripCount() << std::endl;
+    std::cout << (registryOk ? "✓ Registries grow, keep pointers stable and recycle terminal trips."
+                             : "✗ Registry growth or recycling is wrong.") << std::endl;
+    printSeparator();
+
+    // Test 4: Central scheduler drives many trips to completion
+    std::cout << "Test 4: Timing-wheel scheduler runs trips to completion" << std::endl;
+    const int SIM_TRIPS = 40;
+    DispatchEngine simEngine(&city, SIM_TRIPS, SIM_TRIPS);
+    for (int id = 1; id <= SIM_TRIPS; id++)
+    {
+        Node *n = gi->nodes[routeNodes[nextRandom(seed) % routeCount]];
+        simEngine.addDriver(id, n->id, n->zone);
+    }
+    TripScheduler *scheduler = simEngine.getScheduler();
+    MovementTally tally = {0, 0};
+    scheduler->setListener(tallyMovement, &tally);
+
+    // Movement logs every step; keep the test output readable
+    std::ostringstream sink;
+    std::streambuf *saved = std::cout.rdbuf(sink.rdbuf());
+    int started = 0;
+    for (int id = 1; id <= SIM_TRIPS; id++)
+    {
+        const char *pickup = gi->nodes[routeNodes[nextRandom(seed) % routeCount]]->id;
+        const char *dropoff = gi->nodes[routeNodes[nextRandom(seed) % routeCount]]->id;
+        if (simEngine.requestTrip(id, id, pickup, dropoff) && simEngine.assignNearestDriver(id) >= 0 &&
+            scheduler->scheduleTrip(id, id == 1 ? 400000 : -1))  // One far event exercises the upper levels
+            started++;
+    }
+    bool scheduleOk = scheduler->getPendingCount() == started && scheduler->scheduleTrip(1) &&
+                      scheduler->getPendingCount() == started;  // Rescheduling is a no-op
+    auto simBegin = std::chrono::steady_clock::now();
+    scheduler->runUntilIdle();
+    auto simEnd = std::chrono::steady_clock::now();
+    std::cout.rdbuf(saved);
+
+    int completed = 0;
+    for (int id = 1; id <= SIM_TRIPS; id++)
+    {
+        Trip *trip = simEngine.getTrip(id);
+        completed += (trip && trip->getState() == COMPLETED) ? 1 : 0;
+    }
+    scheduleOk = scheduleOk && started > 0 && completed == started && tally.completed == started &&
+                 scheduler->getPendingCount() == 0 && scheduler->getSimTimeMs() >= 400000 && tally.deltas == scheduler->getTotalSteps() &&
+                 simEngine.getAvailableDriverCount() == SIM_TRIPS;
+    std::cout << started << " trips, " << scheduler->getTotalSteps() << " steps, "
+              << scheduler->getSimTimeMs() / 1000.0 << " s simulated in "
+              << std::chrono::duration<double, std::milli>(simEnd - simBegin).count() << " ms" << std::endl;
+    std::cout << (scheduleOk ? "✓ Scheduler completed every trip and reported each step once."
+                             : "✗ Scheduler lost, duplicated or stalled trips.") << std::endl;
+    printSeparator();
+
+    // Test 5: Zone shards with concurrent producers keep global state consistent
+    std::cout << "Test 5: Zone-sharded dispatch with concurrent producers" << std::endl;
+    const int SHARD_DRIVERS = 300;
+    const int PRODUCERS = 4;
+    const int PER_PRODUCER = 50;
+    NullBuffer nullBuffer;
+    saved = std::cout.rdbuf(&nullBuffer);
+    ShardedDispatcher sharded(&city, 5, PRODUCERS * PER_PRODUCER);
+    sharded.start();
+    for (int i = 0; i < SHARD_DRIVERS; i++)
+        sharded.addDriver(gi->nodes[routeNodes[nextRandom(seed) % routeCount]]->id);
+    std::thread producers[PRODUCERS];
+    for (int p = 0; p < PRODUCERS; p++)
+        producers[p] = std::thread(submitRequests, &sharded, gi.get(), routeNodes, routeCount,
+                                   PER_PRODUCER, 100u + p);
+    for (int p = 0; p < PRODUCERS; p++)
+        producers[p].join();
+    sharded.drain();
+
+    // Every trip id resolved exactly once, and assigned trips live in their owner shard
+    bool shardOk = sharded.getAssignedCount() + sharded.getUnassignedCount() == PRODUCERS * PER_PRODUCER;
+    int activeTotal = 0;
+    for (int i = 0; i < sharded.getShardCount(); i++)
+        activeTotal += sharded.getShardEngine(i)->getActiveTripsCount();
+    for (int id = 1; shardOk && id <= PRODUCERS * PER_PRODUCER; id++)
+    {
+        int owner = sharded.getTripOwner(id);
+        Trip *trip = owner >= 0 ? sharded.getShardEngine(owner)->getTrip(id) : nullptr;
+        shardOk = owner == ShardedDispatcher::TRIP_UNASSIGNED || (trip && trip->getState() == ASSIGNED);
+    }
+    shardOk = shardOk && activeTotal == sharded.getAssignedCount();
+
+    // Completing moves drivers into their drop-off zone's shard; none are lost
+    for (int id = 1; id <= PRODUCERS * PER_PRODUCER; id++)
+        sharded.completeTrip(id);
+    sharded.drain();
+    int driverTotal = 0;
+    int freeTotal = 0;
+    long long newest = -1;
+    for (int i = 0; i < sharded.getShardCount(); i++)
+    {
+        DispatchEngine *shardEngine = sharded.getShardEngine(i);
+        driverTotal += shardEngine->getDriverCount();
+        freeTotal += shardEngine->getAvailableDriverCount();
+        long long last = shardEngine->getRollbackManager()->getLastSequence();
+        newest = last > newest ? last : newest;
+    }
+    shardOk = shardOk && driverTotal == SHARD_DRIVERS && freeTotal == SHARD_DRIVERS;
+
+    // Rollback undoes the globally newest operation
+    bool rolledBack = sharded.rollbackLast();
+    long long newestAfter = -1;
+    for (int i = 0; i < sharded.getShardCount(); i++)
+    {
+        long long last = sharded.getShardEngine(i)->getRollbackManager()->getLastSequence();
+        newestAfter = last > newestAfter ? last : newestAfter;
+    }
+    shardOk = shardOk && rolledBack && newestAfter < newest;
+    sharded.stop();
+
+    // With no drivers every request circles the whole ring of tiny inboxes;
+    // workers must keep going when the next shard's inbox is full
+    const int RING_REQUESTS = 400;
+    ShardedDispatcher ring(&city, 5, RING_REQUESTS, 2);
+    ring.start();
+    std::thread ringProducers[PRODUCERS];
+    for (int p = 0; p < PRODUCERS; p++)
+        ringProducers[p] = std::thread(submitRequests, &ring, gi.get(), routeNodes, routeCount,
+                                       RING_REQUESTS / PRODUCERS, 200u + p);
+    for (int p = 0; p < PRODUCERS; p++)
+        ringProducers[p].join();
+    auto ringDeadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (ring.getUnassignedCount() < RING_REQUESTS && std::chrono::steady_clock::now() < ringDeadline)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    bool ringOk = ring.getUnassignedCount() == RING_REQUESTS && ring.getAssignedCount() == 0 &&
+                  ring.getHandoffCount() == RING_REQUESTS * 4;
+    ring.stop();
+    std::cout.rdbuf(saved);
+
+    std::cout << "Assigned: " << sharded.getAssignedCount() << ", unassigned: " << sharded.getUnassignedCount()
+              << ", handoffs: " << sharded.getHandoffCount() << ", driver migrations: "
+              << sharded.getMigrationCount() << std::endl;
+    std::cout << (shardOk ? "✓ Shards resolve every request once, keep all drivers and roll back in global order."
+                          : "✗ Sharded dispatch lost or duplicated state.") << std::endl;
+    std::cout << (ringOk ? "✓ A ring of full shard inboxes still resolves every request."
+                         : "✗ Shard workers stalled on each other's full inboxes.") << std::endl;
+    printSeparator();
+
+    // Test 6: Pooled rides along one corridor stay within seats and detour bounds
+    std::cout << "Test 6: Shared-ride pooling by cheapest insertion" << std::endl;
+    const int POOL_DRIVERS = 3;
+    const int POOL_TRIPS = 12;
+    const double DETOUR = 0.5;
+    DispatchEngine poolEngine(&city, POOL_DRIVERS, POOL_TRIPS);
+    poolEngine.setPoolingOptions(3, DETOUR, 5000.0);
+
+    // Corridor: riders start near one route node and travel to near another ~2.5 km away
+    Node *home = gi->nodes[routeNodes[nextRandom(seed) % routeCount]];
+    Node *mall = nullptr;
+    for (int i = 0; i < routeCount && !mall; i++)
+    {
+        Node *n = gi->nodes[routeNodes[i]];
+        double dist = std::sqrt((n->x - home->x) * (n->x - home->x) + (n->y - home->y) * (n->y - home->y));
+        if (dist > 2000.0 && dist < 3000.0)
+            mall = n;
+    }
+    if (!mall)
+        mall = gi->nodes[routeNodes[(nextRandom(seed) % routeCount)]];
+    int *nearHome = new int[routeCount];
+    int *nearMall = new int[routeCount];
+    int homeCount = 0;
+    int mallCount = 0;
+    for (int i = 0; i < routeCount; i++)
+    {
+        Node *n = gi->nodes[routeNodes[i]];
+        if (std::fabs(n->x - home->x) + std::fabs(n->y - home->y) < 400.0)
+            nearHome[homeCount++] = routeNodes[i];
+        if (std::fabs(n->x - mall->x) + std::fabs(n->y - mall->y) < 400.0)
+            nearMall[mallCount++] = routeNodes[i];
+    }
+    for (int id = 1; id <= POOL_DRIVERS; id++)
+        poolEngine.addDriver(id, gi->nodes[nearHome[nextRandom(seed) % homeCount]]->id, home->zone);
+
+    saved = std::cout.rdbuf(sink.rdbuf());
+    int pooledAssigned = 0;
+    int sharedRoutes = 0;
+    double direct[POOL_TRIPS + 1];
+    for (int id = 1; id <= POOL_TRIPS; id++)
+    {
+        int p = nearHome[nextRandom(seed) % homeCount];
+        int d = nearMall[nextRandom(seed) % mallCount];
+        city.findDistancesToNodes(gi->nodes[p]->id, &d, 1, &direct[id]);
+        poolEngine.requestTrip(id, id, gi->nodes[p]->id, gi->nodes[d]->id);
+        pooledAssigned += poolEngine.assignPooled(id) >= 0 ? 1 : 0;
+    }
+    for (int id = 1; id <= POOL_DRIVERS; id++)
+    {
+        const PoolRoute *route = poolEngine.getPoolRoute(id);
+        sharedRoutes += (route && route->stopCount > 2) ? 1 : 0;
+    }
+    bool poolOk = pooledAssigned > POOL_DRIVERS && sharedRoutes > 0 &&
+                  poolEngine.getRidePool()->getSearchCount() == 2 * POOL_TRIPS;
+
+    // Drive every vehicle stop by stop, measuring legs independently of the cache
+    double ridden[POOL_TRIPS + 1];
+    bool onBoard[POOL_TRIPS + 1];
+    for (int id = 0; id <= POOL_TRIPS; id++)
+    {
+        ridden[id] = 0.0;
+        onBoard[id] = false;
+    }
+    int maxLoad = 0;
+    bool moved = true;
+    while (poolOk && moved)
+    {
+        moved = false;
+        for (int driverId = 1; poolOk && driverId <= POOL_DRIVERS; driverId++)
+        {
+            const PoolRoute *route = poolEngine.getPoolRoute(driverId);
+            if (!route)
+                continue;
+            int next = route->stops[0].nodeIndex;
+            double leg = -1.0;
+            city.findDistancesToNodes(poolEngine.getDriver(driverId)->getCurrentNodeId(), &next, 1, &leg);
+            poolOk = std::fabs(leg - route->legs[0]) < 1e-6;
+            int load = 0;
+            for (int id = 1; id <= POOL_TRIPS; id++)
+            {
+                Trip *trip = poolEngine.getTrip(id);
+                if (onBoard[id] && trip->getDriverId() == driverId)
+                {
+                    ridden[id] += leg;
+                    load++;
+                }
+            }
+            maxLoad = load > maxLoad ? load : maxLoad;
+            int served = poolEngine.advancePooledStop(driverId);
+            onBoard[served] = poolEngine.getTrip(served)->getState() == ONGOING;
+            moved = true;
+        }
+    }
+    std::cout.rdbuf(saved);
+
+    int pooledCompleted = 0;
+    for (int id = 1; poolOk && id <= POOL_TRIPS; id++)
+    {
+        Trip *trip = poolEngine.getTrip(id);
+        if (trip->getState() == REQUESTED)
+            continue;
+        pooledCompleted += trip->getState() == COMPLETED ? 1 : 0;
+        poolOk = ridden[id] <= direct[id] * (1.0 + DETOUR) + 1e-6;
+    }
+    poolOk = poolOk && pooledCompleted == pooledAssigned && maxLoad <= 3 &&
+             poolEngine.getAvailableDriverCount() == POOL_DRIVERS;
+
+    // A short ride along a long route belongs inside it, even though the
+    // route's next stop is far beyond the short ride's own detour bounds
+    int homeIndex = city.getNodeIndex(home->id);
+    double *fromHome = new double[routeCount];
+    city.findDistancesToNodes(home->id, routeNodes, routeCount, fromHome);
+    int farIndex = homeIndex;
+    double farDistance = 0.0;
+    for (int i = 0; i < routeCount; i++)
+    {
+        if (fromHome[i] > farDistance)
+        {
+            farDistance = fromHome[i];
+            farIndex = routeNodes[i];
+        }
+    }
+    delete[] fromHome;
+    PathResult corridor = city.findShortestPathAStar(home->id, gi->nodes[farIndex]->id);
+    int nearIndex = -1;
+    for (int k = 1; k < corridor.pathLength && nearIndex < 0; k++)
+    {
+        int index = city.getNodeIndex(corridor.path[k]);
+        if (roadDistance(city, homeIndex, index) >= 400.0)
+            nearIndex = index;
+    }
+    DispatchEngine corridorEngine(&city, 1, 2);
+    corridorEngine.setPoolingOptions(3, DETOUR, 2000.0);
+    corridorEngine.addDriver(1, home->id, home->zone);
+    saved = std::cout.rdbuf(sink.rdbuf());
+    corridorEngine.requestTrip(1, 1, home->id, gi->nodes[farIndex]->id);
+    corridorEngine.requestTrip(2, 2, home->id, gi->nodes[nearIndex >= 0 ? nearIndex : farIndex]->id);
+    bool corridorOk = nearIndex >= 0 && corridorEngine.assignPooled(1) == 1;
+    double expectedAdded = -1.0;
+    double chosenAdded = -2.0;
+    if (corridorOk)
+    {
+        const PoolRoute *route = corridorEngine.getPoolRoute(1);
+        expectedAdded = bruteForceInsertion(city, route, homeIndex, nearIndex, 3, DETOUR, 2000.0);
+        double before = 0.0;
+        for (int k = 0; k < route->stopCount; k++)
+            before += route->legs[k];
+        corridorOk = corridorEngine.assignPooled(2) == 1;
+        route = corridorEngine.getPoolRoute(1);
+        chosenAdded = -before;
+        for (int k = 0; k < route->stopCount; k++)
+            chosenAdded += route->legs[k];
+    }
+    std::cout.rdbuf(saved);
+    corridorOk = corridorOk && expectedAdded >= 0.0 && std::fabs(chosenAdded - expectedAdded) < 1e-6;
+    poolOk = poolOk && corridorOk;
+    std::cout << pooledAssigned << " of " << POOL_TRIPS << " requests pooled onto " << POOL_DRIVERS
+              << " vehicles, peak load " << maxLoad << ", " << poolEngine.getRidePool()->getSearchCount()
+              << " distance searches" << std::endl;
+    std::cout << "Short ride inside a " << farDistance << " m route added " << chosenAdded
+              << " m (cheapest possible: " << expectedAdded << " m)" << std::endl;
+    std::cout << (poolOk ? "✓ Pooled routes respect seats and detour bounds with cached legs and take the cheapest insertion."
+                         : "✗ Pooled routes broke a bound, a cached leg is wrong or a cheaper insertion was missed.") << std::endl;
+    printSeparator();
+
+    // Test 7: Idle drivers drift towards the colony that is requesting rides
+    std::cout << "Test 7: Idle-driver rebalancing towards decayed demand" << std::endl;
+    const int IDLE_DRIVERS = 6;
+    DispatchEngine idleEngine(&city, IDLE_DRIVERS, 20);
+    Rebalancer *rebalancer = idleEngine.getRebalancer();
+    rebalancer->setHalfLife(600.0);
+    int homeColony = rebalancer->getColonyId(home->id);
+    int hotColony = -1;
+    Node *hotNode = nullptr;
+    for (int i = 0; i < routeCount && !hotNode; i++)
+    {
+        Node *n = gi->nodes[routeNodes[i]];
+        double dist = std::sqrt((n->x - home->x) * (n->x - home->x) + (n->y - home->y) * (n->y - home->y));
+        int colony = rebalancer->getColonyId(n->id);
+        if (colony != homeColony && dist > 1000.0 && dist < 2500.0)
+        {
+            hotNode = n;
+            hotColony = colony;
+        }
+    }
+    bool rebalanceOk = hotNode != nullptr;
+    int issued = 0;
+    int arrived = 0;
+    double before = 0.0;
+    double after = 0.0;
+    if (rebalanceOk)
+    {
+        saved = std::cout.rdbuf(sink.rdbuf());
+        for (int id = 1; id <= IDLE_DRIVERS; id++)
+            idleEngine.addDriver(id, gi->nodes[nearHome[nextRandom(seed) % homeCount]]->id, home->zone);
+        for (int id = 1; id <= 10; id++)
+            idleEngine.requestTrip(id, id, hotNode->id, mall->id);
+        issued = rebalancer->rebalanceNow();
+        before = rebalancer->getDemand(hotColony);
+        idleEngine.getScheduler()->advanceBy(600000);
+        rebalancer->update();
+        after = rebalancer->getDemand(hotColony);
+        std::cout.rdbuf(saved);
+        for (int id = 1; id <= IDLE_DRIVERS; id++)
+            arrived += rebalancer->getColonyId(idleEngine.getDriver(id)->getCurrentNodeId()) == hotColony ? 1 : 0;
+        rebalanceOk = issued > 0 && arrived >= issued && rebalancer->getActiveMoveCount() == 0 &&
+                      std::fabs(before - 10.0) < 1e-9 && std::fabs(after - 5.0) < 1e-6;
+    }
+    std::cout << issued << " of " << IDLE_DRIVERS << " idle drivers sent to " << rebalancer->getColonyName(hotColony)
+              << ", " << arrived << " arrived; demand " << before << " -> " << after << " after one half-life" << std::endl;
+    std::cout << (rebalanceOk ? "✓ Idle drivers reposition towards demand and demand decays."
+                              : "✗ Rebalancing did not move drivers or demand did not decay.") << std::endl;
+    printSeparator();
+
+    // Test 8: Asynchronous assignment reserves drivers at once and routes off-thread
+    std::cout << "Test 8: Asynchronous assignment with mid-routing cancellation" << std::endl;
+    const int ASYNC_TRIPS = 40;
+    DispatchEngine asyncEngine(&city, ASYNC_TRIPS, ASYNC_TRIPS);
+    saved = std::cout.rdbuf(sink.rdbuf());
+    for (int id = 1; id <= ASYNC_TRIPS; id++)
+    {
+        Node *node = gi->nodes[routeNodes[nextRandom(seed) % routeCount]];
+        asyncEngine.addDriver(id, node->id, node->zone);
+    }
+    RoutedTally routedTally = {0, 0, ASYNC_TRIPS / 2, false};
+    bool asyncOk = true;
+    auto reserveStart = std::chrono::steady_clock::now();
+    for (int id = 1; id <= ASYNC_TRIPS; id++)
+    {
+        asyncEngine.requestTrip(id, id, gi->nodes[routeNodes[nextRandom(seed) % routeCount]]->id,
+                                gi->nodes[routeNodes[nextRandom(seed) % routeCount]]->id);
+        int driverId = asyncEngine.assignNearestDriverAsync(id, tallyRouted, &routedTally);
+        Driver *driver = asyncEngine.getDriver(driverId);
+        asyncOk = asyncOk && driver && !driver->isAvailable() && asyncEngine.getTrip(id)->getState() == ASSIGNED;
+    }
+    double reserveMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - reserveStart).count();
+    int cancelledDriver = asyncEngine.getTrip(routedTally.cancelledTripId)->getDriverId();
+    bool blocked = asyncEngine.isRoutingPending(ASYNC_TRIPS) && !asyncEngine.startPickupMovement(ASYNC_TRIPS);
+    asyncEngine.cancelTrip(routedTally.cancelledTripId);
+    auto routeStart = std::chrono::steady_clock::now();
+    while (asyncEngine.getPendingRouteCount() > 0)
+        asyncEngine.deliverRoutedAssignments(100);
+    double routeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - routeStart).count();
+
+    // Routed legs match a synchronous search from the same nodes
+    for (int id = 1; asyncOk && id <= ASYNC_TRIPS; id++)
+    {
+        Trip *trip = asyncEngine.getTrip(id);
+        if (id == routedTally.cancelledTripId)
+            continue;
+        PathResult expected = city.findShortestPathAStar(trip->getEffectivePickupNodeId(), trip->getDropoffNodeId());
+        asyncOk = std::fabs(trip->getPickupToDropoffPath().totalDistance - expected.totalDistance) < 1e-6 &&
+                  trip->getPickupToDropoffPath().pathLength == expected.pathLength;
+    }
+    bool startsAfter = asyncEngine.startPickupMovement(ASYNC_TRIPS);
+    std::cout.rdbuf(saved);
+    asyncOk = asyncOk && blocked && startsAfter && routedTally.routed == ASYNC_TRIPS - 1 &&
+              routedTally.cancelled == 1 && routedTally.cancelledReported &&
+              asyncEngine.getDriver(cancelledDriver)->isAvailable();
+    std::cout << ASYNC_TRIPS << " drivers reserved in " << reserveMs << " ms, routes delivered "
+              << routeMs << " ms later; " << routedTally.routed << " routed, " << routedTally.cancelled
+              << " cancelled mid-routing" << std::endl;
+    std::cout << (asyncOk ? "✓ Async assignment reserves immediately and discards cancelled routes."
+                          : "✗ Async assignment delivered wrong routes or mishandled a cancellation.") << std::endl;
+    printSeparator();
+
+    // Test 9: Trip and Driver objects shared between threads stay paired,
+    // first driven directly, then through one DispatchEngine
+    std::cout << "Test 9: Compare-and-swap transitions under concurrent actors" << std::endl;
+    const int RACE_TRIPS = 400;
+    const int RACE_DRIVERS = 64;
+    const int RACE_ROUNDS = 25;
+    bool raceOk = true;
+    int raceCancelled = 0;
+    int raceCompleted = 0;
+    const char *raceNode = gi->nodes[routeNodes[0]]->id;
+    for (int round = 0; raceOk && round < RACE_ROUNDS; round++)
+    {
+        Trip **raceTrips = new Trip *[RACE_TRIPS];
+        Driver **raceDrivers = new Driver *[RACE_DRIVERS];
+        for (int t = 0; t < RACE_TRIPS; t++)
+            raceTrips[t] = new Trip(t + 1, t + 1, raceNode, raceNode);
+        for (int d = 0; d < RACE_DRIVERS; d++)
+            raceDrivers[d] = new Driver(d, raceNode, "zone1");
+
+        std::thread dispatcher(raceAssign, raceTrips, RACE_TRIPS, raceDrivers, RACE_DRIVERS);
+        std::thread rider(raceCancel, raceTrips, RACE_TRIPS, raceDrivers);
+        std::thread mover(raceMove, raceTrips, RACE_TRIPS, raceDrivers);
+        dispatcher.join();
+        rider.join();
+        mover.join();
+
+        // Every busy driver is on a live trip that names it, and vice versa
+        for (int d = 0; raceOk && d < RACE_DRIVERS; d++)
+        {
+            if (raceDrivers[d]->isAvailable())
+                continue;
+            Trip *trip = raceTrips[raceDrivers[d]->getAssignedTripId() - 1];
+            TripState state = trip->getState();
+            raceOk = trip->getDriverId() == d && (state == ASSIGNED || state == PICKUP_IN_PROGRESS);
+        }
+        for (int t = 0; raceOk && t < RACE_TRIPS; t++)
+        {
+            TripState state = raceTrips[t]->getState();
+            raceCancelled += state == CANCELLED ? 1 : 0;
+            raceCompleted += state == COMPLETED ? 1 : 0;
+            if (state == ASSIGNED || state == PICKUP_IN_PROGRESS)
+            {
+                Driver *driver = raceDrivers[raceTrips[t]->getDriverId()];
+                raceOk = !driver->isAvailable() && driver->getAssignedTripId() == t + 1;
+            }
+            if (t % 2 == 0)
+                raceOk = raceOk && state == CANCELLED;
+        }
+
+        for (int t = 0; t < RACE_TRIPS; t++)
+            delete raceTrips[t];
+        for (int d = 0; d < RACE_DRIVERS; d++)
+            delete raceDrivers[d];
+        delete[] raceTrips;
+        delete[] raceDrivers;
+    }
+    // An assignment that loses its transition leaves nothing to roll back
+    DispatchEngine lostEngine(&city, 4, 4);
+    saved = std::cout.rdbuf(&nullBuffer);
+    lostEngine.addDriver(1, raceNode, "zone1", false);
+    lostEngine.addDriver(2, raceNode, "zone1", false);
+    lostEngine.requestTrip(1, 1, raceNode, raceNode);
+    lostEngine.requestTrip(2, 2, raceNode, raceNode);
+    raceOk = raceOk && lostEngine.assignTrip(2, 2) && lostEngine.cancelTrip(1);
+    int lostOps = lostEngine.getRollbackManager()->getOperationCount();
+    // Rolling back now undoes trip 2's assignment, not the lost one
+    raceOk = raceOk && !lostEngine.assignTrip(1, 1) && lostEngine.getDriver(1)->isAvailable() &&
+             lostEngine.getRollbackManager()->getOperationCount() == lostOps &&
+             lostEngine.getRollbackManager()->rollbackLast(&lostEngine) &&
+             lostEngine.getDriver(2)->isAvailable();
+    std::cout.rdbuf(saved);
+
+    // The engine's own dispatch, waiting queue, movement and cancellation
+    // on three threads at once, with a journal thread reading the events.
+    // Build with -fsanitize=thread to check the engine's locking as well.
+    const int ENGINE_TRIPS = 60;
+    const int ENGINE_DRIVERS = 8;
+    const int ENGINE_ROUNDS = 6;
+    int engineCompleted = 0;
+    int engineCancelled = 0;
+    int engineWaiting = 0;
+    for (int round = 0; raceOk && round < ENGINE_ROUNDS; round++)
+    {
+        DispatchEngine raceEngine(&city, ENGINE_DRIVERS, ENGINE_TRIPS);
+        saved = std::cout.rdbuf(&nullBuffer);
+        for (int d = 1; d <= ENGINE_DRIVERS; d++)
+        {
+            Node *n = gi->nodes[routeNodes[nextRandom(seed) % routeCount]];
+            raceEngine.addDriver(d, n->id, n->zone);
+        }
+        const char **pickups = new const char *[ENGINE_TRIPS];
+        const char **dropoffs = new const char *[ENGINE_TRIPS];
+        for (int t = 0; t < ENGINE_TRIPS; t++)
+        {
+            pickups[t] = gi->nodes[routeNodes[nextRandom(seed) % routeCount]]->id;
+            dropoffs[t] = gi->nodes[routeNodes[nextRandom(seed) % routeCount]]->id;
+        }
+        TripEventBus *raceBus = raceEngine.getEventBus();
+        TripEventSubscription *raceJournal = raceBus->subscribe(1 << 16);
+        EventReplay raceReplay;
+        raceReplay.states = new int[ENGINE_TRIPS + 1];
+        for (int id = 0; id <= ENGINE_TRIPS; id++)
+            raceReplay.states[id] = -1;
+        raceReplay.maxTripId = ENGINE_TRIPS;
+        raceReplay.events = 0;
+        raceReplay.inOrder = true;
+        std::atomic<bool> raceJournalDone(false);
+
+        EngineRace race;
+        race.engine = &raceEngine;
+        race.tripCount = ENGINE_TRIPS;
+        race.pickups = pickups;
+        race.dropoffs = dropoffs;
+        race.dispatched.store(false);
+        race.cancelled.store(false);
+        std::thread journalThread(replayEvents, raceJournal, &raceJournalDone, &raceReplay);
+        std::thread dispatcher(engineDispatch, &race);
+        std::thread rider(engineCancel, &race);
+        std::thread mover(engineMove, &race);
+        dispatcher.join();
+        rider.join();
+        mover.join();
+        raceJournalDone.store(true, std::memory_order_release);
+        journalThread.join();
+        std::cout.rdbuf(saved);
+
+        // Counters and the active set match the trips, every driver is free
+        // again, and each trip finished or still waits for a driver
+        raceOk = activeSetMatches(raceEngine, ENGINE_TRIPS) && raceEngine.getActiveTripsCount() == 0 &&
+                 raceEngine.getAvailableDriverCount() == ENGINE_DRIVERS;
+        for (int id = 1; raceOk && id <= ENGINE_TRIPS; id++)
+        {
+            TripState state = raceEngine.getTrip(id)->getState();
+            bool waiting = state == REQUESTED && raceEngine.isWaitingForDriver(id);
+            engineCompleted += state == COMPLETED ? 1 : 0;
+            engineCancelled += state == CANCELLED ? 1 : 0;
+            engineWaiting += waiting ? 1 : 0;
+            raceOk = (state == COMPLETED || waiting || (id % 2 == 1 && state == CANCELLED)) &&
+                     raceReplay.states[id] == state;
+        }
+        // The journal saw every event in order; the rollback log lost no
+        // snapshot and stayed newest first
+        int logged = 0;
+        long long newer = 0;
+        for (OperationSnapshot *snap = raceEngine.getRollbackManager()->getSnapshotStack(); snap; snap = snap->next)
+        {
+            raceOk = raceOk && (logged == 0 || snap->sequence < newer);
+            newer = snap->sequence;
+            logged++;
+        }
+        raceOk = raceOk && logged == raceEngine.getRollbackManager()->getOperationCount() &&
+                 raceReplay.inOrder && raceReplay.events == raceBus->getPublishedCount();
+        raceBus->unsubscribe(raceJournal);
+        delete[] raceReplay.states;
+        delete[] pickups;
+        delete[] dropoffs;
+    }
+    std::cout << RACE_ROUNDS << " rounds of " << RACE_TRIPS << " trips: " << raceCancelled << " cancelled, "
+              << raceCompleted << " completed, no driver left on a dead trip" << std::endl;
+    std::cout << ENGINE_ROUNDS << " rounds of " << ENGINE_TRIPS << " trips through one engine: " << engineCancelled
+              << " cancelled, " << engineCompleted << " completed, " << engineWaiting << " still waiting" << std::endl;
+    std::cout << (raceOk ? "✓ Trip and driver pairing, counters and logs stay consistent under concurrent actors."
+                         : "✗ A driver and trip, a counter or a log disagree after concurrent actors.") << std::endl;
+    printSeparator();
+
+    // Test 10: Positions follow from departure time and speed, so coarse updates keep ETAs exact
+    std::cout << "Test 10: Kinematic movement with coarse and fine updates" << std::endl;
+    const int KIN_TRIPS = 30;
+    long long *etaCoarse = new long long[(KIN_TRIPS + 1) * 6];
+    long long *dropCoarse = etaCoarse + (KIN_TRIPS + 1);
+    long long *doneCoarse = dropCoarse + (KIN_TRIPS + 1);
+    long long *etaFine = doneCoarse + (KIN_TRIPS + 1);
+    long long *dropFine = etaFine + (KIN_TRIPS + 1);
+    long long *doneFine = dropFine + (KIN_TRIPS + 1);
+    saved = std::cout.rdbuf(&nullBuffer);
+    bool kinematicOk = runKinematicTrips(city, gi.get(), routeNodes, routeCount, KIN_TRIPS, 1000,
+                                         etaCoarse, dropCoarse, doneCoarse);
+    kinematicOk = runKinematicTrips(city, gi.get(), routeNodes, routeCount, KIN_TRIPS, 100,
+                                    etaFine, dropFine, doneFine) && kinematicOk;
+    std::cout.rdbuf(saved);
+    long long worstLate = 0;
+    for (int id = 1; kinematicOk && id <= KIN_TRIPS; id++)
+    {
+        long long late = doneCoarse[id] - dropCoarse[id];
+        if (late > worstLate)
+            worstLate = late;
+        kinematicOk = etaCoarse[id] == etaFine[id] && dropCoarse[id] == dropFine[id] &&
+                      late >= 0 && late < 100 && doneFine[id] == doneCoarse[id];
+    }
+    std::cout << KIN_TRIPS << " trips at 1 Hz and 10 Hz updates, latest completion " << worstLate
+              << " ms after its ETA" << std::endl;
+    std::cout << (kinematicOk ? "✓ ETAs and positions do not depend on the update interval."
+                              : "✗ Coarse updates changed an ETA, a position or a completion time.") << std::endl;
+    printSeparator();
+    delete[] etaCoarse;
+
+    // Test 11: Active-trip set and per-state counters follow every transition and rollback
+    std::cout << "Test 11: Indexed active trips with per-state counters" << std::endl;
+    const int COUNT_TRIPS = 400;
+    DispatchEngine countEngine(&city, 60, COUNT_TRIPS);
+    for (int id = 1; id <= 60; id++)
+    {
+        Node *n = gi->nodes[routeNodes[nextRandom(seed) % routeCount]];
+        countEngine.addDriver(id, n->id, n->zone);
+    }
+    saved = std::cout.rdbuf(&nullBuffer);
+    bool countsOk = true;
+    int requestedIds = 0;
+    for (int op = 0; countsOk && op < 3000; op++)
+    {
+        int action = nextRandom(seed) % 8;
+        int id = requestedIds > 0 ? 1 + (int)(nextRandom(seed) % requestedIds) : 0;
+        if ((action == 0 || id == 0) && requestedIds < COUNT_TRIPS)
+        {
+            requestedIds++;
+            countEngine.requestTrip(requestedIds, requestedIds,
+                                    gi->nodes[routeNodes[nextRandom(seed) % routeCount]]->id,
+                                    gi->nodes[routeNodes[nextRandom(seed) % routeCount]]->id);
+        }
+        else if (id == 0)
+            continue;
+        else if (action == 1)
+            countEngine.assignNearestDriver(id);
+        else if (action == 2)
+            countEngine.startPickupMovement(id);
+        else if (action == 3)
+            countEngine.startTrip(id);
+        else if (action == 4)
+            countEngine.completeTrip(id);
+        else if (action == 5)
+            countEngine.cancelTrip(id);
+        else if (action == 6)
+            countEngine.getRollbackManager()->rollbackLast(&countEngine);
+        else
+            countEngine.advanceTripMovement(id);
+        countsOk = activeSetMatches(countEngine, requestedIds);
+    }
+    std::cout.rdbuf(saved);
+    int countTotal = 0;
+    for (int st = 0; st < TRIP_STATE_COUNT; st++)
+        countTotal += countEngine.getTripCountInState((TripState)st);
+    countsOk = countsOk && countTotal == countEngine.getTripCount();
+    std::cout << requestedIds << " trips: " << countEngine.getActiveTripsCount() << " active, "
+              << countEngine.getTripCountInState(COMPLETED) << " completed, "
+              << countEngine.getTripCountInState(CANCELLED) << " cancelled" << std::endl;
+    std::cout << (countsOk ? "✓ Active set and state counters match a full scan after every operation."
+                           : "✗ Active set or state counters drifted from the stored trips.") << std::endl;
+    printSeparator();
+
+    // Test 12: Per-driver shortest-path trees answer ranking lookups exactly
+    std::cout << "Test 12: Driver shortest-path trees vs fresh searches" << std::endl;
+    const int REACH_DRIVERS = 40, REACH_TARGETS = 60;
+    DispatchEngine reachEngine(&city, REACH_DRIVERS, 1);
+    for (int id = 1; id <= REACH_DRIVERS; id++)
+    {
+        Node *n = gi->nodes[routeNodes[nextRandom(seed) % routeCount]];
+        reachEngine.addDriver(id, n->id, n->zone);
+    }
+    int reachTargets[REACH_TARGETS];
+    for (int t = 0; t < REACH_TARGETS; t++)
+        reachTargets[t] = routeNodes[nextRandom(seed) % routeCount];
+    // Targets near the drivers as well, so the trees answer most lookups
+    for (int t = 0; t < REACH_TARGETS / 2; t++)
+    {
+        Driver *driver = reachEngine.getDriverByIndex(t % REACH_DRIVERS);
+        int at = city.getNodeIndex(driver->getCurrentNodeId());
+        int e = gi->adjOffset[at];
+        reachTargets[t] = e < gi->adjOffset[at + 1] ? gi->adjTarget[e] : at;
+    }
+    DriverReach *reachTrees = reachEngine.getDriverReach();
+    int answered = 0;
+    bool reachOk = reachMatchesSearch(city, reachEngine, reachTargets, REACH_TARGETS, answered);
+    long builtOnce = reachTrees->getRebuildCount();
+    reachOk = reachOk && builtOnce == REACH_DRIVERS &&
+              reachMatchesSearch(city, reachEngine, reachTargets, REACH_TARGETS, answered) &&
+              reachTrees->getRebuildCount() == builtOnce;   // Unchanged drivers reuse their trees
+
+    // One driver moves along a road: only its tree is rebuilt
+    Driver *mover = reachEngine.getDriverByIndex(0);
+    int moverAt = city.getNodeIndex(mover->getCurrentNodeId());
+    mover->setCurrentNodeId(gi->nodes[gi->adjTarget[gi->adjOffset[moverAt]]]->id);
+    reachOk = reachOk && reachMatchesSearch(city, reachEngine, reachTargets, REACH_TARGETS, answered) &&
+              reachTrees->getRebuildCount() == builtOnce + 1;
+
+    // A road change bumps the graph version and stales every tree
+    Driver *closer = reachEngine.getDriverByIndex(1);
+    int closerAt = city.getNodeIndex(closer->getCurrentNodeId());
+    const char *closedFrom = gi->nodes[closerAt]->id;
+    const char *closedTo = gi->nodes[gi->adjTarget[gi->adjOffset[closerAt]]]->id;
+    reachOk = reachOk && city.closeRoad(closedFrom, closedTo) &&
+              reachMatchesSearch(city, reachEngine, reachTargets, REACH_TARGETS, answered) &&
+              reachTrees->getRebuildCount() == builtOnce + 1 + REACH_DRIVERS;
+    city.reopenRoad(closedFrom, closedTo);
+    std::cout << reachTrees->getLookupCount() << " lookups, " << answered << " answered by trees, "
+              << reachTrees->getRebuildCount() << " tree builds" << std::endl;
+    reachOk = reachOk && answered > 0;
+    std::cout << (reachOk ? "✓ Tree distances match fresh searches and trees rebuild only after a move or road change."
+                          : "✗ Tree distances drifted or trees were rebuilt needlessly.") << std::endl;
+    printSeparator();
+
+    // Test 13: Requests wait for a driver and are served by urgency when one frees up
+    std::cout << "Test 13: Waiting requests served on driver release" << std::endl;
+    bool waitOk = requestQueueOrderHolds(seed);
+    DispatchEngine waitEngine(&city, 2, 16);
+    saved = std::cout.rdbuf(&nullBuffer);
+    for (int id = 1; id <= 2; id++)
+    {
+        Node *n = gi->nodes[routeNodes[nextRandom(seed) % routeCount]];
+        waitEngine.addDriver(id, n->id, n->zone);
+    }
+    for (int id = 1; id <= 8; id++)
+        waitEngine.requestTrip(id, id, gi->nodes[routeNodes[nextRandom(seed) % routeCount]]->id,
+                               gi->nodes[routeNodes[nextRandom(seed) % routeCount]]->id);
+    waitOk = waitOk && waitEngine.assignNearestDriver(1) >= 0 && waitEngine.assignNearestDriver(2) >= 0 &&
+             waitEngine.assignNearestDriver(3) < 0;
+    int expiredReports = 0;
+    waitOk = waitOk && waitEngine.waitForDriver(3, 60.0) &&       // Normal, late deadline
+             waitEngine.waitForDriver(4, 30.0) &&                 // Normal, earlier deadline
+             waitEngine.waitForDriver(5, 60.0, 1) &&              // Priority
+             waitEngine.waitForDriver(6, 0.0, 0, &tallyExpired, &expiredReports) &&  // Already due
+             waitEngine.waitForDriver(7, 60.0, 5) &&
+             !waitEngine.waitForDriver(1, 60.0);                  // Not REQUESTED
+    waitEngine.cancelTrip(7);                                     // Leaves the queue with its trip
+    waitOk = waitOk && !waitEngine.isWaitingForDriver(7) && waitEngine.getWaitingRequestCount() == 4;
+
+    // Completing trip 1 hands its driver straight to the priority request
+    int firstFreed = waitEngine.getTrip(1)->getDriverId();
+    waitEngine.startPickupMovement(1);
+    waitEngine.startTrip(1);
+    waitEngine.completeTrip(1);
+    waitOk = waitOk && waitEngine.getTrip(5)->getState() == ASSIGNED &&
+             waitEngine.getTrip(5)->getDriverId() == firstFreed;
+    // Cancelling trip 2 frees the other driver: the expired request is
+    // cancelled on the way to the earliest live deadline
+    waitEngine.cancelTrip(2);
+    waitOk = waitOk && waitEngine.getTrip(6)->getState() == CANCELLED && expiredReports == 1 &&
+             waitEngine.getTrip(4)->getState() == ASSIGNED &&
+             waitEngine.getTrip(3)->getState() == REQUESTED && waitEngine.isWaitingForDriver(3);
+    // A new driver is a freed driver too
+    Node *joining = gi->nodes[routeNodes[nextRandom(seed) % routeCount]];
+    waitEngine.addDriver(3, joining->id, joining->zone);
+    waitOk = waitOk && waitEngine.getTrip(3)->getState() == ASSIGNED &&
+             waitEngine.getTrip(3)->getDriverId() == 3 && waitEngine.getWaitingRequestCount() == 0;
+    // Expiry without any driver event
+    waitOk = waitOk && waitEngine.waitForDriver(8, 0.0, 0, &tallyExpired, &expiredReports) &&
+             waitEngine.expireWaitingRequests() == 1 && expiredReports == 2 &&
+             waitEngine.getTrip(8)->getState() == CANCELLED;
+    std::cout.rdbuf(saved);
+    std::cout << expiredReports << " expired, " << waitEngine.getTripCountInState(ASSIGNED)
+              << " assigned from the queue" << std::endl;
+    std::cout << (waitOk ? "✓ Freed drivers go to the most urgent waiting request; expired requests are cancelled."
+                         : "✗ Waiting requests were served out of order or not at all.") << std::endl;
+    printSeparator();
+
+    // Test 14: Ranked candidate streams with per-request exclusions
+    std::cout << "Test 14: Candidate streams and rejected drivers" << std::endl;
+    const int CANDIDATE_DRIVERS = 60;
+    DispatchEngine candidateEngine(&city, CANDIDATE_DRIVERS, 16);
+    saved = std::cout.rdbuf(&nullBuffer);
+    for (int id = 1; id <= CANDIDATE_DRIVERS; id++)
+    {
+        Node *n = gi->nodes[routeNodes[nextRandom(seed) % routeCount]];
+        candidateEngine.addDriver(id, n->id, n->zone);
+    }
+    const char *candidatePickup = gi->nodes[routeNodes[nextRandom(seed) % routeCount]]->id;
+    const char *candidateDrop = gi->nodes[routeNodes[nextRandom(seed) % routeCount]]->id;
+    for (int id = 1; id <= 4; id++)
+        candidateEngine.requestTrip(id, id, candidatePickup, candidateDrop);
+    bool candidatesOk = candidateOrderMatches(city, candidateEngine, CANDIDATE_DRIVERS, 1);
+
+    // Rejecting drivers moves the trip down the same ranking
+    int ranked[3];
+    for (int r = 0; r < 3; r++)
+        ranked[r] = candidateEngine.nextCandidate(2);
+    candidatesOk = candidatesOk && candidateEngine.assignNearestDriver(3) == ranked[0] &&
+                   candidateEngine.reassignToNextCandidate(3) == ranked[1] &&
+                   candidateEngine.reassignToNextCandidate(3) == ranked[2] &&
+                   candidateEngine.getTrip(3)->getDriverId() == ranked[2] &&
+                   candidateEngine.getExcludedCandidateCount(3) == 2 &&
+                   candidateEngine.getDriver(ranked[0])->isAvailable() &&
+                   candidateEngine.getDriver(ranked[1])->isAvailable();
+    // Excluded drivers stay excluded for that request only
+    candidatesOk = candidatesOk && candidateEngine.excludeCandidate(4, ranked[0]) &&
+                   !candidateEngine.excludeCandidate(4, ranked[0]) &&
+                   candidateEngine.assignNearestDriver(4) == ranked[1] &&
+                   activeSetMatches(candidateEngine, 4);
+    candidateEngine.cancelTrip(3);
+    candidateEngine.cancelTrip(4);
+    candidatesOk = candidatesOk && candidateEngine.getExcludedCandidateCount(3) == 0;
+
+    // With nobody else free the trip keeps its driver
+    DispatchEngine loneEngine(&city, 1, 4);
+    Node *loneNode = gi->nodes[routeNodes[nextRandom(seed) % routeCount]];
+    loneEngine.addDriver(1, loneNode->id, loneNode->zone);
+    loneEngine.requestTrip(1, 1, candidatePickup, candidateDrop);
+    candidatesOk = candidatesOk && loneEngine.assignNearestDriver(1) == 1 &&
+                   loneEngine.reassignToNextCandidate(1) == -1 &&
+                   loneEngine.getTrip(1)->getState() == ASSIGNED && loneEngine.getTrip(1)->getDriverId() == 1;
+
+    // The only candidate is taken before it can be reserved: the trip keeps
+    // its driver, and that driver is not handed to a waiting request
+    DispatchEngine lostCandidateEngine(&city, 2, 4);
+    lostCandidateEngine.addDriver(1, loneNode->id, loneNode->zone);
+    lostCandidateEngine.addDriver(2, loneNode->id, loneNode->zone);
+    lostCandidateEngine.requestTrip(1, 1, candidatePickup, candidateDrop);
+    lostCandidateEngine.requestTrip(2, 2, candidatePickup, candidateDrop);
+    candidatesOk = candidatesOk && lostCandidateEngine.assignTrip(1, 1) &&
+                   lostCandidateEngine.waitForDriver(2, 60.0);
+    lostCandidateEngine.setOfferListener(takeOfferedDriver, &lostCandidateEngine);
+    int lostResult = lostCandidateEngine.reassignToNextCandidate(1);
+    Trip *lostTrip = lostCandidateEngine.getTrip(1);
+    candidatesOk = candidatesOk && lostCandidateEngine.getDriver(2)->getAssignedTripId() == 1 << 30 &&
+                   lostResult == -1 &&
+                   lostTrip->getState() == ASSIGNED && lostTrip->getDriverId() == 1 &&
+                   lostCandidateEngine.getDriver(1)->getAssignedTripId() == 1 &&
+                   lostCandidateEngine.getTrip(2)->getState() == REQUESTED &&
+                   activeSetMatches(lostCandidateEngine, 2);
+    std::cout.rdbuf(saved);
+    std::cout << "Ranked " << candidateEngine.getAvailableDriverCount() << " free drivers; rejected "
+              << ranked[0] << " and " << ranked[1] << ", trip moved to " << ranked[2] << std::endl;
+    std::cout << (candidatesOk ? "✓ Candidate streams follow the nearest-driver order and honour exclusions."
+                               : "✗ Candidate streams repeated, skipped or misordered drivers.") << std::endl;
+    printSeparator();
+
+    // Test 15: Pre-booked rides are planned ahead and leave at pickup time minus the drive
+    std::cout << "Test 15: Pre-booked rides on the timing wheel" << std::endl;
+    DispatchEngine bookEngine(&city, 4, 64);
+    TripScheduler *bookClock = bookEngine.getScheduler();
+    saved = std::cout.rdbuf(&nullBuffer);
+    int bookDriverNodes[3];
+    for (int id = 1; id <= 3; id++)
+    {
+        bookDriverNodes[id - 1] = routeNodes[nextRandom(seed) % routeCount];
+        Node *n = gi->nodes[bookDriverNodes[id - 1]];
+        bookEngine.addDriver(id, n->id, n->zone);
+    }
+    const char *bookPickup = gi->nodes[routeNodes[nextRandom(seed) % routeCount]]->id;
+    const char *bookDrop = gi->nodes[routeNodes[nextRandom(seed) % routeCount]]->id;
+    const long long MINUTE = 60 * 1000;
+    bookEngine.setBookingLeadTime(60 * MINUTE);
+    long long bookPickupAt = 90 * MINUTE;
+    bool bookOk = bookEngine.bookTrip(1, 1, bookPickup, bookDrop, bookPickupAt) &&
+                  !bookEngine.bookTrip(1, 1, bookPickup, bookDrop, bookPickupAt) &&
+                  !bookEngine.requestTrip(1, 1, bookPickup, bookDrop) &&
+                  bookEngine.isBooked(1) && !bookEngine.getTrip(1);
+
+    // Planned at pickup minus the lead time, for the driver with the shortest drive
+    bookClock->advanceTo(30 * MINUTE + 100);
+    double bookDistances[3];
+    city.findDistancesToNodes(bookPickup, bookDriverNodes, 3, bookDistances);
+    int nearestBooked = 1;
+    for (int d = 1; d < 3; d++)
+        if (bookDistances[d] < bookDistances[nearestBooked - 1])
+            nearestBooked = d + 1;
+    long long dispatchAt = bookEngine.getBookingDispatchMs(1);
+    bookOk = bookOk && bookEngine.getTrip(1) && bookEngine.getTrip(1)->getState() == REQUESTED &&
+             bookEngine.getPlannedDriver(1) == nearestBooked &&
+             dispatchAt >= 30 * MINUTE && dispatchAt <= bookPickupAt;
+    // Dispatched at pickup minus the drive, so the driver arrives on time
+    bookClock->advanceTo(dispatchAt + 100);
+    long long bookedEta = bookClock->getPickupEtaMs(1);
+    bookOk = bookOk && !bookEngine.isBooked(1) && bookEngine.getTrip(1)->getState() == PICKUP_IN_PROGRESS &&
+             bookEngine.getTrip(1)->getDriverId() == nearestBooked &&
+             std::llabs(bookedEta - bookPickupAt) <= 101;
+
+    // A driver still on a trip is planned from its drop-off ETA and position
+    DispatchEngine busyEngine(&city, 1, 8);
+    TripScheduler *busyClock = busyEngine.getScheduler();
+    Node *busyStart = gi->nodes[routeNodes[nextRandom(seed) % routeCount]];
+    busyEngine.addDriver(1, busyStart->id, busyStart->zone);
+    busyEngine.requestTrip(1, 1, bookPickup, bookDrop);
+    busyEngine.assignNearestDriver(1);
+    busyClock->scheduleTrip(1);
+    long long busyFreeAt = busyClock->getDropoffEtaMs(1);
+    long long busyPickupAt = busyFreeAt + 30 * MINUTE;
+    busyEngine.setBookingLeadTime(busyPickupAt - 1000);
+    bookOk = bookOk && busyEngine.bookTrip(2, 2, bookPickup, bookDrop, busyPickupAt);
+    busyClock->advanceTo(1100);
+    long long busyDispatchAt = busyEngine.getBookingDispatchMs(2);
+    bookOk = bookOk && busyEngine.getPlannedDriver(2) == 1 && busyDispatchAt >= busyFreeAt;
+    busyClock->advanceTo(busyDispatchAt + 100);
+    bookOk = bookOk && busyEngine.getTrip(1)->getState() == COMPLETED &&
+             busyEngine.getTrip(2)->getState() == PICKUP_IN_PROGRESS &&
+             std::llabs(busyClock->getPickupEtaMs(2) - busyPickupAt) <= 101;
+    busyClock->runUntilIdle();
+    bookOk = bookOk && busyEngine.getTrip(2)->getState() == COMPLETED;
+
+    // With no driver at all, the booking waits one lead time on the simulated clock
+    DispatchEngine emptyEngine(&city, 1, 4);
+    TripScheduler *emptyClock = emptyEngine.getScheduler();
+    emptyEngine.setBookingLeadTime(10 * MINUTE);
+    bookOk = bookOk && emptyEngine.bookTrip(1, 1, bookPickup, bookDrop, 30 * MINUTE);
+    emptyClock->advanceTo(30 * MINUTE + 100);
+    bookOk = bookOk && emptyEngine.isWaitingForDriver(1) && emptyEngine.getTrip(1)->getState() == REQUESTED;
+    emptyClock->advanceTo(40 * MINUTE - 1000);
+    bookOk = bookOk && emptyEngine.isWaitingForDriver(1) && emptyEngine.isBooked(1);
+    emptyClock->advanceTo(40 * MINUTE + 100);
+    bookOk = bookOk && !emptyEngine.isWaitingForDriver(1) && !emptyEngine.isBooked(1) &&
+             emptyEngine.getTrip(1)->getState() == CANCELLED;
+
+    // Many future bookings: O(1) inserts, cancelled before they are planned
+    const int FUTURE_BOOKINGS = 20000;
+    std::chrono::steady_clock::time_point bookBegin = std::chrono::steady_clock::now();
+    for (int b = 0; b < FUTURE_BOOKINGS; b++)
+        bookEngine.bookTrip(1000 + b, b, bookPickup, bookDrop,
+                            bookPickupAt + (long long)(nextRandom(seed) % (7 * 24 * 60)) * MINUTE);
+    double bookMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - bookBegin).count();
+    bookOk = bookOk && bookEngine.getBookingCount() == FUTURE_BOOKINGS && bookEngine.getTripCount() == 1;
+    for (int b = 0; b < FUTURE_BOOKINGS; b++)
+        bookOk = bookOk && bookEngine.cancelTrip(1000 + b);
+    bookOk = bookOk && bookEngine.getBookingCount() == 0 && !bookEngine.isBooked(1000);
+    std::cout.rdbuf(saved);
+    std::cout << "Booking planned for driver " << nearestBooked << ", pickup ETA " << bookedEta / 1000.0
+              << " s for " << bookPickupAt / 1000.0 << " s; " << FUTURE_BOOKINGS << " bookings stored in "
+              << bookMs << " ms" << std::endl;
+    std::cout << (bookOk ? "✓ Bookings are planned ahead, dispatched at pickup time minus the drive and arrive on time."
+                         : "✗ Bookings were planned, dispatched or stored incorrectly.") << std::endl;
+    printSeparator();
+
+    // Test 16: Lifecycle events fan out to per-subscriber rings without blocking the engine
+    std::cout << "Test 16: Trip event bus with asynchronous consumers" << std::endl;
+    const int EVENT_TRIPS = 400;
+    DispatchEngine eventEngine(&city, 60, EVENT_TRIPS);
+    for (int id = 1; id <= 60; id++)
+    {
+        Node *n = gi->nodes[routeNodes[nextRandom(seed) % routeCount]];
+        eventEngine.addDriver(id, n->id, n->zone);
+    }
+    TripEventBus *bus = eventEngine.getEventBus();
+    TripEventSubscription *journal = bus->subscribe(1 << 16);
+    TripEventSubscription *laggard = bus->subscribe(16);   // Never drained until the end
+    EventReplay replay;
+    replay.maxTripId = EVENT_TRIPS;
+    replay.states = new int[EVENT_TRIPS + 1];
+    for (int id = 0; id <= EVENT_TRIPS; id++)
+        replay.states[id] = -1;
+    replay.events = 0;
+    replay.inOrder = true;
+    std::atomic<bool> eventsDone(false);
+    std::thread journalThread(replayEvents, journal, &eventsDone, &replay);
+
+    saved = std::cout.rdbuf(&nullBuffer);
+    int eventIds = 0;
+    for (int op = 0; op < 3000; op++)
+    {
+        int action = nextRandom(seed) % 8;
+        int id = eventIds > 0 ? 1 + (int)(nextRandom(seed) % eventIds) : 0;
+        if ((action == 0 || id == 0) && eventIds < EVENT_TRIPS)
+        {
+            eventIds++;
+            eventEngine.requestTrip(eventIds, eventIds,
+                                    gi->nodes[routeNodes[nextRandom(seed) % routeCount]]->id,
+                                    gi->nodes[routeNodes[nextRandom(seed) % routeCount]]->id);
+        }
+        else if (id == 0)
+            continue;
+        else if (action == 1)
+            eventEngine.assignNearestDriver(id);
+        else if (action == 2)
+            eventEngine.startPickupMovement(id);
+        else if (action == 3)
+            eventEngine.startTrip(id);
+        else if (action == 4)
+            eventEngine.completeTrip(id);
+        else if (action == 5)
+            eventEngine.cancelTrip(id);
+        else if (action == 6)
+            eventEngine.getRollbackManager()->rollbackLast(&eventEngine);
+        else
+            eventEngine.advanceTripMovement(id);
+    }
+    std::cout.rdbuf(saved);
+    eventsDone.store(true, std::memory_order_release);
+    journalThread.join();
+
+    long long published = bus->getPublishedCount();
+    bool eventsOk = replay.inOrder && replay.events == published && journal->getDropped() == 0;
+    for (int id = 1; eventsOk && id <= eventIds; id++)
+        eventsOk = eventEngine.getTrip(id) && replay.states[id] == eventEngine.getTrip(id)->getState();
+    TripEvent lagged[16];
+    int laggedCount = laggard->poll(lagged, 16);
+    eventsOk = eventsOk && laggedCount == 16 && laggedCount + laggard->getDropped() == published &&
+               lagged[0].sequence == 1;
+    bus->unsubscribe(journal);
+    bus->unsubscribe(laggard);
+    eventsOk = eventsOk && !bus->hasSubscribers();
+    delete[] replay.states;
+    std::cout << published << " events for " << eventIds << " trips; slow subscriber kept " << laggedCount
+              << " and dropped " << (published - laggedCount) << std::endl;
+    std::cout << (eventsOk ? "✓ Replaying the event stream reproduces every trip's state; a full ring drops only its own events."
+                           : "✗ Event stream was out of order, incomplete or disagreed with the engine.") << std::endl;
+    printSeparator();
+
+    // Test 17: Finished trips are archived as compact records and stay queryable
+    std::cout << "Test 17: Trip archival with bounded live storage" << std::endl;
+    const int ARCHIVE_DRIVERS = 20;
+    const int ARCHIVE_RETENTION = 16;
+    DispatchEngine archiveEngine(&city, ARCHIVE_DRIVERS, 32);
+    DispatchEngine diskEngine(&city, ARCHIVE_DRIVERS, 32);
+    for (int id = 1; id <= ARCHIVE_DRIVERS; id++)
+    {
+        Node *n = gi->nodes[routeNodes[nextRandom(seed) % routeCount]];
+        archiveEngine.addDriver(id, n->id, n->zone);
+        diskEngine.addDriver(id, n->id, n->zone);
+    }
+    archiveEngine.setTerminalTripRetention(ARCHIVE_RETENTION);
+    diskEngine.setTerminalTripRetention(ARCHIVE_RETENTION);
+    const char *archivePath = "testdispatch_archive.bin";
+    bool archiveOk = diskEngine.setTripArchiveFile(archivePath) && !diskEngine.setTripArchiveFile(archivePath);
+    int maxStored = 0;
+    int diskMaxStored = 0;
+    saved = std::cout.rdbuf(&nullBuffer);
+    archiveOk = runArchivedTrips(archiveEngine, gi.get(), routeNodes, routeCount, seed, 100, maxStored) &&
+                runArchivedTrips(diskEngine, gi.get(), routeNodes, routeCount, seed, 10, diskMaxStored) &&
+                archiveOk;
+    std::cout.rdbuf(saved);
+    std::remove(archivePath);
+    // Archived ids stay taken, and rollbacks never reach an archived trip
+    archiveOk = archiveOk && maxStored <= ARCHIVE_RETENTION + ARCHIVE_DRIVERS &&
+                diskMaxStored <= ARCHIVE_RETENTION + ARCHIVE_DRIVERS &&
+                archiveEngine.getTrip(1) == nullptr && !archiveEngine.requestTrip(1, 1, homeNode, homeNode) &&
+                archiveEngine.getTripCount() == 100 * ARCHIVE_DRIVERS;
+    int archived = archiveEngine.getArchivedTripCount();
+    std::cout << archived << " trips archived in " << archived * sizeof(TripRecord) / 1024 << " KB (as Trip objects: "
+              << archived * (sizeof(Trip) / 1024) / 1024 << " MB); at most " << maxStored << " stored at once" << std::endl;
+    std::cout << (archiveOk ? "✓ Finished trips are archived in memory or on disk and found by id with their fare."
+                            : "✗ Archived trips were lost, wrong or kept in full.") << std::endl;
+    printSeparator();
+
+    // Test 18: One search prices every candidate drop-off as the trip will be charged
+    std::cout << "Test 18: Fare quotes for many destinations" << std::endl;
+    DispatchEngine quoteEngine(&city, 30, 64);
+    for (int id = 1; id <= 30; id++)
+    {
+        Node *n = gi->nodes[routeNodes[nextRandom(seed) % routeCount]];
+        quoteEngine.addDriver(id, n->id, n->zone);
+    }
+    // Destinations: locations (not road nodes) anywhere in the city
+    const int QUOTES = 400;
+    int *quoteTargets = new int[QUOTES];
+    for (int q = 0; q < QUOTES; q++)
+    {
+        int index;
+        do
+            index = (int)(nextRandom(seed) % gi->nodeCount);
+        while (city.isRouteNode(index));
+        quoteTargets[q] = index;
+    }
+    FareQuote *quotes = new FareQuote[QUOTES];
+    const char *quotePickup = gi->nodes[quoteTargets[0]]->id;   // A location, resolved to its road node
+    std::chrono::steady_clock::time_point quoteBegin = std::chrono::steady_clock::now();
+    int quoted = quoteEngine.quoteFares(quotePickup, quoteTargets, QUOTES, quotes);
+    double quoteMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - quoteBegin).count();
+
+    // Book a sample for real: fare, zone surcharge and drop-off ETA must agree
+    saved = std::cout.rdbuf(&nullBuffer);
+    bool quoteOk = quoted == QUOTES && quotes[0].rideDistance >= 0.0 && !quotes[0].crossZone;
+    int crossZoneQuotes = 0;
+    std::chrono::steady_clock::time_point searchBegin = std::chrono::steady_clock::now();
+    for (int q = 0; quoteOk && q < 40; q++)
+    {
+        int tripId = q + 1;
+        quoteOk = quoteEngine.requestTrip(tripId, tripId, quotePickup, gi->nodes[quoteTargets[q]]->id) &&
+                  quoteEngine.assignNearestDriver(tripId) >= 0 &&
+                  quoteEngine.getScheduler()->scheduleTrip(tripId);
+        Trip *quotedTrip = quoteEngine.getTrip(tripId);
+        quoteOk = quoteOk && std::fabs(quotedTrip->calculateTotalFare() - quotes[q].fare) < 1e-6 &&
+                  quotedTrip->calculateZoneSurcharge() == (quotes[q].crossZone ? CROSS_ZONE_SURCHARGE : 0.0) &&
+                  std::llabs(quoteEngine.getScheduler()->getDropoffEtaMs(tripId) - quotes[q].dropoffEtaMs) <= 1;
+        crossZoneQuotes += quotes[q].crossZone ? 1 : 0;
+        quoteEngine.cancelTrip(tripId);
+    }
+    double searchMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - searchBegin).count();
+    std::cout.rdbuf(saved);
+    quoteOk = quoteOk && crossZoneQuotes > 0 && crossZoneQuotes < 40;
+    std::cout << QUOTES << " destinations quoted in " << quoteMs << " ms; 40 of them booked and routed in "
+              << searchMs << " ms" << std::endl;
+    std::cout << (quoteOk ? "✓ Quoted fares, surcharges and drop-off ETAs match the booked trips."
+                          : "✗ A quote disagreed with the trip it priced.") << std::endl;
+    delete[] quotes;
+    delete[] quoteTargets;
+    printSeparator();
+
+    // Test 19: Driver state lives in columns; handles write through to them
+    std::cout << "Test 19: Structure-of-arrays driver fleet" << std::endl;
+    const int FLEET_DRIVERS = 20000;
+    DispatchEngine fleetEngine(&city, 16, 16);
+    for (int id = 1; id <= FLEET_DRIVERS; id++)
+    {
+        Node *n = gi->nodes[routeNodes[nextRandom(seed) % routeCount]];
+        fleetEngine.addDriver(id, n->id, n->zone, false);
+    }
+    // Reserve, release, move and rezone through the handles, then drop a few
+    for (int step = 0; step < 4 * FLEET_DRIVERS; step++)
+    {
+        Driver *driver = fleetEngine.getDriver(1 + (int)(nextRandom(seed) % FLEET_DRIVERS));
+        if (!driver)
+            continue;
+        switch (nextRandom(seed) % 4)
+        {
+        case 0:
+            driver->tryReserve(step);
+            break;
+        case 1:
+            driver->releaseTrip(driver->getAssignedTripId());
+            break;
+        case 2:
+            driver->setCurrentNodeId(gi->nodes[routeNodes[nextRandom(seed) % routeCount]]->id);
+            break;
+        default:
+            driver->setZone(step % 2 ? "zone1" : "zone2");
+            break;
+        }
+    }
+    for (int i = 0; i < FLEET_DRIVERS / 20; i++)
+        fleetEngine.removeDriver(1 + (int)(nextRandom(seed) % FLEET_DRIVERS));
+    bool fleetOk = fleetColumnsMatch(city, fleetEngine) && fleetEngine.getFleet()->find(FLEET_DRIVERS + 1) == nullptr;
+
+    // Free-driver scans over the handles and over the availability bits
+    const DriverFleet *fleet = fleetEngine.getFleet();
+    const int SCANS = 200;
+    long handleFree = 0;
+    long columnFree = 0;
+    std::chrono::steady_clock::time_point scanBegin = std::chrono::steady_clock::now();
+    for (int r = 0; r < SCANS; r++)
+    {
+        for (int slot = 0; slot < fleetEngine.getDriverCount(); slot++)
+            handleFree += fleetEngine.getDriverByIndex(slot)->isAvailable() ? 1 : 0;
+    }
+    double handleMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - scanBegin).count();
+    scanBegin = std::chrono::steady_clock::now();
+    for (int r = 0; r < SCANS; r++)
+        columnFree += fleet->countAvailable();
+    double columnMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - scanBegin).count();
+    int zone1 = fleet->getZoneId("zone1");
+    int zone2 = fleet->getZoneId("zone2");
+    int zoned = fleet->countAvailableInZone(zone1) + fleet->countAvailableInZone(zone2);
+    int otherZones = 0;
+    for (int slot = 0; slot < fleet->size(); slot++)
+    {
+        Driver *driver = fleet->at(slot);
+        otherZones += driver->isAvailable() && strcmp(driver->getZone(), "zone1") != 0 &&
+                      strcmp(driver->getZone(), "zone2") != 0 ? 1 : 0;
+    }
+    fleetOk = fleetOk && handleFree == columnFree && zone1 >= 0 && zone2 >= 0 &&
+              zoned + otherZones == fleet->countAvailable();
+
+    // Renumbering the graph leaves handles alone and the node column follows
+    city.freeze(false);
+    fleetOk = fleetOk && fleetColumnsMatch(city, fleetEngine);
+    city.freeze();
+    fleetOk = fleetOk && fleetColumnsMatch(city, fleetEngine);
+    std::cout << fleet->size() << " drivers (" << sizeof(Driver) << "-byte handles); " << SCANS
+              << " free-driver scans: " << handleMs << " ms over handles, " << columnMs << " ms over columns" << std::endl;
+    std::cout << (fleetOk ? "✓ Fleet columns track every handle update, removal and graph renumbering."
+                          : "✗ A fleet column disagreed with its driver.") << std::endl;
+    printSeparator();
+
+    delete[] nearHome;
+    delete[] nearMall;
+    delete[] routeNodes;
+    std::cout << "\n=== All Tests Completed Successfully! ===" << std::endl;
+    return 0;
+}
@@ -2,8 +2,18 @@
 #include <iostream>
 #include <cstring>
 
+static_assert(Trip::isValidTransition(REQUESTED, ASSIGNED) && Trip::isValidTransition(REQUESTED, CANCELLED) &&
+              Trip::isValidTransition(ASSIGNED, PICKUP_IN_PROGRESS) && Trip::isValidTransition(ASSIGNED, CANCELLED) &&
+              Trip::isValidTransition(PICKUP_IN_PROGRESS, ONGOING) &&
+              Trip::isValidTransition(PICKUP_IN_PROGRESS, CANCELLED) && Trip::isValidTransition(ONGOING, COMPLETED),
+              "trip lifecycle transitions missing from TRIP_TRANSITIONS");
+static_assert(!Trip::isValidTransition(ONGOING, CANCELLED) && !Trip::isValidTransition(COMPLETED, CANCELLED) &&
+              !Trip::isValidTransition(CANCELLED, REQUESTED) && !Trip::isValidTransition(REQUESTED, ONGOING),
+              "TRIP_TRANSITIONS allows a forbidden transition");
+
 Trip::Trip(int id, int rider, const char *pickup, const char *dropoff)
-    : tripId(id), riderId(rider), driverId(-1), state(REQUESTED), currentPathIndex(0)
+    : tripId(id), riderId(rider), status(packStatus(REQUESTED, -1)), currentPathIndex(0),
+      requestedAtMs(0), finishedAtMs(0)
 {
     strncpy(pickupNodeId, pickup, MAX_STRING_LENGTH - 1);
     pickupNodeId[MAX_STRING_LENGTH - 1] = '\0';
@@ -30,12 +40,12 @@ int Trip::getRiderId() const
 
 int Trip::getDriverId() const
 {
-    return driverId;
+    return (int)(unsigned int)(status.load() >> 32);
 }
 
 TripState Trip::getState() const
 {
-    return state;
+    return (TripState)(status.load() & 0xFF);
 }
 
 const char *Trip::getPickupNodeId() const
@@ -94,63 +104,68 @@ int Trip::getCurrentPathIndex() const
     return currentPathIndex;
 }
 
-bool Trip::isValidTransition(TripState from, TripState to)
-{
-    // REQUESTED -> ASSIGNED, CANCELLED
-    if (from == REQUESTED && (to == ASSIGNED || to == CANCELLED))
-        return true;
-    // ASSIGNED -> PICKUP_IN_PROGRESS, CANCELLED
-    if (from == ASSIGNED && (to == PICKUP_IN_PROGRESS || to == CANCELLED))
-        return true;
-    // PICKUP_IN_PROGRESS -> ONGOING, CANCELLED
-    if (from == PICKUP_IN_PROGRESS && (to == ONGOING || to == CANCELLED))
-        return true;
-    // ONGOING -> COMPLETED
-    if (from == ONGOING && to == COMPLETED)
-        return true;
-    return false;
+long long Trip::getRequestedAtMs() const
+{
+    return requestedAtMs;
+}
+
+long long Trip::getFinishedAtMs() const
+{
+    return finishedAtMs;
+}
+
+std::mutex &Trip::getLock() const
+{
+    return lock;
+}
+
+unsigned long long Trip::packStatus(TripState s, int driver)
+{
+    return ((unsigned long long)(unsigned int)driver << 32) | (unsigned long long)s;
+}
+
+// Retries only when another thread changed the word in between; gives up as
+// soon as the state it would leave no longer allows the move
+bool Trip::transitionTo(TripState to, int newDriver)
+{
+    unsigned long long current = status.load();
+    while (true)
+    {
+        TripState from = (TripState)(current & 0xFF);
+        if (!isValidTransition(from, to))
+            return false;
+        int driver = newDriver >= 0 ? newDriver : (int)(unsigned int)(current >> 32);
+        if (status.compare_exchange_weak(current, packStatus(to, driver)))
+            return true;
+    }
 }
 
 bool Trip::transitionToAssigned(int driver)
 {
-    if (!isValidTransition(state, ASSIGNED))
-        return false;
-    driverId = driver;
-    state = ASSIGNED;
-    return true;
+    return transitionTo(ASSIGNED, driver);
 }
 
 bool Trip::transitionToPickupInProgress()
 {
-    if (!isValidTransition(state, PICKUP_IN_PROGRESS))
+    if (!transitionTo(PICKUP_IN_PROGRESS, -1))
         return false;
-    state = PICKUP_IN_PROGRESS;
     currentPathIndex = 0;
     return true;
 }
 
 bool Trip::transitionToOngoing()
 {
-    if (!isValidTransition(state, ONGOING))
-        return false;
-    state = ONGOING;
-    return true;
+    return transitionTo(ONGOING, -1);
 }
 
 bool Trip::transitionToCompleted()
 {
-    if (!isValidTransition(state, COMPLETED))
-        return false;
-    state = COMPLETED;
-    return true;
+    return transitionTo(COMPLETED, -1);
 }
 
 bool Trip::transitionToCancelled()
 {
-    if (!isValidTransition(state, CANCELLED))
-        return false;
-    state = CANCELLED;
-    return true;
+    return transitionTo(CANCELLED, -1);
 }
 
 void Trip::setDriverToPickupPath(const PathResult &path)
@@ -165,7 +180,10 @@ void Trip::setPickupToDropoffPath(const PathResult &path)
 
 void Trip::setState(TripState s)
 {
-    state = s;
+    unsigned long long current = status.load();
+    while (!status.compare_exchange_weak(current, packStatus(s, (int)(unsigned int)(current >> 32))))
+    {
+    }
 }
 
 void Trip::setEffectivePickupNodeId(const char *nodeId)
@@ -191,6 +209,16 @@ void Trip::setCurrentPathIndex(int index)
     currentPathIndex = index;
 }
 
+void Trip::setRequestedAtMs(long long ms)
+{
+    requestedAtMs = ms;
+}
+
+void Trip::setFinishedAtMs(long long ms)
+{
+    finishedAtMs = ms;
+}
+
 bool Trip::advanceMovement()
 {
     // Returns true if there are more nodes to traverse
@@ -198,6 +226,7 @@ bool Trip::advanceMovement()
     currentPathIndex++;
     
     // Check if we've reached the end of current path segment
+    TripState state = getState();
     if (state == PICKUP_IN_PROGRESS)
     {
         return currentPathIndex < driverToPickupPath.pathLength;
@@ -234,8 +263,8 @@ const char *Trip::stateToString(TripState s) const
 void Trip::display() const
 {
     std::cout << "Trip #" << tripId << " | Rider: " << riderId
-              << " | Driver: " << (driverId == -1 ? -1 : driverId)
-              << " | State: " << stateToString(state)
+              << " | Driver: " << getDriverId()
+              << " | State: " << stateToString(getState())
               << " | Distance: " << getTotalDistance() << "m" << std::endl;
 }
 
@@ -267,7 +296,7 @@ double Trip::calculateBaseFare() const
     // Base fare should be calculated on the rider's actual trip distance only
     double rideDistance = getRideDistance();
     // Rate: 150 rupees per 1000 meters = 0.15 rupees per meter
-    double baseFare = (rideDistance / 1000.0) * 150.0;
+    double baseFare = (rideDistance / 1000.0) * FARE_PER_KM;
     return baseFare;
 }
 
@@ -285,7 +314,7 @@ double Trip::calculateZoneSurcharge() const
     // If zones are different, add 100 rupees surcharge
     if (strcmp(pickupZone, dropoffZone) != 0)
     {
-        return 100.0;
+        return CROSS_ZONE_SURCHARGE;
     }
     return 0.0;
 }
@@ -295,3 +324,8 @@ double Trip::calculateTotalFare() const
 {
     return calculateBaseFare() + calculateZoneSurcharge();
 }
+
+double Trip::fareFor(double rideDistance, bool crossZone)
+{
+    return (rideDistance / 1000.0) * FARE_PER_KM + (crossZone ? CROSS_ZONE_SURCHARGE : 0.0);
+}
@@ -2,6 +2,8 @@
 #define TRIP_H
 
 #include "city.h"
+#include <atomic>
+#include <mutex>
 
 enum TripState
 {
@@ -13,13 +15,30 @@ enum TripState
     CANCELLED
 };
 
+const int TRIP_STATE_COUNT = 6;
+
+const double FARE_PER_KM = 150.0;            // Rupees per 1000 m ridden
+const double CROSS_ZONE_SURCHARGE = 100.0;   // Pickup and drop-off in different zones
+
+// Legal transitions: row = current state, bit n = may move to TripState n
+constexpr unsigned char TRIP_TRANSITIONS[TRIP_STATE_COUNT] = {
+    (1 << ASSIGNED) | (1 << CANCELLED),             // REQUESTED
+    (1 << PICKUP_IN_PROGRESS) | (1 << CANCELLED),   // ASSIGNED
+    (1 << ONGOING) | (1 << CANCELLED),              // PICKUP_IN_PROGRESS
+    (1 << COMPLETED),                               // ONGOING
+    0,                                              // COMPLETED
+    0                                               // CANCELLED
+};
+
 class Trip
 {
 private:
     int tripId;
     int riderId;
-    int driverId;
-    TripState state;
+    // State (bits 0-7) and driver id (bits 32-63, -1 when unassigned) in one
+    // word, so concurrent transitions are a single compare-and-swap and a
+    // reader never sees a state paired with another assignment's driver
+    std::atomic<unsigned long long> status;
     char pickupNodeId[MAX_STRING_LENGTH];
     char dropoffNodeId[MAX_STRING_LENGTH];
     char effectivePickupNodeId[MAX_STRING_LENGTH];  // Resolved pickup node (route node)
@@ -28,6 +47,12 @@ private:
     PathResult driverToPickupPath;
     PathResult pickupToDropoffPath;
     int currentPathIndex;                            // For movement simulation
+    long long requestedAtMs;                         // Scheduler clock, set by the engine
+    long long finishedAtMs;                          // When it became COMPLETED/CANCELLED
+    mutable std::mutex lock;                         // See getLock()
+
+    static unsigned long long packStatus(TripState s, int driver);
+    bool transitionTo(TripState to, int newDriver);  // newDriver < 0 keeps the current one
 
 public:
     Trip(int id, int rider, const char *pickup, const char *dropoff);
@@ -48,6 +73,13 @@ public:
     double getTotalDistance() const;
     double getRideDistance() const;              // Distance rider actually travels (pickup->dropoff)
     int getCurrentPathIndex() const;
+    long long getRequestedAtMs() const;
+    long long getFinishedAtMs() const;
+
+    // Held by the engine across a transition and the paths, positions and
+    // path index that go with it, so a thread moving the trip never sees a
+    // state without its paths or a driver another thread has released
+    std::mutex &getLock() const;
 
     // State transitions
     bool transitionToAssigned(int driver);
@@ -68,17 +100,24 @@ public:
     void setDriverCurrentNodeId(const char *nodeId);
     void setRiderCurrentNodeId(const char *nodeId);
     void setCurrentPathIndex(int index);
+    void setRequestedAtMs(long long ms);
+    void setFinishedAtMs(long long ms);
 
     // Movement simulation
     bool advanceMovement();  // Advances one step, returns true if more steps remain
 
     // Validation
-    static bool isValidTransition(TripState from, TripState to);
+    static constexpr bool isValidTransition(TripState from, TripState to)
+    {
+        return from >= 0 && from < TRIP_STATE_COUNT && to >= 0 && to < TRIP_STATE_COUNT &&
+               ((TRIP_TRANSITIONS[from] >> to) & 1) != 0;
+    }
 
     // Payment calculation
     double calculateBaseFare() const;        // Calculate fare based on distance (150 rupees per 1000m)
     double calculateZoneSurcharge() const;   // Check if cross-zone and add 100 rupees surcharge
     double calculateTotalFare() const;       // Total fare including surcharge
+    static double fareFor(double rideDistance, bool crossZone);  // Same rule, before a trip exists
     
     // Helper function to extract zone from node ID
     static void extractZone(const char *nodeId, char *zone, int maxLen);
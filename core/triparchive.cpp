@@ -0,0 +1,93 @@
+#include "triparchive.h"
+
+TripArchive::TripArchive()
+    : chunks(nullptr), chunkCount(0), chunkCapacity(0), memoryCount(0), fileCount(0), slots(256)
+{
+}
+
+TripArchive::~TripArchive()
+{
+    for (int c = 0; c < chunkCount; c++)
+        delete[] chunks[c];
+    delete[] chunks;
+}
+
+bool TripArchive::openFile(const char *path)
+{
+    if (file.is_open())
+        return false;   // Records already written must stay readable
+    file.open(path, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+    return file.is_open();
+}
+
+bool TripArchive::isFileBacked() const
+{
+    return file.is_open();
+}
+
+bool TripArchive::append(const TripRecord &record)
+{
+    if (contains(record.tripId))
+        return false;
+
+    if (file.is_open())
+    {
+        file.seekp((std::streamoff)fileCount * sizeof(TripRecord));
+        file.write((const char *)&record, sizeof(TripRecord));
+        if (file.good())
+        {
+            slots.insert(record.tripId, -(fileCount + 1));
+            fileCount++;
+            return true;
+        }
+        file.clear();   // Disk trouble: keep the record in memory instead
+    }
+
+    if (memoryCount == chunkCount * CHUNK_RECORDS)
+    {
+        if (chunkCount == chunkCapacity)
+        {
+            int newCapacity = chunkCapacity > 0 ? chunkCapacity * 2 : 8;
+            TripRecord **grown = new TripRecord *[newCapacity];
+            for (int c = 0; c < chunkCount; c++)
+                grown[c] = chunks[c];
+            delete[] chunks;
+            chunks = grown;
+            chunkCapacity = newCapacity;
+        }
+        chunks[chunkCount++] = new TripRecord[CHUNK_RECORDS];
+    }
+    chunks[memoryCount / CHUNK_RECORDS][memoryCount % CHUNK_RECORDS] = record;
+    slots.insert(record.tripId, memoryCount);
+    memoryCount++;
+    return true;
+}
+
+bool TripArchive::find(int tripId, TripRecord &record) const
+{
+    int slot;
+    if (!slots.find(tripId, slot))
+        return false;
+    if (slot >= 0)
+    {
+        record = chunks[slot / CHUNK_RECORDS][slot % CHUNK_RECORDS];
+        return true;
+    }
+    file.seekg((std::streamoff)(-slot - 1) * sizeof(TripRecord));
+    file.read((char *)&record, sizeof(TripRecord));
+    if (file.good())
+        return true;
+    file.clear();
+    return false;
+}
+
+bool TripArchive::contains(int tripId) const
+{
+    int slot;
+    return slots.find(tripId, slot);
+}
+
+int TripArchive::size() const
+{
+    return slots.size();
+}
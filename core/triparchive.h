@@ -0,0 +1,59 @@
+#ifndef TRIPARCHIVE_H
+#define TRIPARCHIVE_H
+
+#include "trip.h"
+#include "registry.h"
+#include <fstream>
+
+// What is kept of a finished trip once its Trip object is freed
+struct TripRecord
+{
+    int tripId;
+    int riderId;
+    int driverId;              // -1 if it was never assigned
+    TripState state;           // COMPLETED or CANCELLED
+    int pickupIndex;           // Graph node indices, -1 if unknown
+    int dropoffIndex;
+    double fare;               // Trip::calculateTotalFare at archival
+    double rideDistance;       // Pickup to drop-off
+    double totalDistance;      // Including the drive to the pickup
+    long long requestedAtMs;   // Scheduler clock
+    long long finishedAtMs;
+};
+
+// Append-only store of finished trips, 64 bytes each against the
+// ~260 KB Trip object they replace. Records live in fixed-size chunks that
+// never move, or, after openFile, in a binary file of fixed-size records so
+// only the trip id index stays in memory. Either way a record is found by
+// trip id in O(1).
+class TripArchive
+{
+private:
+    static const int CHUNK_RECORDS = 1024;
+
+    TripRecord **chunks;
+    int chunkCount;
+    int chunkCapacity;
+    int memoryCount;           // Records held in chunks
+    int fileCount;             // Records written to the file
+    IdMap slots;               // trip id -> record number; file records as -(n + 1)
+    mutable std::fstream file;
+
+public:
+    TripArchive();
+    ~TripArchive();
+    TripArchive(const TripArchive &) = delete;
+    TripArchive &operator=(const TripArchive &) = delete;
+
+    // Later records go to this file (truncated). Once per archive; false if
+    // a file is already open or this one cannot be opened.
+    bool openFile(const char *path);
+    bool isFileBacked() const;
+
+    bool append(const TripRecord &record);   // False if the trip id is already archived
+    bool find(int tripId, TripRecord &record) const;
+    bool contains(int tripId) const;
+    int size() const;
+};
+
+#endif // TRIPARCHIVE_H
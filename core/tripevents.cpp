@@ -0,0 +1,80 @@
+#include "tripevents.h"
+
+TripEventSubscription::TripEventSubscription(int capacity) : ring(capacity), dropped(0)
+{
+}
+
+int TripEventSubscription::poll(TripEvent *events, int maxCount)
+{
+    int count = 0;
+    while (count < maxCount && ring.tryPop(events[count]))
+        count++;
+    return count;
+}
+
+long TripEventSubscription::getDropped() const
+{
+    return dropped.load(std::memory_order_relaxed);
+}
+
+TripEventBus::TripEventBus()
+    : subscribers(nullptr), subscriberCount(0), subscriberCapacity(0), nextSequence(1)
+{
+}
+
+TripEventBus::~TripEventBus()
+{
+    for (int i = 0; i < subscriberCount; i++)
+        delete subscribers[i];
+    delete[] subscribers;
+}
+
+TripEventSubscription *TripEventBus::subscribe(int capacity)
+{
+    if (subscriberCount == subscriberCapacity)
+    {
+        int newCapacity = subscriberCapacity > 0 ? subscriberCapacity * 2 : 4;
+        TripEventSubscription **grown = new TripEventSubscription *[newCapacity];
+        for (int i = 0; i < subscriberCount; i++)
+            grown[i] = subscribers[i];
+        delete[] subscribers;
+        subscribers = grown;
+        subscriberCapacity = newCapacity;
+    }
+    TripEventSubscription *subscription = new TripEventSubscription(capacity > 0 ? capacity : 4096);
+    subscribers[subscriberCount++] = subscription;
+    return subscription;
+}
+
+void TripEventBus::unsubscribe(TripEventSubscription *subscription)
+{
+    for (int i = 0; i < subscriberCount; i++)
+    {
+        if (subscribers[i] == subscription)
+        {
+            delete subscription;
+            subscribers[i] = subscribers[--subscriberCount];
+            return;
+        }
+    }
+}
+
+int TripEventBus::getSubscriberCount() const
+{
+    return subscriberCount;
+}
+
+void TripEventBus::publish(TripEvent &event)
+{
+    event.sequence = nextSequence++;
+    for (int i = 0; i < subscriberCount; i++)
+    {
+        if (!subscribers[i]->ring.tryPush(event))
+            subscribers[i]->dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+long long TripEventBus::getPublishedCount() const
+{
+    return nextSequence - 1;
+}
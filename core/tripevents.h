@@ -0,0 +1,76 @@
+#ifndef TRIPEVENTS_H
+#define TRIPEVENTS_H
+
+#include "trip.h"
+#include "lockfreequeue.h"
+#include <atomic>
+
+enum TripEventType
+{
+    TRIP_EVENT_REQUESTED,
+    TRIP_EVENT_ASSIGNED,
+    TRIP_EVENT_MOVED,        // Pickup or ride started, or the driver reached the next path node
+    TRIP_EVENT_COMPLETED,
+    TRIP_EVENT_CANCELLED,
+    TRIP_EVENT_ROLLED_BACK   // State restored by the rollback manager
+};
+
+struct TripEvent
+{
+    long long sequence;      // Per bus, from 1 and without gaps as published
+    long long simTimeMs;     // Scheduler clock when published
+    TripEventType type;
+    TripState state;         // Trip state after the event
+    int tripId;
+    int driverId;            // -1 when none
+    int nodeIndex;           // Driver's graph node for TRIP_EVENT_MOVED, else -1
+};
+
+// One consumer's view of the bus. Its ring is filled by the publishing
+// thread and drained by the consumer's thread only.
+class TripEventSubscription
+{
+private:
+    friend class TripEventBus;
+    SpscRing<TripEvent> ring;
+    std::atomic<long> dropped;
+
+public:
+    explicit TripEventSubscription(int capacity);
+
+    int poll(TripEvent *events, int maxCount);   // Consumer thread; returns events copied
+    long getDropped() const;                     // Events lost because the ring was full
+};
+
+// Typed trip lifecycle events, fanned out to every subscriber through its
+// own single-producer/single-consumer ring. Publishing copies the event into
+// each ring and never waits: when a consumer falls behind, its ring fills
+// and further events are counted as dropped for that subscriber only. So a
+// slow UI, journal or metrics thread cannot slow the dispatch path. With no
+// subscribers, publishing is one branch. Subscribe and unsubscribe from the
+// publishing (engine) thread; unsubscribe only after the consumer has
+// stopped polling.
+class TripEventBus
+{
+private:
+    TripEventSubscription **subscribers;
+    int subscriberCount;
+    int subscriberCapacity;
+    long long nextSequence;
+
+public:
+    TripEventBus();
+    ~TripEventBus();
+    TripEventBus(const TripEventBus &) = delete;
+    TripEventBus &operator=(const TripEventBus &) = delete;
+
+    TripEventSubscription *subscribe(int capacity = 4096);
+    void unsubscribe(TripEventSubscription *subscription);
+    bool hasSubscribers() const { return subscriberCount > 0; }
+    int getSubscriberCount() const;
+
+    void publish(TripEvent &event);              // Stamps the sequence number
+    long long getPublishedCount() const;
+};
+
+#endif // TRIPEVENTS_H
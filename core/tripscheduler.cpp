@@ -0,0 +1,553 @@
+#include "tripscheduler.h"
+#include "dispatchengine.h"
+#include <cmath>
+#include <cstring>
+
+TripScheduler::TripScheduler(DispatchEngine *e, long long tickMillis, long long stepMillis)
+    : engine(e), tickMs(tickMillis > 0 ? tickMillis : 100), stepMs(stepMillis > 0 ? stepMillis : 300),
+      currentTick(0), simTimeMs(0), overflow(nullptr), freeEvents(nullptr), pendingCount(0), ticking(false),
+      motions(nullptr), motionCount(0), motionAllocated(0), motionSlots(64), driverSpeed(10.0), deltas(nullptr), deltaCount(0), deltaCapacity(0), totalSteps(0),
+      listener(nullptr), listenerContext(nullptr), speed(1.0), realTimeStarted(false), carryMs(0.0)
+{
+    for (int l = 0; l < WHEEL_LEVELS; l++)
+        for (int s = 0; s < WHEEL_SLOTS; s++)
+            wheel[l][s] = nullptr;
+}
+
+TripScheduler::~TripScheduler()
+{
+    // Pending events go back to the free list, then the free list is released
+    for (int l = 0; l < WHEEL_LEVELS; l++)
+    {
+        for (int s = 0; s < WHEEL_SLOTS; s++)
+        {
+            while (wheel[l][s])
+            {
+                TimerEvent *event = wheel[l][s];
+                wheel[l][s] = event->next;
+                freeEvent(event);
+            }
+        }
+    }
+    while (overflow)
+    {
+        TimerEvent *event = overflow;
+        overflow = event->next;
+        freeEvent(event);
+    }
+    while (freeEvents)
+    {
+        TimerEvent *event = freeEvents;
+        freeEvents = event->next;
+        delete event;
+    }
+    for (int m = 0; m < motionAllocated; m++)
+        delete motions[m];
+    delete[] motions;
+    delete[] deltas;
+}
+
+TripScheduler::TimerEvent *TripScheduler::allocEvent()
+{
+    if (!freeEvents)
+        return new TimerEvent();
+    TimerEvent *event = freeEvents;
+    freeEvents = event->next;
+    return event;
+}
+
+void TripScheduler::freeEvent(TimerEvent *event)
+{
+    event->next = freeEvents;
+    freeEvents = event;
+}
+
+// Place an event on the level whose span covers its distance from now
+void TripScheduler::insertEvent(TimerEvent *event)
+{
+    long long delta = event->dueTick - currentTick;
+    if (delta < 0)
+        delta = 0;
+
+    TimerEvent **list = &overflow;
+    for (int l = 0; l < WHEEL_LEVELS; l++)
+    {
+        if (delta < (1LL << (WHEEL_BITS * (l + 1))))
+        {
+            int slot = (int)((event->dueTick >> (WHEEL_BITS * l)) & (WHEEL_SLOTS - 1));
+            if (delta == 0)
+                slot = (int)(currentTick & (WHEEL_SLOTS - 1));
+            list = &wheel[l][slot];
+            break;
+        }
+    }
+    event->next = *list;
+    *list = event;
+}
+
+// Move the events of the current slot at a higher level down the hierarchy
+void TripScheduler::cascade(int level)
+{
+    int slot = (int)((currentTick >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1));
+    TimerEvent *event = wheel[level][slot];
+    wheel[level][slot] = nullptr;
+    while (event)
+    {
+        TimerEvent *next = event->next;
+        insertEvent(event);
+        event = next;
+    }
+}
+
+MovementDelta *TripScheduler::appendDelta()
+{
+    if (deltaCount == deltaCapacity)
+    {
+        int newCapacity = deltaCapacity > 0 ? deltaCapacity * 2 : 32;
+        MovementDelta *grown = new MovementDelta[newCapacity];
+        if (deltaCount > 0)
+            memcpy(grown, deltas, sizeof(MovementDelta) * deltaCount);
+        delete[] deltas;
+        deltas = grown;
+        deltaCapacity = newCapacity;
+    }
+    return &deltas[deltaCount++];
+}
+
+TripScheduler::Motion *TripScheduler::findMotion(int tripId) const
+{
+    int slot;
+    return motionSlots.find(tripId, slot) ? motions[slot] : nullptr;
+}
+
+// Take a spare motion (or allocate one) for a newly scheduled trip
+TripScheduler::Motion *TripScheduler::createMotion(int tripId)
+{
+    if (motionCount == motionAllocated)
+    {
+        int newAllocated = motionAllocated > 0 ? motionAllocated * 2 : 16;
+        Motion **grown = new Motion*[newAllocated];
+        for (int m = 0; m < motionAllocated; m++)
+            grown[m] = motions[m];
+        for (int m = motionAllocated; m < newAllocated; m++)
+            grown[m] = new Motion();
+        delete[] motions;
+        motions = grown;
+        motionAllocated = newAllocated;
+    }
+    Motion *motion = motions[motionCount];
+    motion->tripId = tripId;
+    motionSlots.insert(tripId, motionCount);
+    motionCount++;
+    return motion;
+}
+
+// Swap the last motion into the freed slot; the freed object becomes a spare
+void TripScheduler::destroyMotion(int tripId)
+{
+    int slot;
+    if (!motionSlots.find(tripId, slot))
+        return;
+    motionSlots.erase(tripId);
+    int last = motionCount - 1;
+    if (slot != last)
+    {
+        Motion *moved = motions[last];
+        motions[last] = motions[slot];
+        motions[slot] = moved;
+        motionSlots.insert(moved->tripId, slot);
+    }
+    motions[last]->pickupLeg.clear();
+    motions[last]->rideLeg.clear();
+    motionCount--;
+}
+
+// Profile the trip's remaining legs. A trip already part-way along a leg is
+// backdated so that its current path index is where it stands at departMs.
+bool TripScheduler::planMotion(Motion *motion, Trip *trip, double departMs)
+{
+    const City *city = engine->getCity();
+    motion->metresPerMs = driverSpeed / 1000.0;
+    if (!motion->rideLeg.build(city, trip->getPickupToDropoffPath()))
+        return false;
+
+    int index = trip->getCurrentPathIndex();
+    if (trip->getState() == PICKUP_IN_PROGRESS)
+    {
+        if (!motion->pickupLeg.build(city, trip->getDriverToPickupPath()))
+            return false;
+        motion->pickupDepartMs = departMs - motion->pickupLeg.getDistanceAt(index) / motion->metresPerMs;
+        motion->rideDepartMs = motion->pickupDepartMs + motion->pickupLeg.getLength() / motion->metresPerMs;
+    }
+    else
+    {
+        motion->pickupLeg.clear();
+        motion->rideDepartMs = departMs - motion->rideLeg.getDistanceAt(index) / motion->metresPerMs;
+        motion->pickupDepartMs = motion->rideDepartMs;
+    }
+    return true;
+}
+
+void TripScheduler::locate(const Motion *motion, double atMs, TripPosition &position) const
+{
+    double dropoffMs = motion->rideDepartMs + motion->rideLeg.getLength() / motion->metresPerMs;
+    position.tripId = motion->tripId;
+    position.pickupEtaMs = (long long)std::ceil(motion->rideDepartMs);
+    position.dropoffEtaMs = (long long)std::ceil(dropoffMs);
+
+    const PathProfile *leg;
+    double travelled;
+    if (atMs < motion->rideDepartMs && motion->pickupLeg.getNodeCount() > 0)
+    {
+        position.state = PICKUP_IN_PROGRESS;
+        leg = &motion->pickupLeg;
+        travelled = (atMs - motion->pickupDepartMs) * motion->metresPerMs;
+    }
+    else
+    {
+        position.state = atMs < dropoffMs ? ONGOING : COMPLETED;
+        leg = &motion->rideLeg;
+        travelled = (atMs - motion->rideDepartMs) * motion->metresPerMs;
+    }
+    leg->locate(travelled, position.edge, position.offset);
+    position.fromIndex = leg->getNodeIndex(position.edge);
+    position.toIndex = position.offset > 0.0 ? leg->getNodeIndex(position.edge + 1) : position.fromIndex;
+    position.x = position.y = 0.0;
+
+    std::shared_ptr<const GraphIndex> gi = engine->getCity()->getGraphIndex();
+    if (!gi || position.fromIndex < 0)
+        return;
+    position.x = gi->x[position.fromIndex];
+    position.y = gi->y[position.fromIndex];
+    double length = leg->getDistanceAt(position.edge + 1) - leg->getDistanceAt(position.edge);
+    if (position.toIndex != position.fromIndex && length > 0.0)
+    {
+        double t = position.offset / length;
+        position.x += (gi->x[position.toIndex] - position.x) * t;
+        position.y += (gi->y[position.toIndex] - position.y) * t;
+    }
+}
+
+// Next sync: one update interval on, but never later than the next arrival.
+// Rounding up to whole ticks keeps arrivals within one tick of their ETA.
+void TripScheduler::queueNext(const Motion *motion, long long nowMs)
+{
+    double dueMs = (double)(nowMs + stepMs);
+    double arrivalMs = nowMs < motion->rideDepartMs
+                           ? motion->rideDepartMs
+                           : motion->rideDepartMs + motion->rideLeg.getLength() / motion->metresPerMs;
+    if (arrivalMs < dueMs)
+        dueMs = arrivalMs;
+
+    long long dueTick = (long long)std::ceil(dueMs / tickMs);
+    if ((double)(dueTick * tickMs) < dueMs)
+        dueTick++;
+    if (dueTick <= currentTick)
+        dueTick = currentTick + 1;
+
+    TimerEvent *event = allocEvent();
+    event->tripId = motion->tripId;
+    event->dueTick = dueTick;
+    event->booking = false;
+    insertEvent(event);
+    pendingCount++;
+}
+
+void TripScheduler::scheduleBooking(int tripId, long long dueMs)
+{
+    long long dueTick = dueMs / tickMs;
+    if (dueTick * tickMs < dueMs)
+        dueTick++;
+    if (dueTick <= currentTick)
+        dueTick = currentTick + 1;
+
+    TimerEvent *event = allocEvent();
+    event->tripId = tripId;
+    event->dueTick = dueTick;
+    event->booking = true;
+    insertEvent(event);
+    pendingCount++;
+}
+
+// Bring one trip's node-level state up to its analytic position at the
+// current tick; reschedule it while it is still moving
+void TripScheduler::stepTrip(int tripId)
+{
+    Motion *motion = findMotion(tripId);
+    Trip *trip = engine->getTrip(tripId);
+    TripState state = trip ? trip->getState() : CANCELLED;
+    Driver *driver = trip ? engine->getDriver(trip->getDriverId()) : nullptr;
+    if (!motion || !driver || (state != PICKUP_IN_PROGRESS && state != ONGOING))
+    {
+        destroyMotion(tripId);  // Cancelled, completed elsewhere or gone
+        return;
+    }
+
+    MovementDelta *delta = appendDelta();
+    delta->tripId = tripId;
+    delta->driverId = driver->getDriverId();
+    strcpy(delta->fromNodeId, driver->getCurrentNodeId());
+
+    long long nowMs = currentTick * tickMs;
+    TripPosition position;
+    locate(motion, (double)nowMs, position);
+
+    // Each advance moves one node; a trip never moves back
+    if (state == PICKUP_IN_PROGRESS)
+    {
+        int target = position.state == PICKUP_IN_PROGRESS ? position.edge
+                                                          : trip->getDriverToPickupPath().pathLength - 1;
+        while (trip->getState() == PICKUP_IN_PROGRESS && trip->getCurrentPathIndex() < target &&
+               engine->advanceTripMovement(tripId))
+        {
+        }
+        if (position.state != PICKUP_IN_PROGRESS && trip->getState() == PICKUP_IN_PROGRESS)
+            engine->advanceTripMovement(tripId);  // Arrived: pick the rider up
+    }
+    if (trip->getState() == ONGOING && position.state != PICKUP_IN_PROGRESS)
+    {
+        int target = position.state == ONGOING ? position.edge : trip->getPickupToDropoffPath().pathLength - 1;
+        while (trip->getCurrentPathIndex() < target && engine->advanceTripMovement(tripId))
+        {
+        }
+        if (position.state == COMPLETED)
+        {
+            while (engine->advanceTripMovement(tripId))
+            {
+            }
+            engine->completeTrip(tripId);
+        }
+    }
+    totalSteps++;
+
+    // completeTrip may recycle the trip, so look it up again
+    trip = engine->getTrip(tripId);
+    delta->state = trip ? trip->getState() : COMPLETED;
+    strcpy(delta->toNodeId, driver->getCurrentNodeId());
+
+    if (delta->state == PICKUP_IN_PROGRESS || delta->state == ONGOING)
+        queueNext(motion, nowMs);
+    else
+        destroyMotion(tripId);
+}
+
+void TripScheduler::tickOnce()
+{
+    currentTick++;
+
+    // Cascade every level whose lower bits just wrapped, highest first
+    int top = 0;
+    for (int l = 1; l < WHEEL_LEVELS; l++)
+    {
+        if ((currentTick & ((1LL << (WHEEL_BITS * l)) - 1)) != 0)
+            break;
+        top = l;
+    }
+    if (top == WHEEL_LEVELS - 1 &&
+        (currentTick & ((1LL << (WHEEL_BITS * WHEEL_LEVELS)) - 1)) == 0)
+    {
+        TimerEvent *event = overflow;
+        overflow = nullptr;
+        while (event)
+        {
+            TimerEvent *next = event->next;
+            insertEvent(event);
+            event = next;
+        }
+    }
+    for (int l = top; l >= 1; l--)
+        cascade(l);
+
+    // Detach the due slot first so rescheduled trips land in future slots
+    int slot = (int)(currentTick & (WHEEL_SLOTS - 1));
+    TimerEvent *due = wheel[0][slot];
+    wheel[0][slot] = nullptr;
+    if (!due)
+        return;
+
+    // Movement first, so a booking due now sees drivers freed in this tick
+    ticking = true;
+    deltaCount = 0;
+    TimerEvent *bookingsDue = nullptr;
+    while (due)
+    {
+        TimerEvent *next = due->next;
+        if (due->booking)
+        {
+            due->next = bookingsDue;
+            bookingsDue = due;
+            due = next;
+            continue;
+        }
+        int tripId = due->tripId;
+        freeEvent(due);
+        pendingCount--;
+        stepTrip(tripId);
+        due = next;
+    }
+    while (bookingsDue)
+    {
+        TimerEvent *next = bookingsDue->next;
+        int tripId = bookingsDue->tripId;
+        freeEvent(bookingsDue);
+        pendingCount--;
+        engine->runBooking(tripId);
+        bookingsDue = next;
+    }
+    ticking = false;
+
+    if (listener && deltaCount > 0)
+        listener(deltas, deltaCount, currentTick * tickMs, listenerContext);
+}
+
+bool TripScheduler::scheduleTrip(int tripId, long long delayMs)
+{
+    if (findMotion(tripId))
+        return true;
+
+    // In real-time mode, bring the clock up to now before timing the departure
+    if (realTimeStarted && !ticking)
+        advanceRealTime();
+
+    Trip *trip = engine->getTrip(tripId);
+    if (!trip)
+        return false;
+    if (trip->getState() == ASSIGNED && !engine->startPickupMovement(tripId))
+        return false;
+    if (trip->getState() != PICKUP_IN_PROGRESS && trip->getState() != ONGOING)
+        return false;
+
+    // The trip leaves now, or after an explicit delay. Within a tick (a
+    // booking being dispatched) now is the tick, not the target of advanceTo.
+    long long nowMs = ticking ? currentTick * tickMs : simTimeMs;
+    long long departMs = nowMs + (delayMs > 0 ? delayMs : 0);
+    Motion *motion = createMotion(tripId);
+    if (!planMotion(motion, trip, (double)departMs))
+    {
+        destroyMotion(tripId);
+        return false;
+    }
+    queueNext(motion, departMs);
+    return true;
+}
+
+bool TripScheduler::isScheduled(int tripId) const
+{
+    return findMotion(tripId) != nullptr;
+}
+
+int TripScheduler::getPendingCount() const
+{
+    return pendingCount;
+}
+
+void TripScheduler::setListener(MovementListener callback, void *context)
+{
+    listener = callback;
+    listenerContext = context;
+}
+
+void TripScheduler::setDriverSpeed(double metresPerSecond)
+{
+    driverSpeed = metresPerSecond > 0.0 ? metresPerSecond : 10.0;
+}
+
+double TripScheduler::getDriverSpeed() const
+{
+    return driverSpeed;
+}
+
+void TripScheduler::setUpdateInterval(long long millis)
+{
+    stepMs = millis > 0 ? millis : 300;
+}
+
+long long TripScheduler::getUpdateInterval() const
+{
+    return stepMs;
+}
+
+bool TripScheduler::getTripPosition(int tripId, long long atMs, TripPosition &position) const
+{
+    const Motion *motion = findMotion(tripId);
+    if (!motion)
+        return false;
+    locate(motion, (double)(atMs < 0 ? simTimeMs : atMs), position);
+    return true;
+}
+
+long long TripScheduler::getPickupEtaMs(int tripId) const
+{
+    TripPosition position;
+    return getTripPosition(tripId, -1, position) ? position.pickupEtaMs : -1;
+}
+
+long long TripScheduler::getDropoffEtaMs(int tripId) const
+{
+    TripPosition position;
+    return getTripPosition(tripId, -1, position) ? position.dropoffEtaMs : -1;
+}
+
+long long TripScheduler::getSimTimeMs() const
+{
+    return simTimeMs;
+}
+
+long long TripScheduler::getTotalSteps() const
+{
+    return totalSteps;
+}
+
+void TripScheduler::advanceTo(long long targetMs)
+{
+    if (targetMs <= simTimeMs)
+        return;
+    simTimeMs = targetMs;
+
+    long long targetTick = simTimeMs / tickMs;
+    while (currentTick < targetTick)
+    {
+        if (pendingCount == 0)
+        {
+            currentTick = targetTick;  // Nothing to fire: jump the clock
+            break;
+        }
+        tickOnce();
+    }
+}
+
+void TripScheduler::advanceBy(long long deltaMs)
+{
+    advanceTo(simTimeMs + deltaMs);
+}
+
+void TripScheduler::setSpeed(double factor)
+{
+    speed = factor > 0.0 ? factor : 1.0;
+}
+
+void TripScheduler::advanceRealTime()
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (!realTimeStarted)
+    {
+        realTimeStarted = true;
+        lastRealTime = now;
+        return;
+    }
+
+    double elapsed = std::chrono::duration<double, std::milli>(now - lastRealTime).count() * speed + carryMs;
+    lastRealTime = now;
+    long long whole = (long long)elapsed;
+    carryMs = elapsed - whole;
+    advanceBy(whole);
+}
+
+void TripScheduler::runUntilIdle(long long maxSimTimeMs)
+{
+    while (pendingCount > 0 && (maxSimTimeMs < 0 || (currentTick + 1) * tickMs <= maxSimTimeMs))
+    {
+        tickOnce();
+        simTimeMs = currentTick * tickMs;
+    }
+}
@@ -0,0 +1,169 @@
+#ifndef TRIPSCHEDULER_H
+#define TRIPSCHEDULER_H
+
+#include "city.h"
+#include "trip.h"
+#include "registry.h"
+#include "pathprofile.h"
+#include <chrono>
+
+class DispatchEngine;
+
+// One trip's movement during a tick
+struct MovementDelta
+{
+    int tripId;
+    int driverId;
+    TripState state;                        // State after the step
+    char fromNodeId[MAX_STRING_LENGTH];     // Driver node before the step
+    char toNodeId[MAX_STRING_LENGTH];       // Driver node after the step
+};
+
+// Exact position of a scheduled trip at some simulated time
+struct TripPosition
+{
+    int tripId;
+    TripState state;          // Leg at that time; COMPLETED once past the drop-off
+    int edge;                 // Segment path[edge] -> path[edge + 1] of that leg
+    double offset;            // Metres along the segment
+    int fromIndex;            // Graph indices of the segment ends (equal at a leg's end)
+    int toIndex;
+    double x;                 // Interpolated coordinates
+    double y;
+    long long pickupEtaMs;    // Simulated time of arrival at the pickup
+    long long dropoffEtaMs;   // Simulated time of arrival at the drop-off
+};
+
+// Called once per tick that moved at least one trip
+typedef void (*MovementListener)(const MovementDelta *deltas, int count,
+                                 long long simTimeMs, void *context);
+
+// Discrete-event scheduler for trip movement, owned by DispatchEngine.
+// Trips drive at a fixed speed: when a trip is scheduled, both legs get a
+// cumulative-distance profile and a departure time, so its (edge, offset)
+// position and ETAs follow analytically for any simulated time. Every moving
+// trip also has one pending event in a hierarchical timing wheel. The event
+// syncs the engine's node-level state (driver node, path index, pickup and
+// completion transitions) with that position. It fires every update interval
+// and exactly at the pickup and drop-off arrivals, so coarse updates never
+// change arrival times. Time advances either with the wall clock
+// (advanceRealTime, scaled by setSpeed) or as fast as possible (runUntilIdle).
+// The same wheel holds the engine's booking timers for pre-booked rides; a
+// tick runs its booking timers after its movement steps.
+class TripScheduler
+{
+private:
+    struct TimerEvent
+    {
+        int tripId;
+        long long dueTick;
+        bool booking;             // Booking timer rather than a movement step
+        TimerEvent *next;
+    };
+
+    static const int WHEEL_BITS = 6;
+    static const int WHEEL_SLOTS = 1 << WHEEL_BITS;  // 64 slots per level
+    static const int WHEEL_LEVELS = 4;               // 2^24 ticks before overflow
+
+    // Both legs of one scheduled trip with their departure times
+    struct Motion
+    {
+        int tripId;
+        double metresPerMs;
+        double pickupDepartMs;
+        double rideDepartMs;      // Arrival at the pickup
+        PathProfile pickupLeg;
+        PathProfile rideLeg;
+    };
+
+    DispatchEngine *engine;
+    long long tickMs;             // Wheel resolution
+    long long stepMs;             // Simulated time between two position syncs of a trip
+    long long currentTick;
+    long long simTimeMs;          // Simulated clock (may run ahead of the last tick)
+    TimerEvent *wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+    TimerEvent *overflow;         // Events beyond the top level
+    TimerEvent *freeEvents;
+    int pendingCount;
+    bool ticking;                 // Inside tickOnce(): the clock stands at currentTick
+
+    // Motions of scheduled trips; slots past motionCount are spares for reuse
+    Motion **motions;
+    int motionCount;
+    int motionAllocated;
+    IdMap motionSlots;            // trip id -> index in motions[] while scheduled
+    double driverSpeed;           // Metres per second for newly scheduled trips
+
+    // Deltas of the tick being processed
+    MovementDelta *deltas;
+    int deltaCount;
+    int deltaCapacity;
+    long long totalSteps;
+
+    MovementListener listener;
+    void *listenerContext;
+
+    // Real-time mode
+    double speed;
+    bool realTimeStarted;
+    std::chrono::steady_clock::time_point lastRealTime;
+    double carryMs;               // Fraction of a tick left over between calls
+
+    TimerEvent *allocEvent();
+    void freeEvent(TimerEvent *event);
+    void insertEvent(TimerEvent *event);
+    void cascade(int level);
+    void tickOnce();
+    void stepTrip(int tripId);
+    MovementDelta *appendDelta();
+    Motion *findMotion(int tripId) const;
+    Motion *createMotion(int tripId);
+    void destroyMotion(int tripId);
+    bool planMotion(Motion *motion, Trip *trip, double departMs);
+    void locate(const Motion *motion, double atMs, TripPosition &position) const;
+    void queueNext(const Motion *motion, long long nowMs);
+
+public:
+    TripScheduler(DispatchEngine *e, long long tickMillis = 100, long long stepMillis = 300);
+    ~TripScheduler();
+    TripScheduler(const TripScheduler &) = delete;
+    TripScheduler &operator=(const TripScheduler &) = delete;
+
+    // Start driving a trip. An ASSIGNED trip is moved to PICKUP_IN_PROGRESS
+    // first. Scheduling an already scheduled trip is a no-op.
+    bool scheduleTrip(int tripId, long long delayMs = -1);
+    bool isScheduled(int tripId) const;
+    int getPendingCount() const;        // Movement steps and booking timers
+
+    // Run DispatchEngine::runBooking(tripId) at simulated time dueMs (the
+    // next tick if that has passed). O(1); a timer cannot be withdrawn, so
+    // the engine ignores timers of bookings that are gone.
+    void scheduleBooking(int tripId, long long dueMs);
+
+    void setListener(MovementListener callback, void *context);
+
+    // Kinematics
+    void setDriverSpeed(double metresPerSecond);  // Trips scheduled afterwards
+    double getDriverSpeed() const;
+    void setUpdateInterval(long long millis);     // Position syncs per moving trip
+    long long getUpdateInterval() const;
+    // Position at atMs (< 0: the current simulated time); false if not scheduled
+    bool getTripPosition(int tripId, long long atMs, TripPosition &position) const;
+    long long getPickupEtaMs(int tripId) const;   // -1 if not scheduled
+    long long getDropoffEtaMs(int tripId) const;
+
+    // Simulated clock
+    long long getSimTimeMs() const;
+    long long getTotalSteps() const;   // Trip steps processed since construction
+    void advanceTo(long long simTimeMs);
+    void advanceBy(long long deltaMs);
+
+    // Real-time mode: advance by the wall time since the previous call, times speed
+    void setSpeed(double factor);
+    void advanceRealTime();
+
+    // As-fast-as-possible mode: run until no trip is moving or maxSimTimeMs is reached
+    void runUntilIdle(long long maxSimTimeMs = -1);
+};
+
+#endif // TRIPSCHEDULER_H
@@ -323,6 +323,8 @@ void MainWindow::ensureDispatchEngine()
     if (!sharedDispatchEngine)
     {
         sharedDispatchEngine = new DispatchEngine(sharedCity, 100, 200);
+        // Drivers move at street speed; replay it 10x so a trip takes seconds on screen
+        sharedDispatchEngine->getScheduler()->setSpeed(10.0);
         qDebug() << "Shared dispatch engine created";
     }
     
@@ -341,8 +343,7 @@ void MainWindow::initializeDrivers()
     QHash<QString, QList<QString>> zoneStreetNodes;
     for (Node *n = sharedCity->getFirstNode(); n != nullptr; n = n->next)
     {
-        QString type = QString::fromUtf8(n->locationType).toLower();
-        if (!(type.contains("street") || type.contains("highway")))
+        if (!n->isRoute())
             continue;
         QString zone = QString::fromUtf8(n->zone).trimmed();
         if (zone.isEmpty())
@@ -739,13 +740,7 @@ void MainWindow::createRollbackManagerPage()
             }
             
             // Perform rollback
-            Trip **trips = new Trip*[sharedDispatchEngine->getTripCount()];
-            for (int i = 0; i < sharedDispatchEngine->getTripCount(); i++) {
-                trips[i] = sharedDispatchEngine->getTrip(i + 1);
-            }
-            
-            bool success = rollbackMgr->rollbackLastK(k, trips, sharedDispatchEngine->getTripCount(), sharedDispatchEngine);
-            delete[] trips;
+            bool success = rollbackMgr->rollbackLastK(k, sharedDispatchEngine);
             
             if (success) {
                 // Remove history entries from session store
@@ -917,11 +912,6 @@ void MainWindow::createRollbackManagerPage()
         }
         
         // Rollback each snapshot related to this trip (from most recent to oldest)
-        Trip **trips = new Trip*[sharedDispatchEngine->getTripCount()];
-        for (int i = 0; i < sharedDispatchEngine->getTripCount(); i++) {
-            trips[i] = sharedDispatchEngine->getTrip(i + 1);
-        }
-        
         bool success = true;
         int rolledBackCount = 0;
         
@@ -943,15 +933,13 @@ void MainWindow::createRollbackManagerPage()
             }
             
             // Rollback from top down to this snapshot
-            if (!rollbackMgr->rollbackLastK(currentIndex + 1, trips, sharedDispatchEngine->getTripCount(), sharedDispatchEngine)) {
+            if (!rollbackMgr->rollbackLastK(currentIndex + 1, sharedDispatchEngine)) {
                 success = false;
                 break;
             }
             rolledBackCount++;
         }
         
-        delete[] trips;
-        
         if (success && rolledBackCount > 0) {
             // Remove history entry for this trip
             if (!riderCode.isEmpty()) {
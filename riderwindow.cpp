@@ -36,7 +36,8 @@ RiderWindow::RiderWindow(const QString &riderId, const QString &locationId, QWid
         : QWidget(parent), riderId(riderId), locationId(locationId), dropoffNodeId(""),
             cityGraph(nullptr), cityLoaded(false), dispatchEngine(nullptr), driversInitialized(false),
             nextTripId(1), tripTimer(new QTimer(this)), tripStatusLabel(nullptr), driverStatusLabel(nullptr),
-            usingSharedResources(false), retryTimer(new QTimer(this)), retryCount(0), maxRetries(5),
+            usingSharedResources(false), driverWaitMs(7500),
+            routingTimer(new QTimer(this)),
             restoredTripWidget(nullptr), cancelRideButton(nullptr), currentTripId(-1)
 {
     // Load any existing session history for this rider before building UI
@@ -48,14 +49,29 @@ RiderWindow::RiderWindow(const QString &riderId, const QString &locationId, QWid
     loadStreetNodes();
     setupUI();
     
-    // Setup auto-retry timer for driver requests
-    connect(retryTimer, &QTimer::timeout, this, &RiderWindow::retryRequestRide);
+    // Deliver routed assignments on the UI thread while any are outstanding
+    connect(routingTimer, &QTimer::timeout, this, [this]() {
+        if (dispatchEngine)
+            dispatchEngine->deliverRoutedAssignments();
+        if (!dispatchEngine || (dispatchEngine->getPendingRouteCount() == 0 &&
+                                !dispatchEngine->isWaitingForDriver(currentTripId)))
+            routingTimer->stop();
+    });
 }
 
 RiderWindow::~RiderWindow()
 {
     // Do not clear session history here; it's memory-only and will reset on app exit
     
+    // Routing still in flight must not call back into this window, and a
+    // request still waiting for a driver has nobody left to take it
+    if (dispatchEngine)
+    {
+        if (dispatchEngine->isWaitingForDriver(currentTripId))
+            dispatchEngine->cancelTrip(currentTripId);
+        dispatchEngine->detachAssignmentCallbacks(this);
+    }
+    
     // Only delete if we own these resources
     if (!usingSharedResources)
     {
@@ -908,7 +924,6 @@ QWidget* RiderWindow::createBookRidePage()
                 "border: none;"
             );
             dropoffNodeId = "";
-            rejectedDriverIds.clear();
             QMessageBox::information(this, "Ride Cancelled", 
                 "Your ride has been cancelled. The driver has been notified.");
         }
@@ -1683,7 +1698,19 @@ void RiderWindow::showLocationSelection(const QString &zone, const QString &colo
     } else {
         QList<LocationInfo> locations = zoneData[zone][colony][street];
         
-        for (const LocationInfo &location : locations) {
+        // Price every location on the street with one search from the rider
+        QVector<int> quoteTargets(locations.size(), -1);
+        QVector<FareQuote> quotes(locations.size());
+        bool quoted = false;
+        if (dispatchEngine && cityGraph && !locationId.isEmpty() && !locations.isEmpty()) {
+            for (int i = 0; i < locations.size(); i++)
+                quoteTargets[i] = cityGraph->getNodeIndex(locations[i].id.toUtf8().constData());
+            quoted = dispatchEngine->quoteFares(locationId.toUtf8().constData(), quoteTargets.constData(),
+                                                quoteTargets.size(), quotes.data()) > 0;
+        }
+        
+        for (int i = 0; i < locations.size(); i++) {
+            const LocationInfo &location = locations[i];
             QString displayText;
             QString icon;
             
@@ -1704,6 +1731,8 @@ void RiderWindow::showLocationSelection(const QString &zone, const QString &colo
             }
             
             displayText = icon + " " + location.name;
+            if (quoted && quotes[i].fare >= 0.0)
+                displayText += QString("  •  Rs. %1").arg(quotes[i].fare, 0, 'f', 2);
             
             QAction *action = menu->addAction(displayText);
             connect(action, &QAction::triggered, this, [this, location]() {
@@ -1845,7 +1874,11 @@ bool RiderWindow::ensureDispatchEngine()
     if (!ensureCityLoaded())
         return false;
     if (!dispatchEngine)
+    {
         dispatchEngine = new DispatchEngine(cityGraph, 100, 200);
+        // Drivers move at street speed; replay it 10x so a trip takes seconds on screen
+        dispatchEngine->getScheduler()->setSpeed(10.0);
+    }
     if (!driversInitialized)
     {
         initializeDrivers();
@@ -1862,8 +1895,7 @@ void RiderWindow::initializeDrivers()
     QHash<QString, QList<QString>> zoneStreetNodes;
     for (Node *n = cityGraph->getFirstNode(); n != nullptr; n = n->next)
     {
-        QString type = QString::fromUtf8(n->locationType).toLower();
-        if (!(type.contains("street") || type.contains("highway")))
+        if (!n->isRoute())
             continue;
         QString zone = QString::fromUtf8(n->zone).trimmed();
         if (zone.isEmpty())
@@ -2003,19 +2035,18 @@ void RiderWindow::onRequestRideClicked()
         // Fallback: scan active trips list to detect ongoing rides for this rider
         if (!hasActiveRide)
         {
-            ActiveTrip *head = dispatchEngine->getActiveTripsHead();
-            while (head)
+            for (int i = 0; i < dispatchEngine->getActiveTripsCount(); i++)
             {
-                if (head->trip && head->trip->getRiderId() == riderNumericIdCheck)
+                const ActiveTrip *active = dispatchEngine->getActiveTrip(i);
+                if (active->trip->getRiderId() == riderNumericIdCheck)
                 {
-                    TripState s = head->trip->getState();
+                    TripState s = active->trip->getState();
                     if (s == PICKUP_IN_PROGRESS || s == ONGOING)
                     {
                         hasActiveRide = true;
                         break;
                     }
                 }
-                head = head->next;
             }
         }
 
@@ -2036,7 +2067,6 @@ void RiderWindow::onRequestRideClicked()
 
     int tripId = nextTripId++;
     currentTripId = tripId;
-    rejectedDriverIds.clear();  // Clear rejected drivers for new trip request
     
     QByteArray pickupBytes = locationId.toUtf8();
     QByteArray dropBytes = dropoffNodeId.toUtf8();
@@ -2047,22 +2077,49 @@ void RiderWindow::onRequestRideClicked()
         return;
     }
 
-    int driverId = dispatchEngine->assignNearestDriver(tripId);
+    int driverId = dispatchEngine->assignNearestDriverAsync(tripId, &RiderWindow::onAssignmentRouted, this);
     if (driverId < 0)
     {
-        // Store the pending request details for auto-retry
-        pendingPickupNodeId = locationId;
-        pendingDropoffNodeId = dropoffNodeId;
-        retryCount = 0;
-        
-        // Start auto-retry - don't show error, just retry
+        // No free driver: the engine hands this trip the next driver that
+        // completes or cancels a ride, so nothing here polls for one
+        dispatchEngine->waitForDriver(tripId, driverWaitMs / 1000.0, 0, &RiderWindow::onAssignmentRouted, this);
         tripStatusLabel->setText("Searching for drivers...");
-        retryTimer->start(1500);  // Retry every 1.5 seconds
+        routingTimer->start(30);
+        QTimer::singleShot(driverWaitMs, this, [this]() {
+            if (dispatchEngine)
+                dispatchEngine->expireWaitingRequests();
+        });
         return;
     }
 
-    // Show driver confirmation dialog instead of directly assigning
-    showDriverConfirmationDialog(tripId, driverId, false);
+    // Driver is reserved; the confirmation dialog opens once the route is ready
+    tripStatusLabel->setText("Driver found, planning route...");
+    routingTimer->start(30);
+}
+
+void RiderWindow::onAssignmentRouted(const AssignmentResult &result, void *context)
+{
+    RiderWindow *self = static_cast<RiderWindow *>(context);
+    if (result.tripId != self->currentTripId)
+        return;
+    if (result.status == ASSIGNMENT_EXPIRED)
+    {
+        // The engine has cancelled the trip; it may be inside another window's call
+        QTimer::singleShot(0, self, [self]() {
+            self->tripStatusLabel->setText("No drivers available. Please try again later.");
+        });
+        return;
+    }
+    if (result.status != ASSIGNMENT_ROUTED)
+        return;
+    
+    // Open the modal dialog after the engine's delivery loop has returned
+    bool isRetry = self->dispatchEngine->getExcludedCandidateCount(result.tripId) > 0;
+    int tripId = result.tripId;
+    int driverId = result.driverId;
+    QTimer::singleShot(0, self, [self, tripId, driverId, isRetry]() {
+        self->showDriverConfirmationDialog(tripId, driverId, isRetry);
+    });
 }
 
 void RiderWindow::startTripProgress(int tripId)
@@ -2071,6 +2128,11 @@ void RiderWindow::startTripProgress(int tripId)
         tripTimer->stop();
     tripTimer->disconnect();
 
+    // Movement is driven by the engine's scheduler; this timer only advances
+    // the shared clock and refreshes the UI
+    if (dispatchEngine)
+        dispatchEngine->getScheduler()->scheduleTrip(tripId);
+
     connect(tripTimer, &QTimer::timeout, this, [this, tripId]() {
         advanceTripProgress(tripId);
     });
@@ -2081,6 +2143,7 @@ void RiderWindow::advanceTripProgress(int tripId)
 {
     if (!dispatchEngine)
         return;
+    dispatchEngine->getScheduler()->advanceRealTime();
     Trip *trip = dispatchEngine->getTrip(tripId);
     if (!trip)
     {
@@ -2088,7 +2151,6 @@ void RiderWindow::advanceTripProgress(int tripId)
         return;
     }
 
-    bool more = dispatchEngine->advanceTripMovement(tripId);
     TripState state = trip->getState();
 
     // Update user's current location during trip
@@ -2110,34 +2172,26 @@ void RiderWindow::advanceTripProgress(int tripId)
     
     emit locationUpdated(riderId, locationId);
 
-    if (!more && state == ONGOING)
+    if (state == COMPLETED)
     {
-        // Trip reached destination
-        dispatchEngine->completeTrip(tripId);
-        trip = dispatchEngine->getTrip(tripId);
-        state = trip ? trip->getState() : COMPLETED;
+        // Trip reached destination; update rider's final location to dropoff
+        QString oldLocation = locationId;
+        locationId = QString::fromUtf8(trip->getDropoffNodeId());
+        updateCurrentLocationUI();
         
-        // Update rider's final location to dropoff
-        if (trip)
-        {
-            QString oldLocation = locationId;
-            locationId = QString::fromUtf8(trip->getDropoffNodeId());
-            updateCurrentLocationUI();
+        // Record rider location change snapshot
+        if (oldLocation != locationId && dispatchEngine && dispatchEngine->getRollbackManager()) {
+            bool ok = false;
+            int riderNumericId = riderId.toInt(&ok);
+            if (!ok) riderNumericId = 1;
             
-            // Record rider location change snapshot
-            if (oldLocation != locationId && dispatchEngine && dispatchEngine->getRollbackManager()) {
-                bool ok = false;
-                int riderNumericId = riderId.toInt(&ok);
-                if (!ok) riderNumericId = 1;
-                
-                dispatchEngine->getRollbackManager()->recordSnapshot(
-                    3, tripId, trip->getDriverId(), state, true,
-                    nullptr, riderNumericId, locationId.toUtf8().constData(), true, riderId.toUtf8().constData()
-                );
-            }
-            
-            emit locationUpdated(riderId, locationId);
+            dispatchEngine->getRollbackManager()->recordSnapshot(
+                3, tripId, trip->getDriverId(), state, true,
+                nullptr, riderNumericId, locationId.toUtf8().constData(), true, riderId.toUtf8().constData()
+            );
         }
+        
+        emit locationUpdated(riderId, locationId);
     }
 
     QString extra;
@@ -2194,13 +2248,11 @@ void RiderWindow::advanceTripProgress(int tripId)
                 "border: none;"
             );
             dropoffNodeId = "";
-            rejectedDriverIds.clear();  // Reset for next ride
         }
         else if (state == CANCELLED)
         {
             // Also reset for cancelled trips
             dropoffNodeId = "";
-            rejectedDriverIds.clear();
         }
     }
 }
@@ -2444,53 +2496,19 @@ void RiderWindow::showDriverConfirmationDialog(int tripId, int driverId, bool is
         dialog.accept();
     });
     
-    connect(findOtherBtn, &QPushButton::clicked, this, [this, tripId, driverId, &dialog]() {
+    connect(findOtherBtn, &QPushButton::clicked, this, [this, tripId, &dialog]() {
         dialog.reject();
-        rejectedDriverIds.append(driverId);
-        
-        Trip *trip = dispatchEngine->getTrip(tripId);
-        if (!trip) {
-            return;
-        }
-        
-        // Free the current driver before finding another
-        Driver *currentDriver = dispatchEngine->getDriver(driverId);
-        if (currentDriver) {
-            currentDriver->setAvailable(true);
-            currentDriver->setAssignedTripId(-1);
-        }
         
-        // Find the nearest available driver, excluding previously rejected ones
-        int newDriverId = -1;
-        double minDistance = 1e9;
-        const char *pickupNode = trip->getPickupNodeId();
-        
-        // Loop through all drivers to find the nearest available one
-        for (int i = 1; i <= 20; i++) {
-            if (!rejectedDriverIds.contains(i)) {
-                Driver *candidate = dispatchEngine->getDriver(i);
-                if (candidate && candidate->isAvailable()) {
-                    // Calculate Euclidean distance as heuristic (actual path calculated on assignment)
-                    double dist = cityGraph->getDistance(candidate->getCurrentNodeId(), pickupNode);
-                    if (dist >= 0 && dist < minDistance) {
-                        minDistance = dist;
-                        newDriverId = i;
-                    }
-                }
-            }
-        }
-        
-        if (newDriverId > 0) {
-            // Reset trip state and reassign to new driver to recalculate paths
-            trip->setState(REQUESTED);
-            dispatchEngine->assignTrip(tripId, newDriverId);
-            showDriverConfirmationDialog(tripId, newDriverId, true);
+        // The engine ranks the remaining drivers for this request and skips
+        // every driver the rider has turned down
+        int newDriverId = dispatchEngine->reassignToNextCandidate(tripId, &RiderWindow::onAssignmentRouted, this);
+        if (newDriverId >= 0) {
+            tripStatusLabel->setText("Alternative driver found, planning route...");
+            routingTimer->start(30);
         } else {
+            // The trip keeps the driver it has
             QMessageBox::warning(this, "No Alternative Drivers", 
                 "No other available drivers found. Would you like to try again?");
-            // Re-assign the rejected driver since no alternative found
-            currentDriver->setAvailable(false);
-            currentDriver->setAssignedTripId(tripId);
         }
     });
     
@@ -2527,7 +2545,6 @@ void RiderWindow::showDriverConfirmationDialog(int tripId, int driverId, bool is
         tripStatusLabel->setText("Ride request cancelled");
         driverStatusLabel->setText("");
         dropoffNodeId = "";
-        rejectedDriverIds.clear();
     });
     
     dialog.exec();
@@ -2540,7 +2557,6 @@ void RiderWindow::handleDriverConfirmation(int tripId, int driverId, bool accept
     
     if (!accepted) {
         dispatchEngine->cancelTrip(tripId);
-        rejectedDriverIds.clear();
         dropoffNodeId = "";
         return;
     }
@@ -2551,7 +2567,6 @@ void RiderWindow::handleDriverConfirmation(int tripId, int driverId, bool accept
     
     dispatchEngine->startPickupMovement(tripId);
     startTripProgress(tripId);
-    // Keep rejectedDriverIds until trip completes - don't clear here
 }
 
 void RiderWindow::addTripToHistory(int tripId, const QString &pickup, const QString &dropoff,
@@ -2660,63 +2675,6 @@ void RiderWindow::clearHistoryFile()
     }
 }
 
-void RiderWindow::retryRequestRide()
-{
-    if (!dispatchEngine)
-    {
-        retryTimer->stop();
-        return;
-    }
-    
-    retryCount++;
-    qDebug() << "Auto-retrying driver request attempt" << retryCount << "of" << maxRetries;
-    
-    // Try to request and assign a new trip
-    int tripId = nextTripId++;
-    currentTripId = tripId;
-    
-    bool ok = false;
-    int riderNumericId = riderId.toInt(&ok);
-    if (!ok) riderNumericId = 1;
-    
-    QByteArray pickupBytes = pendingPickupNodeId.toUtf8();
-    QByteArray dropBytes = pendingDropoffNodeId.toUtf8();
-    
-    if (!dispatchEngine->requestTrip(tripId, riderNumericId, pickupBytes.constData(), dropBytes.constData()))
-    {
-        // Failed to create trip, retry again
-        if (retryCount >= maxRetries)
-        {
-            retryTimer->stop();
-            tripStatusLabel->setText("Failed to find drivers. Please try again.");
-            qWarning() << "Max retries exceeded for driver assignment";
-        }
-        return;
-    }
-    
-    // Try to find a driver
-    int driverId = dispatchEngine->assignNearestDriver(tripId);
-    if (driverId < 0)
-    {
-        // No driver found yet, continue retrying
-        if (retryCount >= maxRetries)
-        {
-            retryTimer->stop();
-            dispatchEngine->cancelTrip(tripId);
-            tripStatusLabel->setText("No drivers available. Please try again later.");
-            qWarning() << "Max retries exceeded for driver assignment after" << maxRetries << "attempts";
-        }
-        return;
-    }
-    
-    // Success! Found a driver
-    retryTimer->stop();
-    qDebug() << "Driver found on attempt" << retryCount << "- Driver ID:" << driverId;
-    
-    // Show the confirmation dialog
-    showDriverConfirmationDialog(tripId, driverId, false);
-}
-
 // Static method to remove a history entry (for rollback functionality)
 bool RiderWindow::removeHistoryEntry(const QString &riderCode, int tripId)
 {
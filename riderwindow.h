@@ -73,12 +73,13 @@ private:
     
     bool usingSharedResources; // Track if using shared resources (don't delete them)
     
-    // Auto-retry for driver requests
-    QTimer *retryTimer;
-    int retryCount;
-    int maxRetries;
-    QString pendingPickupNodeId;
-    QString pendingDropoffNodeId;
+    // How long a request waits in the engine's queue for a driver to free up
+    int driverWaitMs;
+    
+    // Asynchronous assignment: routes are computed off the UI thread and
+    // delivered by this timer
+    QTimer *routingTimer;
+    static void onAssignmentRouted(const AssignmentResult &result, void *context);
     
     // Location data structures
     struct LocationInfo {
@@ -95,7 +96,6 @@ private:
     
     // Driver confirmation state
     int currentTripId;
-    QList<int> rejectedDriverIds;  // Track rejected drivers in current request
     
     // Trip history for this rider
     QVector<TripHistoryRecord> tripHistory;
@@ -144,7 +144,6 @@ private:
     void loadHistoryFromFile();
     QString getHistoryFilePath() const;
     void clearHistoryFile();
-    void retryRequestRide();  // Automatic retry for driver requests
     
 private slots:
     void onDestinationClick();